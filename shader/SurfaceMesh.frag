@@ -0,0 +1,43 @@
+#version 420 core
+
+in vec3 positionWS;
+in vec3 normalWS;
+out vec4 FragColor;
+
+struct Light{
+    vec3 pos;
+    vec3 col;
+    float affectDistance;
+    float intensity;
+};
+
+uniform mat4 view;
+uniform vec3 volumeExtent;//バウンディングボックスの大きさ(最大辺が1)
+uniform vec3 ambientLight;
+uniform Light light;
+
+const vec3 surfaceColor=vec3(.85,.8,.72);
+
+void main()
+{
+    vec3 cameraPos=vec3(inverse(view)[3]);
+    vec3 viewDir=normalize(cameraPos-positionWS);
+    //法線が求まらない頂点(勾配が0)は視線の向きにする。裏面も同じように照らす
+    vec3 normal=length(normalWS)>0.?normalize(normalWS):viewDir;
+    if(dot(normal,viewDir)<0.)
+    {
+        normal=-normal;
+    }
+    //カメラからの光で形が分かるようにする
+    vec3 lighting=ambientLight+vec3(.6*max(dot(normal,viewDir),0.));
+    //点光源はレイキャスティングと同じくテクスチャ座標で影響範囲を決める
+    vec3 texcoord=positionWS/volumeExtent+vec3(.5);
+    float distanceToLight=distance(texcoord,light.pos);
+    if(distanceToLight<light.affectDistance)
+    {
+        float falloff=(light.affectDistance-distanceToLight)*(light.affectDistance-distanceToLight)/(light.affectDistance*light.affectDistance);
+        vec3 lightDir=normalize((light.pos-vec3(.5))*volumeExtent-positionWS);
+        lighting+=light.col*light.intensity*falloff*max(dot(normal,lightDir),0.);
+    }
+    FragColor=vec4(surfaceColor*lighting,1.);
+}
@@ -0,0 +1,19 @@
+#version 420 core
+
+layout(location=0)in vec3 inPosition;
+layout(location=1)in vec3 inNormal;
+
+out vec3 positionWS;
+out vec3 normalWS;
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec4 world=model*vec4(inPosition,1.);
+    positionWS=world.xyz;
+    normalWS=mat3(model)*inNormal;
+    gl_Position=projection*view*world;
+}
@@ -7,11 +7,24 @@ uniform sampler3D volumeTexture;
 uniform mat4 view;
 uniform vec2 alphaRange;
 uniform vec2 nearFarClip;
-uniform int volumeResolution;
-
-const float SQRT3=sqrt(3);
-int maxSteps=int(sqrt(3.*volumeResolution*volumeResolution));//1ステップで1ボクセル参照するような長さにする(最悪でも)
-const float boxFarestLength=SQRT3;//sqrt(1^2+1^2+1^2)バウンディングボックス内での最長距離
+uniform ivec3 volumeResolution;
+uniform vec3 volumeExtent;//バウンディングボックスの大きさ(最大辺が1)
+uniform bool pagedVolume;//ブリック単位でページングしているか
+uniform int brickSize;
+layout(binding=2)uniform usampler3D brickTable;//ブリック -> アトラス内のスロット(a=1なら常駐)
+uniform int volumeLevels;//ミップレベル数(レベル0を含む)
+uniform float pixelAngle;//1ピクセルが張る視野角[rad]
+uniform bool labelsEnabled;//クラスタIDで成分ごとに非表示・色替えするか
+layout(binding=3)uniform usampler3D labelTexture;//クラスタID(0は背景)
+layout(binding=4)uniform samplerBuffer labelTable;//クラスタID -> 色(rgb)と表示(a: 0なら非表示、0.5なら元の色、1ならrgbの色)
+uniform bool macrocellsEnabled;//透明なマクロセルを飛び越えるか
+uniform int macrocellSize;//マクロセルの一辺のボクセル数
+layout(binding=6)uniform usampler3D macrocellTexture;//マクロセルの分類(1ならサンプルが必要、0ならalphaRangeで透明)
+uniform bool distanceFieldEnabled;//距離場で空の領域を大きく進むか
+uniform float minVoxelSize;//ボクセルの最も短い辺のワールドでの長さ
+layout(binding=7)uniform usampler3D distanceTexture;//閾値を超える最も近いボクセルまでの距離[ボクセル](切り捨て)
+uniform bool binaryVolume;//1ボクセル1ビットに詰めた2値ボリュームか
+layout(binding=8)uniform usampler3D binaryTexture;//詰めたボクセル(R32UI、幅は行の32bitワード数。ボクセルzはワードz/32のビットz%32)
 
 // HSV to RGB conversion
 vec3 HSVtoRGB(float h,float s,float v)
@@ -31,10 +44,110 @@ vec3 HSVtoRGB(float h,float s,float v)
     return rgb+vec3(m);
 }
 
+// 詰めたボクセルのビット(ボリュームの外は端のボクセル。通常のテクスチャのCLAMP_TO_EDGEと同じ)
+float BinaryVoxel(ivec3 voxel)
+{
+    voxel=clamp(voxel,ivec3(0),volumeResolution-1);
+    uint word=texelFetch(binaryTexture,ivec3(voxel.x>>5,voxel.yz),0).r;
+    return float((word>>uint(voxel.x&31))&1u);
+}
+
+// 2値ボリュームを周囲8ボクセルのビットから線形補間する(整数テクスチャはハードウェアで補間できない)
+float SampleBinary(vec3 texcoord)
+{
+    vec3 voxel=texcoord*vec3(volumeResolution)-.5;
+    ivec3 base=ivec3(floor(voxel));
+    vec3 f=voxel-vec3(base);
+    float c00=mix(BinaryVoxel(base),BinaryVoxel(base+ivec3(1,0,0)),f.x);
+    float c10=mix(BinaryVoxel(base+ivec3(0,1,0)),BinaryVoxel(base+ivec3(1,1,0)),f.x);
+    float c01=mix(BinaryVoxel(base+ivec3(0,0,1)),BinaryVoxel(base+ivec3(1,0,1)),f.x);
+    float c11=mix(BinaryVoxel(base+ivec3(0,1,1)),BinaryVoxel(base+ivec3(1,1,1)),f.x);
+    return mix(mix(c00,c10,f.y),mix(c01,c11,f.y),f.z);
+}
+
+// ボリュームをミップレベルlodでサンプルする。ページングしている場合はブリック表を引いてアトラス(レベル0のみ)から読む。
+// 2値ボリュームはミップレベルを持たないので常にレベル0
+float SampleVolume(vec3 texcoord,float lod)
+{
+    if(binaryVolume)
+    {
+        return SampleBinary(texcoord);
+    }
+    if(!pagedVolume)
+    {
+        return textureLod(volumeTexture,texcoord,lod).r;
+    }
+    vec3 voxel=texcoord*vec3(volumeResolution);
+    ivec3 brick=clamp(ivec3(voxel)/brickSize,ivec3(0),textureSize(brickTable,0)-1);
+    uvec4 slot=texelFetch(brickTable,brick,0);
+    if(slot.a==0u)
+    {
+        return 0.;//非常駐(空のブリック、または未転送)
+    }
+    //アトラス内の隣のスロットと補間しないよう、ブリックの内側に収める
+    vec3 brickExtent=vec3(min(ivec3(brickSize),volumeResolution-brick*brickSize));
+    vec3 local=clamp(voxel-vec3(brick*brickSize),vec3(.5),brickExtent-vec3(.5));
+    return textureLod(volumeTexture,(vec3(slot.xyz)*float(brickSize)+local)/vec3(textureSize(volumeTexture,0)),0.).r;
+}
+
+// texcoordのボクセルが属する成分の表示設定(最近傍)。ラベルが無ければ元の色で表示する
+vec4 LabelStyle(vec3 texcoord)
+{
+    if(!labelsEnabled)
+    {
+        return vec4(1.,1.,1.,.5);
+    }
+    ivec3 voxel=clamp(ivec3(texcoord*vec3(volumeResolution)),ivec3(0),volumeResolution-1);
+    uint label=texelFetch(labelTexture,voxel,0).r;
+    return texelFetch(labelTable,int(label));
+}
+
+// texcoordを含むマクロセルが透明なら、レイ(テクスチャ座標系での向きrayDirTex、ワールドの長さあたり)がそのセルを出るまでのワールドでの距離。サンプルが必要なら0
+float EmptyCellExitDistance(vec3 texcoord,vec3 rayDirTex)
+{
+    if(!macrocellsEnabled)
+    {
+        return 0.;
+    }
+    vec3 cellCoord=texcoord*vec3(volumeResolution)/float(macrocellSize);
+    ivec3 cell=clamp(ivec3(cellCoord),ivec3(0),textureSize(macrocellTexture,0)-1);
+    if(texelFetch(macrocellTexture,cell,0).r!=0u)
+    {
+        return 0.;
+    }
+    //進む向きにあるセルの面までの距離が最も近い軸で出る
+    vec3 cellDir=rayDirTex*vec3(volumeResolution)/float(macrocellSize);
+    vec3 toFace=mix(cellCoord-vec3(cell),vec3(cell)+1.-cellCoord,step(0.,cellDir));
+    vec3 exitDistance=max(toFace,0.)/max(abs(cellDir),vec3(1e-6));
+    return min(min(exitDistance.x,exitDistance.y),exitDistance.z);
+}
+
+// texcoordからどの向きに進んでも、補間に閾値を超えるボクセルが混ざらないワールドでの距離(0なら近くに占有ボクセルがある)
+float EmptyDistance(vec3 texcoord)
+{
+    if(!distanceFieldEnabled)
+    {
+        return 0.;
+    }
+    ivec3 voxel=clamp(ivec3(texcoord*vec3(volumeResolution)),ivec3(0),volumeResolution-1);
+    //ボクセル中心からtexcoordまでの最大sqrt(3)/2と、補間に使う8ボクセルまでの最大sqrt(3)を差し引く
+    float voxels=float(texelFetch(distanceTexture,voxel,0).r)-1.5*sqrt(3.);
+    return max(voxels,0.)*minVoxelSize;
+}
+
+// 画面上の1ピクセルが覆う大きさ(カメラからの距離に比例)がボクセル何個分かでミップレベルを選ぶ
+float SelectLod(float distanceFromCamera,float voxelSize)
+{
+    float footprint=distanceFromCamera*pixelAngle;
+    return clamp(log2(footprint/voxelSize),0.,float(volumeLevels-1));
+}
+
 void main()
 {
     //FragColor=vec4(1,0,0,1);
     //return;
+    int maxSteps=int(length(vec3(volumeResolution)));//1ステップで1ボクセル参照するような長さにする(最悪でも)
+    float boxFarestLength=length(volumeExtent);//バウンディングボックス内での最長距離(対角線)
     vec3 cameraPos=vec3(inverse(view)[3]);
     vec3 rayDir=normalize(positionWS.xyz-cameraPos);
     
@@ -45,38 +158,62 @@ void main()
     vec3 initialPos;
     if(gl_FrontFacing)//表面が映ってるならその表面内からレイ開始
     {
-        initialPos=positionWS.xyz+vec3(.5);
+        initialPos=positionWS.xyz;
     }
     else{//背面が映っている＝カメラがボリューム内ならカメラ位置からレイ開始
-        initialPos=cameraPos+vec3(.5)+rayDir*rayStartOffset;
+        initialPos=cameraPos+rayDir*rayStartOffset;
     }
     
     // レイの最長距離(ボックス内での最長距離)か、ファークリップ距離の短いほう最短距離とする
     float maxRayDistance=min(boxFarestLength+rayStartOffset,nearFarClip.y);
-    // 1回でレイを進める長さを計算。
-    float stepSize=maxRayDistance/float(maxSteps);
+    // 1回でレイを進める基準の長さ(レベル0で1ボクセル程度)。遠くでは選んだミップレベルに合わせて広げる
+    float baseStepSize=maxRayDistance/float(maxSteps);
+    float voxelSize=max(max(volumeExtent.x/float(volumeResolution.x),volumeExtent.y/float(volumeResolution.y)),volumeExtent.z/float(volumeResolution.z));
     
     float maxAlpha=0.;//残留している透明度
     vec3 maxColor=vec3(0.);//加算されていく最終的な色
+    float rayDistance=0.;//レイの始点からの距離
+    vec3 rayDirTex=rayDir/volumeExtent;//ワールドの長さあたりのテクスチャ座標の変化
     
     //レイマーチング開始
-    for(int i=0;i<maxSteps;i++)
+    for(int i=0;i<maxSteps&&rayDistance<maxRayDistance;i++)
     {
-        vec3 currentPos=rayDir*stepSize*float(i)+initialPos;
+        vec3 worldPos=rayDir*rayDistance+initialPos;
+        //最大値はステップ幅に依らないので不透明度の補正は不要(最大値で縮約したミップなら粗いレベルでも最大値が残る)
+        float lod=SelectLod(distance(worldPos,cameraPos),voxelSize);
+        float stepSize=baseStepSize*exp2(lod);
+        rayDistance+=stepSize;
+        //ワールド座標からテクスチャ座標(0~1)へ変換
+        vec3 currentPos=worldPos/volumeExtent+vec3(.5);
         
         //開始は必ずボリューム内なのでボリューム外なら中断。
         if(any(lessThan(currentPos,vec3(0.)))||any(greaterThan(currentPos,vec3(1.))))
         {
             continue;
         }
+        //透明なマクロセルの中はサンプルせず、セルの出口まで進める(次のセルに入るよう少しだけ越える)
+        float leap=EmptyCellExitDistance(currentPos,rayDirTex);
+        if(leap>0.)
+        {
+            rayDistance=max(rayDistance,rayDistance-stepSize+leap+.01*baseStepSize);
+            continue;
+        }
+        //距離場があれば、占有ボクセルに届かない範囲をまとめて進む(球を置いて進むのと同じ)
+        float emptyDistance=EmptyDistance(currentPos);
+        if(emptyDistance>stepSize)
+        {
+            rayDistance+=emptyDistance-stepSize;
+            continue;
+        }
         
-        float intensity=texture(volumeTexture,currentPos).r;//サンプル
+        vec4 style=LabelStyle(currentPos);
+        float intensity=style.a>0.?SampleVolume(currentPos,lod):0.;//サンプル(非表示の成分は空とみなす)
         //alphamin~alphamaxの範囲を0~1に正規化して、現在のアルファ値とする。
         float alpha=smoothstep(alphaRange.x,alphaRange.y,intensity);
         if(alpha>maxAlpha)//より大きなアルファ値がきたら更新
         {
             maxAlpha=alpha;
-            maxColor=HSVtoRGB((1-alpha)*260,1.,alpha);
+            maxColor=style.a>.75?style.rgb*alpha:HSVtoRGB((1-alpha)*260,1.,alpha);
         }
         if(maxAlpha>.99)//これ以上大きなアルファが来なさそうなら終了
         {
@@ -12,7 +12,7 @@ uniform mat4 view;
 uniform mat4 projection;
 uniform vec2 alphaRange;
 uniform float pointSize;
-uniform int volumeResolution;
+uniform ivec3 volumeResolution;
 
 // HSV to RGB conversion
 vec3 HSVtoRGB(float h,float s,float v)
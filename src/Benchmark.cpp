@@ -0,0 +1,1497 @@
+#include "Benchmark.hpp"
+#include <iostream>
+#include <iomanip>
+#include <functional>
+#include <map>
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <tuple>
+#include <array>
+#include <optional>
+#include <cmath>
+
+#include "Volume.hpp"
+#include "PointCloud.hpp"
+#include "Profiling.hpp"
+#include "BrickedVolume.hpp"
+#include "MipPyramid.hpp"
+#include "Gradient.hpp"
+#include "Macrocell.hpp"
+#include "DistanceField.hpp"
+#include "Histogram.hpp"
+#include "IsoSurface.hpp"
+#include "VoxelSurface.hpp"
+#include "DerivedCache.hpp"
+#include "SliceStack.hpp"
+#include "Morphology.hpp"
+#include "Filter.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+
+using namespace std;
+
+VoxelGrid<uint8_t> MakeSyntheticVolume(size_t n)
+{
+    VoxelGrid<uint8_t> grid(n, n, n);
+    const double center = (n - 1) * 0.5;
+    const double outer = n * 0.45, inner = n * 0.40, core = n * 0.1;
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < n; ++j)
+        {
+            for (size_t k = 0; k < n; ++k)
+            {
+                const double dx = i - center, dy = j - center, dz = k - center;
+                const double r = sqrt(dx * dx + dy * dy + dz * dz);
+                if ((r >= inner && r <= outer) || r <= core)
+                    grid(i, j, k) = static_cast<uint8_t>(20 + (i * 7 + j * 13 + k * 29) % 100);
+            }
+        }
+    }
+    return grid;
+}
+
+namespace
+{
+    /// 計測結果を最適化で消されないようにするための出力先
+    volatile long long benchmarkSink = 0;
+
+    /// @brief 関数をrepeat回実行し、最短時間[ms]を返す
+    double MeasureMs(const function<void()> &func, int repeat = 3)
+    {
+        double best = numeric_limits<double>::max();
+        for (int r = 0; r < repeat; ++r)
+        {
+            Stopwatch timer;
+            func();
+            best = min(best, timer.ElapsedMs());
+        }
+        return best;
+    }
+
+    void PrintComparison(const string &bench, size_t n, const string &kernel,
+                         const string &baseName, double baseMs, const string &newName, double newMs)
+    {
+        cout << "[BENCH] " << bench << " N=" << n << " " << left << setw(12) << kernel << right << fixed << setprecision(2)
+             << baseName << " " << setw(9) << baseMs << "ms  "
+             << newName << " " << setw(9) << newMs << "ms  x" << baseMs / newMs << endl;
+    }
+
+    /// 旧実装のネストしたvectorによるセル配列(比較用)
+    struct LegacyCell
+    {
+        uint8_t intencity;
+        unsigned char id;
+    };
+    using LegacyVolumeData = vector<vector<vector<LegacyCell>>>;
+
+    /// 旧実装のBFS領域探索(比較用)
+    void LegacySearch(LegacyVolumeData &v, size_t x, size_t y, size_t z, unsigned int id)
+    {
+        const size_t size = v.size();
+        queue<tuple<size_t, size_t, size_t>> queue;
+        queue.emplace(x, y, z);
+        while (!queue.empty())
+        {
+            auto [cx, cy, cz] = queue.front();
+            queue.pop();
+            if (cx >= size || cy >= size || cz >= size)
+                continue;
+            LegacyCell &cell = v[cx][cy][cz];
+            if (cell.intencity == 0 || cell.id != 0)
+                continue;
+            cell.id = id;
+            if (cx + 1 < size)
+                queue.emplace(cx + 1, cy, cz);
+            if (cx > 0)
+                queue.emplace(cx - 1, cy, cz);
+            if (cy + 1 < size)
+                queue.emplace(cx, cy + 1, cz);
+            if (cy > 0)
+                queue.emplace(cx, cy - 1, cz);
+            if (cz + 1 < size)
+                queue.emplace(cx, cy, cz + 1);
+            if (cz > 0)
+                queue.emplace(cx, cy, cz - 1);
+        }
+    }
+
+    /// @brief ネストしたvectorと連続領域のボクセル配列の走査速度を比較する
+    void BenchmarkLayout(size_t n)
+    {
+        Volume<uint8_t> volume(MakeSyntheticVolume(n));
+        const Volume<uint8_t>::IntencityGrid &grid = volume.intencity;
+
+        LegacyVolumeData legacy(n, vector<vector<LegacyCell>>(n, vector<LegacyCell>(n)));
+        for (size_t i = 0; i < n; ++i)
+            for (size_t j = 0; j < n; ++j)
+                for (size_t k = 0; k < n; ++k)
+                    legacy[i][j][k].intencity = grid(i, j, k);
+
+        // 全ボクセル走査
+        const double legacyTraverse = MeasureMs([&]
+                                                {
+            long long sum = 0;
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < n; ++j)
+                    for (size_t k = 0; k < n; ++k)
+                        sum += legacy[i][j][k].intencity;
+            benchmarkSink += sum; });
+        const double flatTraverse = MeasureMs([&]
+                                              {
+            long long sum = 0;
+            const uint8_t *voxel = grid.Data();
+            for (size_t index = 0; index < grid.Count(); ++index)
+                sum += voxel[index];
+            benchmarkSink += sum; });
+        PrintComparison("layout", n, "traverse", "nested", legacyTraverse, "flat", flatTraverse);
+
+        // 勾配計算(後退差分)
+        const double legacyGradient = MeasureMs([&]
+                                                {
+            long long sum = 0;
+            for (size_t i = 1; i < n; ++i)
+                for (size_t j = 1; j < n; ++j)
+                    for (size_t k = 1; k < n; ++k)
+                    {
+                        const int c = legacy[i][j][k].intencity;
+                        sum += (legacy[i - 1][j][k].intencity - c) + (legacy[i][j - 1][k].intencity - c) + (legacy[i][j][k - 1].intencity - c);
+                    }
+            benchmarkSink += sum; });
+        const double flatGradient = MeasureMs([&]
+                                              {
+            long long sum = 0;
+            for (size_t i = 1; i < n; ++i)
+                for (size_t j = 1; j < n; ++j)
+                {
+                    const uint8_t *row = &grid(i, j, 0);
+                    for (size_t k = 1; k < n; ++k)
+                    {
+                        const int c = row[k];
+                        sum += (row[k - grid.StrideX()] - c) + (row[k - grid.StrideY()] - c) + (row[k - 1] - c);
+                    }
+                }
+            benchmarkSink += sum; });
+        PrintComparison("layout", n, "gradient", "nested", legacyGradient, "flat", flatGradient);
+
+        // 点群変換
+        const double legacyVertices = MeasureMs([&]
+                                                {
+            vector<Vertex> vertices;
+            const float scale = 1.0f / n;
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < n; ++j)
+                    for (size_t k = 0; k < n; ++k)
+                        if (legacy[i][j][k].intencity != 0)
+                            vertices.push_back(Vertex{glm::vec3((i + 0.5f) * scale - 0.5f, (j + 0.5f) * scale - 0.5f, (k + 0.5f) * scale - 0.5f),
+                                                      static_cast<float>(legacy[i][j][k].intencity) / 255.0f});
+            benchmarkSink += vertices.size(); });
+        const double flatVertices = MeasureMs([&]
+                                              { benchmarkSink += PointCloud::VolumeToVertices(volume).size(); });
+        PrintComparison("layout", n, "vertices", "nested", legacyVertices, "flat", flatVertices);
+
+        // クラスタリング(旧実装のBFSと並列union-find)。ID領域は毎回作り直す
+        const double legacyClustering = MeasureMs([&]
+                                                  {
+            for (auto &plane : legacy)
+                for (auto &row : plane)
+                    for (auto &cell : row)
+                        cell.id = 0;
+            unsigned int id = 1;
+            for (size_t i = 0; i < n; ++i)
+                for (size_t j = 0; j < n; ++j)
+                    for (size_t k = 0; k < n; ++k)
+                        if (legacy[i][j][k].intencity > 0 && legacy[i][j][k].id == 0)
+                            LegacySearch(legacy, i, j, k, id++); }, 1);
+        const double flatClustering = MeasureMs([&]
+                                                {
+            VolumeBase::IdGrid ids;
+            Volume<uint8_t>::Clustering(grid, ids);
+            benchmarkSink += ids[ids.Count() / 2]; }, 1);
+        PrintComparison("layout", n, "clustering", "nested", legacyClustering, "flat", flatClustering);
+    }
+
+    /// @brief 生のボクセル配列の複製と、ブリック化した圧縮ペイロードの展開を比較する
+    void BenchmarkBricks(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+
+        VolumeHeader header;
+        ostringstream os;
+        Stopwatch encodeTimer;
+        const size_t payloadBytes = WriteBrickedVolume(os, header, grid);
+        const double encodeMs = encodeTimer.ElapsedMs();
+        const string file = os.str();
+        const char *payload = file.data() + header.payloadOffset;
+
+        VoxelGrid<uint8_t> decoded(n, n, n);
+        const double rawMs = MeasureMs([&]
+                                       { memcpy(decoded.Data(), grid.Data(), grid.Bytes()); });
+        const double decodeMs = MeasureMs([&]
+                                          { DecodeBrickedVolume(header, payload, file.size() - header.payloadOffset, decoded); });
+        PrintComparison("bricks", n, "decode", "raw", rawMs, "bricked", decodeMs);
+        cout << "[BENCH] bricks N=" << n << " ratio " << static_cast<double>(grid.Bytes()) / payloadBytes << "x"
+             << ", encode " << encodeMs << "ms, decode " << grid.Bytes() / (decodeMs * 1e6) << "GB/s"
+             << (memcmp(decoded.Data(), grid.Data(), grid.Bytes()) == 0 ? "" : " MISMATCH") << endl;
+    }
+
+    /// @brief 出力ボクセルごとに2x2x2を集める素朴なミップレベル生成(比較用、単一スレッド)
+    VoxelGrid<uint8_t> NaiveReduceMipLevel(const VoxelGrid<uint8_t> &source, MipReduction reduction)
+    {
+        const size_t nx = source.SizeX(), ny = source.SizeY(), nz = source.SizeZ();
+        const size_t outX = max<size_t>(nx / 2, 1), outY = max<size_t>(ny / 2, 1), outZ = max<size_t>(nz / 2, 1);
+        VoxelGrid<uint8_t> result(outX, outY, outZ);
+        // 奇数なら最後の出力は3つ分を覆う
+        auto range = [](size_t i, size_t outSize, size_t inSize)
+        { return make_pair(min(2 * i, inSize - 1), i + 1 == outSize ? inSize : 2 * i + 2); };
+        for (size_t x = 0; x < outX; ++x)
+            for (size_t y = 0; y < outY; ++y)
+                for (size_t z = 0; z < outZ; ++z)
+                {
+                    const auto [x0, x1] = range(x, outX, nx);
+                    const auto [y0, y1] = range(y, outY, ny);
+                    const auto [z0, z1] = range(z, outZ, nz);
+                    unsigned int maxValue = 0, sum = 0, bits = 0, count = 0;
+                    for (size_t i = x0; i < x1; ++i)
+                        for (size_t j = y0; j < y1; ++j)
+                            for (size_t k = z0; k < z1; ++k)
+                            {
+                                const unsigned int v = source(i, j, k);
+                                maxValue = max(maxValue, v);
+                                sum += v;
+                                bits |= v;
+                                count++;
+                            }
+                    result(x, y, z) = static_cast<uint8_t>(reduction == MipReduction::Max       ? maxValue
+                                                           : reduction == MipReduction::Average ? (sum + count / 2) / count
+                                                                                                : bits);
+                }
+        return result;
+    }
+
+    /// @brief ボクセル配列を(幅,高さ,奥行き)の位置で3重線形補間する(端は繰り返す)。テクスチャのサンプルの代わり
+    template <typename T, typename Load>
+    auto SampleTrilinear(const VoxelGrid<T> &grid, float w, float h, float d, Load load)
+    {
+        const auto clampIndex = [](float v, size_t size)
+        { return static_cast<size_t>(min(max(v, 0.0f), static_cast<float>(size - 1))); };
+        const float fw = w - floor(w), fh = h - floor(h), fd = d - floor(d);
+        const size_t w0 = clampIndex(floor(w), grid.SizeZ()), w1 = clampIndex(floor(w) + 1, grid.SizeZ());
+        const size_t h0 = clampIndex(floor(h), grid.SizeY()), h1 = clampIndex(floor(h) + 1, grid.SizeY());
+        const size_t d0 = clampIndex(floor(d), grid.SizeX()), d1 = clampIndex(floor(d) + 1, grid.SizeX());
+        const auto lerp = [](auto a, auto b, float t)
+        { return a + (b - a) * t; };
+        const auto c00 = lerp(load(grid(d0, h0, w0)), load(grid(d0, h0, w1)), fw);
+        const auto c01 = lerp(load(grid(d0, h1, w0)), load(grid(d0, h1, w1)), fw);
+        const auto c10 = lerp(load(grid(d1, h0, w0)), load(grid(d1, h0, w1)), fw);
+        const auto c11 = lerp(load(grid(d1, h1, w0)), load(grid(d1, h1, w1)), fw);
+        return lerp(lerp(c00, c01, fh), lerp(c10, c11, fh), fd);
+    }
+
+    /// @brief 陰影用の勾配を、素朴な逐次計算(float3)と並列・ベクトル化したRGB8への詰め込みで比べ、
+    /// レイマーチングで毎ステップ6点から求める場合と事前計算を1回読む場合の1フレームの時間とメモリを比べる
+    /// @details フレームはCPUで模擬する(奥行き方向に一辺最大256本のレイを1ボクセル間隔で進め、不透明になるまで拡散反射を積算)。
+    /// GPUでの実際のフレーム時間はControl PanelのGradient Shadingを切り替えてfpsで確認する
+    void BenchmarkGradients(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const auto loadIntensity = [](uint8_t v)
+        { return v / 255.0f; };
+
+        vector<glm::vec3> naive;
+        const double naiveMs = MeasureMs([&]
+                                         {
+            naive.assign(grid.Count(), glm::vec3(0.0f));
+            for (size_t x = 0; x < n; ++x)
+                for (size_t y = 0; y < n; ++y)
+                    for (size_t z = 0; z < n; ++z)
+                    {
+                        const auto at = [&](size_t i, size_t j, size_t k)
+                        { return grid(min(i, n - 1), min(j, n - 1), min(k, n - 1)) / 255.0f; };
+                        const glm::vec3 g((at(x, y, z + 1) - at(x, y, z > 0 ? z - 1 : 0)) * n,
+                                          (at(x, y + 1, z) - at(x, y > 0 ? y - 1 : 0, z)) * n,
+                                          (at(x + 1, y, z) - at(x > 0 ? x - 1 : 0, y, z)) * n);
+                        const float length = sqrt(g.x * g.x + g.y * g.y + g.z * g.z);
+                        naive[grid.Index(x, y, z)] = length > 0.0f ? g / length : glm::vec3(0.0f);
+                    }
+            benchmarkSink += naive.size(); }, 1);
+        VoxelGrid<PackedGradient> packed;
+        const double packedMs = MeasureMs([&]
+                                          { packed = ComputeGradients(grid); });
+        PrintComparison("gradients", n, "build", "naive-f32", naiveMs, "packed-rgb8", packedMs);
+
+        // 詰め込みの誤差(単位ベクトルの角度)
+        double maxErrorDegrees = 0.0;
+        for (size_t i = 0; i < grid.Count(); i += 7)
+        {
+            const glm::vec3 reference = naive[i];
+            const glm::vec3 decoded(packed[i].x / 127.0f, packed[i].y / 127.0f, packed[i].z / 127.0f);
+            const float length = sqrt(decoded.x * decoded.x + decoded.y * decoded.y + decoded.z * decoded.z);
+            if (length == 0.0f || (reference.x == 0.0f && reference.y == 0.0f && reference.z == 0.0f))
+                continue;
+            const float cosine = (reference.x * decoded.x + reference.y * decoded.y + reference.z * decoded.z) / length;
+            maxErrorDegrees = max(maxErrorDegrees, acos(min(max(static_cast<double>(cosine), -1.0), 1.0)) * 180.0 / M_PI);
+        }
+        naive = vector<glm::vec3>();
+
+        // 模擬フレーム。ライトは斜め前から
+        const glm::vec3 light = glm::vec3(0.48f, 0.6f, 0.64f);
+        const size_t pixels = min<size_t>(n, 256);
+        const auto frame = [&](bool precomputed)
+        {
+            double image = 0.0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : image)
+            for (long long py = 0; py < static_cast<long long>(pixels); ++py)
+                for (size_t pw = 0; pw < pixels; ++pw)
+                {
+                    const float h = (py + 0.25f) * n / pixels, w = (pw + 0.25f) * n / pixels;
+                    float remain = 1.0f, color = 0.0f;
+                    for (float d = 0.5f; d < n && remain > 0.01f; d += 1.0f)
+                    {
+                        const float alpha = SampleTrilinear(grid, w, h, d, loadIntensity) * 0.2f;
+                        if (alpha <= 0.0f)
+                            continue;
+                        glm::vec3 g;
+                        if (precomputed)
+                            g = SampleTrilinear(packed, w, h, d, [](const PackedGradient &v)
+                                                { return glm::vec3(v.x, v.y, v.z); });
+                        else
+                            g = glm::vec3(SampleTrilinear(grid, w + 1, h, d, loadIntensity) - SampleTrilinear(grid, w - 1, h, d, loadIntensity),
+                                          SampleTrilinear(grid, w, h + 1, d, loadIntensity) - SampleTrilinear(grid, w, h - 1, d, loadIntensity),
+                                          SampleTrilinear(grid, w, h, d + 1, loadIntensity) - SampleTrilinear(grid, w, h, d - 1, loadIntensity));
+                        const float length = sqrt(g.x * g.x + g.y * g.y + g.z * g.z);
+                        const float diffuse = length > 0.0f ? abs(g.x * light.x + g.y * light.y + g.z * light.z) / length : 0.0f;
+                        color += remain * alpha * diffuse;
+                        remain *= 1.0f - alpha;
+                    }
+                    image += color;
+                }
+            benchmarkSink += static_cast<long long>(image);
+        };
+        const double onTheFlyMs = MeasureMs([&]
+                                            { frame(false); });
+        const double precomputedMs = MeasureMs([&]
+                                               { frame(true); });
+        PrintComparison("gradients", n, "frame", "on-the-fly", onTheFlyMs, "precomputed", precomputedMs);
+        cout << "[BENCH] gradients N=" << n << " memory: intensity " << ToMiB(grid.Bytes()) << "MiB, packed gradients +"
+             << ToMiB(packed.Bytes()) << "MiB (float3 would be " << ToMiB(grid.Count() * sizeof(glm::vec3)) << "MiB), max packing error "
+             << setprecision(2) << maxErrorDegrees << " deg" << endl;
+    }
+
+    /// @brief マクロセル(強度の最小・最大)を素朴な逐次計算と並列・ベクトル化した計算で作り、
+    /// アルファの下限での分類と、透明なセルを飛び越える場合と全ステップをサンプルする場合の1フレームの時間を比べる
+    /// @details フレームはCPUで模擬する(奥行き方向に一辺最大256本のレイを1ボクセル間隔で進め、不透明になるまで積算)。
+    /// 飛び越えても同じ位置でサンプルするので、画像は一致しなければならない
+    void BenchmarkMacrocells(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const size_t cells = (n + macrocellSize - 1) / macrocellSize;
+
+        VoxelGrid<ValueRange> naive;
+        const double naiveMs = MeasureMs([&]
+                                         {
+            naive = VoxelGrid<ValueRange>(cells, cells, cells);
+            for (size_t i = 0; i < cells; ++i)
+                for (size_t j = 0; j < cells; ++j)
+                    for (size_t k = 0; k < cells; ++k)
+                    {
+                        ValueRange range{1.0f, 0.0f};
+                        for (size_t x = i * macrocellSize > 0 ? i * macrocellSize - 1 : 0; x < min((i + 1) * macrocellSize + 1, n); ++x)
+                            for (size_t y = j * macrocellSize > 0 ? j * macrocellSize - 1 : 0; y < min((j + 1) * macrocellSize + 1, n); ++y)
+                                for (size_t z = k * macrocellSize > 0 ? k * macrocellSize - 1 : 0; z < min((k + 1) * macrocellSize + 1, n); ++z)
+                                {
+                                    const float v = VoxelTraits<uint8_t>::Normalize(grid(x, y, z));
+                                    range.min = min(range.min, v);
+                                    range.max = max(range.max, v);
+                                }
+                        naive(i, j, k) = range;
+                    } }, 1);
+        VoxelGrid<ValueRange> macrocells;
+        const double parallelMs = MeasureMs([&]
+                                            { macrocells = ComputeMacrocells(grid); });
+        PrintComparison("macrocells", n, "build", "naive", naiveMs, "parallel", parallelMs);
+        if (memcmp(naive.Data(), macrocells.Data(), naive.Bytes()) != 0)
+            cout << "[BENCH] macrocells N=" << n << " MISMATCH" << endl;
+
+        const float alphaMin = 0.1f, alphaMax = 0.5f;
+        vector<uint8_t> occupancy;
+        size_t occupied = 0;
+        const double classifyMs = MeasureMs([&]
+                                            { occupied = ClassifyMacrocells(macrocells, alphaMin, occupancy); });
+        cout << "[BENCH] macrocells N=" << n << " classify " << fixed << setprecision(3) << classifyMs << "ms, "
+             << occupied << "/" << macrocells.Count() << " cells sampled (" << setprecision(1) << 100.0 * occupied / macrocells.Count()
+             << "%), range grid " << setprecision(2) << ToMiB(macrocells.Bytes()) << "MiB" << endl;
+
+        const size_t pixels = min<size_t>(n, 256);
+        const auto frame = [&](bool skip, long long &samples)
+        {
+            double image = 0.0;
+            long long sampleCount = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : image, sampleCount)
+            for (long long py = 0; py < static_cast<long long>(pixels); ++py)
+                for (size_t pw = 0; pw < pixels; ++pw)
+                {
+                    const float h = (py + 0.25f) * n / pixels, w = (pw + 0.25f) * n / pixels;
+                    const size_t cellH = static_cast<size_t>(h) / macrocellSize, cellW = static_cast<size_t>(w) / macrocellSize;
+                    float remain = 1.0f, color = 0.0f;
+                    for (float d = 0.5f; d < n && remain > 0.01f; d += 1.0f)
+                    {
+                        const size_t cellD = static_cast<size_t>(d) / macrocellSize;
+                        if (skip && !occupancy[macrocells.Index(cellD, cellH, cellW)])
+                        {
+                            // セルの出口の次のサンプル位置へ(ループの+1を引いておく)
+                            d = static_cast<float>((cellD + 1) * macrocellSize) - 0.5f;
+                            continue;
+                        }
+                        ++sampleCount;
+                        const float t = min(max((SampleTrilinear(grid, w, h, d, [](uint8_t v)
+                                                                 { return v / 255.0f; }) -
+                                                 alphaMin) /
+                                                    (alphaMax - alphaMin),
+                                                0.0f),
+                                            1.0f);
+                        const float alpha = t * t * (3.0f - 2.0f * t);
+                        color += remain * alpha * (1.0f - alpha);
+                        remain *= 1.0f - alpha;
+                    }
+                    image += color;
+                }
+            samples = sampleCount;
+            return image;
+        };
+        long long fullSamples = 0, skippedSamples = 0;
+        double fullImage = 0.0, skippedImage = 0.0;
+        const double fullMs = MeasureMs([&]
+                                        { fullImage = frame(false, fullSamples); });
+        const double skipMs = MeasureMs([&]
+                                        { skippedImage = frame(true, skippedSamples); });
+        PrintComparison("macrocells", n, "frame", "every-step", fullMs, "skipping", skipMs);
+        cout << "[BENCH] macrocells N=" << n << " samples " << fullSamples << " -> " << skippedSamples
+             << (fullImage == skippedImage ? "" : " IMAGE MISMATCH") << endl;
+        benchmarkSink += static_cast<long long>(fullImage + skippedImage);
+    }
+
+    /// @brief 距離場の生成時間と正しさ(総当たりとの比較)、全ステップをサンプルする場合・透明なマクロセルを飛び越える場合・
+    /// 距離場で進む場合の1フレームの時間を比べる
+    /// @details フレームはBenchmarkMacrocellsと同じ模擬で、どの方法でも同じ位置でサンプルするので画像は一致しなければならない
+    void BenchmarkDistance(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const float alphaMin = 0.1f, alphaMax = 0.5f;
+        VoxelGrid<uint8_t> field;
+        const double buildMs = MeasureMs([&]
+                                         { field = ComputeDistanceField(grid, alphaMin); });
+        cout << "[BENCH] distance N=" << n << " build " << fixed << setprecision(2) << buildMs << "ms ("
+             << grid.Count() / (buildMs * 1000.0) << " Mvoxel/s), field " << ToMiB(field.Bytes()) << "MiB" << endl;
+
+        // 間引いたボクセルで総当たりの距離と比べる
+        vector<array<int, 3>> occupied;
+        for (size_t x = 0; x < n; ++x)
+            for (size_t y = 0; y < n; ++y)
+                for (size_t z = 0; z < n; ++z)
+                    if (VoxelTraits<uint8_t>::Normalize(grid(x, y, z)) > alphaMin)
+                        occupied.push_back({static_cast<int>(x), static_cast<int>(y), static_cast<int>(z)});
+        size_t mismatches = 0;
+        const size_t checks = 256;
+        for (size_t c = 0; c < checks; ++c)
+        {
+            const size_t index = (c * 2654435761u) % grid.Count();
+            const int x = static_cast<int>(index / (n * n)), y = static_cast<int>(index / n % n), z = static_cast<int>(index % n);
+            long long best = numeric_limits<long long>::max();
+            for (const auto &o : occupied)
+            {
+                const long long dx = o[0] - x, dy = o[1] - y, dz = o[2] - z;
+                best = min(best, dx * dx + dy * dy + dz * dz);
+            }
+            const uint8_t expected = static_cast<uint8_t>(min<double>(floor(sqrt(static_cast<double>(best))), maxFieldDistance));
+            mismatches += field[index] != expected;
+        }
+        if (mismatches)
+            cout << "[BENCH] distance N=" << n << " MISMATCH " << mismatches << "/" << checks << endl;
+
+        const VoxelGrid<ValueRange> macrocells = ComputeMacrocells(grid);
+        vector<uint8_t> occupancy;
+        ClassifyMacrocells(macrocells, alphaMin, occupancy);
+        const size_t pixels = min<size_t>(n, 256);
+        // 0: 全ステップ, 1: マクロセル, 2: マクロセルと距離場(シェーダと同じ)
+        const auto frame = [&](int mode, long long &samples)
+        {
+            double image = 0.0;
+            long long sampleCount = 0;
+#pragma omp parallel for schedule(dynamic) reduction(+ : image, sampleCount)
+            for (long long py = 0; py < static_cast<long long>(pixels); ++py)
+                for (size_t pw = 0; pw < pixels; ++pw)
+                {
+                    const float h = (py + 0.25f) * n / pixels, w = (pw + 0.25f) * n / pixels;
+                    const size_t cellH = static_cast<size_t>(h) / macrocellSize, cellW = static_cast<size_t>(w) / macrocellSize;
+                    float remain = 1.0f, color = 0.0f;
+                    for (float d = 0.5f; d < n && remain > 0.01f; d += 1.0f)
+                    {
+                        if (mode >= 1)
+                        {
+                            const size_t cellD = static_cast<size_t>(d) / macrocellSize;
+                            if (!occupancy[macrocells.Index(cellD, cellH, cellW)])
+                            {
+                                d = static_cast<float>((cellD + 1) * macrocellSize) - 0.5f;
+                                continue;
+                            }
+                        }
+                        if (mode == 2)
+                        {
+                            // ここの補間はボクセル中心が整数座標なので、切り捨てたボクセルまで最大sqrt(3)、補間する8ボクセルまで最大sqrt(3)
+                            const float empty = field(static_cast<size_t>(d), static_cast<size_t>(h), static_cast<size_t>(w)) - 2.0f * sqrt(3.0f);
+                            if (empty >= 1.0f)
+                            {
+                                d += floor(empty) - 1.0f;
+                                continue;
+                            }
+                        }
+                        ++sampleCount;
+                        const float t = min(max((SampleTrilinear(grid, w, h, d, [](uint8_t v)
+                                                                 { return v / 255.0f; }) -
+                                                 alphaMin) /
+                                                    (alphaMax - alphaMin),
+                                                0.0f),
+                                            1.0f);
+                        const float alpha = t * t * (3.0f - 2.0f * t);
+                        color += remain * alpha * (1.0f - alpha);
+                        remain *= 1.0f - alpha;
+                    }
+                    image += color;
+                }
+            samples = sampleCount;
+            return image;
+        };
+        long long samples[3] = {};
+        double images[3] = {}, times[3] = {};
+        for (int mode = 0; mode < 3; ++mode)
+            times[mode] = MeasureMs([&]
+                                    { images[mode] = frame(mode, samples[mode]); });
+        PrintComparison("distance", n, "frame-cells", "every-step", times[0], "macrocells", times[1]);
+        PrintComparison("distance", n, "frame-field", "every-step", times[0], "cells+field", times[2]);
+        cout << "[BENCH] distance N=" << n << " samples " << samples[0] << " / " << samples[1] << " / " << samples[2]
+             << (images[0] == images[1] && images[0] == images[2] ? "" : " IMAGE MISMATCH") << endl;
+        benchmarkSink += static_cast<long long>(images[0] + images[1] + images[2]);
+    }
+
+    /// @brief 1つのビン配列に順に数えるヒストグラムと、塊ごとに並列に数えるヒストグラム、部分領域の差分更新を比較する
+    void BenchmarkHistogram(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        VoxelGrid<uint16_t> wide(n, n, n);
+        for (size_t i = 0; i < grid.Count(); ++i)
+            wide[i] = static_cast<uint16_t>(grid[i] * 257);
+        const auto compare = [n](const char *label, const auto &source)
+        {
+            vector<uint64_t> naive;
+            const double naiveMs = MeasureMs([&]
+                                             {
+                naive.assign(size_t(1) << (8 * sizeof(source[0])), 0);
+                for (size_t i = 0; i < source.Count(); ++i)
+                    ++naive[source[i]]; });
+            Histogram histogram;
+            const double parallelMs = MeasureMs([&]
+                                                { histogram = ComputeHistogram(source); });
+            PrintComparison("histogram", n, label, "serial", naiveMs, "chunked", parallelMs);
+            if (histogram.bins != naive)
+                cout << "[BENCH] histogram N=" << n << " " << label << " MISMATCH" << endl;
+            return histogram;
+        };
+        const Histogram histogram = compare("uint8", grid);
+        compare("uint16", wide);
+        cout << "[BENCH] histogram N=" << n << " otsu " << histogram.OtsuThreshold(true) << ", 2-98% "
+             << histogram.Percentile(0.02, true) << " - " << histogram.Percentile(0.98, true) << endl;
+
+        // 部分領域を1スライスずつ奥へずらしていく
+        const uint32_t side = static_cast<uint32_t>(n / 2), steps = static_cast<uint32_t>(min<size_t>(n / 4, 32));
+        const auto regionAt = [side](uint32_t offset)
+        {
+            VolumeRegion region;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                region.begin[axis] = axis == 2 ? offset : side / 2;
+                region.end[axis] = region.begin[axis] + side;
+            }
+            return region;
+        };
+        RegionHistogram incremental;
+        incremental.Update(grid, regionAt(0), histogram);
+        Histogram full;
+        const double recountMs = MeasureMs([&]
+                                           {
+            for (uint32_t step = 1; step <= steps; ++step)
+            {
+                full = histogram;
+                fill(full.bins.begin(), full.bins.end(), 0);
+                AccumulateHistogram(grid, regionAt(step), full);
+            } });
+        const double updateMs = MeasureMs([&]
+                                          {
+            for (uint32_t step = 1; step <= steps; ++step)
+                incremental.Update(grid, regionAt(step), histogram); });
+        PrintComparison("histogram", n, "roi-move", "recount", recountMs, "incremental", updateMs);
+        if (incremental.Get().bins != full.bins)
+            cout << "[BENCH] histogram N=" << n << " roi MISMATCH" << endl;
+        benchmarkSink += static_cast<long long>(full.Total());
+    }
+
+    /// @brief 1枚の板で求めた等値面と、板に分けて並列に求めた等値面を比較し、頂点の共有と面の閉じ方を確かめる
+    void BenchmarkIsoSurface(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const glm::vec3 extent(1.0f);
+        for (float isovalue : {0.1f, 0.3f})
+        {
+            vector<MeshVertex> serialVertices, vertices;
+            vector<GLuint> serialIndices, indices;
+            const double serialMs = MeasureMs([&]
+                                              { IsoSurface::Extract(grid, extent, isovalue, serialVertices, serialIndices, 1); });
+            const double parallelMs = MeasureMs([&]
+                                                { IsoSurface::Extract(grid, extent, isovalue, vertices, indices); });
+            ostringstream label;
+            label << "iso " << isovalue;
+            PrintComparison("isosurface", n, label.str(), "one-slab", serialMs, "slabs", parallelMs);
+            const bool same = indices == serialIndices && vertices.size() == serialVertices.size() &&
+                              equal(vertices.begin(), vertices.end(), serialVertices.begin(), [](const MeshVertex &a, const MeshVertex &b)
+                                    { return a.position == b.position && a.normal == b.normal; });
+
+            // 閉じた面なら、三角形の辺(a, b)には必ず逆向きの辺(b, a)がある
+            vector<uint64_t> edges;
+            edges.reserve(indices.size());
+            for (size_t t = 0; t < indices.size(); t += 3)
+                for (int e = 0; e < 3; ++e)
+                    edges.push_back(static_cast<uint64_t>(indices[t + e]) << 32 | indices[t + (e + 1) % 3]);
+            sort(edges.begin(), edges.end());
+            size_t openEdges = 0;
+            for (uint64_t edge : edges)
+                openEdges += !binary_search(edges.begin(), edges.end(), edge << 32 | edge >> 32);
+            const size_t triangles = indices.size() / 3;
+            cout << "[BENCH] isosurface N=" << n << " iso " << isovalue << " " << triangles << " triangles, " << vertices.size()
+                 << " shared vertices (" << ToMiB(vertices.size() * sizeof(MeshVertex) + indices.size() * sizeof(GLuint)) << "MiB vs "
+                 << ToMiB(triangles * 3 * sizeof(MeshVertex)) << "MiB unshared), " << fixed << setprecision(1)
+                 << triangles / (parallelMs * 1000.0) << " Mtri/s"
+                 << (openEdges ? ", " + to_string(openEdges) + " OPEN EDGES" : "") << (same ? "" : ", MISMATCH") << endl;
+            benchmarkSink += static_cast<long long>(triangles);
+        }
+    }
+
+    /// @brief 点群(非0ボクセルごとの点、毎フレーム並べ替え)と、貪欲法でまとめたボクセルの表面を比較する
+    void BenchmarkVoxelSurface(size_t n)
+    {
+        const Volume<uint8_t> volume(MakeSyntheticVolume(n));
+        optional<PointCloud> pointCloud;
+        const double pointMs = MeasureMs([&]
+                                         { pointCloud.emplace(volume); }, 1);
+        vector<MeshVertex> vertices;
+        vector<GLuint> indices;
+        size_t exposedFaces = 0;
+        // 点群と同じく非0のボクセルを描く
+        const double surfaceMs = MeasureMs([&]
+                                           { VoxelSurface::Extract(volume.intencity, volume.extent, 0.0f, vertices, indices, &exposedFaces); });
+        PrintComparison("voxelsurface", n, "build", "point-cloud", pointMs, "greedy", surfaceMs);
+
+        // 点群は毎フレーム視点順に並べ替えてインデックスを転送し直す。表面は深度テストなので何もしない
+        glm::mat4 modelView(1.0f);
+        modelView[0] = glm::vec4(0.8f, 0.0f, -0.6f, 0.0f);
+        modelView[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+        modelView[2] = glm::vec4(0.6f, 0.0f, 0.8f, 0.0f);
+        modelView[3] = glm::vec4(0.0f, 0.0f, -2.0f, 1.0f);
+        size_t reordered = 0;
+        const double sortMs = MeasureMs([&]
+                                        { reordered = PointCloud::ReorderIndices(pointCloud->indicesX, pointCloud->indicesY, pointCloud->indicesZ, modelView).size(); });
+        const size_t points = pointCloud->vertices.size(), quads = indices.size() / 6;
+        cout << "[BENCH] voxelsurface N=" << n << " primitives " << points << " points vs " << quads << " quads (" << exposedFaces
+             << " exposed faces, " << fixed << setprecision(2) << static_cast<double>(exposedFaces) / max<size_t>(quads, 1) << " faces/quad), x"
+             << static_cast<double>(points) / max<size_t>(quads * 2, 1) << " fewer primitives (points vs triangles)" << endl;
+        cout << "[BENCH] voxelsurface N=" << n << " per-frame CPU " << sortMs << "ms sort + " << ToMiB(reordered * sizeof(GLuint))
+             << "MiB index upload vs 0ms; buffers " << ToMiB(points * sizeof(Vertex) + 4 * points * sizeof(GLuint)) << "MiB vs "
+             << ToMiB(vertices.size() * sizeof(MeshVertex) + indices.size() * sizeof(GLuint)) << "MiB" << endl;
+        benchmarkSink += static_cast<long long>(reordered + quads);
+    }
+
+    /// @brief 1バイトのボクセルと1ビットに詰めたボクセルで、メモリ量と占有・近傍の問い合わせ、点群・クラスタリング・表面を比較する
+    void BenchmarkBinary(size_t n)
+    {
+        const Volume<uint8_t> volume(MakeSyntheticVolume(n));
+        const VoxelGrid<uint8_t> &grid = volume.intencity;
+        Volume<uint8_t> packed(MakeSyntheticVolume(n));
+        const double packMs = MeasureMs([&]
+                                        { benchmarkSink += static_cast<long long>(BitGrid::Pack(grid).Bytes()); });
+        packed.PackBits();
+        const BitGrid &bits = packed.bits;
+        const glm::ivec3 texture = packed.TextureResolution(0);
+        const size_t textureBytes = static_cast<size_t>(texture.x) * texture.y * texture.z * sizeof(uint32_t);
+        cout << "[BENCH] binary N=" << n << " pack " << fixed << setprecision(2) << packMs << "ms; host " << ToMiB(grid.Bytes()) << "MiB (u8) vs "
+             << ToMiB(bits.Bytes()) << "MiB (x" << static_cast<double>(grid.Bytes()) / bits.Bytes() << "); GPU " << ToMiB(grid.Bytes())
+             << "MiB (R8), " << ToMiB(grid.Count() * sizeof(float)) << "MiB (R32F) vs " << ToMiB(textureBytes) << "MiB (R32UI, x"
+             << static_cast<double>(grid.Count() * sizeof(float)) / textureBytes << " vs float)" << endl;
+
+        // 占有ボクセル数
+        size_t byteCount = 0, bitCount = 0;
+        const double byteCountMs = MeasureMs([&]
+                                             { byteCount = static_cast<size_t>(count_if(grid.Data(), grid.Data() + grid.Count(), [](uint8_t v)
+                                                                                        { return v != 0; })); });
+        const double bitCountMs = MeasureMs([&]
+                                            { bitCount = bits.CountOnes(); });
+        PrintComparison("binary", n, "occupancy", "bytes", byteCountMs, "popcount", bitCountMs);
+
+        // 6近傍のどれかが空の(表面の)ボクセル
+        VoxelGrid<uint8_t> byteSurface;
+        BitGrid bitSurface;
+        const double byteSurfaceMs = MeasureMs([&]
+                                               {
+            byteSurface = VoxelGrid<uint8_t>(n, n, n);
+            for (size_t x = 0; x < n; ++x)
+                for (size_t y = 0; y < n; ++y)
+                    for (size_t z = 0; z < n; ++z)
+                    {
+                        if (grid(x, y, z) == 0)
+                            continue;
+                        const bool interior = x > 0 && x + 1 < n && y > 0 && y + 1 < n && z > 0 && z + 1 < n &&
+                                              grid(x - 1, y, z) && grid(x + 1, y, z) && grid(x, y - 1, z) && grid(x, y + 1, z) && grid(x, y, z - 1) && grid(x, y, z + 1);
+                        byteSurface(x, y, z) = interior ? 0 : 1;
+                    } }, 1);
+        const double bitSurfaceMs = MeasureMs([&]
+                                              { bitSurface = bits.Surface(); });
+        PrintComparison("binary", n, "surface", "bytes", byteSurfaceMs, "words", bitSurfaceMs);
+        bool surfaceMatch = true;
+        for (size_t x = 0; surfaceMatch && x < n; ++x)
+            for (size_t y = 0; surfaceMatch && y < n; ++y)
+                for (size_t z = 0; surfaceMatch && z < n; ++z)
+                    surfaceMatch = (byteSurface(x, y, z) != 0) == bitSurface.Get(x, y, z);
+
+        // 点群(詰めた場合は表面だけ)、クラスタリング、ボクセルの表面
+        vector<Vertex> bytePoints, bitPoints;
+        const double bytePointMs = MeasureMs([&]
+                                             { bytePoints = PointCloud::VolumeToVertices(volume); }, 1);
+        const double bitPointMs = MeasureMs([&]
+                                            { bitPoints = PointCloud::VolumeToVertices(packed); }, 1);
+        PrintComparison("binary", n, "points", "bytes", bytePointMs, "bits", bitPointMs);
+        VolumeBase::IdGrid byteIds, bitIds;
+        uint32_t byteComponents = 0, bitComponents = 0;
+        const double byteCclMs = MeasureMs([&]
+                                           { byteComponents = Volume<uint8_t>::Clustering(grid, byteIds); });
+        const double bitCclMs = MeasureMs([&]
+                                          { bitComponents = VolumeBase::Clustering(bits, bitIds); });
+        PrintComparison("binary", n, "ccl", "bytes", byteCclMs, "bits", bitCclMs);
+        vector<MeshVertex> byteVertices, bitVertices;
+        vector<GLuint> byteIndices, bitIndices;
+        const double byteMeshMs = MeasureMs([&]
+                                            { VoxelSurface::Extract(grid, volume.extent, 0.0f, byteVertices, byteIndices); });
+        const double bitMeshMs = MeasureMs([&]
+                                           { VoxelSurface::Extract(bits, packed.extent, 0.0f, bitVertices, bitIndices); });
+        PrintComparison("binary", n, "mesh", "bytes", byteMeshMs, "bits", bitMeshMs);
+
+        const bool match = byteCount == bitCount && surfaceMatch && bitPoints.size() == bitSurface.CountOnes() &&
+                           byteComponents == bitComponents && memcmp(byteIds.Data(), bitIds.Data(), byteIds.Bytes()) == 0 &&
+                           byteIndices == bitIndices && byteVertices.size() == bitVertices.size();
+        cout << "[BENCH] binary N=" << n << " occupied " << bitCount << ", surface " << bitPoints.size() << " of " << bytePoints.size()
+             << " points, components " << bitComponents << (match ? "" : " MISMATCH") << endl;
+    }
+
+    /// @brief 素朴なミップピラミッド生成と、並列・ベクトル化した生成を比較する
+    void BenchmarkMips(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        for (MipReduction reduction : {MipReduction::Max, MipReduction::Average, MipReduction::Or})
+        {
+            vector<VoxelGrid<uint8_t>> naive, pyramid;
+            const double naiveMs = MeasureMs([&]
+                                             {
+                naive.clear();
+                const VoxelGrid<uint8_t> *previous = &grid;
+                while (previous->SizeX() > 1 || previous->SizeY() > 1 || previous->SizeZ() > 1)
+                {
+                    naive.push_back(NaiveReduceMipLevel(*previous, reduction));
+                    previous = &naive.back();
+                } }, 1);
+            const double pyramidMs = MeasureMs([&]
+                                               { pyramid = BuildMipPyramid(grid, reduction); });
+            bool match = naive.size() == pyramid.size();
+            for (size_t level = 0; match && level < naive.size(); ++level)
+                match = memcmp(naive[level].Data(), pyramid[level].Data(), naive[level].Bytes()) == 0;
+            PrintComparison("mips", n, string("pyramid-") + MipReductionName(reduction), "naive", naiveMs, "parallel", pyramidMs);
+            if (!match)
+                cout << "[BENCH] mips N=" << n << " " << MipReductionName(reduction) << " MISMATCH" << endl;
+        }
+    }
+
+    /// @brief 派生データ(点群、ミップピラミッド、クラスタID)を作る時間と、キャッシュから読む時間を比較する
+    void BenchmarkDerived(size_t n)
+    {
+        const filesystem::path directory = filesystem::temp_directory_path() / ("volumen-bench-cache-" + to_string(n));
+        error_code error;
+        filesystem::remove_all(directory, error);
+        const DerivedCache cache(directory.string());
+        Volume<uint8_t> volume(MakeSyntheticVolume(n));
+
+        const double hashMs = MeasureMs([&]
+                                        { benchmarkSink += DerivedCache::Hash(volume.intencity.Data(), volume.intencity.Bytes()); });
+        cout << "[BENCH] derived N=" << n << " content hash " << fixed << setprecision(2) << hashMs << "ms ("
+             << ToMiB(volume.intencity.Bytes()) / (hashMs / 1000.0) << "MiB/s)" << endl;
+
+        // 点群(頂点と軸ソート済みインデックス)
+        size_t builtPoints = 0, loadedPoints = 0;
+        const double buildPointsMs = MeasureMs([&]
+                                               { builtPoints = PointCloud(volume).vertices.size(); }, 1);
+        PointCloud(volume, &cache); // 保存
+        const double loadPointsMs = MeasureMs([&]
+                                              { loadedPoints = PointCloud(volume, &cache).vertices.size(); });
+        PrintComparison("derived", n, "points", "build", buildPointsMs, "cached", loadPointsMs);
+
+        // ミップピラミッド(占有グリッド)
+        const double buildMipsMs = MeasureMs([&]
+                                             { volume.BuildMipmaps(MipReduction::Or); }, 1);
+        volume.BuildMipmaps(MipReduction::Or, &cache); // 保存
+        const double loadMipsMs = MeasureMs([&]
+                                            { volume.BuildMipmaps(MipReduction::Or, &cache); });
+        PrintComparison("derived", n, "mips-or", "build", buildMipsMs, "cached", loadMipsMs);
+
+        // クラスタID
+        const double buildLabelsMs = MeasureMs([&]
+                                               { volume.Clustering(); }, 1);
+        const vector<uint32_t> labels(volume.ids.Data(), volume.ids.Data() + volume.ids.Count());
+        volume.ClusteringCached(cache); // 保存
+        const double loadLabelsMs = MeasureMs([&]
+                                              { volume.ClusteringCached(cache); });
+        PrintComparison("derived", n, "labels", "build", buildLabelsMs, "cached", loadLabelsMs);
+
+        const bool match = builtPoints == loadedPoints && memcmp(labels.data(), volume.ids.Data(), labels.size() * sizeof(uint32_t)) == 0;
+        if (!match)
+            cout << "[BENCH] derived N=" << n << " MISMATCH" << endl;
+        filesystem::remove_all(directory, error);
+    }
+
+    /// @brief 非ゼロの割合がおよそdensityの乱雑なボリューム(小さな成分が多数できる)
+    VoxelGrid<uint8_t> MakeRandomVolume(size_t n, double density)
+    {
+        VoxelGrid<uint8_t> grid(n, n, n);
+        const uint32_t threshold = static_cast<uint32_t>(density * 4294967295.0);
+        uint32_t state = 12345;
+        for (size_t i = 0; i < grid.Count(); ++i)
+        {
+            // xorshift32
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            grid[i] = state < threshold ? static_cast<uint8_t>(1 + state % 255) : 0;
+        }
+        return grid;
+    }
+
+    /// @brief 以前のClustering(1スレッドのBFS、8bitのID)。比較用
+    /// @details 以前の実装はIDが256で0に戻り、探索済みのボクセルを未探索とみなして終わらなくなるので、ここでは1~255で循環させる
+    unsigned int BfsClustering(const VoxelGrid<uint8_t> &intencity, VoxelGrid<unsigned char> &ids)
+    {
+        const size_t sx = intencity.SizeX(), sy = intencity.SizeY(), sz = intencity.SizeZ();
+        unsigned int id = 1;
+        queue<tuple<size_t, size_t, size_t>> queue;
+        for (size_t i = 0; i < sx; ++i)
+            for (size_t j = 0; j < sy; ++j)
+                for (size_t k = 0; k < sz; ++k)
+                {
+                    if (ids(i, j, k) != 0 || intencity(i, j, k) == 0)
+                        continue;
+                    queue.emplace(i, j, k);
+                    while (!queue.empty())
+                    {
+                        auto [cx, cy, cz] = queue.front();
+                        queue.pop();
+                        if (cx >= sx || cy >= sy || cz >= sz || ids(cx, cy, cz) != 0 || intencity(cx, cy, cz) == 0)
+                            continue;
+                        ids(cx, cy, cz) = static_cast<unsigned char>(1 + (id - 1) % 255);
+                        queue.emplace(cx + 1, cy, cz);
+                        queue.emplace(cx - 1, cy, cz);
+                        queue.emplace(cx, cy + 1, cz);
+                        queue.emplace(cx, cy - 1, cz);
+                        queue.emplace(cx, cy, cz + 1);
+                        queue.emplace(cx, cy, cz - 1);
+                    }
+                    id++;
+                }
+        return id - 1;
+    }
+
+    /// @brief 1スレッドのBFSと並列union-findの連結成分ラベリングを比較する(合成ボリュームと乱雑なボリューム)
+    /// @brief 成分の統計(ボクセル数・外接直方体・重心)を、ボクセルごとの逐次集計と区間ごとの並列集計で比べる
+    void BenchmarkComponentStats(size_t n, const string &name, const VolumeBase::IdGrid &ids, uint32_t count)
+    {
+        vector<ComponentStats> sequential;
+        const double sequentialMs = MeasureMs([&]
+                                              {
+            sequential.assign(size_t(count) + 1, ComponentStats());
+            vector<array<uint64_t, 3>> sums(size_t(count) + 1, {0, 0, 0});
+            for (auto &component : sequential)
+                fill(begin(component.bounds.begin), end(component.bounds.begin), UINT32_MAX);
+            for (size_t x = 0; x < ids.SizeX(); ++x)
+                for (size_t y = 0; y < ids.SizeY(); ++y)
+                    for (size_t z = 0; z < ids.SizeZ(); ++z)
+                    {
+                        const uint32_t label = ids(x, y, z);
+                        if (label == 0)
+                            continue;
+                        ComponentStats &component = sequential[label];
+                        const uint32_t position[3] = {uint32_t(z), uint32_t(y), uint32_t(x)};
+                        component.voxelCount++;
+                        for (int axis = 0; axis < 3; ++axis)
+                        {
+                            sums[label][axis] += position[axis];
+                            component.bounds.begin[axis] = min(component.bounds.begin[axis], position[axis]);
+                            component.bounds.end[axis] = max(component.bounds.end[axis], position[axis] + 1);
+                        }
+                    }
+            for (size_t label = 1; label < sequential.size(); ++label)
+                for (int axis = 0; axis < 3; ++axis)
+                    sequential[label].centroid[axis] = double(sums[label][axis]) / max<uint64_t>(sequential[label].voxelCount, 1); }, 1);
+        vector<ComponentStats> parallel;
+        const double parallelMs = MeasureMs([&]
+                                            { parallel = MeasureComponents(ids, count); });
+        bool match = parallel.size() == sequential.size();
+        for (size_t label = 1; match && label < parallel.size(); ++label)
+            for (int axis = 0; axis < 3; ++axis)
+                match = match && parallel[label].voxelCount == sequential[label].voxelCount &&
+                        parallel[label].bounds.begin[axis] == sequential[label].bounds.begin[axis] &&
+                        parallel[label].bounds.end[axis] == sequential[label].bounds.end[axis] &&
+                        abs(parallel[label].centroid[axis] - sequential[label].centroid[axis]) < 1e-6;
+        PrintComparison("ccl", n, name + "-stat", "per-voxel", sequentialMs, "parallel-runs", parallelMs);
+        if (!match)
+            cout << "[BENCH] ccl N=" << n << " " << name << "-stats MISMATCH" << endl;
+    }
+
+    void BenchmarkCcl(size_t n)
+    {
+        for (const bool random : {false, true})
+        {
+            const VoxelGrid<uint8_t> grid = random ? MakeRandomVolume(n, 0.3) : MakeSyntheticVolume(n);
+            const string name = random ? "random" : "shells";
+            VoxelGrid<unsigned char> bfsIds;
+            unsigned int bfsCount = 0;
+            const double bfsMs = MeasureMs([&]
+                                           {
+                bfsIds = VoxelGrid<unsigned char>(n, n, n);
+                bfsCount = BfsClustering(grid, bfsIds); }, 1);
+            for (Connectivity connectivity : {Connectivity::Face, Connectivity::Edge, Connectivity::Vertex})
+            {
+                VolumeBase::IdGrid ids;
+                uint32_t count = 0;
+                const double unionFindMs = MeasureMs([&]
+                                                     { count = Volume<uint8_t>::Clustering(grid, ids, connectivity); });
+                PrintComparison("ccl", n, name + "-" + ConnectivityName(connectivity), "bfs-6", bfsMs, "union-find", unionFindMs);
+                cout << "[BENCH] ccl N=" << n << " " << name << "-" << ConnectivityName(connectivity) << " components " << count;
+                if (connectivity == Connectivity::Face)
+                {
+                    // 6近傍ならBFSと同じ番号になる(BFSのIDは8bitで折り返す)
+                    bool match = count == bfsCount;
+                    for (size_t i = 0; match && i < ids.Count(); ++i)
+                        match = (ids[i] == 0 ? 0 : 1 + (ids[i] - 1) % 255) == bfsIds[i];
+                    cout << (match ? "" : " MISMATCH") << (count > 255 ? " (bfs ids wrapped)" : "");
+                }
+                cout << endl;
+                if (connectivity == Connectivity::Face)
+                    BenchmarkComponentStats(n, name, ids, count);
+            }
+        }
+    }
+
+    /// @brief ファイル全体の読み込みと、部分領域(一辺N/4)だけの読み込みを比較する(生の.datとブリック化した.glvr)
+    void BenchmarkRoi(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const filesystem::path directory = filesystem::temp_directory_path();
+        const string rawPath = (directory / ("volumen-bench-roi-" + to_string(n) + ".dat")).string();
+        const string brickedPath = (directory / ("volumen-bench-roi-" + to_string(n) + ".glvr")).string();
+        {
+            ofstream raw(rawPath, ios::binary);
+            raw.write(reinterpret_cast<const char *>(grid.Data()), grid.Bytes());
+            VolumeHeader header;
+            ofstream bricked(brickedPath, ios::binary);
+            WriteBrickedVolume(bricked, header, grid);
+        }
+
+        // ブリック境界に揃わない領域(ヘッダの軸順: 幅=グリッドのz)
+        VolumeRegion region;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            region.begin[axis] = static_cast<uint32_t>(n / 3 + axis);
+            region.end[axis] = static_cast<uint32_t>(min(n, n / 3 + n / 4 + 5));
+        }
+        for (const string &path : {rawPath, brickedPath})
+        {
+            // どちらもページキャッシュから追い出した状態で計測し、ストレージから読んだ量も比べる
+            DropFileCache(path);
+            size_t readBefore = GetStorageReadBytes();
+            Stopwatch fullTimer;
+            {
+                unique_ptr<VolumeBase> volume = LoadVolume(path);
+                // マップしただけでは読まれないので、全ページに触れる
+                const VolumeBase::TextureSource source = volume->GetTextureSource();
+                long long sum = 0;
+                for (size_t i = 0; i < grid.Count(); i += 4096)
+                    sum += source.data[i];
+                benchmarkSink += sum;
+            }
+            const double fullMs = fullTimer.ElapsedMs();
+            const size_t fullRead = GetStorageReadBytes() - readBefore;
+
+            DropFileCache(path);
+            readBefore = GetStorageReadBytes();
+            Stopwatch roiTimer;
+            const unique_ptr<VolumeBase> loaded = LoadVolumeRegion(path, region);
+            const double roiMs = roiTimer.ElapsedMs();
+            const size_t roiRead = GetStorageReadBytes() - readBefore;
+
+            const auto &roi = static_cast<const Volume<uint8_t> &>(*loaded).intencity;
+            bool match = roi.SizeX() == region.Size(2) && roi.SizeY() == region.Size(1) && roi.SizeZ() == region.Size(0);
+            for (size_t x = 0; match && x < roi.SizeX(); ++x)
+                for (size_t y = 0; match && y < roi.SizeY(); ++y)
+                    match = memcmp(&roi(x, y, 0), &grid(region.begin[2] + x, region.begin[1] + y, region.begin[0]), roi.SizeZ()) == 0;
+            PrintComparison("roi", n, path == rawPath ? "raw" : "bricked", "full", fullMs, "region", roiMs);
+            cout << "[BENCH] roi N=" << n << " read from storage: full " << ToMiB(fullRead) << "MiB, region " << ToMiB(roiRead)
+                 << "MiB (region voxels " << ToMiB(region.VoxelCount()) << "MiB)" << (match ? "" : " MISMATCH") << endl;
+        }
+        error_code error;
+        filesystem::remove(rawPath, error);
+        filesystem::remove(brickedPath, error);
+    }
+
+    /// @brief グリッドのスライス(グリッドのx)をページにした非圧縮・8bitのマルチページTIFFを書き出す(比較用)
+    void WriteTiffStack(const string &path, const VoxelGrid<uint8_t> &grid)
+    {
+        ofstream os(path, ios::binary);
+        auto u16 = [&](uint16_t v)
+        { os.put(static_cast<char>(v & 0xFF)).put(static_cast<char>(v >> 8)); };
+        auto u32 = [&](uint32_t v)
+        { u16(static_cast<uint16_t>(v)); u16(static_cast<uint16_t>(v >> 16)); };
+        const uint32_t width = static_cast<uint32_t>(grid.SizeZ()), height = static_cast<uint32_t>(grid.SizeY());
+        const uint32_t sliceBytes = width * height;
+        constexpr uint16_t entryCount = 9;
+        constexpr uint32_t ifdBytes = 2 + entryCount * 12 + 4;
+        os.write("II", 2);
+        u16(42);
+        u32(8 + sliceBytes); // 最初のIFDは最初のスライスの直後
+        for (size_t x = 0; x < grid.SizeX(); ++x)
+        {
+            const uint32_t pixels = static_cast<uint32_t>(8 + x * (sliceBytes + ifdBytes));
+            os.write(reinterpret_cast<const char *>(&grid(x, 0, 0)), sliceBytes);
+            // タグ, 型(3=SHORT, 4=LONG), 個数, 値。タグは昇順に並べる
+            const uint32_t entries[entryCount][3] = {{256, 4, width}, {257, 4, height}, {258, 3, 8}, {259, 3, 1}, {262, 3, 1}, {273, 4, pixels}, {277, 3, 1}, {278, 4, height}, {279, 4, sliceBytes}};
+            u16(entryCount);
+            for (const auto &entry : entries)
+            {
+                u16(static_cast<uint16_t>(entry[0]));
+                u16(static_cast<uint16_t>(entry[1]));
+                u32(1);
+                if (entry[1] == 3)
+                {
+                    u16(static_cast<uint16_t>(entry[2]));
+                    u16(0);
+                }
+                else
+                    u32(entry[2]);
+            }
+            const bool last = x + 1 == grid.SizeX();
+            u32(last ? 0 : pixels + sliceBytes + ifdBytes + sliceBytes);
+        }
+    }
+
+    /// @brief スライスの積み重ね(マルチページTIFFと生スライスのディレクトリ)を、1スレッドとスレッドプールで読み込んで比較する
+    void BenchmarkSlices(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const filesystem::path directory = filesystem::temp_directory_path() / ("volumen-bench-slices-" + to_string(n));
+        error_code error;
+        filesystem::remove_all(directory, error);
+        filesystem::create_directories(directory / "raw");
+        const string tiffPath = (directory / "stack.tif").string();
+        WriteTiffStack(tiffPath, grid);
+        vector<string> rawPaths;
+        for (size_t x = 0; x < n; ++x)
+        {
+            rawPaths.push_back((directory / "raw" / ("z_" + to_string(x) + ".raw")).string());
+            ofstream os(rawPaths.back(), ios::binary);
+            os.write(reinterpret_cast<const char *>(&grid(x, 0, 0)), n * n);
+        }
+
+        for (const string &pattern : {tiffPath, (directory / "raw").string()})
+        {
+            const bool tiff = pattern == tiffPath;
+            auto dropCache = [&]
+            {
+                if (tiff)
+                    DropFileCache(tiffPath);
+                else
+                    for (const string &path : rawPaths)
+                        DropFileCache(path);
+            };
+            // ページキャッシュから追い出した状態で計測する
+            unique_ptr<VolumeBase> volume;
+            dropCache();
+            Stopwatch singleTimer;
+            volume = SliceStack(pattern).Load(1);
+            const double singleMs = singleTimer.ElapsedMs();
+            dropCache();
+            Stopwatch poolTimer;
+            volume = SliceStack(pattern).Load();
+            const double poolMs = poolTimer.ElapsedMs();
+
+            const auto &loaded = static_cast<const Volume<uint8_t> &>(*volume).intencity;
+            const bool match = loaded.Bytes() == grid.Bytes() && memcmp(loaded.Data(), grid.Data(), grid.Bytes()) == 0;
+            PrintComparison("slices", n, tiff ? "tiff" : "raw-dir", "1-thread", singleMs, "pool", poolMs);
+            cout << "[BENCH] slices N=" << n << " " << (tiff ? "tiff" : "raw-dir") << " " << n / (poolMs / 1000.0) << " slices/s, "
+                 << ToMiB(grid.Bytes()) / (poolMs / 1000.0) << "MiB/s" << (match ? "" : " MISMATCH") << endl;
+        }
+        filesystem::remove_all(directory, error);
+    }
+
+    /// @brief 構造要素の中の最小・最大をボクセルごとにそのまま取る収縮・膨張(比較用)
+    template <typename T>
+    VoxelGrid<T> NaiveMorphology(const VoxelGrid<T> &grid, bool dilate, const StructuringElement &element)
+    {
+        const int r = element.radius;
+        vector<array<int, 3>> offsets;
+        for (int dx = -r; dx <= r; ++dx)
+            for (int dy = -r; dy <= r; ++dy)
+                for (int dz = -r; dz <= r; ++dz)
+                {
+                    const int axes = (dx != 0) + (dy != 0) + (dz != 0);
+                    if ((element.shape == StructuringShape::Cross && axes > 1) ||
+                        (element.shape == StructuringShape::Ball && dx * dx + dy * dy + dz * dz > r * r))
+                        continue;
+                    offsets.push_back({dx, dy, dz});
+                }
+        const long long nx = grid.SizeX(), ny = grid.SizeY(), nz = grid.SizeZ();
+        VoxelGrid<T> result(grid.SizeX(), grid.SizeY(), grid.SizeZ());
+#pragma omp parallel for schedule(static)
+        for (long long x = 0; x < nx; ++x)
+            for (long long y = 0; y < ny; ++y)
+                for (long long z = 0; z < nz; ++z)
+                {
+                    T value = grid(x, y, z);
+                    for (const array<int, 3> &offset : offsets)
+                    {
+                        const long long px = x + offset[0], py = y + offset[1], pz = z + offset[2];
+                        if (px < 0 || px >= nx || py < 0 || py >= ny || pz < 0 || pz >= nz)
+                            continue;
+                        const T other = grid(px, py, pz);
+                        value = dilate ? max(value, other) : min(value, other);
+                    }
+                    result(x, y, z) = value;
+                }
+        return result;
+    }
+
+    /// @brief モルフォロジー演算を素朴な実装、行の最小・最大をスカラー、AVX2で求める実装で比較し、スループット(ボクセル/秒)を出す
+    void BenchmarkMorphology(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        cout << "[BENCH] morphology N=" << n << " AVX2 " << (MorphologySimdAvailable() ? "available" : "not available (scalar only)") << endl;
+        const double voxels = static_cast<double>(grid.Count());
+        const StructuringElement elements[] = {{StructuringShape::Cube, 1}, {StructuringShape::Cross, 1}, {StructuringShape::Ball, 2}};
+        for (const StructuringElement &element : elements)
+        {
+            // 素朴な実装は遅いので1回だけ測り、Open/Closeは収縮・膨張の結果を使い回す
+            Stopwatch naiveTimer;
+            const VoxelGrid<uint8_t> eroded = NaiveMorphology(grid, false, element);
+            const double naivePassMs = naiveTimer.ElapsedMs();
+            const VoxelGrid<uint8_t> dilated = NaiveMorphology(grid, true, element);
+            for (MorphologyOp op : {MorphologyOp::Erode, MorphologyOp::Dilate, MorphologyOp::Open, MorphologyOp::Close})
+            {
+                const VoxelGrid<uint8_t> expected = op == MorphologyOp::Erode    ? eroded
+                                                    : op == MorphologyOp::Dilate ? dilated
+                                                    : op == MorphologyOp::Open   ? NaiveMorphology(eroded, true, element)
+                                                                                 : NaiveMorphology(dilated, false, element);
+                const double naiveMs = naivePassMs * MorphologyPasses(op);
+
+                // その場で書き換えるので、毎回写してから測る
+                double bestMs[2] = {numeric_limits<double>::max(), numeric_limits<double>::max()};
+                bool match = true;
+                for (int simd = 0; simd < 2; ++simd)
+                    for (int r = 0; r < 3; ++r)
+                    {
+                        VoxelGrid<uint8_t> work = grid;
+                        Stopwatch timer;
+                        const vector<uint8_t> changed = ApplyMorphology(work, op, element, simd == 1);
+                        bestMs[simd] = min(bestMs[simd], timer.ElapsedMs());
+                        match = match && memcmp(work.Data(), expected.Data(), expected.Bytes()) == 0;
+                        // 値が変わった平面は必ず印が付いていること
+                        for (size_t x = 0; x < n; ++x)
+                            if (!changed[x] && memcmp(&work(x, 0, 0), &grid(x, 0, 0), n * n) != 0)
+                                match = false;
+                    }
+                const string shape = StructuringShapeName(element.shape) + to_string(element.radius);
+                const string kernel = string(MorphologyOpName(op)) + "-" + shape;
+                PrintComparison(string("morphology ") + MorphologyOpName(op), n, shape, "scalar", bestMs[0], "avx2", bestMs[1]);
+                cout << "[BENCH] morphology N=" << n << " " << kernel << " naive " << voxels * MorphologyPasses(op) / (naiveMs / 1000.0) / 1e6 << " Mvoxel/s, scalar "
+                     << voxels * MorphologyPasses(op) / (bestMs[0] / 1000.0) / 1e6 << " Mvoxel/s, avx2 " << voxels * MorphologyPasses(op) / (bestMs[1] / 1000.0) / 1e6
+                     << " Mvoxel/s (x" << naiveMs / bestMs[1] << " vs naive)" << (match ? "" : " MISMATCH") << endl;
+            }
+        }
+
+        // 16bit・浮動小数点の行カーネルもスカラーと一致すること
+        auto checkType = [&](auto zero, const char *name)
+        {
+            using T = decltype(zero);
+            VoxelGrid<T> typed(n, n, n);
+            for (size_t i = 0; i < grid.Count(); ++i)
+                typed.Data()[i] = static_cast<T>(grid.Data()[i] * 3);
+            VoxelGrid<T> scalar = typed, simd = typed;
+            const StructuringElement element{StructuringShape::Ball, 2};
+            const double scalarMs = MeasureMs([&]
+                                              { ApplyMorphology(scalar, MorphologyOp::Close, element, false); }, 1);
+            const double simdMs = MeasureMs([&]
+                                            { ApplyMorphology(simd, MorphologyOp::Close, element, true); }, 1);
+            PrintComparison("morphology", n, string("close-") + name, "scalar", scalarMs, "avx2", simdMs);
+            if (memcmp(scalar.Data(), simd.Data(), scalar.Bytes()) != 0)
+                cout << "[BENCH] morphology N=" << n << " " << name << " MISMATCH" << endl;
+        };
+        checkType(uint16_t(0), "u16");
+        checkType(0.0f, "f32");
+    }
+
+    /// @brief 軸ごとにボクセルの窓を元の配列から直接(y, xは大きなストライドで)集める分離可能フィルタ(比較用)
+    template <typename T>
+    void NaiveFilter(VoxelGrid<T> &grid, const FilterSettings &settings)
+    {
+        const long long size[3] = {static_cast<long long>(grid.SizeX()), static_cast<long long>(grid.SizeY()), static_cast<long long>(grid.SizeZ())};
+        const int r = settings.radius;
+        const vector<float> weights = GaussianWeights(r, settings.sigma);
+        for (int axis = 2; axis >= 0; --axis)
+        {
+            const VoxelGrid<T> source = grid;
+#pragma omp parallel for schedule(static)
+            for (long long x = 0; x < size[0]; ++x)
+            {
+                vector<float> window(2 * r + 1);
+                for (long long y = 0; y < size[1]; ++y)
+                    for (long long z = 0; z < size[2]; ++z)
+                    {
+                        long long p[3] = {x, y, z};
+                        const long long center = p[axis];
+                        for (int k = -r; k <= r; ++k)
+                        {
+                            p[axis] = clamp<long long>(center + k, 0, size[axis] - 1);
+                            window[k + r] = static_cast<float>(source(p[0], p[1], p[2]));
+                        }
+                        float value = 0.0f;
+                        if (settings.kind == FilterKind::Median)
+                        {
+                            nth_element(window.begin(), window.begin() + r, window.end());
+                            value = window[r];
+                        }
+                        else
+                            for (int k = 0; k <= 2 * r; ++k)
+                                value += (settings.kind == FilterKind::Gaussian ? weights[k] : 1.0f / (2 * r + 1)) * window[k];
+                        grid(x, y, z) = static_cast<T>(clamp(value + 0.5f, 0.0f, static_cast<float>(numeric_limits<T>::max())));
+                    }
+            }
+        }
+    }
+
+    /// @brief 分離可能フィルタを素朴な実装(ストライドのある走査、メディアンは窓ごとの選択)と帯に区切った実装で比較する
+    void BenchmarkFilter(size_t n)
+    {
+        const VoxelGrid<uint8_t> grid = MakeSyntheticVolume(n);
+        const double voxels = static_cast<double>(grid.Count());
+        auto compare = [&](const auto &input, const FilterSettings &settings, const string &kernel)
+        {
+            auto naive = input, blocked = input;
+            const double naiveMs = MeasureMs([&]
+                                             { NaiveFilter(naive, settings); }, 1);
+            const double blockedMs = MeasureMs([&]
+                                               { ApplyFilter(blocked, settings); }, 1);
+            // 箱型は窓の和をずらして更新するので、丸めで1段ずれることがある
+            const int tolerance = settings.kind == FilterKind::Box ? 1 : 0;
+            size_t mismatches = 0;
+            for (size_t i = 0; i < input.Count(); ++i)
+                mismatches += abs(static_cast<int>(naive.Data()[i]) - static_cast<int>(blocked.Data()[i])) > tolerance;
+            PrintComparison("filter", n, kernel, "naive", naiveMs, "blocked", blockedMs);
+            cout << "[BENCH] filter N=" << n << " " << kernel << " " << voxels / (blockedMs / 1000.0) / 1e6 << " Mvoxel/s"
+                 << (mismatches ? " MISMATCH " + to_string(mismatches) : "") << endl;
+        };
+        const FilterSettings settings[] = {{FilterKind::Gaussian, 1, 0.0f}, {FilterKind::Gaussian, 3, 0.0f}, {FilterKind::Box, 1, 0.0f},
+                                           {FilterKind::Box, 8, 0.0f}, {FilterKind::Median, 1, 0.0f}, {FilterKind::Median, 3, 0.0f}};
+        for (const FilterSettings &setting : settings)
+            compare(grid, setting, string(FilterKindName(setting.kind)) + to_string(setting.radius));
+
+        // 16bitのメディアンは整列した窓で求める
+        VoxelGrid<uint16_t> wide(n, n, n);
+        for (size_t i = 0; i < grid.Count(); ++i)
+            wide.Data()[i] = static_cast<uint16_t>(grid.Data()[i] * 257);
+        compare(wide, FilterSettings{FilterKind::Median, 1, 0.0f}, "median1-u16");
+    }
+
+    /// @brief 近傍を読むカーネルを3次元インデックスだけで書き、並び(Layout)ごとの時間[ms]と検算用の値を返す
+    /// @details 並びの違いだけを見るため、どのカーネルも1スレッドで、x, y, zの順に走査する
+    template <typename Layout>
+    array<pair<double, long long>, 4> RunLayoutKernels(const VoxelGrid<uint8_t, Layout> &grid)
+    {
+        const size_t nx = grid.SizeX(), ny = grid.SizeY(), nz = grid.SizeZ();
+        array<pair<double, long long>, 4> results;
+
+        // 全ボクセルの和
+        long long sum = 0;
+        results[0].first = MeasureMs([&]
+                                     {
+            sum = 0;
+            for (size_t x = 0; x < nx; ++x)
+                for (size_t y = 0; y < ny; ++y)
+                    for (size_t z = 0; z < nz; ++z)
+                        sum += grid(x, y, z); });
+        results[0].second = sum;
+
+        // 6近傍の中心差分(法線)。隣はy方向でN、x方向でN^2要素離れている
+        long long gradient = 0;
+        results[1].first = MeasureMs([&]
+                                     {
+            gradient = 0;
+            for (size_t x = 1; x + 1 < nx; ++x)
+                for (size_t y = 1; y + 1 < ny; ++y)
+                    for (size_t z = 1; z + 1 < nz; ++z)
+                        gradient += abs(grid(x + 1, y, z) - grid(x - 1, y, z)) + abs(grid(x, y + 1, z) - grid(x, y - 1, z)) + abs(grid(x, y, z + 1) - grid(x, y, z - 1)); });
+        results[1].second = gradient;
+
+        // 6近傍のBFSによる連結成分(旧実装のSearchと同じ探索)
+        long long components = 0;
+        results[2].first = MeasureMs([&]
+                                     {
+            VoxelGrid<uint8_t, Layout> visited(nx, ny, nz);
+            vector<array<uint32_t, 3>> queue;
+            components = 0;
+            for (size_t x = 0; x < nx; ++x)
+                for (size_t y = 0; y < ny; ++y)
+                    for (size_t z = 0; z < nz; ++z)
+                    {
+                        if (grid(x, y, z) == 0 || visited(x, y, z))
+                            continue;
+                        ++components;
+                        visited(x, y, z) = 1;
+                        queue.assign(1, {static_cast<uint32_t>(x), static_cast<uint32_t>(y), static_cast<uint32_t>(z)});
+                        for (size_t head = 0; head < queue.size(); ++head)
+                        {
+                            const array<uint32_t, 3> voxel = queue[head];
+                            for (int axis = 0; axis < 3; ++axis)
+                                for (int dir = -1; dir <= 1; dir += 2)
+                                {
+                                    array<uint32_t, 3> next = voxel;
+                                    next[axis] += dir;
+                                    const size_t size[3] = {nx, ny, nz};
+                                    if (next[axis] >= size[axis] || grid(next[0], next[1], next[2]) == 0 || visited(next[0], next[1], next[2]))
+                                        continue;
+                                    visited(next[0], next[1], next[2]) = 1;
+                                    queue.push_back(next);
+                                }
+                        }
+                    }
+        }, 1);
+        results[2].second = components;
+
+        // 3x3x3の箱型フィルタ(同じ並びの出力に書く)
+        long long filtered = 0;
+        results[3].first = MeasureMs([&]
+                                     {
+            VoxelGrid<uint16_t, Layout> out(nx, ny, nz);
+            for (size_t x = 1; x + 1 < nx; ++x)
+                for (size_t y = 1; y + 1 < ny; ++y)
+                    for (size_t z = 1; z + 1 < nz; ++z)
+                    {
+                        unsigned total = 0;
+                        for (size_t dx = x - 1; dx <= x + 1; ++dx)
+                            for (size_t dy = y - 1; dy <= y + 1; ++dy)
+                                for (size_t dz = z - 1; dz <= z + 1; ++dz)
+                                    total += grid(dx, dy, dz);
+                        out(x, y, z) = static_cast<uint16_t>(total);
+                    }
+            filtered = 0;
+            for (size_t x = 0; x < nx; ++x)
+                for (size_t y = 0; y < ny; ++y)
+                    for (size_t z = 0; z < nz; ++z)
+                        filtered += out(x, y, z);
+        }, 1);
+        results[3].second = filtered;
+        return results;
+    }
+
+    /// @brief 線形・Morton・ブリック内Mortonの並びで、近傍を読むカーネルの速さを比べる
+    void BenchmarkMorton(size_t n)
+    {
+        const VoxelGrid<uint8_t> linear = MakeSyntheticVolume(n);
+        Stopwatch mortonTimer;
+        const VoxelGrid<uint8_t, MortonLayout> morton(linear);
+        const double mortonMs = mortonTimer.ElapsedMs();
+        Stopwatch brickedTimer;
+        const VoxelGrid<uint8_t, BrickedMortonLayout<8>> bricked(linear);
+        const double brickedMs = brickedTimer.ElapsedMs();
+        cout << "[BENCH] morton N=" << n << " reorder " << MortonLayout::Name() << " " << mortonMs << "ms (" << ToMiB(morton.Bytes()) << "MiB), "
+             << BrickedMortonLayout<8>::Name() << " " << brickedMs << "ms (" << ToMiB(bricked.Bytes()) << "MiB), linear " << ToMiB(linear.Bytes()) << "MiB" << endl;
+
+        const auto linearResults = RunLayoutKernels(linear);
+        const auto mortonResults = RunLayoutKernels(morton);
+        const auto brickedResults = RunLayoutKernels(bricked);
+        const char *kernels[] = {"traverse", "gradient", "bfs", "box3"};
+        for (int k = 0; k < 4; ++k)
+        {
+            PrintComparison("morton", n, kernels[k], LinearLayout::Name(), linearResults[k].first, MortonLayout::Name(), mortonResults[k].first);
+            PrintComparison("morton", n, kernels[k], LinearLayout::Name(), linearResults[k].first, BrickedMortonLayout<8>::Name(), brickedResults[k].first);
+            const double times[3] = {linearResults[k].first, mortonResults[k].first, brickedResults[k].first};
+            const char *names[3] = {LinearLayout::Name(), MortonLayout::Name(), BrickedMortonLayout<8>::Name()};
+            const int best = static_cast<int>(min_element(times, times + 3) - times);
+            const bool match = linearResults[k].second == mortonResults[k].second && linearResults[k].second == brickedResults[k].second;
+            cout << "[BENCH] morton N=" << n << " " << kernels[k] << " fastest: " << names[best] << (match ? "" : " MISMATCH") << endl;
+        }
+    }
+
+    /// 登録済みベンチマーク(名前 -> 一辺Nを受け取る関数)
+    const map<string, function<void(size_t)>> &Benchmarks()
+    {
+        static const map<string, function<void(size_t)>> benchmarks = {
+            {"layout", BenchmarkLayout},
+            {"morton", BenchmarkMorton},
+            {"bricks", BenchmarkBricks},
+            {"mips", BenchmarkMips},
+            {"gradients", BenchmarkGradients},
+            {"macrocells", BenchmarkMacrocells},
+            {"distance", BenchmarkDistance},
+            {"histogram", BenchmarkHistogram},
+            {"isosurface", BenchmarkIsoSurface},
+            {"voxelsurface", BenchmarkVoxelSurface},
+            {"binary", BenchmarkBinary},
+            {"morphology", BenchmarkMorphology},
+            {"filter", BenchmarkFilter},
+            {"derived", BenchmarkDerived},
+            {"roi", BenchmarkRoi},
+            {"ccl", BenchmarkCcl},
+            {"slices", BenchmarkSlices},
+        };
+        return benchmarks;
+    }
+}
+
+int RunBenchmark(const vector<string> &args)
+{
+    const auto &benchmarks = Benchmarks();
+    if (args.empty() || benchmarks.count(args[0]) == 0)
+    {
+        cerr << "Usage: volumen --bench <name> [N...]" << endl
+             << "Available benchmarks:";
+        for (const auto &[name, func] : benchmarks)
+            cerr << " " << name;
+        cerr << endl;
+        return -1;
+    }
+
+    vector<size_t> sizes;
+    for (size_t i = 1; i < args.size(); ++i)
+        sizes.push_back(stoul(args[i]));
+    if (sizes.empty())
+        sizes = {256, 512, 1024};
+
+    for (size_t n : sizes)
+    {
+        benchmarks.at(args[0])(n);
+        cout << "[BENCH] peak RSS " << ToMiB(GetPeakResidentBytes()) << "MiB" << endl;
+    }
+    return 0;
+}
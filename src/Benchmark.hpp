@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "VoxelGrid.hpp"
+
+/// @brief ベンチマーク用の合成ボリューム(中空の球殻+内部の小球)を生成する
+/// @param n 一辺のボクセル数
+VoxelGrid<uint8_t> MakeSyntheticVolume(size_t n);
+
+/// @brief `volumen --bench <name> [N...]` のエントリポイント。結果は標準出力へ書き出す
+/// @param args --benchの後ろに続く引数
+/// @return 終了コード
+int RunBenchmark(const std::vector<std::string> &args);
@@ -0,0 +1,83 @@
+#include "BitGrid.hpp"
+#include <algorithm>
+
+using namespace std;
+
+template <typename T>
+BitGrid BitGrid::Pack(const VoxelGrid<T> &grid)
+{
+    BitGrid bits(grid.SizeX(), grid.SizeY(), grid.SizeZ());
+    const size_t height = grid.SizeY(), width = grid.SizeZ();
+    const long long rows = static_cast<long long>(grid.SizeX() * height);
+#pragma omp parallel for schedule(static)
+    for (long long row = 0; row < rows; ++row)
+    {
+        const T *values = &grid(row / height, row % height, 0);
+        uint64_t *out = bits.Row(row / height, row % height);
+        for (size_t w = 0; w < bits.wordsPerRow; ++w)
+        {
+            // 1ワード分を分岐なしで詰める
+            const size_t begin = w * 64, end = min(begin + 64, width);
+            uint64_t word = 0;
+            for (size_t z = begin; z < end; ++z)
+                word |= static_cast<uint64_t>(!VoxelTraits<T>::IsZero(values[z])) << (z - begin);
+            out[w] = word;
+        }
+    }
+    return bits;
+}
+
+size_t BitGrid::CountOnes() const
+{
+    const long long planes = static_cast<long long>(nx);
+    const size_t planeWords = ny * wordsPerRow;
+    vector<size_t> counts(nx, 0);
+#pragma omp parallel for schedule(static)
+    for (long long x = 0; x < planes; ++x)
+    {
+        const uint64_t *plane = words.data() + x * planeWords;
+        size_t count = 0;
+        for (size_t w = 0; w < planeWords; ++w)
+            count += PopCount(plane[w]);
+        counts[x] = count;
+    }
+    size_t total = 0;
+    for (size_t count : counts)
+        total += count;
+    return total;
+}
+
+BitGrid BitGrid::Surface() const
+{
+    BitGrid surface(nx, ny, nz);
+    const long long rows = static_cast<long long>(nx * ny);
+#pragma omp parallel for schedule(static)
+    for (long long row = 0; row < rows; ++row)
+    {
+        const size_t x = row / ny, y = row % ny;
+        const uint64_t *center = Row(x, y);
+        uint64_t *out = surface.Row(x, y);
+        // ボリュームの外の行は0なので、端の行は全て表面になる
+        if (x == 0 || x + 1 == nx || y == 0 || y + 1 == ny)
+        {
+            copy(center, center + wordsPerRow, out);
+            continue;
+        }
+        const uint64_t *xPrev = Row(x - 1, y), *xNext = Row(x + 1, y), *yPrev = Row(x, y - 1), *yNext = Row(x, y + 1);
+        for (size_t w = 0; w < wordsPerRow; ++w)
+        {
+            const uint64_t word = center[w];
+            // ビットzにz-1、z+1の値が来るようにずらす。行末の余りのビットは0なので、最後のボクセルの+z側は外として扱われる
+            const uint64_t lower = (word << 1) | (w > 0 ? center[w - 1] >> 63 : 0);
+            const uint64_t upper = (word >> 1) | (w + 1 < wordsPerRow ? center[w + 1] << 63 : 0);
+            const uint64_t interior = word & lower & upper & xPrev[w] & xNext[w] & yPrev[w] & yNext[w];
+            out[w] = word & ~interior;
+        }
+    }
+    return surface;
+}
+
+template BitGrid BitGrid::Pack(const VoxelGrid<uint8_t> &);
+template BitGrid BitGrid::Pack(const VoxelGrid<uint16_t> &);
+template BitGrid BitGrid::Pack(const VoxelGrid<Half> &);
+template BitGrid BitGrid::Pack(const VoxelGrid<float> &);
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+/// @brief 64bitワードの立っているビットの数
+inline int PopCount(uint64_t word)
+{
+#ifdef _MSC_VER
+    return static_cast<int>(__popcnt64(word));
+#else
+    return __builtin_popcountll(word);
+#endif
+}
+
+/// @brief 64bitワードの最下位の立っているビットの位置。wordは0でないこと
+inline int CountTrailingZeros(uint64_t word)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(word);
+#endif
+}
+
+/// @brief 1ボクセル1ビットの2値の3次元配列(前景なら1)
+/// @details VoxelGridと同じくx(最も遅い軸), y, z(最も速い軸)の順に並ぶ。行(x, yを固定したz方向の並び)ごとに
+/// ceil(nz / 64)個の64bitワードを持ち、zはワードの下位ビットから詰める。行末の余りのビットは常に0
+class BitGrid
+{
+private:
+    std::vector<uint64_t> words;
+    size_t nx = 0, ny = 0, nz = 0;
+    size_t wordsPerRow = 0;
+
+public:
+    BitGrid() = default;
+    /// @brief 全て0のグリッドを確保する
+    BitGrid(size_t _nx, size_t _ny, size_t _nz)
+        : words(_nx * _ny * ((_nz + 63) / 64), 0), nx(_nx), ny(_ny), nz(_nz), wordsPerRow((_nz + 63) / 64)
+    {
+    }
+
+    /// @brief 非ゼロのボクセルを1として詰める(クラスタリングの前景と同じ判定)。行ごとに並列化する
+    template <typename T>
+    static BitGrid Pack(const VoxelGrid<T> &grid);
+
+    bool Get(size_t x, size_t y, size_t z) const { return (Row(x, y)[z >> 6] >> (z & 63)) & 1; }
+    void Set(size_t x, size_t y, size_t z, bool value)
+    {
+        const uint64_t bit = uint64_t(1) << (z & 63);
+        uint64_t &word = Row(x, y)[z >> 6];
+        word = value ? word | bit : word & ~bit;
+    }
+    /// @brief 行の先頭のワード
+    uint64_t *Row(size_t x, size_t y) { return words.data() + (x * ny + y) * wordsPerRow; }
+    const uint64_t *Row(size_t x, size_t y) const { return words.data() + (x * ny + y) * wordsPerRow; }
+    const uint64_t *Data() const { return words.data(); }
+
+    size_t SizeX() const { return nx; }
+    size_t SizeY() const { return ny; }
+    size_t SizeZ() const { return nz; }
+    /// @brief 1行のワード数
+    size_t WordsPerRow() const { return wordsPerRow; }
+    /// @brief ボクセル数
+    size_t Count() const { return nx * ny * nz; }
+    size_t Bytes() const { return words.size() * sizeof(uint64_t); }
+    bool Empty() const { return words.empty(); }
+
+    /// @brief 1のボクセルの数。ワードごとのpopcountをx平面ごとに並列に合計する
+    size_t CountOnes() const;
+    /// @brief 6近傍のどれかが0(ボリュームの外も0とみなす)の1のボクセルだけを残したグリッド
+    /// @details 隣の行とはワードのANDで、z方向の隣とはワードのシフト(前後のワードの端のビットを繰り込む)で、64ボクセルずつまとめて判定する
+    BitGrid Surface() const;
+};
@@ -0,0 +1,201 @@
+#include "BrickAtlas.hpp"
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "Profiling.hpp"
+
+using namespace std;
+
+BrickAtlas::BrickAtlas(const glm::ivec3 &_resolution, const glm::vec3 &_extent, int _brickSize, vector<bool> _emptyBricks,
+                       GLenum internalFormat, GLenum _format, GLenum _type, size_t _voxelBytes, size_t budgetBytes)
+    : resolution(_resolution), extent(_extent), brickSize(_brickSize), format(_format), type(_type),
+      voxelBytes(_voxelBytes), emptyBricks(std::move(_emptyBricks))
+{
+    counts = (resolution + glm::ivec3(brickSize - 1)) / brickSize;
+
+    // スロット数は予算と空でないブリック数で決め、テクスチャの最大サイズとRGBA8UIの範囲に収める
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize);
+    const size_t maxSlotsPerAxis = clamp<size_t>(maxTextureSize / brickSize, 1, 255);
+    const size_t brickBytes = static_cast<size_t>(brickSize) * brickSize * brickSize * voxelBytes;
+    const size_t nonEmpty = max<size_t>(count(emptyBricks.begin(), emptyBricks.end(), false), 1);
+    const size_t slotBudget = clamp<size_t>(budgetBytes / brickBytes, 1, nonEmpty);
+    const size_t side = clamp<size_t>(static_cast<size_t>(cbrt(static_cast<double>(slotBudget))), 1, maxSlotsPerAxis);
+    const size_t depth = clamp<size_t>((slotBudget + side * side - 1) / (side * side), 1, maxSlotsPerAxis);
+    slots = glm::ivec3(side, side, depth);
+
+    glGenTextures(1, &atlasTexture);
+    glBindTexture(GL_TEXTURE_3D, atlasTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, internalFormat, slots.x * brickSize, slots.y * brickSize, slots.z * brickSize);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // ブリック表は全て非常駐(0)で始める
+    glGenTextures(1, &tableTexture);
+    glBindTexture(GL_TEXTURE_3D, tableTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGBA8UI, counts.x, counts.y, counts.z);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    const vector<unsigned char> zeros(static_cast<size_t>(counts.x) * counts.y * counts.z * 4, 0);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, counts.x, counts.y, counts.z, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, zeros.data());
+
+    const size_t slotCount = static_cast<size_t>(slots.x) * slots.y * slots.z;
+    slotOfBrick.assign(emptyBricks.size(), -1);
+    brickOfSlot.assign(slotCount, -1);
+    slotGeneration.assign(slotCount, 0);
+    slotLruPosition.resize(slotCount);
+    for (size_t slot = 0; slot < slotCount; ++slot)
+        slotLruPosition[slot] = slotLru.insert(slotLru.end(), static_cast<int>(slot));
+}
+
+BrickAtlas::~BrickAtlas()
+{
+    if (atlasTexture)
+        glDeleteTextures(1, &atlasTexture);
+    if (tableTexture)
+        glDeleteTextures(1, &tableTexture);
+}
+
+glm::ivec3 BrickAtlas::BrickCoord(size_t brick) const
+{
+    return glm::ivec3(brick % counts.x, (brick / counts.x) % counts.y, brick / (static_cast<size_t>(counts.x) * counts.y));
+}
+
+void BrickAtlas::CollectWanted(const glm::mat4 &modelViewProjection)
+{
+    generation++;
+    wanted.clear();
+    wantedCursor = 0;
+
+    // ブリックの角は格子状に共有されるので、格子点ごとに1回だけクリップ座標へ変換する
+    const glm::ivec3 lattice = counts + glm::ivec3(1);
+    vector<glm::vec4> clip(static_cast<size_t>(lattice.x) * lattice.y * lattice.z);
+    for (int d = 0; d < lattice.z; ++d)
+    {
+        for (int h = 0; h < lattice.y; ++h)
+        {
+            for (int w = 0; w < lattice.x; ++w)
+            {
+                const glm::vec3 voxel = glm::min(glm::vec3(w, h, d) * static_cast<float>(brickSize), glm::vec3(resolution));
+                const glm::vec3 position = (voxel / glm::vec3(resolution) - glm::vec3(0.5f)) * extent;
+                clip[(static_cast<size_t>(d) * lattice.y + h) * lattice.x + w] = modelViewProjection * glm::vec4(position, 1.0f);
+            }
+        }
+    }
+
+    vector<pair<float, size_t>> visible;
+    for (size_t brick = 0; brick < emptyBricks.size(); ++brick)
+    {
+        if (emptyBricks[brick])
+            continue;
+        const glm::ivec3 coord = BrickCoord(brick);
+        // 8つの角が全て同じ視錐台平面の外側にあれば見えない
+        int outside[6] = {0, 0, 0, 0, 0, 0};
+        float depth = 0.0f;
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            const glm::ivec3 p = coord + glm::ivec3(corner & 1, (corner >> 1) & 1, (corner >> 2) & 1);
+            const glm::vec4 &c = clip[(static_cast<size_t>(p.z) * lattice.y + p.y) * lattice.x + p.x];
+            outside[0] += c.x < -c.w;
+            outside[1] += c.x > c.w;
+            outside[2] += c.y < -c.w;
+            outside[3] += c.y > c.w;
+            outside[4] += c.z < -c.w;
+            outside[5] += c.z > c.w;
+            depth += c.w;
+        }
+        if (any_of(begin(outside), end(outside), [](int n)
+                   { return n == 8; }))
+            continue;
+        visible.emplace_back(depth, brick);
+    }
+
+    // スロットに収まる分だけ、カメラに近い順に選ぶ
+    const size_t keep = min(visible.size(), SlotCount());
+    partial_sort(visible.begin(), visible.begin() + keep, visible.end());
+    wanted.reserve(keep);
+    for (size_t i = 0; i < keep; ++i)
+    {
+        const size_t brick = visible[i].second;
+        wanted.push_back(brick);
+        // 既に常駐しているブリックは今回も使うので、再利用の対象から外す
+        const int slot = slotOfBrick[brick];
+        if (slot >= 0)
+        {
+            slotGeneration[slot] = generation;
+            slotLru.splice(slotLru.end(), slotLru, slotLruPosition[slot]);
+        }
+    }
+}
+
+void BrickAtlas::WriteTableEntry(size_t brick, int slot)
+{
+    const glm::ivec3 coord = BrickCoord(brick);
+    unsigned char entry[4] = {0, 0, 0, 0};
+    if (slot >= 0)
+    {
+        entry[0] = static_cast<unsigned char>(slot % slots.x);
+        entry[1] = static_cast<unsigned char>((slot / slots.x) % slots.y);
+        entry[2] = static_cast<unsigned char>(slot / (slots.x * slots.y));
+        entry[3] = 1;
+    }
+    glBindTexture(GL_TEXTURE_3D, tableTexture);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, coord.x, coord.y, coord.z, 1, 1, 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, entry);
+}
+
+void BrickAtlas::Update(const glm::mat4 &modelViewProjection, double budgetMs, const FetchFunc &fetch)
+{
+    if (modelViewProjection != lastModelViewProjection)
+    {
+        CollectWanted(modelViewProjection);
+        lastModelViewProjection = modelViewProjection;
+    }
+
+    Stopwatch timer;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    while (wantedCursor < wanted.size())
+    {
+        const size_t brick = wanted[wantedCursor++];
+        if (slotOfBrick[brick] >= 0)
+            continue;
+
+        // 最も長く使われていないスロットを再利用する
+        const int slot = slotLru.front();
+        if (slotGeneration[slot] == generation)
+            break; // 全スロットが今回のカメラで使用中
+        if (brickOfSlot[slot] >= 0)
+        {
+            slotOfBrick[brickOfSlot[slot]] = -1;
+            WriteTableEntry(brickOfSlot[slot], -1);
+        }
+
+        const glm::ivec3 coord = BrickCoord(brick);
+        const glm::ivec3 size = glm::min(glm::ivec3(brickSize), resolution - coord * brickSize);
+        const glm::ivec3 slotCoord(slot % slots.x, (slot / slots.x) % slots.y, slot / (slots.x * slots.y));
+        // ブリック内のボクセル順(幅が最速)はテクスチャと同じなので、そのまま転送できる
+        glBindTexture(GL_TEXTURE_3D, atlasTexture);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, slotCoord.x * brickSize, slotCoord.y * brickSize, slotCoord.z * brickSize,
+                        size.x, size.y, size.z, format, type, fetch(brick));
+        uploadedBytes += static_cast<size_t>(size.x) * size.y * size.z * voxelBytes;
+
+        brickOfSlot[slot] = static_cast<long long>(brick);
+        slotOfBrick[brick] = slot;
+        slotGeneration[slot] = generation;
+        slotLru.splice(slotLru.end(), slotLru, slotLruPosition[slot]);
+        WriteTableEntry(brick, slot);
+
+        if (timer.ElapsedMs() >= budgetMs)
+            break;
+    }
+}
+
+size_t BrickAtlas::ResidentCount() const
+{
+    return static_cast<size_t>(count_if(brickOfSlot.begin(), brickOfSlot.end(), [](long long brick)
+                                        { return brick >= 0; }));
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/// @brief ページングしたボリュームのうち、カメラに必要なブリックだけをGPUに載せるアトラス
+/// @details ブリックを固定サイズのスロットに詰めた3Dテクスチャ(アトラス)と、
+/// ブリックごとのスロット位置を持つ整数3Dテクスチャ(ブリック表, RGBA8UI, a=1なら常駐)からなる。
+/// シェーダはブリック表を引いてアトラスをサンプルする。常駐していないブリックは0として描画される。
+/// スロットが足りない場合はカメラに近いブリックを優先し、使われなくなったスロットから再利用する。
+class BrickAtlas
+{
+public:
+    /// ブリック番号から、そのブリックのボクセル列(BrickBox順)を返す関数
+    using FetchFunc = std::function<const char *(size_t brick)>;
+
+private:
+    GLuint atlasTexture = 0;
+    GLuint tableTexture = 0;
+    glm::ivec3 resolution; // ボリュームの解像度(幅,高さ,奥行き)
+    glm::vec3 extent;
+    int brickSize;
+    glm::ivec3 counts; // (幅,高さ,奥行き)方向のブリック数
+    glm::ivec3 slots;  // (幅,高さ,奥行き)方向のスロット数
+    GLenum format;
+    GLenum type;
+    size_t voxelBytes;
+    std::vector<bool> emptyBricks;
+
+    std::vector<int> slotOfBrick;            // ブリック -> スロット(-1なら非常駐)
+    std::vector<long long> brickOfSlot;      // スロット -> ブリック(-1なら空き)
+    std::list<int> slotLru;                  // 先頭が最も長く使われていないスロット
+    std::vector<std::list<int>::iterator> slotLruPosition;
+    std::vector<uint64_t> slotGeneration;    // スロットが最後に必要とされた世代
+
+    std::vector<size_t> wanted; // 現在のカメラで必要なブリック(近い順)
+    size_t wantedCursor = 0;
+    uint64_t generation = 0;
+    glm::mat4 lastModelViewProjection = glm::mat4(0.0f);
+    size_t uploadedBytes = 0;
+
+    glm::ivec3 BrickCoord(size_t brick) const;
+    void CollectWanted(const glm::mat4 &modelViewProjection);
+    void WriteTableEntry(size_t brick, int slot);
+
+public:
+    /// @param resolution ボリュームの解像度(幅,高さ,奥行き)
+    /// @param extent バウンディングボックスの大きさ
+    /// @param emptyBricks 全ボクセル0のブリック(転送しない)
+    /// @param budgetBytes アトラスに使うGPUメモリの上限
+    BrickAtlas(const glm::ivec3 &resolution, const glm::vec3 &extent, int brickSize, std::vector<bool> emptyBricks,
+               GLenum internalFormat, GLenum format, GLenum type, size_t voxelBytes, size_t budgetBytes);
+    ~BrickAtlas();
+    BrickAtlas(const BrickAtlas &) = delete;
+    BrickAtlas &operator=(const BrickAtlas &) = delete;
+
+    /// @brief カメラから見えるブリックを時間予算の範囲でアトラスへ転送する。毎フレーム呼ぶ
+    /// @param modelViewProjection ボリュームのモデル座標からクリップ座標への変換
+    /// @param budgetMs このフレームで転送に使ってよい時間[ms]
+    void Update(const glm::mat4 &modelViewProjection, double budgetMs, const FetchFunc &fetch);
+
+    GLuint AtlasTexture() const { return atlasTexture; }
+    GLuint TableTexture() const { return tableTexture; }
+    int BrickSize() const { return brickSize; }
+    size_t SlotCount() const { return brickOfSlot.size(); }
+    /// @brief 常駐しているブリック数
+    size_t ResidentCount() const;
+    /// @brief 現在のカメラで必要なブリックのうち未転送の数
+    size_t PendingCount() const { return wanted.size() - wantedCursor; }
+    /// @brief GPUへ転送したバイト数の累計
+    size_t UploadedBytes() const { return uploadedBytes; }
+};
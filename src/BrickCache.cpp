@@ -0,0 +1,119 @@
+#include "BrickCache.hpp"
+#include <algorithm>
+#include <sstream>
+#include <stdexcept>
+
+#include "Profiling.hpp"
+
+using namespace std;
+
+namespace
+{
+    bool IsHostLittleEndian()
+    {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    }
+}
+
+template <typename T>
+BrickCache<T>::BrickCache(MappedFile &&_file, const VolumeHeader &_header, size_t _capacityBytes)
+    : file(std::move(_file)), header(_header), capacityBytes(_capacityBytes)
+{
+    if (header.BrickCount() == 0)
+        throw runtime_error("Paged volumes require a bricked file.");
+    if (VolumeHeader::VoxelBytes(header.voxelType) != sizeof(T))
+        throw runtime_error("Voxel type does not match the brick cache.");
+    if (header.payloadOffset > file.Size())
+        throw runtime_error("Volume payload is truncated.");
+    ValidateBrickTable(header, file.Size() - header.payloadOffset);
+    GetBrickCounts(header, counts);
+
+    const bool payloadLittle = header.endian == VolumeHeader::Endian::Little;
+    swapBytes = sizeof(T) > 1 && payloadLittle != IsHostLittleEndian();
+
+    // 空のブリックは展開も転送も不要なので、符号化方式だけ先に調べておく
+    const char *payload = file.Data() + header.payloadOffset;
+    emptyBricks.resize(header.BrickCount());
+    for (size_t brick = 0; brick < emptyBricks.size(); ++brick)
+        emptyBricks[brick] = IsEmptyBrick(header, payload, brick);
+}
+
+template <typename T>
+size_t BrickCache<T>::BrickIndex(size_t x, size_t y, size_t z) const
+{
+    const size_t brickSize = header.brickSize;
+    return ((x / brickSize) * counts[1] + y / brickSize) * counts[0] + z / brickSize;
+}
+
+template <typename T>
+const T *BrickCache<T>::Brick(size_t brick) const
+{
+    auto found = entries.find(brick);
+    if (found != entries.end())
+    {
+        stats.hits++;
+        lru.splice(lru.begin(), lru, found->second.lruPosition);
+        return found->second.voxels.data();
+    }
+
+    stats.misses++;
+    const BrickBox box = Box(brick);
+    const size_t bytes = box.Count() * sizeof(T);
+    // 容量を超えるなら古いものから捨てる(最低1ブリックは保持する)
+    while (!lru.empty() && usedBytes + bytes > capacityBytes)
+    {
+        const size_t victim = lru.back();
+        lru.pop_back();
+        auto evicted = entries.find(victim);
+        usedBytes -= evicted->second.voxels.size() * sizeof(T);
+        entries.erase(evicted);
+        stats.evictions++;
+        if (victim == lastBrick)
+            lastBrick = SIZE_MAX;
+    }
+
+    Entry &entry = entries[brick];
+    entry.voxels.resize(box.Count());
+    DecodeBrick(header, file.Data() + header.payloadOffset, brick, entry.voxels.data(), entry.voxels.size());
+    if (swapBytes)
+    {
+        char *bytesPtr = reinterpret_cast<char *>(entry.voxels.data());
+        for (size_t i = 0; i < entry.voxels.size(); ++i)
+            reverse(bytesPtr + i * sizeof(T), bytesPtr + (i + 1) * sizeof(T));
+    }
+    lru.push_front(brick);
+    entry.lruPosition = lru.begin();
+    usedBytes += bytes;
+    stats.bytesPaged += bytes;
+    return entry.voxels.data();
+}
+
+template <typename T>
+T BrickCache<T>::operator()(size_t x, size_t y, size_t z) const
+{
+    const size_t brick = BrickIndex(x, y, z);
+    if (brick != lastBrick)
+    {
+        lastVoxels = Brick(brick);
+        lastBox = Box(brick);
+        lastBrick = brick;
+    }
+    const size_t lx = x - lastBox.origin[0], ly = y - lastBox.origin[1], lz = z - lastBox.origin[2];
+    return lastVoxels[(lx * lastBox.size[1] + ly) * lastBox.size[2] + lz];
+}
+
+template <typename T>
+string BrickCache<T>::Sammary() const
+{
+    stringstream ss;
+    ss.precision(3);
+    ss << "hit " << stats.HitRate() * 100.0 << "% (" << stats.hits << "/" << stats.hits + stats.misses << "), paged "
+       << ToMiB(stats.bytesPaged) << "MiB, resident " << ToMiB(usedBytes) << "/" << ToMiB(capacityBytes) << "MiB";
+    return ss.str();
+}
+
+template class BrickCache<uint8_t>;
+template class BrickCache<uint16_t>;
+template class BrickCache<Half>;
+template class BrickCache<float>;
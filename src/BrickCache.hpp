@@ -0,0 +1,97 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "MappedFile.hpp"
+#include "VolumeHeader.hpp"
+#include "BrickedVolume.hpp"
+#include "VoxelTraits.hpp"
+
+/// @brief ブリック化ファイルから必要なブリックだけを展開して保持するLRUキャッシュ
+/// @details ホストのメモリに収まらないボリュームを扱うためのもの。
+/// 圧縮されたファイルはメモリマップで参照し(ページはOSが必要に応じて読み書きする)、
+/// 展開済みのブリックは容量を超えたら最も長く使われていないものから捨てる。
+/// VoxelGridと同じ読み取り用インターフェース(SizeX/Y/Z, operator())を持つので、同じアルゴリズムをそのまま適用できる。
+/// スレッドセーフではない。
+/// @tparam T ボクセルの型
+template <typename T>
+class BrickCache
+{
+public:
+    /// @brief キャッシュの統計(ブリック単位)
+    struct Stats
+    {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t evictions = 0;
+        size_t bytesPaged = 0; // 展開してキャッシュに載せたバイト数の累計
+        double HitRate() const { return hits + misses > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    };
+
+private:
+    struct Entry
+    {
+        std::vector<T> voxels;
+        std::list<size_t>::iterator lruPosition;
+    };
+
+    MappedFile file;
+    VolumeHeader header;
+    size_t counts[3]; // (幅,高さ,奥行き)方向のブリック数
+    size_t capacityBytes;
+    bool swapBytes;
+    std::vector<bool> emptyBricks;
+
+    // 読み取りでもLRUの順序は変わるのでmutable
+    mutable std::unordered_map<size_t, Entry> entries;
+    mutable std::list<size_t> lru; // 先頭が最も最近使われたブリック
+    mutable size_t usedBytes = 0;
+    mutable Stats stats;
+    // 直前に参照したブリック(同じブリック内の連続アクセスを速くする)
+    mutable size_t lastBrick = SIZE_MAX;
+    mutable const T *lastVoxels = nullptr;
+    mutable BrickBox lastBox;
+
+public:
+    /// @brief ブリック化ファイルのキャッシュを作る。不正なファイルならstd::runtime_errorを投げる
+    /// @param capacityBytes 展開済みブリックに使う最大バイト数(最低1ブリックは保持する)
+    BrickCache(MappedFile &&file, const VolumeHeader &header, size_t capacityBytes);
+
+    const VolumeHeader &Header() const { return header; }
+    /// @brief 圧縮されたブリック化ファイルのマップ
+    const MappedFile &File() const { return file; }
+    size_t SizeX() const { return header.resolution[2]; }
+    size_t SizeY() const { return header.resolution[1]; }
+    size_t SizeZ() const { return header.resolution[0]; }
+    size_t Count() const { return header.VoxelCount(); }
+    size_t BrickCount() const { return emptyBricks.size(); }
+    const size_t *BrickCounts() const { return counts; }
+    BrickBox Box(size_t brick) const { return GetBrickBox(header, counts, brick); }
+    /// @brief グリッド座標を含むブリックの番号
+    size_t BrickIndex(size_t x, size_t y, size_t z) const;
+    /// @brief 全ボクセル0のブリックか(展開しない)
+    bool IsEmpty(size_t brick) const { return emptyBricks[brick]; }
+    const std::vector<bool> &EmptyBricks() const { return emptyBricks; }
+
+    /// @brief 展開済みのブリックを取得する。キャッシュに無ければ展開し、必要なら古いブリックを捨てる
+    /// @return Box(brick).Count()要素の配列。次にBrick()かoperator()を呼ぶまで有効
+    const T *Brick(size_t brick) const;
+    /// @brief ボクセル値を取得する
+    T operator()(size_t x, size_t y, size_t z) const;
+
+    const Stats &GetStats() const { return stats; }
+    void ResetStats() const { stats = Stats(); }
+    size_t CapacityBytes() const { return capacityBytes; }
+    size_t UsedBytes() const { return usedBytes; }
+    /// @brief 統計の要約(ヒット率、ページングしたバイト数など)
+    std::string Sammary() const;
+};
+
+extern template class BrickCache<uint8_t>;
+extern template class BrickCache<uint16_t>;
+extern template class BrickCache<Half>;
+extern template class BrickCache<float>;
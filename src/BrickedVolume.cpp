@@ -0,0 +1,441 @@
+#include "BrickedVolume.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+#include "Volume.hpp"
+#include "Profiling.hpp"
+
+using namespace std;
+
+namespace
+{
+    /// 1トークンで表せる最大要素数
+    constexpr size_t MAX_TOKEN = 128;
+    /// この長さ以上の繰り返しをランとして符号化する
+    constexpr size_t MIN_RUN = 3;
+
+    bool IsHostLittleEndian()
+    {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    }
+
+    /// @brief ビット単位で等しいか(floatの-0と0、NaNも区別する)
+    template <typename T>
+    bool SameVoxel(const T &a, const T &b)
+    {
+        return memcmp(&a, &b, sizeof(T)) == 0;
+    }
+
+    template <typename T>
+    void AppendVoxels(vector<char> &out, const T *voxels, size_t count)
+    {
+        const char *bytes = reinterpret_cast<const char *>(voxels);
+        out.insert(out.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    /// @brief ブリック内のボクセル値を圧縮する
+    template <typename T>
+    void EncodeBrick(const T *voxels, size_t count, vector<char> &out)
+    {
+        out.clear();
+        size_t same = 1;
+        while (same < count && SameVoxel(voxels[same], voxels[0]))
+            ++same;
+        if (same == count)
+        {
+            out.push_back(static_cast<char>(BrickEncoding::Constant));
+            AppendVoxels(out, voxels, 1);
+            return;
+        }
+
+        out.push_back(static_cast<char>(BrickEncoding::RunLength));
+        size_t i = 0;
+        while (i < count)
+        {
+            size_t run = 1;
+            while (i + run < count && run < MAX_TOKEN && SameVoxel(voxels[i + run], voxels[i]))
+                ++run;
+            if (run >= MIN_RUN)
+            {
+                out.push_back(static_cast<char>(0x80 | (run - 1)));
+                AppendVoxels(out, voxels + i, 1);
+                i += run;
+                continue;
+            }
+            // 次のランが始まるまでをそのままコピーする
+            const size_t start = i;
+            while (i < count && i - start < MAX_TOKEN)
+            {
+                if (i + MIN_RUN - 1 < count && SameVoxel(voxels[i], voxels[i + 1]) && SameVoxel(voxels[i], voxels[i + 2]))
+                    break;
+                ++i;
+            }
+            out.push_back(static_cast<char>(i - start - 1));
+            AppendVoxels(out, voxels + start, i - start);
+        }
+
+        // 圧縮で大きくなるならそのまま格納する
+        if (out.size() >= 1 + count * sizeof(T))
+        {
+            out.clear();
+            out.push_back(static_cast<char>(BrickEncoding::Raw));
+            AppendVoxels(out, voxels, count);
+        }
+    }
+
+    /// @brief 圧縮されたブリックを展開する
+    /// @return 不正なデータならfalse
+    template <typename T>
+    bool DecodeBrickBytes(const char *src, size_t srcBytes, T *dst, size_t count)
+    {
+        if (srcBytes < 1)
+            return false;
+        const BrickEncoding encoding = static_cast<BrickEncoding>(src[0]);
+        ++src;
+        --srcBytes;
+        switch (encoding)
+        {
+        case BrickEncoding::Raw:
+            if (srcBytes != count * sizeof(T))
+                return false;
+            memcpy(dst, src, srcBytes);
+            return true;
+        case BrickEncoding::Constant:
+        {
+            if (srcBytes != sizeof(T))
+                return false;
+            T value;
+            memcpy(&value, src, sizeof(T));
+            fill_n(dst, count, value);
+            return true;
+        }
+        case BrickEncoding::RunLength:
+        {
+            size_t out = 0, in = 0;
+            while (in < srcBytes)
+            {
+                const unsigned char token = static_cast<unsigned char>(src[in++]);
+                const size_t length = (token & 0x7F) + 1;
+                if (out + length > count)
+                    return false;
+                if (token & 0x80)
+                {
+                    if (in + sizeof(T) > srcBytes)
+                        return false;
+                    T value;
+                    memcpy(&value, src + in, sizeof(T));
+                    fill_n(dst + out, length, value);
+                    in += sizeof(T);
+                }
+                else
+                {
+                    const size_t bytes = length * sizeof(T);
+                    if (in + bytes > srcBytes)
+                        return false;
+                    memcpy(dst + out, src + in, bytes);
+                    in += bytes;
+                }
+                out += length;
+            }
+            return out == count;
+        }
+        }
+        return false;
+    }
+}
+
+void GetBrickCounts(const VolumeHeader &header, size_t counts[3])
+{
+    for (int axis = 0; axis < 3; ++axis)
+        counts[axis] = header.brickSize == 0 ? 0 : (header.resolution[axis] + header.brickSize - 1) / header.brickSize;
+}
+
+BrickBox GetBrickBox(const VolumeHeader &header, const size_t counts[3], size_t brick)
+{
+    const size_t brickSize = header.brickSize;
+    const size_t index[3] = {brick / (counts[0] * counts[1]), (brick / counts[0]) % counts[1], brick % counts[0]};
+    const size_t gridSize[3] = {header.resolution[2], header.resolution[1], header.resolution[0]};
+    BrickBox box;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        box.origin[axis] = index[axis] * brickSize;
+        box.size[axis] = min(brickSize, gridSize[axis] - box.origin[axis]);
+    }
+    return box;
+}
+
+bool IsEmptyBrick(const VolumeHeader &header, const char *payload, size_t brick)
+{
+    const uint64_t begin = header.brickOffsets[brick];
+    const uint64_t bytes = header.brickOffsets[brick + 1] - begin;
+    if (bytes != 1 + VolumeHeader::VoxelBytes(header.voxelType) || static_cast<BrickEncoding>(payload[begin]) != BrickEncoding::Constant)
+        return false;
+    // 0はどのボクセル型でも全ビット0(エンディアンにも依存しない)
+    for (uint64_t i = 1; i < bytes; ++i)
+    {
+        if (payload[begin + i] != 0)
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+void DecodeBrick(const VolumeHeader &header, const char *payload, size_t brick, T *voxels, size_t count)
+{
+    const uint64_t begin = header.brickOffsets[brick];
+    if (!DecodeBrickBytes(payload + begin, header.brickOffsets[brick + 1] - begin, voxels, count))
+        throw runtime_error("Corrupted brick data: brick " + to_string(brick));
+}
+
+template <typename T>
+size_t WriteBrickedVolume(ostream &os, VolumeHeader &header, const VoxelGrid<T> &grid)
+{
+    header.resolution[0] = static_cast<uint32_t>(grid.SizeZ());
+    header.resolution[1] = static_cast<uint32_t>(grid.SizeY());
+    header.resolution[2] = static_cast<uint32_t>(grid.SizeX());
+    header.voxelType = VoxelTraits<T>::voxelType;
+    header.endian = IsHostLittleEndian() ? VolumeHeader::Endian::Little : VolumeHeader::Endian::Big;
+    if (header.brickSize == 0)
+        header.brickSize = DEFAULT_BRICK_SIZE;
+
+    size_t counts[3];
+    GetBrickCounts(header, counts);
+    const long long brickCount = static_cast<long long>(counts[0] * counts[1] * counts[2]);
+
+    // ブリックごとに独立しているので並列に圧縮する
+    vector<vector<char>> encoded(brickCount);
+#pragma omp parallel
+    {
+        vector<T> scratch;
+#pragma omp for schedule(dynamic)
+        for (long long brick = 0; brick < brickCount; ++brick)
+        {
+            const BrickBox box = GetBrickBox(header, counts, brick);
+            scratch.resize(box.Count());
+            T *dst = scratch.data();
+            for (size_t x = 0; x < box.size[0]; ++x)
+            {
+                for (size_t y = 0; y < box.size[1]; ++y)
+                {
+                    memcpy(dst, &grid(box.origin[0] + x, box.origin[1] + y, box.origin[2]), box.size[2] * sizeof(T));
+                    dst += box.size[2];
+                }
+            }
+            EncodeBrick(scratch.data(), scratch.size(), encoded[brick]);
+        }
+    }
+
+    header.brickOffsets.assign(brickCount + 1, 0);
+    for (long long brick = 0; brick < brickCount; ++brick)
+        header.brickOffsets[brick + 1] = header.brickOffsets[brick] + encoded[brick].size();
+
+    WriteVolumeHeader(os, header);
+    for (const vector<char> &bytes : encoded)
+        os.write(bytes.data(), bytes.size());
+    if (!os)
+        throw runtime_error("Failed to write bricked volume.");
+    return header.brickOffsets.back();
+}
+
+void ValidateBrickTable(const VolumeHeader &header, size_t payloadBytes)
+{
+    size_t counts[3];
+    GetBrickCounts(header, counts);
+    const size_t brickCount = counts[0] * counts[1] * counts[2];
+    if (header.BrickCount() != brickCount)
+        throw runtime_error("Brick count does not match the volume resolution.");
+    for (size_t brick = 0; brick < brickCount; ++brick)
+    {
+        if (header.brickOffsets[brick] > header.brickOffsets[brick + 1])
+            throw runtime_error("Brick offset table is not monotonic.");
+    }
+    if (header.brickOffsets.back() > payloadBytes)
+        throw runtime_error("Bricked payload is truncated.");
+}
+
+template <typename T>
+void DecodeBrickedVolume(const VolumeHeader &header, const char *payload, size_t payloadBytes, VoxelGrid<T> &grid)
+{
+    ValidateBrickTable(header, payloadBytes);
+    if (grid.SizeX() != header.resolution[2] || grid.SizeY() != header.resolution[1] || grid.SizeZ() != header.resolution[0])
+        throw runtime_error("Voxel grid does not match the volume resolution.");
+    size_t counts[3];
+    GetBrickCounts(header, counts);
+    const long long brickCount = static_cast<long long>(header.BrickCount());
+
+    atomic<bool> corrupted{false};
+#pragma omp parallel
+    {
+        vector<T> scratch;
+#pragma omp for schedule(dynamic)
+        for (long long brick = 0; brick < brickCount; ++brick)
+        {
+            const BrickBox box = GetBrickBox(header, counts, brick);
+            scratch.resize(box.Count());
+            const uint64_t begin = header.brickOffsets[brick];
+            if (!DecodeBrickBytes(payload + begin, header.brickOffsets[brick + 1] - begin, scratch.data(), scratch.size()))
+            {
+                corrupted = true;
+                continue;
+            }
+            const T *src = scratch.data();
+            for (size_t x = 0; x < box.size[0]; ++x)
+            {
+                for (size_t y = 0; y < box.size[1]; ++y)
+                {
+                    memcpy(&grid(box.origin[0] + x, box.origin[1] + y, box.origin[2]), src, box.size[2] * sizeof(T));
+                    src += box.size[2];
+                }
+            }
+        }
+    }
+    if (corrupted)
+        throw runtime_error("Corrupted brick data.");
+}
+
+template <typename T>
+void DecodeBrickedRegion(const VolumeHeader &header, const char *payload, size_t payloadBytes, const VolumeRegion &region, VoxelGrid<T> &grid)
+{
+    ValidateBrickTable(header, payloadBytes);
+    // グリッドの(x,y,z)はヘッダの(奥行き,高さ,幅)
+    const size_t lower[3] = {region.begin[2], region.begin[1], region.begin[0]};
+    const size_t upper[3] = {region.end[2], region.end[1], region.end[0]};
+    if (grid.SizeX() != upper[0] - lower[0] || grid.SizeY() != upper[1] - lower[1] || grid.SizeZ() != upper[2] - lower[2])
+        throw runtime_error("Voxel grid does not match the region size.");
+    size_t counts[3];
+    GetBrickCounts(header, counts);
+
+    // 領域に交わるブリックだけを集める(ブリックの表は小さいので全走査でよい)
+    vector<size_t> bricks;
+    for (size_t brick = 0; brick < header.BrickCount(); ++brick)
+    {
+        const BrickBox box = GetBrickBox(header, counts, brick);
+        bool overlaps = true;
+        for (int axis = 0; axis < 3; ++axis)
+            overlaps = overlaps && box.origin[axis] < upper[axis] && lower[axis] < box.origin[axis] + box.size[axis];
+        if (overlaps)
+            bricks.push_back(brick);
+    }
+
+    const long long brickCount = static_cast<long long>(bricks.size());
+    atomic<bool> corrupted{false};
+#pragma omp parallel
+    {
+        vector<T> scratch;
+#pragma omp for schedule(dynamic)
+        for (long long i = 0; i < brickCount; ++i)
+        {
+            const size_t brick = bricks[i];
+            const BrickBox box = GetBrickBox(header, counts, brick);
+            scratch.resize(box.Count());
+            const uint64_t begin = header.brickOffsets[brick];
+            if (!DecodeBrickBytes(payload + begin, header.brickOffsets[brick + 1] - begin, scratch.data(), scratch.size()))
+            {
+                corrupted = true;
+                continue;
+            }
+            // ブリックと領域の重なりをブリック内の座標で求め、z方向の連続した行ごとにコピーする
+            size_t from[3], to[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                from[axis] = max(lower[axis], box.origin[axis]) - box.origin[axis];
+                to[axis] = min(upper[axis], box.origin[axis] + box.size[axis]) - box.origin[axis];
+            }
+            for (size_t x = from[0]; x < to[0]; ++x)
+            {
+                for (size_t y = from[1]; y < to[1]; ++y)
+                {
+                    const T *src = scratch.data() + (x * box.size[1] + y) * box.size[2] + from[2];
+                    memcpy(&grid(box.origin[0] + x - lower[0], box.origin[1] + y - lower[1], box.origin[2] + from[2] - lower[2]), src, (to[2] - from[2]) * sizeof(T));
+                }
+            }
+        }
+    }
+    if (corrupted)
+        throw runtime_error("Corrupted brick data.");
+}
+
+int RunConvert(const vector<string> &args)
+{
+    if (args.size() < 2)
+    {
+        cerr << "Usage: volumen --convert <input.dat|input.glvr> <output.glvr> [brickSize]" << endl;
+        return -1;
+    }
+    try
+    {
+        VolumeHeader header;
+        header.brickSize = args.size() >= 3 ? static_cast<uint32_t>(stoul(args[2])) : DEFAULT_BRICK_SIZE;
+        VolumeHeader inputHeader;
+        if (ReadVolumeHeader(args[0], inputHeader))
+            copy(begin(inputHeader.spacing), end(inputHeader.spacing), header.spacing);
+        unique_ptr<VolumeBase> volume = LoadVolume(args[0]);
+
+        // 圧縮
+        Stopwatch encodeTimer;
+        size_t payloadBytes;
+        {
+            ofstream os(args[1], ios::binary);
+            if (!os.is_open())
+                throw runtime_error("Failed to open file: " + args[1]);
+            payloadBytes = VisitVolume(*volume, [&](auto &typed)
+                                       { return WriteBrickedVolume(os, header, typed.intencity); });
+        }
+        const double encodeMs = encodeTimer.ElapsedMs();
+        const size_t rawBytes = header.PayloadBytes();
+        cout << "[INFO] Converted " << args[0] << " -> " << args[1] << ": " << volume->Sammary() << ", "
+             << header.BrickCount() << " bricks of " << header.brickSize << "^3" << endl;
+        cout << "[INFO] raw " << ToMiB(rawBytes) << "MiB -> payload " << ToMiB(payloadBytes) << "MiB, ratio "
+             << static_cast<double>(rawBytes) / max<size_t>(payloadBytes, 1) << "x, encode " << encodeMs << "ms" << endl;
+
+        // 書き出したファイルから展開して、速度と内容を確認する
+        MappedFile file(args[1]);
+        const VolumeHeader written = ParseVolumeHeader(file.Data(), file.Size());
+        const char *payload = file.Data() + written.payloadOffset;
+        const size_t available = file.Size() - written.payloadOffset;
+        bool identical = false;
+        double decodeMs = 0.0;
+        VisitVolume(*volume, [&](auto &typed)
+                    {
+            using Grid = std::decay_t<decltype(typed.intencity)>;
+            Grid grid(typed.intencity.SizeX(), typed.intencity.SizeY(), typed.intencity.SizeZ());
+            decodeMs = 1e30;
+            for (int r = 0; r < 3; ++r)
+            {
+                Stopwatch decodeTimer;
+                DecodeBrickedVolume(written, payload, available, grid);
+                decodeMs = min(decodeMs, decodeTimer.ElapsedMs());
+            }
+            identical = memcmp(grid.Data(), typed.intencity.Data(), grid.Bytes()) == 0; });
+        cout << "[INFO] decode " << decodeMs << "ms, " << rawBytes / (decodeMs * 1e6) << "GB/s, round trip "
+             << (identical ? "OK" : "MISMATCH") << endl;
+        return identical ? 0 : -1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "[ERROR] " << e.what() << endl;
+        return -1;
+    }
+}
+
+template size_t WriteBrickedVolume<uint8_t>(ostream &, VolumeHeader &, const VoxelGrid<uint8_t> &);
+template size_t WriteBrickedVolume<uint16_t>(ostream &, VolumeHeader &, const VoxelGrid<uint16_t> &);
+template size_t WriteBrickedVolume<Half>(ostream &, VolumeHeader &, const VoxelGrid<Half> &);
+template size_t WriteBrickedVolume<float>(ostream &, VolumeHeader &, const VoxelGrid<float> &);
+template void DecodeBrickedVolume<uint8_t>(const VolumeHeader &, const char *, size_t, VoxelGrid<uint8_t> &);
+template void DecodeBrickedVolume<uint16_t>(const VolumeHeader &, const char *, size_t, VoxelGrid<uint16_t> &);
+template void DecodeBrickedVolume<Half>(const VolumeHeader &, const char *, size_t, VoxelGrid<Half> &);
+template void DecodeBrickedVolume<float>(const VolumeHeader &, const char *, size_t, VoxelGrid<float> &);
+template void DecodeBrickedRegion<uint8_t>(const VolumeHeader &, const char *, size_t, const VolumeRegion &, VoxelGrid<uint8_t> &);
+template void DecodeBrickedRegion<uint16_t>(const VolumeHeader &, const char *, size_t, const VolumeRegion &, VoxelGrid<uint16_t> &);
+template void DecodeBrickedRegion<Half>(const VolumeHeader &, const char *, size_t, const VolumeRegion &, VoxelGrid<Half> &);
+template void DecodeBrickedRegion<float>(const VolumeHeader &, const char *, size_t, const VolumeRegion &, VoxelGrid<float> &);
+template void DecodeBrick<uint8_t>(const VolumeHeader &, const char *, size_t, uint8_t *, size_t);
+template void DecodeBrick<uint16_t>(const VolumeHeader &, const char *, size_t, uint16_t *, size_t);
+template void DecodeBrick<Half>(const VolumeHeader &, const char *, size_t, Half *, size_t);
+template void DecodeBrick<float>(const VolumeHeader &, const char *, size_t, float *, size_t);
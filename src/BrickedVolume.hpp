@@ -0,0 +1,84 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "VoxelGrid.hpp"
+#include "VolumeHeader.hpp"
+
+/// @brief ブリック化・圧縮したボリューム(.glvrのブリックペイロード)の読み書き
+/// @details ボリュームを一辺brickSizeのブリックに分割し、ブリックごとに独立して圧縮する。
+/// ブリックは幅(最速軸)方向が最も速く変化する順に並び、ヘッダのオフセット表で任意のブリックに直接アクセスできる。
+/// 端のブリックはボリュームからはみ出した分を含まない。
+/// 各ブリックの先頭1バイトは符号化方式(BrickEncoding)で、それに続くデータは以下のとおり。
+/// - Raw:       ブリック内のボクセル値をそのまま
+/// - Constant:  全ボクセルに共通する値1要素
+/// - RunLength: PackBits形式の列。制御バイトhの最上位ビットが1なら次の1要素を(h&0x7F)+1回繰り返し、
+///              0なら続く(h&0x7F)+1要素をそのままコピーする
+enum class BrickEncoding : uint8_t
+{
+    Raw = 0,
+    Constant = 1,
+    RunLength = 2,
+};
+
+constexpr uint32_t DEFAULT_BRICK_SIZE = 32;
+
+/// @brief ブリック化した各軸のブリック数
+/// @param header 解像度とbrickSizeが設定されたヘッダ
+/// @param counts (幅,高さ,奥行き)方向のブリック数
+void GetBrickCounts(const VolumeHeader &header, size_t counts[3]);
+
+/// @brief ブリックのグリッド上の範囲。ブリック内のボクセルはグリッドと同じ順(zが最速)に詰めて並ぶ
+struct BrickBox
+{
+    size_t origin[3]; // グリッドの(x,y,z)
+    size_t size[3];
+    size_t Count() const { return size[0] * size[1] * size[2]; }
+};
+
+/// @brief ブリック番号からグリッド上の範囲を求める。ブリックは幅(グリッドのz)方向が最も速く変化する
+/// @param counts GetBrickCountsで求めたブリック数
+BrickBox GetBrickBox(const VolumeHeader &header, const size_t counts[3], size_t brick);
+
+/// @brief ブリックが全ボクセル0か(展開せずに符号化方式だけで判定する)
+/// @param payload ペイロード先頭。オフセット表は検証済みであること
+bool IsEmptyBrick(const VolumeHeader &header, const char *payload, size_t brick);
+
+/// @brief ブリック1つを展開する。不正なデータならstd::runtime_errorを投げる。エンディアンの変換はしない
+/// @param voxels 展開先。GetBrickBox(...).Count()要素
+template <typename T>
+void DecodeBrick(const VolumeHeader &header, const char *payload, size_t brick, T *voxels, size_t count);
+
+/// @brief グリッドをブリック化・圧縮して書き出す(ブリックごとに並列に圧縮する)
+/// @details headerの解像度・ボクセル型・エンディアン・オフセット表はgridから設定される
+/// @param header spacingとbrickSizeを設定したヘッダ。brickSizeが0ならDEFAULT_BRICK_SIZEを使う
+/// @return 圧縮後のペイロードのバイト数
+template <typename T>
+size_t WriteBrickedVolume(std::ostream &os, VolumeHeader &header, const VoxelGrid<T> &grid);
+
+/// @brief オフセット表がペイロードに収まり単調増加しているか検証する。不正ならstd::runtime_errorを投げる
+void ValidateBrickTable(const VolumeHeader &header, size_t payloadBytes);
+
+/// @brief ブリックペイロードをグリッドに展開する(ブリックごとに並列に展開する)
+/// @details 不正なペイロードならstd::runtime_errorを投げる。エンディアンの変換はしない
+/// @param payload ペイロード先頭(header.payloadOffsetの位置)
+/// @param payloadBytes ペイロードとして利用できるバイト数
+/// @param grid 展開先。解像度がheaderと一致していること
+template <typename T>
+void DecodeBrickedVolume(const VolumeHeader &header, const char *payload, size_t payloadBytes, VoxelGrid<T> &grid);
+
+/// @brief ブリックペイロードのうち部分領域に交わるブリックだけを展開し、領域をグリッドに切り出す
+/// @details 不正なペイロードならstd::runtime_errorを投げる。エンディアンの変換はしない
+/// @param region 解像度の範囲に切り詰めた領域(幅,高さ,奥行き)
+/// @param grid 展開先。大きさが(奥行き,高さ,幅)=regionの大きさと一致していること
+template <typename T>
+void DecodeBrickedRegion(const VolumeHeader &header, const char *payload, size_t payloadBytes, const VolumeRegion &region, VoxelGrid<T> &grid);
+
+/// @brief `volumen --convert <input> <output.glvr> [brickSize]` のエントリポイント
+/// @details 生の.datまたは非ブリックの.glvrを読み込んでブリック化し、圧縮率と展開速度を表示する
+/// @param args --convertの後ろに続く引数
+/// @return 終了コード
+int RunConvert(const std::vector<std::string> &args);
@@ -0,0 +1,387 @@
+#include "ConnectedComponents.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    // ラベル付けの途中では、配列の値は0が背景、それ以外は(親のインデックス+1)。根は自分自身を指す。
+    // 根へラベルを書き込んでから他のボクセルが読むまでの間は、根の値にこの印を付けて区別する
+    constexpr uint32_t ROOT_TAG = 0x80000000u;
+
+    static_assert(sizeof(atomic<uint32_t>) == sizeof(uint32_t), "atomic<uint32_t> must have the same layout as uint32_t");
+
+    /// @brief 他のスレッドも読み書きする要素をアトミックに扱う
+    inline atomic<uint32_t> &AtomicAt(uint32_t *data, size_t index)
+    {
+        return reinterpret_cast<atomic<uint32_t> &>(data[index]);
+    }
+
+    inline void AtomicMin(atomic<uint32_t> &target, uint32_t value)
+    {
+        for (uint32_t current = target.load(memory_order_relaxed); value < current && !target.compare_exchange_weak(current, value, memory_order_relaxed);)
+        {
+        }
+    }
+
+    inline void AtomicMax(atomic<uint32_t> &target, uint32_t value)
+    {
+        for (uint32_t current = target.load(memory_order_relaxed); value > current && !target.compare_exchange_weak(current, value, memory_order_relaxed);)
+        {
+        }
+    }
+
+    template <typename T>
+    inline atomic<T> &AsAtomic(T &value)
+    {
+        static_assert(sizeof(atomic<T>) == sizeof(T), "atomic<T> must have the same layout as T");
+        return reinterpret_cast<atomic<T> &>(value);
+    }
+
+    /// @brief 成分の集計値。軸は(幅,高さ,奥行き)の順
+    struct ComponentAccumulator
+    {
+        uint64_t count = 0;
+        uint64_t sum[3] = {0, 0, 0};
+        uint32_t lower[3] = {UINT32_MAX, UINT32_MAX, UINT32_MAX};
+        uint32_t upper[3] = {0, 0, 0}; // 最大の座標+1
+
+        /// @brief 幅方向の区間 [zBegin, zEnd) を足し込む。concurrentなら他のスレッドと同時に足し込んでよい
+        template <bool concurrent>
+        void AddRun(uint32_t x, uint32_t y, uint32_t zBegin, uint32_t zEnd)
+        {
+            const uint64_t length = zEnd - zBegin;
+            const uint64_t sums[3] = {(uint64_t(zBegin) + zEnd - 1) * length / 2, uint64_t(y) * length, uint64_t(x) * length};
+            const uint32_t begin[3] = {zBegin, y, x}, end[3] = {zEnd, y + 1, x + 1};
+            if (concurrent)
+            {
+                AsAtomic(count).fetch_add(length, memory_order_relaxed);
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    AsAtomic(sum[axis]).fetch_add(sums[axis], memory_order_relaxed);
+                    AtomicMin(AsAtomic(lower[axis]), begin[axis]);
+                    AtomicMax(AsAtomic(upper[axis]), end[axis]);
+                }
+                return;
+            }
+            count += length;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                sum[axis] += sums[axis];
+                lower[axis] = min(lower[axis], begin[axis]);
+                upper[axis] = max(upper[axis], end[axis]);
+            }
+        }
+    };
+
+    struct Offset
+    {
+        long long dx, dy, dz;
+    };
+
+    /// @brief ラスタ順で前にある近傍(走査中に既に訪れたボクセル)へのオフセット
+    vector<Offset> BackwardOffsets(Connectivity connectivity)
+    {
+        const long long maxDistance = connectivity == Connectivity::Face ? 1 : connectivity == Connectivity::Edge ? 2 : 3;
+        vector<Offset> offsets;
+        for (long long dx = -1; dx <= 0; ++dx)
+            for (long long dy = -1; dy <= 1; ++dy)
+                for (long long dz = -1; dz <= 1; ++dz)
+                {
+                    const bool backward = dx < 0 || (dx == 0 && (dy < 0 || (dy == 0 && dz < 0)));
+                    const long long distance = -dx + (dy < 0 ? -dy : dy) + (dz < 0 ? -dz : dz);
+                    if (backward && distance <= maxDistance)
+                        offsets.push_back({dx, dy, dz});
+                }
+        return offsets;
+    }
+
+    /// @brief 根を探す。経路を半分ずつ縮める(path halving)
+    inline uint32_t Find(uint32_t *parent, uint32_t i)
+    {
+        while (true)
+        {
+            const uint32_t p = parent[i] - 1;
+            if (p == i)
+                return i;
+            const uint32_t grandParent = parent[p] - 1;
+            parent[i] = grandParent + 1;
+            i = grandParent;
+        }
+    }
+
+    /// @brief 2つの木を結合する。インデックスの小さい根を新しい根にするので、根は常に成分の最初のボクセルになる
+    inline void Unite(uint32_t *parent, uint32_t a, uint32_t b)
+    {
+        a = Find(parent, a);
+        b = Find(parent, b);
+        if (a < b)
+            parent[b] = a + 1;
+        else if (b < a)
+            parent[a] = b + 1;
+    }
+
+    /// @brief 近傍のボクセル(範囲外ならSIZE_MAX)
+    inline size_t Neighbor(const VoxelGrid<uint32_t> &labels, const Offset &offset, size_t x, size_t y, size_t z, size_t xLower)
+    {
+        const long long nx = static_cast<long long>(x) + offset.dx;
+        const long long ny = static_cast<long long>(y) + offset.dy;
+        const long long nz = static_cast<long long>(z) + offset.dz;
+        if (nx < static_cast<long long>(xLower) || ny < 0 || ny >= static_cast<long long>(labels.SizeY()) || nz < 0 || nz >= static_cast<long long>(labels.SizeZ()))
+            return SIZE_MAX;
+        return labels.Index(nx, ny, nz);
+    }
+
+    /// @brief x∈[xBegin, xEnd)の前景ボクセルを木にし、ブロック内の前の近傍と結合する
+    /// @details 最初に見つかった前景の近傍の根を親にし(新しい木を作らない)、残りの近傍とは結合する。
+    /// 内側のボクセルは範囲の判定を省き、線形のオフセットで近傍を参照する
+    void LabelBlock(VoxelGrid<uint32_t> &labels, const vector<Offset> &offsets, size_t xBegin, size_t xEnd)
+    {
+        uint32_t *parent = labels.Data();
+        const size_t sizeY = labels.SizeY(), sizeZ = labels.SizeZ();
+        vector<long long> deltas;
+        for (const Offset &offset : offsets)
+            deltas.push_back((offset.dx * static_cast<long long>(sizeY) + offset.dy) * static_cast<long long>(sizeZ) + offset.dz);
+
+        for (size_t x = xBegin; x < xEnd; ++x)
+        {
+            for (size_t y = 0; y < sizeY; ++y)
+            {
+                const bool interiorRow = x > xBegin && y > 0 && y + 1 < sizeY;
+                for (size_t z = 0; z < sizeZ; ++z)
+                {
+                    const size_t i = labels.Index(x, y, z);
+                    if (parent[i] == 0)
+                        continue;
+                    uint32_t root = static_cast<uint32_t>(i);
+                    const bool interior = interiorRow && z > 0 && z + 1 < sizeZ;
+                    for (size_t o = 0; o < offsets.size(); ++o)
+                    {
+                        const size_t j = interior ? i + deltas[o] : Neighbor(labels, offsets[o], x, y, z, xBegin);
+                        if (j == SIZE_MAX || parent[j] == 0)
+                            continue;
+                        if (root == i)
+                            root = Find(parent, static_cast<uint32_t>(j));
+                        else
+                            Unite(parent, root, static_cast<uint32_t>(j));
+                    }
+                    // 結合で根が変わっていても、親は成分の祖先を指していればよい
+                    parent[i] = root + 1;
+                }
+            }
+        }
+    }
+
+    /// @brief 平面xの前景ボクセルを、平面x-1にある近傍と結合する(ブロックの境界)
+    void MergePlane(VoxelGrid<uint32_t> &labels, const vector<Offset> &crossOffsets, size_t x)
+    {
+        uint32_t *parent = labels.Data();
+        for (size_t y = 0; y < labels.SizeY(); ++y)
+        {
+            for (size_t z = 0; z < labels.SizeZ(); ++z)
+            {
+                const size_t i = labels.Index(x, y, z);
+                if (parent[i] == 0)
+                    continue;
+                for (const Offset &offset : crossOffsets)
+                {
+                    const size_t j = Neighbor(labels, offset, x, y, z, x - 1);
+                    if (j != SIZE_MAX && parent[j] != 0)
+                        Unite(parent, static_cast<uint32_t>(i), static_cast<uint32_t>(j));
+                }
+            }
+        }
+    }
+}
+
+const char *ConnectivityName(Connectivity connectivity)
+{
+    switch (connectivity)
+    {
+    case Connectivity::Edge:
+        return "18";
+    case Connectivity::Vertex:
+        return "26";
+    case Connectivity::Face:
+    default:
+        return "6";
+    }
+}
+
+Connectivity ParseConnectivity(const string &name)
+{
+    if (name == "6")
+        return Connectivity::Face;
+    if (name == "18")
+        return Connectivity::Edge;
+    if (name == "26")
+        return Connectivity::Vertex;
+    throw runtime_error("Unknown connectivity: " + name + " (6, 18, 26)");
+}
+
+uint32_t LabelComponents(VoxelGrid<uint32_t> &labels, Connectivity connectivity, const atomic<bool> *cancel)
+{
+    if (labels.Count() >= ROOT_TAG - 1)
+        throw runtime_error("Volume is too large for 32-bit component labels.");
+    const vector<Offset> offsets = BackwardOffsets(connectivity);
+    // 境界面の結合では、前のブロックにある近傍だけを見ればよい
+    vector<Offset> crossOffsets;
+    copy_if(offsets.begin(), offsets.end(), back_inserter(crossOffsets), [](const Offset &offset)
+            { return offset.dx < 0; });
+    uint32_t *parent = labels.Data();
+    const size_t sizeX = labels.SizeX(), planeCount = labels.SizeY() * labels.SizeZ();
+
+    // x方向のブロック。スレッド数より多めに分けて負荷を均す
+    const size_t blockCount = max<size_t>(min<size_t>(sizeX, 4 * max(thread::hardware_concurrency(), 1u)), 1);
+    vector<size_t> blockBegin(blockCount + 1);
+    for (size_t b = 0; b <= blockCount; ++b)
+        blockBegin[b] = sizeX * b / blockCount;
+    const long long blocks = static_cast<long long>(blockCount);
+    const auto cancelled = [cancel]
+    { return cancel && cancel->load(memory_order_relaxed); };
+
+    // 1. ブロック内で前景を木にまとめる
+#pragma omp parallel for schedule(dynamic)
+    for (long long b = 0; b < blocks; ++b)
+    {
+        if (!cancelled())
+            LabelBlock(labels, offsets, blockBegin[b], blockBegin[b + 1]);
+    }
+    if (cancelled())
+        return 0;
+
+    // 2. 隣り合うブロックの組の境界面を結合する。組を倍々に広げ、各段では組ごとに互いに素な木だけを触るので並列にしてよい
+    for (long long step = 1; step < blocks; step *= 2)
+    {
+#pragma omp parallel for schedule(dynamic)
+        for (long long first = 0; first < blocks; first += 2 * step)
+        {
+            const long long second = first + step;
+            if (second < blocks)
+                MergePlane(labels, crossOffsets, blockBegin[second]);
+        }
+    }
+    if (cancelled())
+        return 0;
+
+    // 3. 全ボクセルを根へ直接つなぎ、ブロックごとに根を集める。
+    // 他のブロックの経路を読むので、アトミックに読み書きする(途中の値も祖先を指すので正しく辿れる)
+    vector<vector<uint32_t>> blockRoots(blockCount);
+#pragma omp parallel for schedule(static)
+    for (long long b = 0; b < blocks; ++b)
+    {
+        const size_t begin = blockBegin[b] * planeCount, end = blockBegin[b + 1] * planeCount;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t value = AtomicAt(parent, i).load(memory_order_relaxed);
+            if (value == 0)
+                continue;
+            if (value - 1 == i)
+            {
+                blockRoots[b].push_back(static_cast<uint32_t>(i));
+                continue;
+            }
+            uint32_t root = value - 1;
+            for (uint32_t next; (next = AtomicAt(parent, root).load(memory_order_relaxed) - 1) != root;)
+                root = next;
+            if (root + 1 != value)
+                AtomicAt(parent, i).store(root + 1, memory_order_relaxed);
+        }
+    }
+
+    // 4. 根はラスター順に集まっているので、ブロックの順に番号を振って根に(印付きで)書き込む
+    vector<uint32_t> blockLabels(blockCount + 1, 0);
+    for (size_t b = 0; b < blockCount; ++b)
+        blockLabels[b + 1] = blockLabels[b] + static_cast<uint32_t>(blockRoots[b].size());
+#pragma omp parallel for schedule(static)
+    for (long long b = 0; b < blocks; ++b)
+    {
+        uint32_t label = blockLabels[b];
+        for (uint32_t root : blockRoots[b])
+            parent[root] = ++label | ROOT_TAG;
+    }
+
+    // 5. 根以外を根のラベルに置き換え、根の印を外す
+#pragma omp parallel for schedule(static)
+    for (long long b = 0; b < blocks; ++b)
+    {
+        for (size_t i = blockBegin[b] * planeCount; i < blockBegin[b + 1] * planeCount; ++i)
+        {
+            const uint32_t value = AtomicAt(parent, i).load(memory_order_relaxed);
+            if (value == 0)
+                continue;
+            const uint32_t label = value & ROOT_TAG ? value : AtomicAt(parent, value - 1).load(memory_order_relaxed);
+            AtomicAt(parent, i).store(label & ~ROOT_TAG, memory_order_relaxed);
+        }
+    }
+    return blockLabels[blockCount];
+}
+
+vector<ComponentStats> MeasureComponents(const VoxelGrid<uint32_t> &labels, uint32_t componentCount)
+{
+    const long long sizeX = static_cast<long long>(labels.SizeX());
+    const size_t sizeY = labels.SizeY(), sizeZ = labels.SizeZ(), planeCount = sizeY * sizeZ;
+    // ラベルはラスタ順に振られているので、平面xで初めて現れるラベルは (それより前の平面の最大, 平面xの最大] になる。
+    // そのラベルは平面xを走査するスレッドだけが持ち主としてアトミック無しで集計し、
+    // 前の平面から続く成分だけを共有の集計値へアトミックに足し込む
+    vector<uint32_t> planeMax(sizeX, 0);
+#pragma omp parallel for schedule(static)
+    for (long long x = 0; x < sizeX; ++x)
+    {
+        const uint32_t *plane = labels.Data() + x * planeCount;
+        planeMax[x] = planeCount > 0 ? *max_element(plane, plane + planeCount) : 0;
+    }
+    vector<uint32_t> firstOwned(sizeX, 1);
+    for (long long x = 1; x < sizeX; ++x)
+        firstOwned[x] = max(firstOwned[x - 1], planeMax[x - 1] + 1);
+
+    vector<ComponentAccumulator> owned(size_t(componentCount) + 1), shared(size_t(componentCount) + 1);
+#pragma omp parallel for schedule(dynamic)
+    for (long long x = 0; x < sizeX; ++x)
+        for (size_t y = 0; y < sizeY; ++y)
+        {
+            const uint32_t *row = &labels(x, y, 0);
+            for (size_t z = 0; z < sizeZ;)
+            {
+                const uint32_t label = row[z];
+                size_t end = z + 1;
+                while (end < sizeZ && row[end] == label)
+                    end++;
+                const uint32_t runX = static_cast<uint32_t>(x), runY = static_cast<uint32_t>(y), runBegin = static_cast<uint32_t>(z), runEnd = static_cast<uint32_t>(end);
+                if (label != 0 && label <= componentCount)
+                {
+                    if (label >= firstOwned[x])
+                        owned[label].AddRun<false>(runX, runY, runBegin, runEnd);
+                    else
+                        shared[label].AddRun<true>(runX, runY, runBegin, runEnd);
+                }
+                z = end;
+            }
+        }
+
+    vector<ComponentStats> stats(size_t(componentCount) + 1);
+    const long long count = static_cast<long long>(stats.size());
+#pragma omp parallel for schedule(static)
+    for (long long label = 1; label < count; ++label)
+    {
+        const ComponentAccumulator &local = owned[label];
+        const ComponentAccumulator &other = shared[label];
+        ComponentStats &component = stats[label];
+        component.voxelCount = local.count + other.count;
+        if (component.voxelCount == 0)
+            continue;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            component.bounds.begin[axis] = min(local.lower[axis], other.lower[axis]);
+            component.bounds.end[axis] = max(local.upper[axis], other.upper[axis]);
+            component.centroid[axis] = static_cast<double>(local.sum[axis] + other.sum[axis]) / component.voxelCount;
+        }
+    }
+    return stats;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VoxelGrid.hpp"
+#include "VolumeHeader.hpp"
+
+/// @brief 連結成分を求める時の近傍
+enum class Connectivity
+{
+    Face = 6,    // 面で接するボクセル
+    Edge = 18,   // 面か辺で接するボクセル
+    Vertex = 26, // 面か辺か頂点で接するボクセル
+};
+
+/// @brief 近傍の名前("6", "18", "26")
+const char *ConnectivityName(Connectivity connectivity);
+/// @brief 名前("6", "18", "26")から近傍を得る。不明な名前ならstd::runtime_errorを投げる
+Connectivity ParseConnectivity(const std::string &name);
+
+/// @brief 前景の連結成分にラベルを付ける(ブロック並列のunion-find)
+/// @details x方向にブロックへ分け、ブロック内の結合を並列に行った後、隣り合うブロックの境界面を
+/// 2つずつ階層的に並列に結合し、最後に全ボクセルを並列に根のラベルへ置き換える。
+/// ラベルは各成分のラスタ順(xが最遅、zが最速)で最初のボクセルの順に1から振るので、
+/// BFSで先頭から探索した場合と同じ番号になる。ボクセル数が2^31-1以上ならstd::runtime_errorを投げる
+/// @param labels 入力は前景なら非0、背景なら0。出力は成分のラベル(背景は0)
+/// @param cancel nullptrでなく、計算中にtrueになったら段階の間で中断して0を返す(labelsは途中の値になる)
+/// @return 成分数
+uint32_t LabelComponents(VoxelGrid<uint32_t> &labels, Connectivity connectivity, const std::atomic<bool> *cancel = nullptr);
+
+/// @brief 連結成分1つの統計
+struct ComponentStats
+{
+    uint64_t voxelCount = 0;
+    /// 外接直方体 [begin, end)(幅,高さ,奥行き)
+    VolumeRegion bounds;
+    /// 重心(幅,高さ,奥行き)[ボクセル]
+    double centroid[3] = {0.0, 0.0, 0.0};
+};
+
+/// @brief 各成分のボクセル数・外接直方体・重心を1回の並列走査で求める
+/// @details 幅方向に同じラベルが続く区間ごとにまとめてから成分の集計値へアトミックに足し込むので、
+/// 大きな成分でもスレッド間の競合は行の数程度に収まる
+/// @param labels LabelComponents()の出力
+/// @param componentCount 成分数(最大のラベル)
+/// @return ラベル順の統計。要素0は背景で使わない
+std::vector<ComponentStats> MeasureComponents(const VoxelGrid<uint32_t> &labels, uint32_t componentCount);
@@ -0,0 +1,160 @@
+#include "DerivedCache.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr size_t HASH_CHUNK_BYTES = 1024 * 1024;
+
+    inline uint64_t RotateLeft(uint64_t v, int bits) { return (v << bits) | (v >> (64 - bits)); }
+
+    inline uint64_t MixWord(uint64_t h, uint64_t word)
+    {
+        h ^= word * 0x87C37B91114253D5ull;
+        return RotateLeft(h, 31) * 0x4CF5AD432745937Full;
+    }
+
+    inline uint64_t Finalize(uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        h *= 0xC4CEB9FE1A85EC53ull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /// @brief 1チャンクのハッシュ。4本の独立した列で8バイトずつ混ぜ、命令レベルの並列性を出す
+    uint64_t HashChunk(const unsigned char *data, size_t bytes, uint64_t seed)
+    {
+        uint64_t lanes[4] = {seed, seed ^ 0x9E3779B97F4A7C15ull, seed + 0x632BE59BD9B4E019ull, seed - 0x8EBC6AF09C88C6E3ull};
+        size_t offset = 0;
+        for (; offset + 32 <= bytes; offset += 32)
+        {
+            for (int lane = 0; lane < 4; ++lane)
+            {
+                uint64_t word;
+                memcpy(&word, data + offset + lane * 8, 8);
+                lanes[lane] = MixWord(lanes[lane], word);
+            }
+        }
+        uint64_t h = MixWord(MixWord(MixWord(lanes[0], lanes[1]), lanes[2]), lanes[3]);
+        for (; offset < bytes; ++offset)
+            h = MixWord(h, data[offset]);
+        return Finalize(h ^ bytes);
+    }
+
+    struct FileHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint64_t elementBytes;
+        uint64_t count;
+        uint64_t payloadHash;
+        uint64_t reserved;
+    };
+    static_assert(sizeof(FileHeader) == DerivedCache::HEADER_SIZE, "cache file header must be 48 bytes");
+}
+
+DerivedCache::DerivedCache(string _directory)
+    : directory(std::move(_directory))
+{
+}
+
+uint64_t DerivedCache::Hash(const void *data, size_t bytes, uint64_t seed)
+{
+    const unsigned char *bytesData = static_cast<const unsigned char *>(data);
+    const long long chunkCount = static_cast<long long>((bytes + HASH_CHUNK_BYTES - 1) / HASH_CHUNK_BYTES);
+    vector<uint64_t> chunkHashes(chunkCount);
+#pragma omp parallel for schedule(static)
+    for (long long chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        const size_t begin = chunk * HASH_CHUNK_BYTES;
+        chunkHashes[chunk] = HashChunk(bytesData + begin, min(HASH_CHUNK_BYTES, bytes - begin), seed + chunk);
+    }
+    uint64_t h = seed ^ bytes;
+    for (uint64_t chunkHash : chunkHashes)
+        h = MixWord(h, chunkHash);
+    return Finalize(h);
+}
+
+string DerivedCache::ArtifactPath(uint64_t key, const string &name) const
+{
+    ostringstream os;
+    os << hex << setw(16) << setfill('0') << key << "-" << name << ".bin";
+    return (fs::path(directory) / os.str()).string();
+}
+
+bool DerivedCache::Open(uint64_t key, const string &name, size_t elementBytes, MappedFile &file, const char *&payload, size_t &count) const
+{
+    const string path = ArtifactPath(key, name);
+    error_code error;
+    if (!fs::is_regular_file(path, error))
+        return false;
+    try
+    {
+        file = MappedFile(path);
+    }
+    catch (const runtime_error &e)
+    {
+        cerr << "[WARNING] " << e.what() << endl;
+        return false;
+    }
+    FileHeader header;
+    if (file.Size() < HEADER_SIZE)
+        return false;
+    memcpy(&header, file.Data(), HEADER_SIZE);
+    if (memcmp(header.magic, MAGIC, 4) != 0 || header.version != VERSION || header.key != key || header.elementBytes != elementBytes ||
+        header.count > (file.Size() - HEADER_SIZE) / max<size_t>(elementBytes, 1))
+        return false;
+    payload = file.Data() + HEADER_SIZE;
+    count = header.count;
+    // 書き込み途中で壊れたファイルを使わないよう、ペイロードのハッシュを確かめる
+    return Hash(payload, count * elementBytes) == header.payloadHash;
+}
+
+bool DerivedCache::StoreRaw(uint64_t key, const string &name, const void *data, size_t count, size_t elementBytes) const
+{
+    const string path = ArtifactPath(key, name);
+    error_code error;
+    fs::create_directories(directory, error);
+
+    FileHeader header = {};
+    memcpy(header.magic, MAGIC, 4);
+    header.version = VERSION;
+    header.key = key;
+    header.elementBytes = elementBytes;
+    header.count = count;
+    header.payloadHash = Hash(data, count * elementBytes);
+
+    // 読み込み中の他のプロセスが途中のファイルを見ないよう、一時ファイルに書いてから置き換える
+    const string temporary = path + ".tmp";
+    {
+        ofstream os(temporary, ios::binary | ios::trunc);
+        os.write(reinterpret_cast<const char *>(&header), HEADER_SIZE);
+        os.write(static_cast<const char *>(data), count * elementBytes);
+        if (!os)
+        {
+            cerr << "[WARNING] Failed to write derived cache: " << temporary << endl;
+            os.close();
+            fs::remove(temporary, error);
+            return false;
+        }
+    }
+    fs::rename(temporary, path, error);
+    if (error)
+    {
+        cerr << "[WARNING] Failed to store derived cache: " << path << ": " << error.message() << endl;
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+/// @brief 自前で確保した配列か、派生データのキャッシュファイル(DerivedCache::Map())のマップ領域をコピーせずに参照する配列
+/// @details マップ領域はコピーオンライトなので、書き換えてもキャッシュファイルは変わらない
+template <typename T>
+class CachedArray
+{
+private:
+    std::vector<T> storage; // 自前で確保した場合の実体
+    MappedFile file;        // マップ領域を参照する場合のファイル
+    T *values = nullptr;
+    size_t count = 0;
+
+public:
+    CachedArray() = default;
+    CachedArray(std::vector<T> &&_storage)
+        : storage(std::move(_storage)), values(storage.data()), count(storage.size())
+    {
+    }
+    /// @brief fileの中のvaluesからcount個を参照する
+    CachedArray(MappedFile &&_file, T *_values, size_t _count)
+        : file(std::move(_file)), values(_values), count(_count)
+    {
+    }
+    // vectorのムーブでも確保済み領域のアドレスは変わらないので、valuesはそのまま使える
+    CachedArray(CachedArray &&other) noexcept { *this = std::move(other); }
+    CachedArray &operator=(CachedArray &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        storage = std::move(other.storage);
+        file = std::move(other.file);
+        values = other.values;
+        count = other.count;
+        other.values = nullptr;
+        other.count = 0;
+        return *this;
+    }
+    CachedArray(const CachedArray &) = delete;
+    CachedArray &operator=(const CachedArray &) = delete;
+
+    T *data() { return values; }
+    const T *data() const { return values; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    T &operator[](size_t index) { return values[index]; }
+    const T &operator[](size_t index) const { return values[index]; }
+    const T *begin() const { return values; }
+    const T *end() const { return values + count; }
+    /// @brief キャッシュファイルのマップ領域を参照しているか
+    bool IsMapped() const { return file.IsOpen(); }
+};
+
+/// @brief ボリュームから作った派生データ(点群の頂点、軸ソート済みインデックス、クラスタID、ミップピラミッドなど)のディスクキャッシュ
+/// @details 派生データは「ボリュームの内容ハッシュ」と「名前(生成パラメータとアルゴリズムの版を含む)」で識別し、
+/// ディレクトリ内の1ファイル(<ハッシュ>-<名前>.bin)に保存する。ファイルは48バイトのヘッダと要素の配列からなり、
+/// メモリマップしてそのまま配列として読める。
+/// | offset | 型       | 内容                        |
+/// |--------|----------|-----------------------------|
+/// | 0      | char[4]  | マジック "GLVC"             |
+/// | 4      | uint32   | バージョン(1)               |
+/// | 8      | uint64   | ボリュームの内容ハッシュ    |
+/// | 16     | uint64   | 要素のバイト数              |
+/// | 24     | uint64   | 要素数                      |
+/// | 32     | uint64   | ペイロードのハッシュ        |
+/// | 40     | uint64   | 予約                        |
+/// | 48     | 要素の配列                             |
+/// キャッシュは同じマシンで使うものなので、ホストのバイト順で書き込む。
+/// 壊れた・古い形式のファイルは読み込みに失敗したものとして扱い、作り直して上書きする。
+class DerivedCache
+{
+private:
+    std::string directory;
+
+    std::string ArtifactPath(uint64_t key, const std::string &name) const;
+    /// @brief 派生データのファイルをマップし、ヘッダを検証する
+    /// @return 有効なファイルがあればtrue。payloadはfileの中を指す
+    bool Open(uint64_t key, const std::string &name, size_t elementBytes, MappedFile &file, const char *&payload, size_t &count) const;
+    bool StoreRaw(uint64_t key, const std::string &name, const void *data, size_t count, size_t elementBytes) const;
+
+public:
+    static constexpr char MAGIC[4] = {'G', 'L', 'V', 'C'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 48;
+
+    /// @param directory キャッシュを置くディレクトリ(無ければ最初の保存時に作る)
+    explicit DerivedCache(std::string directory);
+
+    const std::string &Directory() const { return directory; }
+
+    /// @brief 高速な64bitハッシュ(1MiBごとに並列に計算して順に合成する)
+    static uint64_t Hash(const void *data, size_t bytes, uint64_t seed = 0);
+
+    /// @brief 派生データを読み込む。無いか壊れていればfalse
+    template <typename T>
+    bool Load(uint64_t key, const std::string &name, std::vector<T> &values) const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cached elements must be trivially copyable");
+        MappedFile file;
+        const char *payload = nullptr;
+        size_t count = 0;
+        if (!Open(key, name, sizeof(T), file, payload, count))
+            return false;
+        values.resize(count);
+        std::memcpy(values.data(), payload, count * sizeof(T));
+        return true;
+    }
+    /// @brief 派生データをコピーせずにマップしたまま読み込む。無いか壊れていればfalse
+    /// @details ミップピラミッドや点群のように大きく、読み込んだ後は読むだけのデータに使う
+    template <typename T>
+    bool Map(uint64_t key, const std::string &name, CachedArray<T> &values) const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cached elements must be trivially copyable");
+        MappedFile file;
+        const char *payload = nullptr;
+        size_t count = 0;
+        if (!Open(key, name, sizeof(T), file, payload, count))
+            return false;
+        // ヘッダは48バイトなので、ページ境界から始まるマップ領域の中で要素は16バイト境界に揃う
+        T *mapped = reinterpret_cast<T *>(file.Data() + (payload - file.Data()));
+        values = CachedArray<T>(std::move(file), mapped, count);
+        return true;
+    }
+    /// @brief 要素数がcountの派生データをvaluesへ読み込む。無いか壊れているか要素数が違えばfalse
+    template <typename T>
+    bool Load(uint64_t key, const std::string &name, T *values, size_t count) const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cached elements must be trivially copyable");
+        MappedFile file;
+        const char *payload = nullptr;
+        size_t stored = 0;
+        if (!Open(key, name, sizeof(T), file, payload, stored) || stored != count)
+            return false;
+        std::memcpy(values, payload, count * sizeof(T));
+        return true;
+    }
+
+    /// @brief 派生データを保存する。失敗した場合は警告を出してfalseを返す(キャッシュが無くても動作は変わらない)
+    template <typename T>
+    bool Store(uint64_t key, const std::string &name, const T *values, size_t count) const
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "cached elements must be trivially copyable");
+        return StoreRaw(key, name, values, count, sizeof(T));
+    }
+    template <typename T>
+    bool Store(uint64_t key, const std::string &name, const std::vector<T> &values) const
+    {
+        return Store(key, name, values.data(), values.size());
+    }
+};
@@ -0,0 +1,195 @@
+#include "DistanceField.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Volume.hpp"
+
+using namespace std;
+
+namespace
+{
+    /// 16bitで飽和させた2乗距離の「遠い(占有ボクセルが無い)」値
+    constexpr uint16_t farSquared = numeric_limits<uint16_t>::max();
+    static_assert(farSquared > maxFieldDistance * maxFieldDistance, "saturated squared distance must exceed the largest stored distance");
+
+    /// @brief 1次元の2乗距離変換 d(p) = min_q (f(q) + (p - q)^2)。放物線の下側包絡線を求めてから各点で評価する
+    /// @param f 入力(count要素)
+    /// @param d 出力(count要素)
+    /// @param vertices, boundaries 作業領域(count要素とcount + 1要素)
+    void SquaredDistance1D(const float *f, float *d, size_t count, int *vertices, float *boundaries)
+    {
+        const int n = static_cast<int>(count);
+        // 放物線qとvの交点の位置
+        const auto intersection = [f](int q, int v)
+        { return ((f[q] + static_cast<float>(q) * q) - (f[v] + static_cast<float>(v) * v)) / (2.0f * (q - v)); };
+        int k = 0;
+        vertices[0] = 0;
+        boundaries[0] = numeric_limits<float>::lowest();
+        boundaries[1] = numeric_limits<float>::max();
+        for (int q = 1; q < n; ++q)
+        {
+            float s = intersection(q, vertices[k]);
+            while (s <= boundaries[k])
+            {
+                --k;
+                s = intersection(q, vertices[k]);
+            }
+            ++k;
+            vertices[k] = q;
+            boundaries[k] = s;
+            boundaries[k + 1] = numeric_limits<float>::max();
+        }
+        k = 0;
+        for (int q = 0; q < n; ++q)
+        {
+            while (boundaries[k + 1] < q)
+                ++k;
+            const float distance = static_cast<float>(q - vertices[k]);
+            d[q] = f[vertices[k]] + distance * distance;
+        }
+    }
+}
+
+template <typename T>
+VoxelGrid<uint8_t> ComputeDistanceField(const VoxelGrid<T> &source, float threshold, const atomic<bool> *cancel)
+{
+    const size_t nx = source.SizeX(), ny = source.SizeY(), nz = source.SizeZ();
+    if (source.Empty())
+        return VoxelGrid<uint8_t>();
+    const auto cancelled = [cancel]
+    { return cancel && cancel->load(memory_order_relaxed); };
+
+    // 幅方向: 占有ボクセルまでの1次元距離を前後から走査して求める
+    VoxelGrid<uint16_t> squared(nx, ny, nz);
+    const long long rows = static_cast<long long>(nx * ny);
+#pragma omp parallel for schedule(static)
+    for (long long row = 0; row < rows; ++row)
+    {
+        if (cancelled())
+            continue;
+        const T *values = &source(static_cast<size_t>(row) / ny, static_cast<size_t>(row) % ny, 0);
+        uint16_t *out = &squared(static_cast<size_t>(row) / ny, static_cast<size_t>(row) % ny, 0);
+        size_t distance = maxFieldDistance + 1;
+        for (size_t z = 0; z < nz; ++z)
+        {
+            distance = VoxelTraits<T>::Normalize(values[z]) > threshold ? 0 : min<size_t>(distance + 1, maxFieldDistance + 1);
+            out[z] = static_cast<uint16_t>(distance);
+        }
+        distance = maxFieldDistance + 1;
+        for (size_t z = nz; z-- > 0;)
+        {
+            distance = out[z] == 0 ? 0 : min<size_t>(distance + 1, maxFieldDistance + 1);
+            const size_t nearest = min<size_t>(out[z], distance);
+            out[z] = nearest > maxFieldDistance ? farSquared : static_cast<uint16_t>(nearest * nearest);
+        }
+    }
+    if (cancelled())
+        return VoxelGrid<uint8_t>();
+
+    // 高さ方向: x平面ごとに列を取り出して変換する
+    const long long planes = static_cast<long long>(nx);
+#pragma omp parallel for schedule(dynamic)
+    for (long long plane = 0; plane < planes; ++plane)
+    {
+        if (cancelled())
+            continue;
+        const size_t x = static_cast<size_t>(plane);
+        vector<float> column(ny), transformed(ny), boundaries(ny + 1);
+        vector<int> vertices(ny);
+        for (size_t z = 0; z < nz; ++z)
+        {
+            for (size_t y = 0; y < ny; ++y)
+                column[y] = squared(x, y, z);
+            SquaredDistance1D(column.data(), transformed.data(), ny, vertices.data(), boundaries.data());
+            for (size_t y = 0; y < ny; ++y)
+                squared(x, y, z) = static_cast<uint16_t>(min(transformed[y], static_cast<float>(farSquared)));
+        }
+    }
+    if (cancelled())
+        return VoxelGrid<uint8_t>();
+
+    // 奥行き方向: 高さごとに列を取り出して変換し、距離にして格納する
+    VoxelGrid<uint8_t> field(nx, ny, nz);
+    const long long heights = static_cast<long long>(ny);
+#pragma omp parallel for schedule(dynamic)
+    for (long long height = 0; height < heights; ++height)
+    {
+        if (cancelled())
+            continue;
+        const size_t y = static_cast<size_t>(height);
+        vector<float> column(nx), transformed(nx), boundaries(nx + 1);
+        vector<int> vertices(nx);
+        for (size_t z = 0; z < nz; ++z)
+        {
+            for (size_t x = 0; x < nx; ++x)
+                column[x] = squared(x, y, z);
+            SquaredDistance1D(column.data(), transformed.data(), nx, vertices.data(), boundaries.data());
+            for (size_t x = 0; x < nx; ++x)
+                field(x, y, z) = static_cast<uint8_t>(min(floor(sqrt(transformed[x])), static_cast<float>(maxFieldDistance)));
+        }
+    }
+    if (cancelled())
+        return VoxelGrid<uint8_t>();
+    return field;
+}
+
+DistanceFieldBuilder::~DistanceFieldBuilder()
+{
+    Cancel();
+}
+
+void DistanceFieldBuilder::Request(const VolumeBase &volume, float threshold)
+{
+    if (requestedSource == &volume && requestedThreshold == threshold)
+        return;
+    Cancel();
+    requestedSource = &volume;
+    requestedThreshold = threshold;
+    cancelRequested = false;
+    building = true;
+    worker = thread(&DistanceFieldBuilder::Run, this, &volume, threshold);
+}
+
+void DistanceFieldBuilder::Cancel()
+{
+    if (worker.joinable())
+    {
+        cancelRequested = true;
+        worker.join();
+    }
+    building = false;
+    requestedSource = nullptr;
+    lock_guard<std::mutex> lock(mutex);
+    result.reset();
+}
+
+optional<DistanceFieldBuilder::Result> DistanceFieldBuilder::Poll()
+{
+    if (building)
+        return nullopt;
+    if (worker.joinable())
+        worker.join();
+    lock_guard<std::mutex> lock(mutex);
+    optional<Result> finished = std::move(result);
+    result.reset();
+    return finished;
+}
+
+void DistanceFieldBuilder::Run(const VolumeBase *volume, float threshold)
+{
+    VoxelGrid<uint8_t> field = VisitVolume(*volume, [&](const auto &typed)
+                                           { return ComputeDistanceField(typed.intencity, threshold, &cancelRequested); });
+    if (!cancelRequested && !field.Empty())
+    {
+        lock_guard<std::mutex> lock(mutex);
+        result = Result{std::move(field), threshold, volume};
+    }
+    building = false;
+}
+
+template VoxelGrid<uint8_t> ComputeDistanceField<uint8_t>(const VoxelGrid<uint8_t> &, float, const atomic<bool> *);
+template VoxelGrid<uint8_t> ComputeDistanceField<uint16_t>(const VoxelGrid<uint16_t> &, float, const atomic<bool> *);
+template VoxelGrid<uint8_t> ComputeDistanceField<Half>(const VoxelGrid<Half> &, float, const atomic<bool> *);
+template VoxelGrid<uint8_t> ComputeDistanceField<float>(const VoxelGrid<float> &, float, const atomic<bool> *);
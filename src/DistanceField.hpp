@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+class VolumeBase;
+
+/// 距離場が保持できる最大の距離[ボクセル]。これ以上離れたボクセルもこの値になる
+constexpr uint8_t maxFieldDistance = 255;
+
+/// @brief 各ボクセルから、正規化した値がthresholdを超える(占有された)最も近いボクセルまでのユークリッド距離を求める
+/// @details 距離はボクセル中心間の距離[ボクセル]を切り捨ててmaxFieldDistanceで飽和させた値で、実際の距離以下になる(レイを進めても占有ボクセルを越えない)。
+/// 幅・高さ・奥行きの順に1次元の距離変換を3回行う分離可能な厳密な変換(下側包絡線)で、各パスは行・列ごとに並列化する。
+/// 途中の2乗距離は16bitで飽和させる(飽和値はmaxFieldDistanceの2乗より大きいので結果は変わらない)
+/// @param cancel nullptrでなく、計算中にtrueになったら中断して空のグリッドを返す
+template <typename T>
+VoxelGrid<uint8_t> ComputeDistanceField(const VoxelGrid<T> &source, float threshold, const std::atomic<bool> *cancel = nullptr);
+
+/// @brief 距離場をバックグラウンドで作るクラス
+/// @details 閾値が変わるたびにRequest()で作り直しを要求し、描画スレッドはPoll()で完成した距離場を受け取ってテクスチャへ転送する。
+/// 作り直し中に次の要求が来た場合は、途中の計算を中断して新しい閾値で作り直す。
+/// ワーカーはボリュームを参照するので、ボリュームを破棄・入れ替える前にCancel()を呼ぶこと
+class DistanceFieldBuilder
+{
+public:
+    /// @brief 完成した距離場と、作った時の閾値・ボリューム
+    struct Result
+    {
+        VoxelGrid<uint8_t> field;
+        float threshold = 0.0f;
+        const VolumeBase *source = nullptr;
+    };
+
+private:
+    std::thread worker;
+    std::atomic<bool> cancelRequested{false};
+    std::atomic<bool> building{false};
+    std::mutex mutex; // resultを保護する
+    std::optional<Result> result;
+    const VolumeBase *requestedSource = nullptr;
+    float requestedThreshold = 0.0f;
+
+    void Run(const VolumeBase *volume, float threshold);
+
+public:
+    DistanceFieldBuilder() = default;
+    ~DistanceFieldBuilder();
+    DistanceFieldBuilder(const DistanceFieldBuilder &) = delete;
+    DistanceFieldBuilder &operator=(const DistanceFieldBuilder &) = delete;
+
+    /// @brief volumeの距離場を閾値thresholdで作り始める。同じボリューム・閾値を要求済みなら何もしない
+    void Request(const VolumeBase &volume, float threshold);
+    /// @brief 作り直しを中断する。ワーカーの終了を待つ
+    void Cancel();
+    /// @brief 距離場が完成していれば受け取る
+    std::optional<Result> Poll();
+    bool IsBuilding() const { return building.load(); }
+};
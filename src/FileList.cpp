@@ -0,0 +1,88 @@
+#include "FileList.hpp"
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+bool MatchWildcard(const char *pattern, const char *name)
+{
+    if (*pattern == '\0')
+        return *name == '\0';
+    if (*pattern == '*')
+        return MatchWildcard(pattern + 1, name) || (*name != '\0' && MatchWildcard(pattern, name + 1));
+    if (*name == '\0')
+        return false;
+    return (*pattern == '?' || *pattern == *name) && MatchWildcard(pattern + 1, name + 1);
+}
+
+bool NaturalLess(const string &a, const string &b)
+{
+    size_t i = 0, j = 0;
+    while (i < a.size() && j < b.size())
+    {
+        if (isdigit(static_cast<unsigned char>(a[i])) && isdigit(static_cast<unsigned char>(b[j])))
+        {
+            // 先頭の0を飛ばし、桁数、数字列の順に比べる
+            while (i < a.size() && a[i] == '0')
+                i++;
+            while (j < b.size() && b[j] == '0')
+                j++;
+            size_t endA = i, endB = j;
+            while (endA < a.size() && isdigit(static_cast<unsigned char>(a[endA])))
+                endA++;
+            while (endB < b.size() && isdigit(static_cast<unsigned char>(b[endB])))
+                endB++;
+            if (endA - i != endB - j)
+                return endA - i < endB - j;
+            const int order = a.compare(i, endA - i, b, j, endB - j);
+            if (order != 0)
+                return order < 0;
+            i = endA;
+            j = endB;
+            continue;
+        }
+        if (a[i] != b[j])
+            return a[i] < b[j];
+        i++;
+        j++;
+    }
+    return a.size() - i < b.size() - j;
+}
+
+bool HasExtension(const string &path, const vector<string> &extensions)
+{
+    string extension = fs::path(path).extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c)
+              { return static_cast<char>(tolower(c)); });
+    return find(extensions.begin(), extensions.end(), extension) != extensions.end();
+}
+
+vector<string> ListFiles(const string &pattern, const vector<string> &extensions)
+{
+    fs::path directory(pattern);
+    string filePattern = "*";
+    if (!fs::is_directory(directory))
+    {
+        filePattern = directory.filename().string();
+        directory = directory.has_parent_path() ? directory.parent_path() : fs::path(".");
+    }
+
+    vector<string> files;
+    error_code error;
+    for (const fs::directory_entry &entry : fs::directory_iterator(directory, error))
+    {
+        if (!entry.is_regular_file())
+            continue;
+        const string name = entry.path().filename().string();
+        // ディレクトリ指定なら指定した拡張子のファイルのみ、ワイルドカード指定なら一致したもの全て
+        if (filePattern == "*" ? HasExtension(name, extensions) : MatchWildcard(filePattern.c_str(), name.c_str()))
+            files.push_back(entry.path().string());
+    }
+    if (error)
+        throw runtime_error("Failed to list " + directory.string() + ": " + error.message());
+    sort(files.begin(), files.end(), NaturalLess);
+    return files;
+}
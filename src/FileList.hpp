@@ -0,0 +1,19 @@
+#pragma once
+#include <string>
+#include <vector>
+
+/// @brief ファイル名がワイルドカード(*は任意の文字列、?は任意の1文字)に一致するか
+bool MatchWildcard(const char *pattern, const char *name);
+
+/// @brief 数字の部分を数値として比較する(frame_2 < frame_10)
+bool NaturalLess(const std::string &a, const std::string &b);
+
+/// @brief ディレクトリ内の指定した拡張子のファイル、またはファイル名のワイルドカード(*, ?)に一致するファイルを列挙する
+/// @details 数字の部分は数値として比較した順に並べる。ディレクトリを列挙できなければstd::runtime_errorを投げる
+/// @param pattern ディレクトリ、またはワイルドカードを含むパス
+/// @param extensions ディレクトリを指定した場合に列挙する拡張子(".dat"など)
+/// @return 一致したファイル。1つも無ければ空
+std::vector<std::string> ListFiles(const std::string &pattern, const std::vector<std::string> &extensions);
+
+/// @brief パスの拡張子(小文字)がextensionsのどれかか
+bool HasExtension(const std::string &path, const std::vector<std::string> &extensions);
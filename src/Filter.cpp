@@ -0,0 +1,349 @@
+#include "Filter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+namespace
+{
+    /// y, x方向のフィルタで一度に扱うz方向の帯の幅。作業領域の1行が数キャッシュラインに収まり、行の計算はベクトル化できる
+    constexpr size_t filterBlockWidth = 64;
+
+    /// @brief ボクセル値を計算用の型にする
+    template <typename T, typename W>
+    W ToWork(T value)
+    {
+        if constexpr (is_same_v<T, W>)
+            return value;
+        else if constexpr (is_same_v<T, Half>)
+            return value.ToFloat();
+        else
+            return static_cast<W>(value);
+    }
+
+    /// @brief 計算用の型からボクセル値に戻す(整数型は丸めて範囲に収める)
+    template <typename T, typename W>
+    T FromWork(W value)
+    {
+        if constexpr (is_same_v<T, W>)
+            return value;
+        else if constexpr (is_same_v<T, Half>)
+            return Half::FromFloat(value);
+        else
+            return static_cast<T>(clamp(value + 0.5f, 0.0f, static_cast<float>(numeric_limits<T>::max())));
+    }
+
+    template <typename T, typename W>
+    void LoadRow(const T *source, W *row, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            row[i] = ToWork<T, W>(source[i]);
+    }
+
+    /// @brief 計算結果の行をボクセル値に戻してdestinationに書く。値が変わったならtrue
+    template <typename T, typename W>
+    bool StoreRow(const W *result, T *destination, size_t n, T *row)
+    {
+        for (size_t i = 0; i < n; ++i)
+            row[i] = FromWork<T, W>(result[i]);
+        if (memcmp(row, destination, n * sizeof(T)) == 0)
+            return false;
+        copy(row, row + n, destination);
+        return true;
+    }
+
+    // 以下の行の計算は、inに端を伸ばしたcount + 2 * radius行(1行width個)、outにcount行を持つ
+
+    /// @brief 重み付きの和。out[i][j] = Σ_k weights[k] * in[i + k][j]。連続した添字の内側のループはベクトル化される
+    void WeightedLines(const float *in, float *out, size_t count, size_t width, const vector<float> &weights)
+    {
+        const size_t n = count * width;
+        fill(out, out + n, 0.0f);
+        for (size_t k = 0; k < weights.size(); ++k)
+        {
+            const float weight = weights[k];
+            const float *shifted = in + k * width;
+            for (size_t i = 0; i < n; ++i)
+                out[i] += weight * shifted[i];
+        }
+    }
+
+    /// @brief 窓の平均。窓の和を1行ずつずらして更新するので、半径によらず1ボクセルあたり加減算2回で済む
+    void BoxLines(const float *in, float *out, size_t count, size_t width, int radius)
+    {
+        const size_t window = 2 * static_cast<size_t>(radius) + 1;
+        fill(out, out + width, 0.0f);
+        for (size_t k = 0; k < window; ++k)
+            for (size_t j = 0; j < width; ++j)
+                out[j] += in[k * width + j];
+        for (size_t i = 1; i < count; ++i)
+        {
+            const float *removed = in + (i - 1) * width, *added = in + (i + window - 1) * width;
+            const float *previous = out + (i - 1) * width;
+            float *current = out + i * width;
+            for (size_t j = 0; j < width; ++j)
+                current[j] = previous[j] + added[j] - removed[j];
+        }
+        const float scale = 1.0f / static_cast<float>(window);
+        for (size_t i = 0; i < count * width; ++i)
+            out[i] *= scale;
+    }
+
+    /// @brief 8bitのメディアン。窓のヒストグラム(16段ずつまとめた粗い段と256段)を1行ずつずらして更新する
+    /// @details 中央値は粗い段を数えて含まれる段を決めてから、その中の16段を数えて求めるので、値が大きく跳んでも1ボクセルあたり高々32段で済む
+    void MedianLines(const uint8_t *in, uint8_t *out, size_t count, size_t width, int radius)
+    {
+        const size_t window = 2 * static_cast<size_t>(radius) + 1;
+        const uint32_t half = static_cast<uint32_t>(radius);
+        for (size_t j = 0; j < width; ++j)
+        {
+            uint32_t coarse[16] = {}, fine[256] = {};
+            for (size_t k = 0; k < window; ++k)
+            {
+                const uint8_t value = in[k * width + j];
+                ++coarse[value >> 4];
+                ++fine[value];
+            }
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (i > 0)
+                {
+                    const uint8_t removed = in[(i - 1) * width + j], added = in[(i + window - 1) * width + j];
+                    --coarse[removed >> 4];
+                    --fine[removed];
+                    ++coarse[added >> 4];
+                    ++fine[added];
+                }
+                // 小さい方からhalf番目(0始まり)の値
+                uint32_t below = 0;
+                int bucket = 0;
+                while (below + coarse[bucket] <= half)
+                    below += coarse[bucket++];
+                int median = bucket << 4;
+                while (below + fine[median] <= half)
+                    below += fine[median++];
+                out[i * width + j] = static_cast<uint8_t>(median);
+            }
+        }
+    }
+
+    /// @brief メディアンの窓の並び。NaNは<では全順序にならず整列が壊れるので、どの値よりも大きいものとして末尾に置く
+    template <typename W>
+    bool MedianLess(const W &a, const W &b)
+    {
+        if constexpr (is_floating_point_v<W>)
+            return !std::isnan(a) && (std::isnan(b) || a < b);
+        else
+            return a < b;
+    }
+
+    /// @brief 8bit以外のメディアン。整列した窓から出ていく値を取り除き、入ってくる値を挿入する
+    template <typename W>
+    void MedianLines(const W *in, W *out, size_t count, size_t width, int radius)
+    {
+        const size_t window = 2 * static_cast<size_t>(radius) + 1;
+        const auto less = [](const W &a, const W &b)
+        { return MedianLess(a, b); };
+        vector<W> sorted(window);
+        for (size_t j = 0; j < width; ++j)
+        {
+            for (size_t k = 0; k < window; ++k)
+                sorted[k] = in[k * width + j];
+            sort(sorted.begin(), sorted.end(), less);
+            out[j] = sorted[radius];
+            for (size_t i = 1; i < count; ++i)
+            {
+                const W removed = in[(i - 1) * width + j], added = in[(i + window - 1) * width + j];
+                size_t pos = lower_bound(sorted.begin(), sorted.end(), removed, less) - sorted.begin();
+                // 同じ順位の値(NaNどうし、+0と-0)が並んでいる場合はビット列の一致する方を探す
+                if (pos == window || memcmp(&sorted[pos], &removed, sizeof(W)) != 0)
+                    pos = find_if(sorted.begin(), sorted.end(), [&](const W &value)
+                                  { return memcmp(&value, &removed, sizeof(W)) == 0; }) -
+                          sorted.begin();
+                // 取り除いた位置から、加える値が収まる位置まで詰める
+                while (pos > 0 && less(added, sorted[pos - 1]))
+                {
+                    sorted[pos] = sorted[pos - 1];
+                    --pos;
+                }
+                while (pos + 1 < window && less(sorted[pos + 1], added))
+                {
+                    sorted[pos] = sorted[pos + 1];
+                    ++pos;
+                }
+                sorted[pos] = added;
+                out[i * width + j] = sorted[radius];
+            }
+        }
+    }
+
+    /// @brief 1次元のフィルタをz, y, xの順に当てる。Wは計算用の型
+    template <typename T, typename W>
+    void FilterAxes(VoxelGrid<T> &grid, const FilterSettings &settings, vector<uint8_t> &changed)
+    {
+        const size_t nx = grid.SizeX(), ny = grid.SizeY(), nz = grid.SizeZ();
+        const int radius = settings.radius;
+        const size_t r = static_cast<size_t>(radius);
+        const vector<float> weights = settings.kind == FilterKind::Gaussian ? GaussianWeights(radius, settings.sigma) : vector<float>();
+        const auto filterLines = [&](const W *in, W *out, size_t count, size_t width)
+        {
+            if constexpr (is_same_v<W, float>)
+            {
+                if (settings.kind == FilterKind::Gaussian)
+                    return WeightedLines(in, out, count, width, weights);
+                if (settings.kind == FilterKind::Box)
+                    return BoxLines(in, out, count, width, radius);
+            }
+            MedianLines(in, out, count, width, radius);
+        };
+        const auto clampIndex = [&](size_t i, size_t size)
+        { return i < r ? 0 : min(i - r, size - 1); };
+
+        // z方向: 行は連続しているので、端を伸ばした行をそのまま計算する
+#pragma omp parallel for schedule(static)
+        for (long long x = 0; x < static_cast<long long>(nx); ++x)
+        {
+            vector<W> padded(nz + 2 * r), out(nz);
+            vector<T> row(nz);
+            for (size_t y = 0; y < ny; ++y)
+            {
+                T *line = &grid(x, y, 0);
+                LoadRow(line, padded.data() + r, nz);
+                fill(padded.begin(), padded.begin() + r, padded[r]);
+                fill(padded.begin() + r + nz, padded.end(), padded[r + nz - 1]);
+                filterLines(padded.data(), out.data(), nz, 1);
+                if (StoreRow(out.data(), line, nz, row.data()))
+                    changed[x] = 1;
+            }
+        }
+
+        // y方向: x平面ごとに、z方向の帯の各行を集めてから行単位で計算する
+#pragma omp parallel for schedule(static)
+        for (long long x = 0; x < static_cast<long long>(nx); ++x)
+        {
+            vector<W> tile((ny + 2 * r) * filterBlockWidth), out(ny * filterBlockWidth);
+            vector<T> row(filterBlockWidth);
+            for (size_t z0 = 0; z0 < nz; z0 += filterBlockWidth)
+            {
+                const size_t width = min(filterBlockWidth, nz - z0);
+                for (size_t i = 0; i < ny + 2 * r; ++i)
+                    LoadRow(&grid(x, clampIndex(i, ny), z0), tile.data() + i * width, width);
+                filterLines(tile.data(), out.data(), ny, width);
+                for (size_t y = 0; y < ny; ++y)
+                    if (StoreRow(out.data() + y * width, &grid(x, y, z0), width, row.data()))
+                        changed[x] = 1;
+            }
+        }
+
+        // x方向: y行ごとに、各x平面の同じ帯を集めてから行単位で計算する。変わった平面はy行ごとに記録して後で合わせる
+        vector<vector<uint8_t>> rowChanged(ny);
+#pragma omp parallel for schedule(static)
+        for (long long y = 0; y < static_cast<long long>(ny); ++y)
+        {
+            vector<uint8_t> &flags = rowChanged[y];
+            flags.assign(nx, 0);
+            vector<W> tile((nx + 2 * r) * filterBlockWidth), out(nx * filterBlockWidth);
+            vector<T> row(filterBlockWidth);
+            for (size_t z0 = 0; z0 < nz; z0 += filterBlockWidth)
+            {
+                const size_t width = min(filterBlockWidth, nz - z0);
+                for (size_t i = 0; i < nx + 2 * r; ++i)
+                    LoadRow(&grid(clampIndex(i, nx), y, z0), tile.data() + i * width, width);
+                filterLines(tile.data(), out.data(), nx, width);
+                for (size_t x = 0; x < nx; ++x)
+                    if (StoreRow(out.data() + x * width, &grid(x, y, z0), width, row.data()))
+                        flags[x] = 1;
+            }
+        }
+        for (const vector<uint8_t> &flags : rowChanged)
+            for (size_t x = 0; x < nx; ++x)
+                changed[x] |= flags[x];
+    }
+}
+
+const char *FilterKindName(FilterKind kind)
+{
+    switch (kind)
+    {
+    case FilterKind::Box:
+        return "box";
+    case FilterKind::Median:
+        return "median";
+    case FilterKind::Gaussian:
+    default:
+        return "gaussian";
+    }
+}
+
+FilterSettings ParseFilterSettings(const string &text)
+{
+    FilterSettings settings;
+    const size_t first = text.find(':');
+    const string kind = text.substr(0, first);
+    if (kind == "gaussian")
+        settings.kind = FilterKind::Gaussian;
+    else if (kind == "box")
+        settings.kind = FilterKind::Box;
+    else if (kind == "median")
+        settings.kind = FilterKind::Median;
+    else
+        throw runtime_error("Unknown filter: " + kind + " (gaussian, box, median)");
+    if (first == string::npos)
+        return settings;
+    const size_t second = text.find(':', first + 1);
+    try
+    {
+        settings.radius = stoi(text.substr(first + 1, second == string::npos ? string::npos : second - first - 1));
+        if (second != string::npos)
+            settings.sigma = stof(text.substr(second + 1));
+    }
+    catch (const exception &)
+    {
+        throw runtime_error("Invalid filter parameters: " + text);
+    }
+    if (settings.radius < 1)
+        throw runtime_error("Filter radius must be at least 1: " + text);
+    if (second != string::npos && settings.kind != FilterKind::Gaussian)
+        throw runtime_error("Sigma is only used by the gaussian filter: " + text);
+    return settings;
+}
+
+vector<float> GaussianWeights(int radius, float sigma)
+{
+    if (sigma <= 0.0f)
+        sigma = max(radius, 1) * 0.5f;
+    vector<float> weights(2 * max(radius, 0) + 1);
+    float sum = 0.0f;
+    for (int k = -radius; k <= radius; ++k)
+    {
+        weights[k + radius] = exp(-static_cast<float>(k * k) / (2.0f * sigma * sigma));
+        sum += weights[k + radius];
+    }
+    for (float &weight : weights)
+        weight /= sum;
+    return weights;
+}
+
+template <typename T>
+vector<uint8_t> ApplyFilter(VoxelGrid<T> &grid, const FilterSettings &settings)
+{
+    vector<uint8_t> changed(grid.SizeX(), 0);
+    if (grid.Empty() || settings.radius < 1)
+        return changed;
+    // メディアンは値を並べ替えるだけなので元の型のまま扱う(Halfは比較のためfloatにする)
+    using MedianWork = conditional_t<is_same_v<T, Half>, float, T>;
+    if (settings.kind == FilterKind::Median)
+        FilterAxes<T, MedianWork>(grid, settings, changed);
+    else
+        FilterAxes<T, float>(grid, settings, changed);
+    return changed;
+}
+
+template vector<uint8_t> ApplyFilter(VoxelGrid<uint8_t> &, const FilterSettings &);
+template vector<uint8_t> ApplyFilter(VoxelGrid<uint16_t> &, const FilterSettings &);
+template vector<uint8_t> ApplyFilter(VoxelGrid<Half> &, const FilterSettings &);
+template vector<uint8_t> ApplyFilter(VoxelGrid<float> &, const FilterSettings &);
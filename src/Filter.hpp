@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+/// @brief 平滑化フィルタの種類
+enum class FilterKind
+{
+    Gaussian, // ガウシアン(重み付きの和)
+    Box,      // 箱型(窓の平均。半径によらず1ボクセルあたり一定の手間)
+    Median,   // メディアン(軸ごとの1次元メディアンを順に当てる)
+};
+
+/// @brief 平滑化フィルタの設定(コマンドラインの--filter)
+struct FilterSettings
+{
+    FilterKind kind = FilterKind::Gaussian;
+    /// 各軸の窓の半径(窓の幅は2 * radius + 1)
+    int radius = 2;
+    /// ガウシアンの標準偏差[ボクセル]。0以下ならradius / 2
+    float sigma = 0.0f;
+};
+
+/// @brief フィルタの名前("gaussian", "box", "median")
+const char *FilterKindName(FilterKind kind);
+/// @brief "kind[:radius[:sigma]]"(例: "gaussian:3:1.5", "median:1")を解釈する。半径の既定は2。不正ならstd::runtime_errorを投げる
+FilterSettings ParseFilterSettings(const std::string &text);
+/// @brief ガウシアンの正規化した重み(2 * radius + 1個)
+std::vector<float> GaussianWeights(int radius, float sigma);
+
+/// @brief 分離可能な平滑化フィルタをgridにその場で適用する
+/// @details z, y, xの順に1次元のフィルタを当てる(ボリュームの外は端の値が続くとみなす)。y, x方向はz方向に数十ボクセルの帯に区切り、
+/// 帯の行を作業領域に集めてから行単位(z方向に連続)で計算するので、大きなストライドでメモリを走査しない。
+/// zとyはx平面ごとに、xはy行ごとに並列化する。ガウシアンと箱型はfloatで計算し、整数型は軸ごとに丸める。
+/// メディアンは8bitなら256段のヒストグラムを窓とともにずらして求め、それ以外は整列した窓に出し入れして求める
+/// @return x平面ごとに、値が変わったなら1
+template <typename T>
+std::vector<uint8_t> ApplyFilter(VoxelGrid<T> &grid, const FilterSettings &settings);
@@ -0,0 +1,94 @@
+#include "Gradient.hpp"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    inline float ToFloat(uint8_t v) { return v; }
+    inline float ToFloat(uint16_t v) { return v; }
+    inline float ToFloat(Half v) { return v.ToFloat(); }
+    inline float ToFloat(float v) { return v; }
+
+    template <typename T>
+    void LoadRow(const T *row, size_t count, float *out)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = ToFloat(row[i]);
+    }
+
+    /// @brief 近傍の行から中心差分を取り、長さ127に正規化した3成分を書き出す
+    /// @details 各行は重ならないので__restrictで伝え、分岐なしの1本のループにして自動ベクトル化させる
+    /// @param center 中心の行(幅方向の端を繰り返して前後に1要素ずつ余分に持つ、count + 2要素)
+    void NormalizedDifferenceRow(const float *__restrict center, const float *__restrict below, const float *__restrict above,
+                                 const float *__restrict back, const float *__restrict front, size_t count,
+                                 float scaleWidth, float scaleHeight, float scaleDepth,
+                                 float *__restrict gradWidth, float *__restrict gradHeight, float *__restrict gradDepth)
+    {
+        for (size_t z = 0; z < count; ++z)
+        {
+            const float gw = (center[z + 2] - center[z]) * scaleWidth;
+            const float gh = (above[z] - below[z]) * scaleHeight;
+            const float gd = (front[z] - back[z]) * scaleDepth;
+            const float length2 = gw * gw + gh * gh + gd * gd;
+            // 平坦(長さ0)なら成分がすべて0なので、微小量を足して割ってもそのまま0になる
+            const float scale = 127.0f / sqrt(length2 + 1e-30f);
+            gradWidth[z] = gw * scale;
+            gradHeight[z] = gh * scale;
+            gradDepth[z] = gd * scale;
+        }
+    }
+}
+
+template <typename T>
+VoxelGrid<PackedGradient> ComputeGradients(const VoxelGrid<T> &source, const atomic<bool> *cancel)
+{
+    const size_t nx = source.SizeX(), ny = source.SizeY(), nz = source.SizeZ();
+    VoxelGrid<PackedGradient> result(nx, ny, nz);
+    if (source.Empty())
+        return result;
+    // テクスチャ座標あたりの変化にするため、差分に軸の解像度を掛ける(共通の1/2は向きに影響しないので省く)
+    const float scaleWidth = static_cast<float>(nz), scaleHeight = static_cast<float>(ny), scaleDepth = static_cast<float>(nx);
+    const long long planes = static_cast<long long>(nx);
+
+#pragma omp parallel for schedule(static)
+    for (long long x = 0; x < planes; ++x)
+    {
+        if (cancel && cancel->load(memory_order_relaxed))
+            continue;
+        // 近傍の行(奥行き方向の前後、高さ方向の前後、中心)と、勾配の3成分
+        vector<float> scratch(8 * nz + 2);
+        float *back = scratch.data(), *front = back + nz, *below = front + nz, *above = below + nz;
+        float *center = above + nz; // 端を繰り返すため前後に1要素ずつ余分に持つ
+        float *gradWidth = center + nz + 2, *gradHeight = gradWidth + nz, *gradDepth = gradHeight + nz;
+        const size_t xm = x > 0 ? x - 1 : 0, xp = min<size_t>(x + 1, nx - 1);
+        for (size_t y = 0; y < ny; ++y)
+        {
+            const size_t ym = y > 0 ? y - 1 : 0, yp = min(y + 1, ny - 1);
+            LoadRow(&source(xm, y, 0), nz, back);
+            LoadRow(&source(xp, y, 0), nz, front);
+            LoadRow(&source(x, ym, 0), nz, below);
+            LoadRow(&source(x, yp, 0), nz, above);
+            LoadRow(&source(x, y, 0), nz, center + 1);
+            center[0] = center[1];
+            center[nz + 1] = center[nz];
+
+            NormalizedDifferenceRow(center, below, above, back, front, nz, scaleWidth, scaleHeight, scaleDepth, gradWidth, gradHeight, gradDepth);
+            PackedGradient *out = &result(x, y, 0);
+            for (size_t z = 0; z < nz; ++z)
+            {
+                out[z].x = static_cast<int8_t>(static_cast<int>(gradWidth[z] + copysign(0.5f, gradWidth[z])));
+                out[z].y = static_cast<int8_t>(static_cast<int>(gradHeight[z] + copysign(0.5f, gradHeight[z])));
+                out[z].z = static_cast<int8_t>(static_cast<int>(gradDepth[z] + copysign(0.5f, gradDepth[z])));
+            }
+        }
+    }
+    return result;
+}
+
+template VoxelGrid<PackedGradient> ComputeGradients<uint8_t>(const VoxelGrid<uint8_t> &, const atomic<bool> *);
+template VoxelGrid<PackedGradient> ComputeGradients<uint16_t>(const VoxelGrid<uint16_t> &, const atomic<bool> *);
+template VoxelGrid<PackedGradient> ComputeGradients<Half>(const VoxelGrid<Half> &, const atomic<bool> *);
+template VoxelGrid<PackedGradient> ComputeGradients<float>(const VoxelGrid<float> &, const atomic<bool> *);
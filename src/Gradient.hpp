@@ -0,0 +1,23 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+/// @brief 勾配の向き1つ。テクスチャ(GL_RGB8_SNORM)の1テクセルで、(幅,高さ,奥行き)の順に-127~127で持つ
+/// @details 線形補間できる形式なので、シェーダは1回のtexture()で補間済みの勾配を得られる(正規化し直して使う)。
+/// 平坦な(勾配が0の)ボクセルは0
+struct PackedGradient
+{
+    int8_t x = 0, y = 0, z = 0;
+};
+static_assert(sizeof(PackedGradient) == 3, "PackedGradient must be tightly packed for RGB8 upload");
+
+/// @brief 中心差分で勾配を求め、正規化してPackedGradientに詰める
+/// @details 勾配はテクスチャ座標あたりの変化で、シェーダで±1テクセル離れた2点をサンプルした差と同じ向きになる
+/// (端はCLAMP_TO_EDGEと同じく端のボクセルを繰り返す)。
+/// 出力のx平面ごとに並列化し、近傍の行をfloatの作業配列に変換してから要素ごとに計算するのでベクトル化される
+/// @param cancel nullptrでなく、計算中にtrueになったら残りの平面を飛ばす(結果は不完全になる)
+template <typename T>
+VoxelGrid<PackedGradient> ComputeGradients(const VoxelGrid<T> &source, const std::atomic<bool> *cancel = nullptr);
@@ -0,0 +1,277 @@
+#include "Histogram.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+using namespace std;
+
+namespace
+{
+    /// @brief ボクセル値からビンの番号を求める。整数型は値そのもの、浮動小数点型は区切りに合わせて丸める
+    template <typename T>
+    struct BinIndex
+    {
+        float lower, scale;
+        size_t last;
+
+        explicit BinIndex(const Histogram &layout)
+            : lower(layout.lower),
+              scale(layout.upper > layout.lower ? static_cast<float>(layout.bins.size() - 1) / (layout.upper - layout.lower) : 0.0f),
+              last(layout.bins.size() - 1)
+        {
+        }
+        size_t operator()(T v) const
+        {
+            if constexpr (is_integral_v<T>)
+                return v;
+            else
+            {
+                const float t = (VoxelTraits<T>::Normalize(v) - lower) * scale + 0.5f;
+                return t > 0.0f ? min(static_cast<size_t>(t), last) : 0; // NaNも0
+            }
+        }
+    };
+
+    /// @brief 塊の数。塊ごとのビンを0にして合計する手間が数える手間より小さくなるようにし、スレッド数を超えない
+    size_t ChunkCount(size_t voxels, size_t binCount, size_t rows)
+    {
+        const size_t threads = max(thread::hardware_concurrency(), 1u);
+        return max<size_t>(1, min({threads, rows, voxels / (binCount * 4)}));
+    }
+
+    /// @brief 領域(幅,高さ,奥行き)の行を塊に分けて塊ごとのビンに数え、ビンごとに合計する
+    template <typename T>
+    void CountRegion(const VoxelGrid<T> &source, const VolumeRegion &region, const Histogram &layout, vector<uint64_t> &counts)
+    {
+        const size_t binCount = layout.bins.size();
+        counts.assign(binCount, 0);
+        const size_t width = region.Size(0), height = region.Size(1), depth = region.Size(2);
+        const size_t rows = height * depth;
+        if (rows == 0 || width == 0 || binCount == 0)
+            return;
+        const size_t chunks = ChunkCount(rows * width, binCount, rows);
+        vector<vector<uint64_t>> partial(chunks);
+        const BinIndex<T> index(layout);
+#pragma omp parallel for schedule(static)
+        for (long long chunk = 0; chunk < static_cast<long long>(chunks); ++chunk)
+        {
+            vector<uint64_t> &bins = partial[chunk];
+            bins.assign(binCount, 0);
+            const size_t first = rows * chunk / chunks, last = rows * (chunk + 1) / chunks;
+            for (size_t row = first; row < last; ++row)
+            {
+                const T *values = &source(region.begin[2] + row / height, region.begin[1] + row % height, region.begin[0]);
+                for (size_t z = 0; z < width; ++z)
+                    ++bins[index(values[z])];
+            }
+        }
+        const long long binTotal = static_cast<long long>(binCount);
+#pragma omp parallel for schedule(static)
+        for (long long bin = 0; bin < binTotal; ++bin)
+        {
+            uint64_t sum = 0;
+            for (const vector<uint64_t> &bins : partial)
+                sum += bins[bin];
+            counts[bin] = sum;
+        }
+    }
+
+    /// @brief 浮動小数点のボリュームの有限な値の範囲(塊ごとに求めてまとめる)
+    template <typename T>
+    void FiniteRange(const VoxelGrid<T> &source, float &lower, float &upper)
+    {
+        const size_t count = source.Count();
+        const size_t chunks = max<size_t>(1, min<size_t>(max(thread::hardware_concurrency(), 1u), count));
+        vector<float> lows(chunks, numeric_limits<float>::max()), highs(chunks, numeric_limits<float>::lowest());
+        const T *values = source.Data();
+#pragma omp parallel for schedule(static)
+        for (long long chunk = 0; chunk < static_cast<long long>(chunks); ++chunk)
+        {
+            float low = numeric_limits<float>::max(), high = numeric_limits<float>::lowest();
+            for (size_t i = count * chunk / chunks; i < count * (chunk + 1) / chunks; ++i)
+            {
+                const float v = VoxelTraits<T>::Normalize(values[i]);
+                if (!isfinite(v))
+                    continue;
+                low = min(low, v);
+                high = max(high, v);
+            }
+            lows[chunk] = low;
+            highs[chunk] = high;
+        }
+        lower = *min_element(lows.begin(), lows.end());
+        upper = *max_element(highs.begin(), highs.end());
+        if (lower > upper)
+            lower = upper = 0.0f; // 有限な値が無い
+    }
+
+    bool SameRegion(const VolumeRegion &a, const VolumeRegion &b)
+    {
+        return equal(a.begin, a.begin + 3, b.begin) && equal(a.end, a.end + 3, b.end);
+    }
+
+    VolumeRegion Intersect(const VolumeRegion &a, const VolumeRegion &b)
+    {
+        VolumeRegion result;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            result.begin[axis] = max(a.begin[axis], b.begin[axis]);
+            result.end[axis] = max(result.begin[axis], min(a.end[axis], b.end[axis]));
+        }
+        return result;
+    }
+
+    /// @brief outerからその内側のinnerを除いた部分を、重ならない直方体(6個以下)に分ける
+    vector<VolumeRegion> Subtract(const VolumeRegion &outer, const VolumeRegion &inner)
+    {
+        vector<VolumeRegion> boxes;
+        VolumeRegion rest = outer; // まだ分けていない部分。軸ごとにinnerの範囲へ狭めていく
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            if (rest.begin[axis] < inner.begin[axis])
+            {
+                VolumeRegion box = rest;
+                box.end[axis] = inner.begin[axis];
+                boxes.push_back(box);
+            }
+            if (inner.end[axis] < rest.end[axis])
+            {
+                VolumeRegion box = rest;
+                box.begin[axis] = inner.end[axis];
+                boxes.push_back(box);
+            }
+            rest.begin[axis] = inner.begin[axis];
+            rest.end[axis] = inner.end[axis];
+        }
+        return boxes;
+    }
+}
+
+uint64_t Histogram::Total(bool skipBackground) const
+{
+    uint64_t total = 0;
+    for (size_t i = skipBackground ? 1 : 0; i < bins.size(); ++i)
+        total += bins[i];
+    return total;
+}
+
+float Histogram::Percentile(double fraction, bool skipBackground) const
+{
+    const size_t first = skipBackground ? 1 : 0;
+    const double target = fraction * static_cast<double>(Total(skipBackground));
+    uint64_t cumulative = 0;
+    for (size_t i = first; i < bins.size(); ++i)
+    {
+        cumulative += bins[i];
+        if (cumulative > 0 && static_cast<double>(cumulative) >= target)
+            return BinValue(i);
+    }
+    return upper;
+}
+
+float Histogram::OtsuThreshold(bool skipBackground) const
+{
+    const size_t first = skipBackground ? 1 : 0;
+    double total = 0.0, sum = 0.0;
+    for (size_t i = first; i < bins.size(); ++i)
+    {
+        total += static_cast<double>(bins[i]);
+        sum += static_cast<double>(i) * bins[i];
+    }
+    double below = 0.0, belowSum = 0.0, bestVariance = -1.0;
+    size_t best = first;
+    for (size_t i = first; i < bins.size(); ++i)
+    {
+        below += static_cast<double>(bins[i]);
+        belowSum += static_cast<double>(i) * bins[i];
+        const double above = total - below;
+        if (below == 0.0 || above == 0.0)
+            continue;
+        const double difference = belowSum / below - (sum - belowSum) / above;
+        const double variance = below * above * difference * difference;
+        if (variance > bestVariance)
+        {
+            bestVariance = variance;
+            best = i;
+        }
+    }
+    return BinValue(best);
+}
+
+template <typename T>
+Histogram ComputeHistogram(const VoxelGrid<T> &source)
+{
+    Histogram histogram;
+    if (source.Empty())
+        return histogram;
+    if constexpr (is_integral_v<T>)
+        histogram.bins.resize(size_t(1) << (8 * sizeof(T)));
+    else
+    {
+        histogram.bins.resize(65536);
+        FiniteRange(source, histogram.lower, histogram.upper);
+    }
+    VolumeRegion whole;
+    whole.end[0] = static_cast<uint32_t>(source.SizeZ());
+    whole.end[1] = static_cast<uint32_t>(source.SizeY());
+    whole.end[2] = static_cast<uint32_t>(source.SizeX());
+    CountRegion(source, whole, histogram, histogram.bins);
+    return histogram;
+}
+
+template <typename T>
+void AccumulateHistogram(const VoxelGrid<T> &source, const VolumeRegion &region, Histogram &histogram, bool subtract)
+{
+    vector<uint64_t> counts;
+    CountRegion(source, region, histogram, counts);
+    for (size_t i = 0; i < counts.size(); ++i)
+        histogram.bins[i] = subtract ? histogram.bins[i] - counts[i] : histogram.bins[i] + counts[i];
+}
+
+template <typename T>
+bool RegionHistogram::Update(const VoxelGrid<T> &source, const VolumeRegion &newRegion, const Histogram &layout)
+{
+    const bool reusable = valid && histogram.SameLayout(layout);
+    if (reusable && SameRegion(region, newRegion))
+    {
+        lastCountedVoxels = 0;
+        return false;
+    }
+    const VolumeRegion overlap = Intersect(region, newRegion);
+    const size_t changed = reusable ? (region.VoxelCount() - overlap.VoxelCount()) + (newRegion.VoxelCount() - overlap.VoxelCount())
+                                    : numeric_limits<size_t>::max();
+    if (changed >= newRegion.VoxelCount())
+    {
+        // 変化分の方が大きい(または前の領域が無い)ので最初から数える
+        histogram = layout;
+        fill(histogram.bins.begin(), histogram.bins.end(), 0);
+        AccumulateHistogram(source, newRegion, histogram);
+        lastCountedVoxels = newRegion.VoxelCount();
+    }
+    else
+    {
+        for (const VolumeRegion &box : Subtract(region, overlap))
+            AccumulateHistogram(source, box, histogram, true);
+        for (const VolumeRegion &box : Subtract(newRegion, overlap))
+            AccumulateHistogram(source, box, histogram);
+        lastCountedVoxels = changed;
+    }
+    region = newRegion;
+    valid = true;
+    return true;
+}
+
+template Histogram ComputeHistogram<uint8_t>(const VoxelGrid<uint8_t> &);
+template Histogram ComputeHistogram<uint16_t>(const VoxelGrid<uint16_t> &);
+template Histogram ComputeHistogram<Half>(const VoxelGrid<Half> &);
+template Histogram ComputeHistogram<float>(const VoxelGrid<float> &);
+template void AccumulateHistogram<uint8_t>(const VoxelGrid<uint8_t> &, const VolumeRegion &, Histogram &, bool);
+template void AccumulateHistogram<uint16_t>(const VoxelGrid<uint16_t> &, const VolumeRegion &, Histogram &, bool);
+template void AccumulateHistogram<Half>(const VoxelGrid<Half> &, const VolumeRegion &, Histogram &, bool);
+template void AccumulateHistogram<float>(const VoxelGrid<float> &, const VolumeRegion &, Histogram &, bool);
+template bool RegionHistogram::Update<uint8_t>(const VoxelGrid<uint8_t> &, const VolumeRegion &, const Histogram &);
+template bool RegionHistogram::Update<uint16_t>(const VoxelGrid<uint16_t> &, const VolumeRegion &, const Histogram &);
+template bool RegionHistogram::Update<Half>(const VoxelGrid<Half> &, const VolumeRegion &, const Histogram &);
+template bool RegionHistogram::Update<float>(const VoxelGrid<float> &, const VolumeRegion &, const Histogram &);
@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+#include "VolumeHeader.hpp"
+
+/// @brief 強度のヒストグラム。ビンは[lower, upper](シェーダでサンプルした時と同じ値)を等間隔に区切る
+/// @details 8bit・16bitのボリュームは値ごとに1ビン(256, 65536ビン)で[0, 1]、
+/// 浮動小数点のボリュームは最小値~最大値を65536ビンに区切る
+struct Histogram
+{
+    std::vector<uint64_t> bins;
+    float lower = 0.0f, upper = 1.0f;
+
+    bool Empty() const { return bins.empty(); }
+    /// @brief ビンの代表値(区切りの位置)
+    float BinValue(size_t bin) const
+    {
+        return bins.size() > 1 ? lower + (upper - lower) * static_cast<float>(bin) / static_cast<float>(bins.size() - 1) : lower;
+    }
+    /// @brief ボクセル数の合計
+    /// @param skipBackground trueなら最初のビン(背景の0)を数えない
+    uint64_t Total(bool skipBackground = false) const;
+    /// @brief 小さい方から数えてボクセル数の割合がfraction(0~1)に達するビンの値
+    float Percentile(double fraction, bool skipBackground = false) const;
+    /// @brief 大津の方法(クラス間分散の最大化)による2値化の閾値
+    float OtsuThreshold(bool skipBackground = false) const;
+    /// @brief 同じビンの区切りか
+    bool SameLayout(const Histogram &other) const { return bins.size() == other.bins.size() && lower == other.lower && upper == other.upper; }
+};
+
+/// @brief ボリューム全体のヒストグラムを作る
+/// @details ボクセル列を(スレッド数程度の)塊に分け、塊ごとのビンに並列に数えてから、ビンごとに並列に合計する(ビンの奪い合いが無い)
+template <typename T>
+Histogram ComputeHistogram(const VoxelGrid<T> &source);
+
+/// @brief ヒストグラムに領域(幅,高さ,奥行き)のボクセルを加える(subtractなら取り除く)。ビンの区切りはhistogramのものを使う
+template <typename T>
+void AccumulateHistogram(const VoxelGrid<T> &source, const VolumeRegion &region, Histogram &histogram, bool subtract = false);
+
+/// @brief 部分領域のヒストグラムを、領域の変化分だけ数え直して保つクラス
+/// @details 領域をずらしたり広げたりした場合は、前の領域から外れた部分を引き、新しく入った部分を足す(各6個以下の直方体)。
+/// 変化分が新しい領域より大きい場合は最初から数え直す
+class RegionHistogram
+{
+    Histogram histogram;
+    VolumeRegion region;
+    bool valid = false;
+    size_t lastCountedVoxels = 0;
+
+public:
+    /// @brief 領域をregionにしてヒストグラムを更新する
+    /// @param layout ビンの区切り(ボリューム全体のヒストグラム)
+    /// @return ヒストグラムが変わったか(領域が前回と同じならfalse)
+    template <typename T>
+    bool Update(const VoxelGrid<T> &source, const VolumeRegion &region, const Histogram &layout);
+    /// @brief 保っている領域を捨てる(次のUpdate()で最初から数える)
+    void Reset() { valid = false; }
+    const Histogram &Get() const { return histogram; }
+    /// @brief 直前のUpdate()で数えた(足した・引いた)ボクセル数
+    size_t LastCountedVoxels() const { return lastCountedVoxels; }
+};
@@ -1,5 +1,9 @@
 #include "ImGuiManager.hpp"
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
 #include "imgui/imgui_stdlib.h"
 using namespace std;
 ImGuiManager::ImGuiManager() {}
@@ -96,25 +100,122 @@ void CustomImGuiManager::RenderUI()
         if (ImGui::Button("Load Volume"))
         {
             filePath = std::string(fileBuffer);
-            std::ifstream file(filePath);
-            if (file.is_open())
-                std::cout << "File loaded: " << filePath << std::endl;
-            else
-                std::cerr << "Failed to load file: " << filePath << std::endl;
-            callback();
+            // 読み込みはバックグラウンドで行い、結果はコールバック側で報告する
+            if (callback)
+                callback();
         }
-        const char *shaderNames[] = {"Ray Casting", "Ray Casting(Max)", "Point Cloud"};
+        // 部分領域の指定。有効ならLoad Volumeで領域の分だけを読み込む
+        ImGui::Checkbox("Region of Interest", &roiEnabled);
+        if (roiEnabled)
+        {
+            ImGui::DragInt3("ROI Begin (x,y,z)", roiBegin, 1.0f, 0, INT_MAX);
+            ImGui::DragInt3("ROI End (x,y,z)", roiEnd, 1.0f, 0, INT_MAX);
+        }
+        // 事前計算の勾配に切り替えたら、勾配を作るために読み込み直す
+        const char *gradientModeNames[] = {"Off", "Precomputed", "On-the-fly"};
+        if (ImGui::Combo("Gradient Shading", &gradientMode, gradientModeNames, IM_ARRAYSIZE(gradientModeNames)) && gradientMode == 1 && !fileBuffer.empty())
+        {
+            filePath = std::string(fileBuffer);
+            if (callback)
+                callback();
+        }
+        // ラベルの有無を変えたら、成分を求める(または捨てる)ために読み込み直す
+        if (ImGui::Checkbox("Label Components", &computeLabels) && !fileBuffer.empty())
+        {
+            filePath = std::string(fileBuffer);
+            if (callback)
+                callback();
+        }
+        if (computeLabels && volumePaged)
+            ImGui::TextDisabled("Not available for paged volumes");
+        // 2値に詰めるかを変えたら、ボクセル値を捨てる(または読み直す)ために読み込み直す
+        if (ImGui::Checkbox("Binary (1 bit/voxel)", &packBits) && !fileBuffer.empty())
+        {
+            filePath = std::string(fileBuffer);
+            if (callback)
+                callback();
+        }
+        // 縮約方法を変えたらミップピラミッドを作り直すために読み込み直す
+        const char *mipReductionNames[] = {"Max", "Average", "Or"};
+        if (ImGui::Combo("Mip Reduction", &mipReduction, mipReductionNames, IM_ARRAYSIZE(mipReductionNames)) && !fileBuffer.empty())
+        {
+            filePath = std::string(fileBuffer);
+            if (callback)
+                callback();
+        }
+        // 表示中のボリュームをその場で掃除する(値が変わった平面だけを転送し直す)
+        const char *morphologyOpNames[] = {"Erode", "Dilate", "Open", "Close"};
+        const char *structuringShapeNames[] = {"Cube", "Cross", "Ball"};
+        ImGui::Combo("Morphology", &morphologyOp, morphologyOpNames, IM_ARRAYSIZE(morphologyOpNames));
+        ImGui::Combo("Structuring Element", &morphologyShape, structuringShapeNames, IM_ARRAYSIZE(structuringShapeNames));
+        ImGui::SliderInt("Element Radius", &morphologyRadius, 1, 5);
+        if (ImGui::Button("Apply Morphology") && morphologyCallback)
+            morphologyCallback();
+        if (!morphologyStats.empty())
+            ImGui::TextUnformatted(morphologyStats.c_str());
+        // 階段状のアーティファクトを減らす平滑化もその場で行う
+        const char *filterKindNames[] = {"Gaussian", "Box", "Median"};
+        ImGui::Combo("Filter", &filterKind, filterKindNames, IM_ARRAYSIZE(filterKindNames));
+        ImGui::SliderInt("Filter Radius", &filterRadius, 1, 8);
+        if (filterKind == 0)
+            ImGui::SliderFloat("Sigma (0 = radius/2)", &filterSigma, 0.0f, 4.0f);
+        if (ImGui::Button("Apply Filter") && filterCallback)
+            filterCallback();
+        if (!filterStats.empty())
+            ImGui::TextUnformatted(filterStats.c_str());
+        // 読み込み・テクスチャ転送の進捗
+        ImGui::SliderFloat("Upload Budget (ms)", &uploadBudgetMs, 0.5f, 33.0f);
+        if (loadProgress >= 0.0f)
+        {
+            ImGui::ProgressBar(loadProgress, ImVec2(-1, 0), loadStage.c_str());
+            if (ImGui::Button("Cancel") && cancelCallback)
+                cancelCallback();
+        }
+        if (!pagingStats.empty())
+            ImGui::TextUnformatted(pagingStats.c_str());
+        // 時系列の再生(File Pathにディレクトリか"frames/*.dat"のようなワイルドカードを指定した場合)
+        if (!seriesStats.empty())
+        {
+            ImGui::Checkbox("Play", &seriesPlaying);
+            ImGui::SameLine();
+            ImGui::SliderFloat("Playback FPS", &seriesFps, 1.0f, 120.0f);
+            ImGui::TextUnformatted(seriesStats.c_str());
+        }
+        const char *shaderNames[] = {"Ray Casting", "Ray Casting(Max)", "Point Cloud", "Iso Surface", "Voxel Surface"};
         if (ImGui::Combo("Select Shader", &currentShaderIndex, shaderNames, IM_ARRAYSIZE(shaderNames)))
         {
         }
+        if (currentShaderIndex >= 3 && !meshStats.empty())
+            ImGui::TextUnformatted(meshStats.c_str());
 
         // アルファ値調整
         ImGui::SliderFloat2("Alpha Min-Max", alphaMinMax, 0.0f, 1.0f);
+        alphaDragging = ImGui::IsItemActive();
+        ImGui::Checkbox("Empty Space Skipping", &emptySpaceSkipping);
+        if (!macrocellStats.empty())
+        {
+            ImGui::SameLine();
+            ImGui::TextUnformatted(macrocellStats.c_str());
+        }
+        ImGui::Checkbox("Distance Stepping", &distanceStepping);
+        if (distanceStepping && distanceFieldBuilding)
+        {
+            ImGui::SameLine();
+            ImGui::TextUnformatted("(rebuilding...)");
+        }
+        RenderHistogram();
 
         ImGui::DragFloat3("CameraPosition", glm::value_ptr(cameraPos), 0.01f);
     }
     ImGui::End();
 
+    if (components && labelTable && !labelTable->Empty())
+    {
+        if (ImGui::Begin("Components"))
+            RenderComponents();
+        ImGui::End();
+    }
+
     if (ImGui::Begin("Light Editor"))
     {
 
@@ -160,6 +261,130 @@ void CustomImGuiManager::RenderUI()
     ImGui::End();
 }
 
+void CustomImGuiManager::SetHistogram(const Histogram *histogram, const string &label)
+{
+    histogramPlot.clear();
+    histogramLabel = label;
+    if (!histogram || histogram->Empty())
+        return;
+    // 隣り合うビンを256本にまとめ、少ない値も見えるように対数にする
+    const size_t bars = min<size_t>(256, histogram->bins.size());
+    histogramPlot.resize(bars);
+    for (size_t i = 0; i < histogram->bins.size(); ++i)
+        histogramPlot[i * bars / histogram->bins.size()] += static_cast<float>(histogram->bins[i]);
+    for (float &bar : histogramPlot)
+        bar = log1p(bar);
+    // 背景(最初のビン)は大半を占めることが多いので候補の計算から除く
+    suggestedOtsu = histogram->OtsuThreshold(true);
+    suggestedLow = histogram->Percentile(0.02, true);
+    suggestedHigh = histogram->Percentile(0.98, true);
+}
+
+void CustomImGuiManager::RenderHistogram()
+{
+    if (!histogramPlot.empty())
+    {
+        ImGui::PlotHistogram("##Histogram", histogramPlot.data(), static_cast<int>(histogramPlot.size()), 0, histogramLabel.c_str(), 0.0f, FLT_MAX, ImVec2(-1, 80));
+        ImGui::Text("Otsu %.3f, 2-98%% %.3f - %.3f", suggestedOtsu, suggestedLow, suggestedHigh);
+        // スライダーの範囲[0, 1]に収める
+        const auto apply = [this](float low, float high)
+        {
+            alphaMinMax[0] = clamp(low, 0.0f, 1.0f);
+            alphaMinMax[1] = clamp(max(high, low), 0.0f, 1.0f);
+        };
+        if (ImGui::Button("Apply Otsu"))
+            apply(suggestedOtsu, suggestedHigh);
+        ImGui::SameLine();
+        if (ImGui::Button("Apply Percentiles"))
+            apply(suggestedLow, suggestedHigh);
+    }
+    // 部分領域のヒストグラム。領域を動かすと変化分だけ数え直す
+    ImGui::Checkbox("Histogram ROI", &histogramRoiEnabled);
+    if (histogramRoiEnabled)
+    {
+        ImGui::DragInt3("Histogram Begin (x,y,z)", histogramRoiBegin, 1.0f, 0, INT_MAX);
+        ImGui::DragInt3("Histogram End (x,y,z)", histogramRoiEnd, 1.0f, 0, INT_MAX);
+    }
+}
+
+void CustomImGuiManager::RenderComponents()
+{
+    const size_t count = min(components->size(), labelTable->styles.size());
+    ImGui::Text("%zu components", count > 0 ? count - 1 : 0);
+    // 表示設定は表(LabelTable)を転送し直すだけで反映され、ボリュームは読み込み直さない
+    if (ImGui::Button("Show All"))
+    {
+        labelTable->SetAllVisible(true);
+        labelTableChanged = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Hide All"))
+    {
+        labelTable->SetAllVisible(false);
+        labelTableChanged = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Recolor All"))
+    {
+        labelTable->SetAllRecolor(true);
+        labelTableChanged = true;
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Original Colors"))
+    {
+        labelTable->SetAllRecolor(false);
+        labelTableChanged = true;
+    }
+
+    const ImGuiTableFlags flags = ImGuiTableFlags_ScrollY | ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders | ImGuiTableFlags_Resizable;
+    if (!ImGui::BeginTable("ComponentsTable", 6, flags))
+        return;
+    ImGui::TableSetupScrollFreeze(0, 1);
+    ImGui::TableSetupColumn("ID");
+    ImGui::TableSetupColumn("Voxels");
+    ImGui::TableSetupColumn("Bounds (x,y,z)");
+    ImGui::TableSetupColumn("Centroid (x,y,z)");
+    ImGui::TableSetupColumn("Show");
+    ImGui::TableSetupColumn("Color");
+    ImGui::TableHeadersRow();
+    // 成分が多くても見えている行だけを描画する
+    ImGuiListClipper clipper;
+    clipper.Begin(static_cast<int>(count > 0 ? count - 1 : 0));
+    while (clipper.Step())
+    {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; ++row)
+        {
+            const uint32_t label = static_cast<uint32_t>(row + 1);
+            const ComponentStats &stats = (*components)[label];
+            LabelStyle &style = labelTable->styles[label];
+            ImGui::PushID(row);
+            ImGui::TableNextRow();
+            ImGui::TableSetColumnIndex(0);
+            ImGui::Text("%u", label);
+            ImGui::TableSetColumnIndex(1);
+            ImGui::Text("%llu", static_cast<unsigned long long>(stats.voxelCount));
+            ImGui::TableSetColumnIndex(2);
+            ImGui::Text("%u:%u,%u:%u,%u:%u", stats.bounds.begin[0], stats.bounds.end[0], stats.bounds.begin[1], stats.bounds.end[1], stats.bounds.begin[2], stats.bounds.end[2]);
+            ImGui::TableSetColumnIndex(3);
+            ImGui::Text("%.1f, %.1f, %.1f", stats.centroid[0], stats.centroid[1], stats.centroid[2]);
+            ImGui::TableSetColumnIndex(4);
+            labelTableChanged |= ImGui::Checkbox("##visible", &style.visible);
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Isolate"))
+            {
+                labelTable->Isolate(label);
+                labelTableChanged = true;
+            }
+            ImGui::TableSetColumnIndex(5);
+            labelTableChanged |= ImGui::Checkbox("##recolor", &style.recolor);
+            ImGui::SameLine();
+            labelTableChanged |= ImGui::ColorEdit3("##color", style.color, ImGuiColorEditFlags_NoInputs);
+            ImGui::PopID();
+        }
+    }
+    ImGui::EndTable();
+}
+
 void ImGuiManager::RenderDockSpace()
 {
     ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoTitleBar | ImGuiWindowFlags_NoCollapse |
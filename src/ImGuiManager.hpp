@@ -12,6 +12,9 @@
 #include "FrameBuffer.hpp"
 #include <vector>
 #include "PointLight.hpp"
+#include "ConnectedComponents.hpp"
+#include "LabelTable.hpp"
+#include "Histogram.hpp"
 
 class ImGuiManager
 {
@@ -36,19 +39,100 @@ class CustomImGuiManager : public ImGuiManager
     using ButtonCallback = std::function<void()>;
 
 private:
+    /// @brief 成分の統計と表示設定の表を描画する
+    void RenderComponents();
+    /// @brief ヒストグラムと、そこから求めたアルファ範囲の候補を描画する
+    void RenderHistogram();
+
+    /// 描画用に256本にまとめたヒストグラム(log(1 + ボクセル数))。空なら表示しない
+    std::vector<float> histogramPlot;
+    std::string histogramLabel;
+    /// ヒストグラムから求めたアルファ範囲の候補(大津の閾値、2・98パーセンタイル)
+    float suggestedOtsu = 0.0f, suggestedLow = 0.0f, suggestedHigh = 1.0f;
+
 public:
     std::vector<float> fpsHistory = std::vector<float>(100, 0);
     float nearClip = 0.01f;
     float farClip = 100.0f;
     float alphaMinMax[2] = {0.0f, 1.0f};
+    /// Alpha Min-Maxのスライダーを操作中か(等値面は離してから作り直す)
+    bool alphaDragging = false;
     float pointSize = 1.0f;
     std::string filePath = "";
     std::string fileBuffer;
     glm::vec3 cameraPos;
     PointLight light;
     glm::vec3 ambientLight = glm::vec3(0.3f);
+    /// 1フレームあたりのテクスチャ転送の時間予算[ms]
+    float uploadBudgetMs = 4.0f;
+    /// 読み込み・テクスチャ転送の進捗(0~1)。読み込み中でなければ負
+    float loadProgress = -1.0f;
+    /// 進捗バーに表示する段階名
+    std::string loadStage;
+    /// ページングの統計。ページングしていなければ空
+    std::string pagingStats;
+    /// ミップピラミッドの縮約方法(MipReductionの値)
+    int mipReduction = 0;
+    /// Load Volumeで部分領域だけを読み込むか、とその範囲 [roiBegin, roiEnd)(幅,高さ,奥行き)
+    bool roiEnabled = false;
+    int roiBegin[3] = {0, 0, 0};
+    int roiEnd[3] = {256, 256, 256};
+    /// 陰影に使う勾配(0: 使わない, 1: 読み込み時に事前計算, 2: シェーダでその場で求める)
+    int gradientMode = 0;
+    /// アルファの下限で透明なマクロセルをレイが飛び越えるか
+    bool emptySpaceSkipping = true;
+    /// 空領域スキップの統計(サンプルが必要なマクロセルの割合)。空なら表示しない
+    std::string macrocellStats;
+    /// 等値面・ボクセルの表面の統計(三角形や四角形の数と作る時間)。空なら表示しない
+    std::string meshStats;
+    /// 占有ボクセルまでの距離場で空の領域を大きく進むか
+    bool distanceStepping = true;
+    /// 距離場をバックグラウンドで作り直している最中か
+    bool distanceFieldBuilding = false;
+    /// ヒストグラムを部分領域 [histogramRoiBegin, histogramRoiEnd)(幅,高さ,奥行き)で数えるか
+    bool histogramRoiEnabled = false;
+    int histogramRoiBegin[3] = {0, 0, 0};
+    int histogramRoiEnd[3] = {64, 64, 64};
+    /// Load Volumeで連結成分のラベルも求めるか
+    bool computeLabels = false;
+    /// 表示中のボリュームがページングしているか(クラスタIDを作れない)
+    bool volumePaged = false;
+    /// Load Volumeで非ゼロを1として1ボクセル1ビットに詰めるか
+    bool packBits = false;
+    /// 表示中のボリュームの成分の統計(クラスタID順、要素0は背景)。ラベルが無ければnullptr
+    const std::vector<ComponentStats> *components = nullptr;
+    /// 成分ごとの表示設定。UIで変更したらlabelTableChangedを立てる
+    LabelTable *labelTable = nullptr;
+    bool labelTableChanged = false;
+    /// 時系列の再生速度[フレーム/秒]と再生中か
+    float seriesFps = 24.0f;
+    bool seriesPlaying = true;
+    /// 時系列の再生の統計(ドロップ数、先読み待ち数など)。時系列を再生していなければ空
+    std::string seriesStats;
+    /// 表示中のボリュームに適用するモルフォロジー演算(MorphologyOp)と構造要素の形(StructuringShape)・半径
+    int morphologyOp = 2;
+    int morphologyShape = 0;
+    int morphologyRadius = 1;
+    /// 最後に適用したモルフォロジー演算の統計(スループット、転送し直した量)。空なら表示しない
+    std::string morphologyStats;
+    /// 表示中のボリュームに適用する平滑化フィルタ(FilterKind)と半径、ガウシアンの標準偏差(0以下なら半径の半分)
+    int filterKind = 0;
+    int filterRadius = 1;
+    float filterSigma = 0.0f;
+    /// 最後に適用したフィルタの統計(スループット、時間)。空なら表示しない
+    std::string filterStats;
 
     virtual void RenderUI() override;
+    /// @brief 表示するヒストグラムを設定する。nullptrなら表示しない
+    /// @param label ヒストグラムの見出し(ボリューム全体か部分領域か)
+    void SetHistogram(const Histogram *histogram, const std::string &label);
     int currentShaderIndex = 0;
+    /// Load Volumeボタンのコールバック。filePathに読み込むパスが入っている
     ButtonCallback callback;
+    /// 読み込み中に表示するCancelボタンのコールバック
+    ButtonCallback cancelCallback;
+    /// Apply Morphologyボタンのコールバック。morphologyOp, morphologyShape, morphologyRadiusに設定が入っている
+    ButtonCallback morphologyCallback;
+    /// Apply Filterボタンのコールバック。filterKind, filterRadius, filterSigmaに設定が入っている
+    ButtonCallback filterCallback;
 };
\ No newline at end of file
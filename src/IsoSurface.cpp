@@ -0,0 +1,264 @@
+#include "IsoSurface.hpp"
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+using namespace std;
+
+namespace
+{
+    /// セル内の三角形の最大数(交差する辺は高々12本で、辺L本の輪からL - 2個の三角形を作る)
+    constexpr size_t maxCellTriangles = 10;
+
+    /// @brief セルの構成(8つの角が内側かのbit)ごとの三角形。値はセルの辺の番号
+    struct CellTriangles
+    {
+        uint8_t count = 0;
+        array<uint8_t, maxCellTriangles * 3> edges{};
+    };
+
+    // セルの角cは(幅, 高さ, 奥行き)方向に(c & 1, c >> 1 & 1, c >> 2 & 1)ずれた位置。
+    // 辺eは軸e / 4(0: 幅, 1: 高さ, 2: 奥行き)に沿い、残りの2軸(小さい順)のずれがe % 4の各bit
+
+    /// @brief 辺の始点(軸の負の側)の角
+    int EdgeOrigin(int edge)
+    {
+        const int axis = edge / 4, m = edge % 4;
+        const int other0 = axis == 0 ? 1 : 0, other1 = axis == 2 ? 1 : 2;
+        return ((m & 1) << other0) | ((m >> 1 & 1) << other1);
+    }
+
+    /// @brief 隣り合う2つの角を結ぶ辺
+    int CornerEdge(int a, int b)
+    {
+        const int diff = a ^ b, origin = a & b;
+        const int axis = diff == 1 ? 0 : diff == 2 ? 1 : 2;
+        const int other0 = axis == 0 ? 1 : 0, other1 = axis == 2 ? 1 : 2;
+        return axis * 4 + (origin >> other0 & 1) + ((origin >> other1 & 1) << 1);
+    }
+
+    /// @brief 256通りの構成の三角形を求める
+    /// @details 6つの面それぞれで、内側の角の並び(面の外から見て反時計回り)を囲む線分を「内側に入る辺 -> 出る辺」の向きで作る。
+    /// 交差する辺はちょうど2つの面で逆向きにたどられるので、線分は閉じた輪につながる。輪を扇形に三角形に分けると、
+    /// 三角形は外側(値が小さい側)から見て反時計回りになる。
+    /// 2つの角だけが対角に内側の面は内側の角を分ける向きに決めるので、面を共有する隣のセルと線分が一致し、穴が開かない
+    array<CellTriangles, 256> BuildTriangulations()
+    {
+        array<CellTriangles, 256> table;
+        for (int config = 0; config < 256; ++config)
+        {
+            const auto inside = [config](int corner)
+            { return (config >> corner & 1) != 0; };
+            array<int, 12> next;
+            next.fill(-1);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                const int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                for (int side = 0; side < 2; ++side)
+                {
+                    const int base = side << axis;
+                    array<int, 4> corners = {base, base | 1 << u, base | 1 << u | 1 << v, base | 1 << v};
+                    if (side == 0)
+                        reverse(corners.begin(), corners.end()); // 負の側の面は外から見ると逆回り
+                    for (int i = 0; i < 4; ++i)
+                    {
+                        if (!inside(corners[i]) || inside(corners[(i + 1) % 4]))
+                            continue;
+                        // 辺(i, i + 1)で内側から出る。遡って内側に入った辺を探す
+                        int j = (i + 3) % 4;
+                        while (inside(corners[j]))
+                            j = (j + 3) % 4;
+                        next[CornerEdge(corners[j], corners[(j + 1) % 4])] = CornerEdge(corners[i], corners[(i + 1) % 4]);
+                    }
+                }
+            }
+            CellTriangles &cell = table[config];
+            array<bool, 12> visited{};
+            for (int start = 0; start < 12; ++start)
+            {
+                if (next[start] < 0 || visited[start])
+                    continue;
+                int loop[12], length = 0;
+                for (int edge = start; !visited[edge]; edge = next[edge])
+                {
+                    visited[edge] = true;
+                    loop[length++] = edge;
+                }
+                for (int k = 1; k + 1 < length; ++k, ++cell.count)
+                {
+                    cell.edges[cell.count * 3 + 0] = static_cast<uint8_t>(loop[0]);
+                    cell.edges[cell.count * 3 + 1] = static_cast<uint8_t>(loop[k]);
+                    cell.edges[cell.count * 3 + 2] = static_cast<uint8_t>(loop[k + 1]);
+                }
+            }
+        }
+        return table;
+    }
+
+    /// @brief 板ごとのメッシュ。頂点番号は板の中での番号
+    struct SlabMesh
+    {
+        vector<MeshVertex> vertices;
+        vector<GLuint> indices;
+        /// 最後の平面(次の板の最初の平面と同じ)の頂点の先頭
+        size_t lastPlaneStart = 0;
+    };
+}
+
+template <typename T>
+void IsoSurface::Extract(const VoxelGrid<T> &grid, const glm::vec3 &extent, float isovalue,
+                         vector<MeshVertex> &vertices, vector<GLuint> &indices, size_t slabs)
+{
+    vertices.clear();
+    indices.clear();
+    const size_t nx = grid.SizeX(), ny = grid.SizeY(), nz = grid.SizeZ();
+    if (nx < 2 || ny < 2 || nz < 2)
+        return;
+    static const array<CellTriangles, 256> triangulations = BuildTriangulations();
+    const size_t cellPlanes = nx - 1, planeSize = ny * nz;
+    if (slabs == 0)
+        slabs = max(thread::hardware_concurrency(), 1u) * 4; // 面の多さの偏りをならすため多めに分ける
+    slabs = min(slabs, cellPlanes);
+
+    // (幅,高さ,奥行き)のボクセル間隔と、ボクセル中心をボリュームの中心からの位置にするずれ(点群と同じ)
+    const glm::vec3 spacing = extent / glm::vec3(static_cast<float>(nz), static_cast<float>(ny), static_cast<float>(nx));
+    const glm::vec3 origin = spacing * 0.5f - extent * 0.5f;
+    const auto value = [&grid](size_t x, size_t y, size_t z)
+    { return VoxelTraits<T>::Normalize(grid(x, y, z)); };
+    // 中心差分の勾配(境界では片側差分)。成分は(幅,高さ,奥行き)の順
+    const auto gradient = [&](size_t x, size_t y, size_t z)
+    {
+        const size_t x0 = x > 0 ? x - 1 : x, x1 = min(x + 1, nx - 1);
+        const size_t y0 = y > 0 ? y - 1 : y, y1 = min(y + 1, ny - 1);
+        const size_t z0 = z > 0 ? z - 1 : z, z1 = min(z + 1, nz - 1);
+        return glm::vec3((value(x, y, z1) - value(x, y, z0)) / (static_cast<float>(z1 - z0) * spacing.x),
+                         (value(x, y1, z) - value(x, y0, z)) / (static_cast<float>(y1 - y0) * spacing.y),
+                         (value(x1, y, z) - value(x0, y, z)) / (static_cast<float>(x1 - x0) * spacing.z));
+    };
+    // ボクセル(x, y, z)からaxis(0: 幅, 1: 高さ, 2: 奥行き)方向の辺上で値がisovalueになる点
+    const auto makeVertex = [&](size_t x, size_t y, size_t z, int axis, float v0, float v1)
+    {
+        const float t = (isovalue - v0) / (v1 - v0);
+        glm::vec3 voxel(static_cast<float>(z), static_cast<float>(y), static_cast<float>(x));
+        voxel[axis] += t;
+        const glm::vec3 g = gradient(x, y, z) * (1.0f - t) + gradient(x + (axis == 2), y + (axis == 1), z + (axis == 0)) * t;
+        const float length = glm::length(g);
+        return MeshVertex{origin + voxel * spacing, length > 0.0f ? g / -length : glm::vec3(0.0f)};
+    };
+
+    vector<SlabMesh> meshes(slabs);
+#pragma omp parallel for schedule(dynamic)
+    for (long long slab = 0; slab < static_cast<long long>(slabs); ++slab)
+    {
+        SlabMesh &mesh = meshes[slab];
+        const size_t first = cellPlanes * slab / slabs, last = cellPlanes * (slab + 1) / slabs;
+        // 手前と奥の平面の値、平面内の幅・高さ方向の辺と平面間の奥行き方向の辺の頂点番号
+        vector<float> values[2] = {vector<float>(planeSize), vector<float>(planeSize)};
+        vector<GLuint> widthEdges[2] = {vector<GLuint>(planeSize), vector<GLuint>(planeSize)};
+        vector<GLuint> heightEdges[2] = {vector<GLuint>(planeSize), vector<GLuint>(planeSize)};
+        vector<GLuint> depthEdges(planeSize);
+        const auto loadValues = [&](size_t x, int side)
+        {
+            const T *row = &grid(x, 0, 0);
+            for (size_t i = 0; i < planeSize; ++i)
+                values[side][i] = VoxelTraits<T>::Normalize(row[i]);
+        };
+        // 平面内の辺の頂点を平面の走査順に作る(隣の板でも同じ順になる)
+        const auto planeVertices = [&](size_t x, int side)
+        {
+            const float *v = values[side].data();
+            for (size_t y = 0; y < ny; ++y)
+                for (size_t z = 0; z < nz; ++z)
+                {
+                    const size_t i = y * nz + z;
+                    const bool in = v[i] > isovalue;
+                    if (z + 1 < nz && in != (v[i + 1] > isovalue))
+                    {
+                        widthEdges[side][i] = static_cast<GLuint>(mesh.vertices.size());
+                        mesh.vertices.push_back(makeVertex(x, y, z, 0, v[i], v[i + 1]));
+                    }
+                    if (y + 1 < ny && in != (v[i + nz] > isovalue))
+                    {
+                        heightEdges[side][i] = static_cast<GLuint>(mesh.vertices.size());
+                        mesh.vertices.push_back(makeVertex(x, y, z, 1, v[i], v[i + nz]));
+                    }
+                }
+        };
+
+        loadValues(first, 0);
+        planeVertices(first, 0);
+        for (size_t x = first; x < last; ++x)
+        {
+            loadValues(x + 1, 1);
+            for (size_t i = 0; i < planeSize; ++i)
+                if ((values[0][i] > isovalue) != (values[1][i] > isovalue))
+                {
+                    depthEdges[i] = static_cast<GLuint>(mesh.vertices.size());
+                    mesh.vertices.push_back(makeVertex(x, i / nz, i % nz, 2, values[0][i], values[1][i]));
+                }
+            mesh.lastPlaneStart = mesh.vertices.size();
+            planeVertices(x + 1, 1);
+
+            // 辺ごとの頂点番号の表(セル(y, z)での位置は先頭 + y * nz + z)
+            const GLuint *edgeTables[12];
+            for (int edge = 0; edge < 12; ++edge)
+            {
+                const int corner = EdgeOrigin(edge), side = corner >> 2;
+                const size_t offset = (corner >> 1 & 1) * nz + (corner & 1);
+                const vector<GLuint> &table = edge < 4 ? widthEdges[side] : edge < 8 ? heightEdges[side] : depthEdges;
+                edgeTables[edge] = table.data() + offset;
+            }
+            for (size_t y = 0; y + 1 < ny; ++y)
+                for (size_t z = 0; z + 1 < nz; ++z)
+                {
+                    const size_t i = y * nz + z;
+                    const int config = (values[0][i] > isovalue) | (values[0][i + 1] > isovalue) << 1 |
+                                       (values[0][i + nz] > isovalue) << 2 | (values[0][i + nz + 1] > isovalue) << 3 |
+                                       (values[1][i] > isovalue) << 4 | (values[1][i + 1] > isovalue) << 5 |
+                                       (values[1][i + nz] > isovalue) << 6 | (values[1][i + nz + 1] > isovalue) << 7;
+                    const CellTriangles &cell = triangulations[config];
+                    for (size_t k = 0; k < cell.count * 3u; ++k)
+                        mesh.indices.push_back(edgeTables[cell.edges[k]][i]);
+                }
+            swap(values[0], values[1]);
+            swap(widthEdges[0], widthEdges[1]);
+            swap(heightEdges[0], heightEdges[1]);
+        }
+    }
+
+    // 板ごとの頂点・インデックスをつなげる。最後の平面の頂点は次の板の最初の平面の頂点に付け替える
+    vector<size_t> vertexOffsets(slabs + 1, 0), indexOffsets(slabs + 1, 0);
+    for (size_t slab = 0; slab < slabs; ++slab)
+    {
+        const size_t owned = slab + 1 < slabs ? meshes[slab].lastPlaneStart : meshes[slab].vertices.size();
+        vertexOffsets[slab + 1] = vertexOffsets[slab] + owned;
+        indexOffsets[slab + 1] = indexOffsets[slab] + meshes[slab].indices.size();
+    }
+    vertices.resize(vertexOffsets[slabs]);
+    indices.resize(indexOffsets[slabs]);
+#pragma omp parallel for schedule(static)
+    for (long long slab = 0; slab < static_cast<long long>(slabs); ++slab)
+    {
+        const SlabMesh &mesh = meshes[slab];
+        const size_t owned = vertexOffsets[slab + 1] - vertexOffsets[slab];
+        copy(mesh.vertices.begin(), mesh.vertices.begin() + owned, vertices.begin() + vertexOffsets[slab]);
+        const GLuint base = static_cast<GLuint>(vertexOffsets[slab]);
+        const GLuint shared = static_cast<GLuint>(vertexOffsets[slab + 1] - owned); // 次の板の先頭 - owned
+        GLuint *out = indices.data() + indexOffsets[slab];
+        for (size_t k = 0; k < mesh.indices.size(); ++k)
+            out[k] = mesh.indices[k] + (mesh.indices[k] < owned ? base : shared);
+    }
+}
+
+IsoSurface::IsoSurface(const VolumeBase &volume, float isovalue)
+    : isovalue(isovalue)
+{
+    VisitVolume(volume, [&](const auto &typed)
+                { Extract(typed.intencity, volume.extent, isovalue, vertices, indices); });
+}
+
+template void IsoSurface::Extract(const VoxelGrid<uint8_t> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t);
+template void IsoSurface::Extract(const VoxelGrid<uint16_t> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t);
+template void IsoSurface::Extract(const VoxelGrid<Half> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t);
+template void IsoSurface::Extract(const VoxelGrid<float> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t);
@@ -0,0 +1,26 @@
+#pragma once
+#include <vector>
+#include "Volume.hpp"
+#include "SurfaceMesh.hpp"
+
+// 等値面のメッシュクラス
+class IsoSurface : public SurfaceMesh
+{
+public:
+    /// 面を求めた時の閾値(正規化した値)
+    float isovalue = 0.0f;
+
+    IsoSurface() = default;
+    /// @brief ボリュームの正規化した値がisovalueを横切る面を求める。ページングしているボリュームと1ビットに詰めたボリュームは空のメッシュになる
+    IsoSurface(const VolumeBase &volume, float isovalue);
+
+    /// @brief マーチングキューブ法で等値面を求める
+    /// @details 最も遅い軸をslabs個の板に分けて並列に処理する。辺上の頂点は辺ごとに1つだけ作り、隣り合うセルで共有する。
+    /// 板の境界の平面の頂点は両側の板で同じ順に作られるので、後から後ろの板の頂点に付け替えて重複を除く
+    /// (結果は板の数によらず同じ)。値がisovalueを超えるボクセルを内側とし、面の曖昧さは内側の頂点を分ける向きに揃える
+    /// @param extent ボリュームの物理的な大きさ(VolumeBase::extent)
+    /// @param slabs 板の数。0ならスレッド数に合わせる
+    template <typename T>
+    static void Extract(const VoxelGrid<T> &grid, const glm::vec3 &extent, float isovalue,
+                        std::vector<MeshVertex> &vertices, std::vector<GLuint> &indices, size_t slabs = 0);
+};
@@ -0,0 +1,93 @@
+#include "LabelTable.hpp"
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+namespace
+{
+    /// @brief 色相hue(0~1)の鮮やかな色
+    void HueToRgb(float hue, float rgb[3])
+    {
+        for (int channel = 0; channel < 3; ++channel)
+        {
+            const float k = fmod(hue * 6.0f + (channel == 0 ? 5.0f : channel == 1 ? 3.0f : 1.0f), 6.0f);
+            rgb[channel] = 1.0f - max(min(min(k, 4.0f - k), 1.0f), 0.0f);
+        }
+    }
+
+    uint8_t ToByte(float value)
+    {
+        return static_cast<uint8_t>(clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+}
+
+LabelTable::~LabelTable()
+{
+    if (texture)
+        glDeleteTextures(1, &texture);
+    if (buffer)
+        glDeleteBuffers(1, &buffer);
+}
+
+void LabelTable::Reset(uint32_t componentCount)
+{
+    styles.assign(size_t(componentCount) + 1, LabelStyle());
+    // 黄金角ずつ色相をずらすと、隣り合うIDの成分が似た色にならない
+    for (size_t label = 1; label < styles.size(); ++label)
+        HueToRgb(fmod(label * 0.618034f, 1.0f), styles[label].color);
+}
+
+void LabelTable::Isolate(uint32_t label)
+{
+    for (size_t i = 1; i < styles.size(); ++i)
+        styles[i].visible = i == label;
+}
+
+void LabelTable::SetAllVisible(bool visible)
+{
+    for (size_t i = 1; i < styles.size(); ++i)
+        styles[i].visible = visible;
+}
+
+void LabelTable::SetAllRecolor(bool recolor)
+{
+    for (size_t i = 1; i < styles.size(); ++i)
+        styles[i].recolor = recolor;
+}
+
+void LabelTable::Upload()
+{
+    vector<uint8_t> entries(styles.size() * 4);
+    for (size_t i = 0; i < styles.size(); ++i)
+    {
+        const LabelStyle &style = styles[i];
+        for (int channel = 0; channel < 3; ++channel)
+            entries[i * 4 + channel] = ToByte(style.color[channel]);
+        entries[i * 4 + 3] = !style.visible ? 0 : style.recolor ? 255 : 128;
+    }
+    if (!buffer)
+    {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if (styles.size() != capacity)
+    {
+        glBufferData(GL_TEXTURE_BUFFER, entries.size(), entries.data(), GL_DYNAMIC_DRAW);
+        capacity = styles.size();
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA8, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+    }
+    else
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, entries.size(), entries.data());
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+}
+
+void LabelTable::Bind(GLuint unit) const
+{
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glActiveTexture(GL_TEXTURE0);
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <GL/glew.h>
+
+/// @brief 成分1つの表示設定
+struct LabelStyle
+{
+    bool visible = true;
+    /// trueなら伝達関数の色の代わりにcolorで描く
+    bool recolor = false;
+    float color[3] = {1.0f, 1.0f, 1.0f};
+};
+
+/// @brief 成分ごとの表示(非表示・色替え)をシェーダに渡す小さな表(テクスチャバッファ, RGBA8)
+/// @details 要素はクラスタID順。rgbは色、aは0なら非表示、128なら伝達関数の色、255ならrgbの色で描く。
+/// 要素0(背景)は常に伝達関数の色で描く(成分の縁で補間された値を、ラベルが無い場合と同じに描くため)。
+/// シェーダはクラスタIDのテクスチャで表を引くので、表示を変えてもUpload()で表だけを転送し直せばよく、
+/// ボリュームやクラスタIDの再計算・再転送は不要
+class LabelTable
+{
+private:
+    GLuint buffer = 0;
+    GLuint texture = 0;
+    size_t capacity = 0; // バッファの要素数
+
+public:
+    /// クラスタID順の表示設定(要素0は背景で変更しない)
+    std::vector<LabelStyle> styles;
+
+    LabelTable() = default;
+    ~LabelTable();
+    LabelTable(const LabelTable &) = delete;
+    LabelTable &operator=(const LabelTable &) = delete;
+
+    /// @brief 成分数に合わせて作り直す。全成分を表示・色替えなしにし、色は成分ごとに色相をずらして割り当てる
+    void Reset(uint32_t componentCount);
+    /// @brief labelの成分だけを表示する
+    void Isolate(uint32_t label);
+    /// @brief 全成分の表示・非表示を切り替える
+    void SetAllVisible(bool visible);
+    /// @brief 全成分の色替えを切り替える
+    void SetAllRecolor(bool recolor);
+    /// @brief stylesをGPUへ転送する(成分数×4バイト)
+    void Upload();
+    /// @brief テクスチャユニットunitにバインドする
+    void Bind(GLuint unit) const;
+    bool Empty() const { return styles.size() <= 1; }
+};
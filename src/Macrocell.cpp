@@ -0,0 +1,110 @@
+#include "Macrocell.hpp"
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+using namespace std;
+
+namespace
+{
+    inline float ToFloat(uint8_t v) { return v; }
+    inline float ToFloat(uint16_t v) { return v; }
+    inline float ToFloat(Half v) { return v.ToFloat(); }
+    inline float ToFloat(float v) { return v; }
+
+    template <typename T>
+    void LoadRow(const T *row, size_t count, float *out)
+    {
+        for (size_t i = 0; i < count; ++i)
+            out[i] = ToFloat(row[i]);
+    }
+
+    /// @brief 行どうしの要素ごとの最小・最大を取る
+    void CombineRow(const float *__restrict row, size_t count, float *__restrict rowMin, float *__restrict rowMax)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            rowMin[i] = row[i] < rowMin[i] ? row[i] : rowMin[i];
+            rowMax[i] = row[i] > rowMax[i] ? row[i] : rowMax[i];
+        }
+    }
+
+    /// @brief ToFloat()の値をシェーダでサンプルした時と同じ0~1の値にする(整数型は正規化整数、浮動小数点型はそのまま)
+    template <typename T>
+    float Normalized(float value)
+    {
+        if constexpr (is_integral_v<T>)
+            return VoxelTraits<T>::Normalize(static_cast<T>(value));
+        else
+            return value;
+    }
+}
+
+template <typename T>
+VoxelGrid<ValueRange> ComputeMacrocells(const VoxelGrid<T> &source, size_t cellSize)
+{
+    const size_t nx = source.SizeX(), ny = source.SizeY(), nz = source.SizeZ();
+    const size_t cx = (nx + cellSize - 1) / cellSize, cy = (ny + cellSize - 1) / cellSize, cz = (nz + cellSize - 1) / cellSize;
+    VoxelGrid<ValueRange> cells(cx, cy, cz);
+    if (source.Empty())
+        return cells;
+    const long long planes = static_cast<long long>(cx);
+
+#pragma omp parallel for schedule(dynamic)
+    for (long long plane = 0; plane < planes; ++plane)
+    {
+        const size_t i = static_cast<size_t>(plane);
+        // セルの行(高さ方向のセル番号)ごとに、奥行き方向と高さ方向を縮約した幅方向の最小・最大
+        vector<float> row(nz), columnMin(cy * nz, numeric_limits<float>::max()), columnMax(cy * nz, numeric_limits<float>::lowest());
+        // 境界で補間される隣のボクセルも含める
+        const size_t x0 = i > 0 ? i * cellSize - 1 : 0, x1 = min((i + 1) * cellSize + 1, nx);
+        for (size_t x = x0; x < x1; ++x)
+        {
+            for (size_t y = 0; y < ny; ++y)
+            {
+                LoadRow(&source(x, y, 0), nz, row.data());
+                // 高さyを含むセル(前後1ボクセルずつ広げた範囲)は高々2つ
+                const size_t firstCell = y >= cellSize ? (y - 1) / cellSize : 0, lastCell = min((y + 1) / cellSize, cy - 1);
+                for (size_t j = firstCell; j <= lastCell; ++j)
+                    CombineRow(row.data(), nz, &columnMin[j * nz], &columnMax[j * nz]);
+            }
+        }
+        for (size_t j = 0; j < cy; ++j)
+        {
+            const float *rowMin = &columnMin[j * nz], *rowMax = &columnMax[j * nz];
+            for (size_t k = 0; k < cz; ++k)
+            {
+                const size_t z0 = k > 0 ? k * cellSize - 1 : 0, z1 = min((k + 1) * cellSize + 1, nz);
+                float low = rowMin[z0], high = rowMax[z0];
+                for (size_t z = z0 + 1; z < z1; ++z)
+                {
+                    low = min(low, rowMin[z]);
+                    high = max(high, rowMax[z]);
+                }
+                cells(i, j, k) = {Normalized<T>(low), Normalized<T>(high)};
+            }
+        }
+    }
+    return cells;
+}
+
+size_t ClassifyMacrocells(const VoxelGrid<ValueRange> &cells, float alphaMin, vector<uint8_t> &occupancy)
+{
+    occupancy.resize(cells.Count());
+    const ValueRange *ranges = cells.Data();
+    uint8_t *flags = occupancy.data();
+    const long long count = static_cast<long long>(cells.Count());
+    long long occupied = 0;
+#pragma omp parallel for schedule(static) reduction(+ : occupied)
+    for (long long i = 0; i < count; ++i)
+    {
+        flags[i] = ranges[i].max > alphaMin ? 1 : 0;
+        occupied += flags[i];
+    }
+    return static_cast<size_t>(occupied);
+}
+
+template VoxelGrid<ValueRange> ComputeMacrocells<uint8_t>(const VoxelGrid<uint8_t> &, size_t);
+template VoxelGrid<ValueRange> ComputeMacrocells<uint16_t>(const VoxelGrid<uint16_t> &, size_t);
+template VoxelGrid<ValueRange> ComputeMacrocells<Half>(const VoxelGrid<Half> &, size_t);
+template VoxelGrid<ValueRange> ComputeMacrocells<float>(const VoxelGrid<float> &, size_t);
@@ -0,0 +1,28 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+/// マクロセル(空領域スキップの単位)の一辺のボクセル数
+constexpr size_t macrocellSize = 8;
+
+/// @brief 1つのマクロセルに含まれる強度の範囲(シェーダでサンプルした時と同じ0~1の値)
+struct ValueRange
+{
+    float min = 0.0f, max = 0.0f;
+};
+
+/// @brief cellSize^3ボクセルごとの強度の最小値・最大値を求める
+/// @details セルの境界付近のサンプルは隣のボクセルとも線形補間されるので、各軸とも前後1ボクセルずつ広げた範囲で求める。
+/// 結果はsourceと同じ軸の順で、各軸の大きさはceil(n / cellSize)。
+/// セルのx平面ごとに並列化し、行をfloatに変換してから要素ごとの最小・最大を取るのでベクトル化される
+template <typename T>
+VoxelGrid<ValueRange> ComputeMacrocells(const VoxelGrid<T> &source, size_t cellSize = macrocellSize);
+
+/// @brief アルファの下限で各セルを分類する。最大値がalphaMin以下のセルはどこをサンプルしても不透明度が0なので飛ばしてよい
+/// @param occupancy 出力。セルごとに1ならサンプルが必要、0なら透明(cellsと同じ並び)
+/// @return サンプルが必要なセルの数
+size_t ClassifyMacrocells(const VoxelGrid<ValueRange> &cells, float alphaMin, std::vector<uint8_t> &occupancy);
@@ -0,0 +1,160 @@
+#include "MappedFile.hpp"
+#include <stdexcept>
+#include <utility>
+#include <cstdint>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+MappedFile::MappedFile(const string &filepath)
+{
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE)
+        throw runtime_error("Failed to open file: " + filepath);
+    this->fileHandle = file;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        Close();
+        throw runtime_error("Failed to get file size: " + filepath);
+    }
+    this->size = static_cast<size_t>(fileSize.QuadPart);
+    if (this->size == 0)
+    {
+        Close();
+        throw runtime_error("File is empty: " + filepath);
+    }
+
+    // PAGE_WRITECOPYでコピーオンライトにする
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_WRITECOPY, 0, 0, nullptr);
+    if (mapping == nullptr)
+    {
+        Close();
+        throw runtime_error("Failed to create file mapping: " + filepath);
+    }
+    this->mappingHandle = mapping;
+
+    this->data = static_cast<char *>(MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0));
+    if (this->data == nullptr)
+    {
+        Close();
+        throw runtime_error("Failed to map file: " + filepath);
+    }
+#else
+    int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Failed to open file: " + filepath);
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        throw runtime_error("Failed to get file size or file is empty: " + filepath);
+    }
+    this->size = static_cast<size_t>(st.st_size);
+
+    // MAP_PRIVATEでコピーオンライトにする。書き込まない限りページキャッシュを共有する
+    void *mapped = mmap(nullptr, this->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd); // マップ後はファイルディスクリプタは不要
+    if (mapped == MAP_FAILED)
+        throw runtime_error("Failed to map file: " + filepath);
+    this->data = static_cast<char *>(mapped);
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept
+{
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept
+{
+    if (this != &other)
+    {
+        Close();
+        swap(this->data, other.data);
+        swap(this->size, other.size);
+#ifdef _WIN32
+        swap(this->fileHandle, other.fileHandle);
+        swap(this->mappingHandle, other.mappingHandle);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (this->data)
+        UnmapViewOfFile(this->data);
+    if (this->mappingHandle)
+        CloseHandle(this->mappingHandle);
+    if (this->fileHandle)
+        CloseHandle(this->fileHandle);
+    this->mappingHandle = nullptr;
+    this->fileHandle = nullptr;
+#else
+    if (this->data)
+        munmap(this->data, this->size);
+#endif
+    this->data = nullptr;
+    this->size = 0;
+}
+
+void MappedFile::AdviseSequential() const
+{
+    if (!this->data)
+        return;
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = {this->data, this->size};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // アドバイスはビットフラグではないので個別に指定する
+    madvise(this->data, this->size, MADV_SEQUENTIAL);
+    madvise(this->data, this->size, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::AdviseRandom() const
+{
+#ifndef _WIN32
+    // Windowsには対応するアドバイスが無い(必要な範囲はPrefetchで個別に読む)
+    if (this->data)
+        madvise(this->data, this->size, MADV_RANDOM);
+#endif
+}
+
+void MappedFile::Prefetch(const void *address, size_t length)
+{
+    if (address == nullptr || length == 0)
+        return;
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range = {const_cast<void *>(address), length};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madviseはページ境界から始まる必要がある
+    const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(address) & ~(pageSize - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(address) + length;
+    madvise(reinterpret_cast<void *>(begin), end - begin, MADV_WILLNEED);
+#endif
+}
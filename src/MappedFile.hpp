@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+/// @brief ファイルをメモリマップするRAIIクラス
+/// @details コピーオンライトでマップするため、書き込んでもファイルには反映されない。
+/// 読み取りのみであればページキャッシュを直接参照するので、ヒープへのコピーは発生しない。
+class MappedFile
+{
+private:
+    char *data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+    void Close();
+
+public:
+    MappedFile() = default;
+    /// @brief ファイルをマップする。失敗した場合はstd::runtime_errorを投げる
+    /// @param filepath マップするファイルのパス
+    explicit MappedFile(const std::string &filepath);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    /// @brief 先頭から順に読み出すことをOSに伝え、先読みを促す
+    void AdviseSequential() const;
+    /// @brief 飛び飛びに読むことをOSに伝え、触れないページまで先読みされるのを防ぐ
+    void AdviseRandom() const;
+    /// @brief マップ領域の一部の読み込みを非同期に開始させる(ページ境界に揃える)
+    static void Prefetch(const void *address, size_t length);
+
+    bool IsOpen() const { return data != nullptr; }
+    char *Data() { return data; }
+    const char *Data() const { return data; }
+    size_t Size() const { return size; }
+};
@@ -0,0 +1,192 @@
+#include "MipPyramid.hpp"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+namespace
+{
+    /// @brief 縮約の途中はfloatで計算する
+    inline float ToAccumulator(uint8_t v) { return v; }
+    inline float ToAccumulator(uint16_t v) { return v; }
+    inline float ToAccumulator(Half v) { return v.ToFloat(); }
+    inline float ToAccumulator(float v) { return v; }
+
+    /// @brief 縮約結果をボクセル型に戻す(整数型は四捨五入)
+    template <typename T>
+    T FromAccumulator(float v)
+    {
+        if constexpr (is_same_v<T, Half>)
+            return Half::FromFloat(v);
+        else if constexpr (is_integral_v<T>)
+            return static_cast<T>(v + 0.5f);
+        else
+            return v;
+    }
+
+    template <typename T>
+    struct MaxOp
+    {
+        using Acc = float;
+        static Acc Load(T v) { return ToAccumulator(v); }
+        static Acc Combine(Acc a, Acc b) { return a > b ? a : b; }
+        static T Store(Acc a, int /*count*/) { return FromAccumulator<T>(a); }
+    };
+
+    template <typename T>
+    struct AverageOp
+    {
+        using Acc = float;
+        static Acc Load(T v) { return ToAccumulator(v); }
+        static Acc Combine(Acc a, Acc b) { return a + b; }
+        static T Store(Acc a, int count) { return FromAccumulator<T>(a / count); }
+    };
+
+    /// 整数型はビットごとのOR
+    template <typename T, typename Enable = void>
+    struct OrOp
+    {
+        using Acc = uint32_t;
+        static Acc Load(T v) { return v; }
+        static Acc Combine(Acc a, Acc b) { return a | b; }
+        static T Store(Acc a, int /*count*/) { return static_cast<T>(a); }
+    };
+
+    /// 浮動小数点型は非ゼロを1とみなした論理和
+    template <typename T>
+    struct OrOp<T, enable_if_t<!is_integral_v<T>>>
+    {
+        using Acc = float;
+        static Acc Load(T v) { return VoxelTraits<T>::IsZero(v) ? 0.0f : 1.0f; }
+        static Acc Combine(Acc a, Acc b) { return a > b ? a : b; }
+        static T Store(Acc a, int /*count*/) { return FromAccumulator<T>(a); }
+    };
+
+    /// @brief 出力ボクセルiが覆う入力の範囲[begin, end)。奇数の大きさなら最後の出力が3つ分を覆う
+    inline void SourceRange(size_t i, size_t outSize, size_t inSize, size_t &begin, size_t &end)
+    {
+        begin = min(2 * i, inSize - 1);
+        end = i + 1 == outSize ? inSize : begin + 2;
+    }
+
+    template <typename T, typename Op>
+    VoxelGrid<T> Reduce(const VoxelGrid<T> &source)
+    {
+        using Acc = typename Op::Acc;
+        const size_t nx = source.SizeX(), ny = source.SizeY(), nz = source.SizeZ();
+        const size_t outX = max<size_t>(nx / 2, 1), outY = max<size_t>(ny / 2, 1), outZ = max<size_t>(nz / 2, 1);
+        VoxelGrid<T> result(outX, outY, outZ);
+
+#pragma omp parallel
+        {
+            // (x,y)方向の2x2行を要素ごとに縮約した行。z方向の縮約はこの行の隣接要素で行う
+            vector<Acc> row(nz);
+#pragma omp for schedule(static)
+            for (long long ox = 0; ox < static_cast<long long>(outX); ++ox)
+            {
+                size_t x0, x1;
+                SourceRange(ox, outX, nx, x0, x1);
+                for (size_t oy = 0; oy < outY; ++oy)
+                {
+                    size_t y0, y1;
+                    SourceRange(oy, outY, ny, y0, y1);
+
+                    Acc *acc = row.data();
+                    const T *first = &source(x0, y0, 0);
+                    for (size_t z = 0; z < nz; ++z)
+                        acc[z] = Op::Load(first[z]);
+                    for (size_t x = x0; x < x1; ++x)
+                    {
+                        for (size_t y = (x == x0 ? y0 + 1 : y0); y < y1; ++y)
+                        {
+                            const T *src = &source(x, y, 0);
+                            for (size_t z = 0; z < nz; ++z)
+                                acc[z] = Op::Combine(acc[z], Op::Load(src[z]));
+                        }
+                    }
+
+                    const int rows = static_cast<int>((x1 - x0) * (y1 - y0));
+                    T *dst = &result(ox, oy, 0);
+                    for (size_t oz = 0; oz + 1 < outZ; ++oz)
+                        dst[oz] = Op::Store(Op::Combine(acc[2 * oz], acc[2 * oz + 1]), rows * 2);
+                    // 最後の出力は奇数なら3つ分
+                    size_t z0, z1;
+                    SourceRange(outZ - 1, outZ, nz, z0, z1);
+                    Acc last = acc[z0];
+                    for (size_t z = z0 + 1; z < z1; ++z)
+                        last = Op::Combine(last, acc[z]);
+                    dst[outZ - 1] = Op::Store(last, rows * static_cast<int>(z1 - z0));
+                }
+            }
+        }
+        return result;
+    }
+}
+
+const char *MipReductionName(MipReduction reduction)
+{
+    switch (reduction)
+    {
+    case MipReduction::Average:
+        return "avg";
+    case MipReduction::Or:
+        return "or";
+    case MipReduction::Max:
+    default:
+        return "max";
+    }
+}
+
+MipReduction ParseMipReduction(const string &name)
+{
+    if (name == "max")
+        return MipReduction::Max;
+    if (name == "avg" || name == "average")
+        return MipReduction::Average;
+    if (name == "or")
+        return MipReduction::Or;
+    throw runtime_error("Unknown mip reduction: " + name + " (max, avg, or)");
+}
+
+template <typename T>
+VoxelGrid<T> ReduceMipLevel(const VoxelGrid<T> &source, MipReduction reduction)
+{
+    switch (reduction)
+    {
+    case MipReduction::Average:
+        return Reduce<T, AverageOp<T>>(source);
+    case MipReduction::Or:
+        return Reduce<T, OrOp<T>>(source);
+    case MipReduction::Max:
+    default:
+        return Reduce<T, MaxOp<T>>(source);
+    }
+}
+
+template <typename T>
+vector<VoxelGrid<T>> BuildMipPyramid(const VoxelGrid<T> &source, MipReduction reduction, const atomic<bool> *cancel)
+{
+    vector<VoxelGrid<T>> levels;
+    if (source.Empty())
+        return levels;
+    const VoxelGrid<T> *previous = &source;
+    while (previous->SizeX() > 1 || previous->SizeY() > 1 || previous->SizeZ() > 1)
+    {
+        if (cancel && cancel->load(memory_order_relaxed))
+            break;
+        levels.push_back(ReduceMipLevel(*previous, reduction));
+        previous = &levels.back();
+    }
+    return levels;
+}
+
+template VoxelGrid<uint8_t> ReduceMipLevel<uint8_t>(const VoxelGrid<uint8_t> &, MipReduction);
+template VoxelGrid<uint16_t> ReduceMipLevel<uint16_t>(const VoxelGrid<uint16_t> &, MipReduction);
+template VoxelGrid<Half> ReduceMipLevel<Half>(const VoxelGrid<Half> &, MipReduction);
+template VoxelGrid<float> ReduceMipLevel<float>(const VoxelGrid<float> &, MipReduction);
+template vector<VoxelGrid<uint8_t>> BuildMipPyramid<uint8_t>(const VoxelGrid<uint8_t> &, MipReduction, const atomic<bool> *);
+template vector<VoxelGrid<uint16_t>> BuildMipPyramid<uint16_t>(const VoxelGrid<uint16_t> &, MipReduction, const atomic<bool> *);
+template vector<VoxelGrid<Half>> BuildMipPyramid<Half>(const VoxelGrid<Half> &, MipReduction, const atomic<bool> *);
+template vector<VoxelGrid<float>> BuildMipPyramid<float>(const VoxelGrid<float> &, MipReduction, const atomic<bool> *);
@@ -0,0 +1,33 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+/// @brief ミップレベルを作る時の2x2x2ボクセルの縮約方法
+enum class MipReduction
+{
+    Max,     // 最大値(細い構造や最大値投影が粗いレベルでも消えない)
+    Average, // 平均値
+    Or,      // 論理和(2値ボリューム向け。整数型はビットごとのOR、浮動小数点型は非ゼロなら1)
+};
+
+/// @brief 縮約方法の名前("max", "avg", "or")
+const char *MipReductionName(MipReduction reduction);
+/// @brief 名前から縮約方法を得る。不明な名前ならstd::runtime_errorを投げる
+MipReduction ParseMipReduction(const std::string &name);
+
+/// @brief 1段粗いミップレベルを作る
+/// @details 各軸の大きさはmax(1, n/2)(GLのミップレベルと同じ)。奇数の場合、最後のボクセルは3つ分を縮約する。
+/// 出力のx平面ごとに並列化し、行単位の要素ごとの演算でベクトル化されるようにしている
+template <typename T>
+VoxelGrid<T> ReduceMipLevel(const VoxelGrid<T> &source, MipReduction reduction);
+
+/// @brief レベル1から1x1x1までのミップピラミッドを作る(レベル0はsourceそのもの)
+/// @param cancel nullptrでなく、計算中にtrueになったらレベルの間で中断して途中までのレベルを返す
+template <typename T>
+std::vector<VoxelGrid<T>> BuildMipPyramid(const VoxelGrid<T> &source, MipReduction reduction, const std::atomic<bool> *cancel = nullptr);
+
@@ -0,0 +1,399 @@
+#include "Morphology.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define MORPHOLOGY_AVX2 1
+#define AVX2_TARGET __attribute__((target("avx2")))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <immintrin.h>
+#include <intrin.h>
+#define MORPHOLOGY_AVX2 1
+#define AVX2_TARGET
+#endif
+
+using namespace std;
+
+namespace
+{
+    /// @brief 構造要素の(x, y)ごとのz方向の半幅(zは[-halfWidth, halfWidth])
+    struct ElementRow
+    {
+        int dx, dy, halfWidth;
+    };
+
+    vector<ElementRow> ElementRows(const StructuringElement &element)
+    {
+        const int r = max(element.radius, 0);
+        vector<ElementRow> rows;
+        for (int dx = -r; dx <= r; ++dx)
+            for (int dy = -r; dy <= r; ++dy)
+            {
+                switch (element.shape)
+                {
+                case StructuringShape::Cross:
+                    if (dx == 0 && dy == 0)
+                        rows.push_back({dx, dy, r});
+                    else if (dx == 0 || dy == 0)
+                        rows.push_back({dx, dy, 0});
+                    break;
+                case StructuringShape::Ball:
+                    if (dx * dx + dy * dy <= r * r)
+                        rows.push_back({dx, dy, static_cast<int>(floor(sqrt(static_cast<double>(r * r - dx * dx - dy * dy))))});
+                    break;
+                case StructuringShape::Cube:
+                default:
+                    rows.push_back({dx, dy, r});
+                    break;
+                }
+            }
+        return rows;
+    }
+
+    /// @brief 演算に影響しない値(最小を取るなら最大値、最大を取るなら最小値)
+    template <typename T, bool takeMax>
+    T Neutral()
+    {
+        if constexpr (is_same_v<T, Half>)
+        {
+            Half infinity;
+            infinity.bits = takeMax ? 0xFC00 : 0x7C00; // -Inf, +Inf
+            return infinity;
+        }
+        else if constexpr (is_floating_point_v<T>)
+            return takeMax ? -numeric_limits<T>::infinity() : numeric_limits<T>::infinity();
+        else
+            return takeMax ? numeric_limits<T>::lowest() : numeric_limits<T>::max();
+    }
+
+    /// @brief out[i] = min(out[i], in[i])(takeMaxならmax)。ベクトル化されるよう分岐の無い形にしてある
+    template <typename T, bool takeMax>
+    void CombineRowScalar(T *out, const T *in, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            if constexpr (is_same_v<T, Half>)
+            {
+                const bool replace = takeMax ? in[i].ToFloat() > out[i].ToFloat() : in[i].ToFloat() < out[i].ToFloat();
+                out[i] = replace ? in[i] : out[i];
+            }
+            else
+                out[i] = takeMax ? max(out[i], in[i]) : min(out[i], in[i]);
+        }
+    }
+
+#ifdef MORPHOLOGY_AVX2
+    template <bool takeMax>
+    AVX2_TARGET void CombineRowAvx2(uint8_t *out, const uint8_t *in, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 32 <= n; i += 32)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), takeMax ? _mm256_max_epu8(a, b) : _mm256_min_epu8(a, b));
+        }
+        CombineRowScalar<uint8_t, takeMax>(out + i, in + i, n - i);
+    }
+
+    template <bool takeMax>
+    AVX2_TARGET void CombineRowAvx2(uint16_t *out, const uint16_t *in, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16)
+        {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(in + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), takeMax ? _mm256_max_epu16(a, b) : _mm256_min_epu16(a, b));
+        }
+        CombineRowScalar<uint16_t, takeMax>(out + i, in + i, n - i);
+    }
+
+    template <bool takeMax>
+    AVX2_TARGET void CombineRowAvx2(float *out, const float *in, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8)
+        {
+            const __m256 a = _mm256_loadu_ps(out + i);
+            const __m256 b = _mm256_loadu_ps(in + i);
+            _mm256_storeu_ps(out + i, takeMax ? _mm256_max_ps(a, b) : _mm256_min_ps(a, b));
+        }
+        CombineRowScalar<float, takeMax>(out + i, in + i, n - i);
+    }
+
+    bool DetectAvx2()
+    {
+#if defined(_MSC_VER)
+        // AVX(OSがYMMレジスタを保存するか)とAVX2の両方を確かめる
+        int info[4];
+        __cpuid(info, 0);
+        if (info[0] < 7)
+            return false;
+        __cpuid(info, 1);
+        const bool osxsave = (info[2] & (1 << 27)) != 0, avx = (info[2] & (1 << 28)) != 0;
+        if (!osxsave || !avx || (_xgetbv(0) & 6) != 6)
+            return false;
+        __cpuidex(info, 7, 0);
+        return (info[1] & (1 << 5)) != 0;
+#else
+        return __builtin_cpu_supports("avx2");
+#endif
+    }
+#endif
+
+    /// @brief 行の最小・最大。simdならAVX2のカーネルを使う(Halfは常にスカラー)
+    template <typename T, bool takeMax>
+    void CombineRow(T *out, const T *in, size_t n, bool simd)
+    {
+#ifdef MORPHOLOGY_AVX2
+        if constexpr (!is_same_v<T, Half>)
+        {
+            if (simd)
+            {
+                CombineRowAvx2<takeMax>(out, in, n);
+                return;
+            }
+        }
+#endif
+        (void)simd;
+        CombineRowScalar<T, takeMax>(out, in, n);
+    }
+
+    /// @brief 構造要素を1回当てる。changedには値が変わった平面を立てる
+    template <typename T, bool takeMax>
+    void MorphologyPass(VoxelGrid<T> &grid, const StructuringElement &element, bool simd, vector<uint8_t> &changed)
+    {
+        const size_t nx = grid.SizeX(), ny = grid.SizeY(), nz = grid.SizeZ();
+        const size_t planeCount = ny * nz;
+        const int r = max(element.radius, 0);
+        const vector<ElementRow> rows = ElementRows(element);
+        const T neutral = Neutral<T, takeMax>();
+
+        // x平面の塊。塊の外側の元の平面(半径分)は、隣の塊が書き戻す前に写しておく
+        const size_t threads = max(thread::hardware_concurrency(), 1u);
+        const size_t blocks = max<size_t>(1, min(threads, nx / (2 * r + 1)));
+        vector<vector<T>> apron(blocks);
+        for (size_t block = 0; block < blocks; ++block)
+        {
+            const size_t begin = nx * block / blocks, end = nx * (block + 1) / blocks;
+            const size_t low = begin - min<size_t>(begin, r), high = min(end + r, nx);
+            apron[block].resize(((begin - low) + (high - end)) * planeCount);
+            copy(&grid(low, 0, 0), &grid(low, 0, 0) + (begin - low) * planeCount, apron[block].begin());
+            copy(&grid(end, 0, 0), &grid(end, 0, 0) + (high - end) * planeCount, apron[block].begin() + (begin - low) * planeCount);
+        }
+
+#pragma omp parallel for schedule(static)
+        for (long long block = 0; block < static_cast<long long>(blocks); ++block)
+        {
+            const size_t begin = nx * block / blocks, end = nx * (block + 1) / blocks;
+            const size_t low = begin - min<size_t>(begin, r);
+            // 元の平面。塊の外は写し、塊の中はまだ書き戻していないので元のまま
+            const auto source = [&](size_t x) -> const T *
+            {
+                if (x < begin)
+                    return apron[block].data() + (x - low) * planeCount;
+                if (x >= end)
+                    return apron[block].data() + ((begin - low) + (x - end)) * planeCount;
+                return &grid(x, 0, 0);
+            };
+            // 書き戻しを待つ出力平面(半径+1枚のリング)と、z方向の窓の平面(半幅1..r)
+            vector<T> ring((r + 1) * planeCount);
+            vector<T> windows(r * planeCount);
+            const auto window = [&](int h) -> T *
+            { return windows.data() + (h - 1) * planeCount; };
+            const auto writeBack = [&](size_t x)
+            {
+                const T *result = ring.data() + (x % (r + 1)) * planeCount;
+                T *plane = &grid(x, 0, 0);
+                if (memcmp(result, plane, planeCount * sizeof(T)) != 0)
+                {
+                    copy(result, result + planeCount, plane);
+                    changed[x] = 1;
+                }
+            };
+
+            for (size_t x = begin; x < end; ++x)
+            {
+                T *out = ring.data() + (x % (r + 1)) * planeCount;
+                fill(out, out + planeCount, neutral);
+                for (int dx = -r; dx <= r; ++dx)
+                {
+                    if ((dx < 0 && x < static_cast<size_t>(-dx)) || x + dx >= nx)
+                        continue;
+                    const T *plane = source(x + dx);
+                    int maxHalfWidth = -1;
+                    for (const ElementRow &row : rows)
+                        if (row.dx == dx)
+                            maxHalfWidth = max(maxHalfWidth, row.halfWidth);
+                    if (maxHalfWidth < 0)
+                        continue;
+                    // 半幅hの窓 = 半幅h-1の窓を前後に1つずらしたものとの最小・最大
+                    for (int h = 1; h <= maxHalfWidth; ++h)
+                    {
+                        const T *previous = h == 1 ? plane : window(h - 1);
+                        T *current = window(h);
+                        copy(previous, previous + planeCount, current);
+                        if (nz < 2)
+                            continue;
+                        for (size_t y = 0; y < ny; ++y)
+                        {
+                            CombineRow<T, takeMax>(current + y * nz + 1, previous + y * nz, nz - 1, simd);
+                            CombineRow<T, takeMax>(current + y * nz, previous + y * nz + 1, nz - 1, simd);
+                        }
+                    }
+                    for (const ElementRow &row : rows)
+                    {
+                        if (row.dx != dx)
+                            continue;
+                        const T *windowed = row.halfWidth == 0 ? plane : window(row.halfWidth);
+                        const size_t yBegin = row.dy < 0 ? static_cast<size_t>(-row.dy) : 0;
+                        const size_t yEnd = row.dy > 0 ? ny - min<size_t>(ny, row.dy) : ny;
+                        for (size_t y = yBegin; y < yEnd; ++y)
+                            CombineRow<T, takeMax>(out + y * nz, windowed + (y + row.dy) * nz, nz, simd);
+                    }
+                }
+                // 平面x-rはもう入力として使わないので書き戻せる
+                if (x >= begin + r)
+                    writeBack(x - r);
+            }
+            for (size_t x = end - min<size_t>(end - begin, r); x < end; ++x)
+                writeBack(x);
+        }
+    }
+
+    template <typename T>
+    void Pass(VoxelGrid<T> &grid, bool takeMax, const StructuringElement &element, bool simd, vector<uint8_t> &changed)
+    {
+        if (takeMax)
+            MorphologyPass<T, true>(grid, element, simd, changed);
+        else
+            MorphologyPass<T, false>(grid, element, simd, changed);
+    }
+}
+
+const char *MorphologyOpName(MorphologyOp op)
+{
+    switch (op)
+    {
+    case MorphologyOp::Erode:
+        return "erode";
+    case MorphologyOp::Dilate:
+        return "dilate";
+    case MorphologyOp::Close:
+        return "close";
+    case MorphologyOp::Open:
+    default:
+        return "open";
+    }
+}
+
+const char *StructuringShapeName(StructuringShape shape)
+{
+    switch (shape)
+    {
+    case StructuringShape::Cross:
+        return "cross";
+    case StructuringShape::Ball:
+        return "ball";
+    case StructuringShape::Cube:
+    default:
+        return "cube";
+    }
+}
+
+MorphologyStep ParseMorphologyStep(const string &text)
+{
+    MorphologyStep step;
+    const size_t first = text.find(':');
+    const string op = text.substr(0, first);
+    if (op == "erode")
+        step.op = MorphologyOp::Erode;
+    else if (op == "dilate")
+        step.op = MorphologyOp::Dilate;
+    else if (op == "open")
+        step.op = MorphologyOp::Open;
+    else if (op == "close")
+        step.op = MorphologyOp::Close;
+    else
+        throw runtime_error("Unknown morphology operation: " + op + " (erode, dilate, open, close)");
+    if (first == string::npos)
+        return step;
+    const size_t second = text.find(':', first + 1);
+    const string shape = text.substr(first + 1, second == string::npos ? string::npos : second - first - 1);
+    if (shape == "cube")
+        step.element.shape = StructuringShape::Cube;
+    else if (shape == "cross")
+        step.element.shape = StructuringShape::Cross;
+    else if (shape == "ball")
+        step.element.shape = StructuringShape::Ball;
+    else
+        throw runtime_error("Unknown structuring element: " + shape + " (cube, cross, ball)");
+    if (second == string::npos)
+        return step;
+    try
+    {
+        step.element.radius = stoi(text.substr(second + 1));
+    }
+    catch (const exception &)
+    {
+        throw runtime_error("Invalid structuring element radius: " + text.substr(second + 1));
+    }
+    if (step.element.radius < 1)
+        throw runtime_error("Structuring element radius must be at least 1: " + text);
+    return step;
+}
+
+int MorphologyPasses(MorphologyOp op)
+{
+    return op == MorphologyOp::Open || op == MorphologyOp::Close ? 2 : 1;
+}
+
+bool MorphologySimdAvailable()
+{
+#ifdef MORPHOLOGY_AVX2
+    static const bool available = DetectAvx2();
+    return available;
+#else
+    return false;
+#endif
+}
+
+template <typename T>
+vector<uint8_t> ApplyMorphology(VoxelGrid<T> &grid, MorphologyOp op, const StructuringElement &element, bool simd)
+{
+    vector<uint8_t> changed(grid.SizeX(), 0);
+    if (grid.Empty() || element.radius < 1)
+        return changed;
+    simd = simd && MorphologySimdAvailable();
+    // Open/Closeで1回目に変わった平面が2回目で元に戻る場合も、変わったものとして扱う
+    switch (op)
+    {
+    case MorphologyOp::Erode:
+        Pass(grid, false, element, simd, changed);
+        break;
+    case MorphologyOp::Dilate:
+        Pass(grid, true, element, simd, changed);
+        break;
+    case MorphologyOp::Open:
+        Pass(grid, false, element, simd, changed);
+        Pass(grid, true, element, simd, changed);
+        break;
+    case MorphologyOp::Close:
+        Pass(grid, true, element, simd, changed);
+        Pass(grid, false, element, simd, changed);
+        break;
+    }
+    return changed;
+}
+
+template vector<uint8_t> ApplyMorphology(VoxelGrid<uint8_t> &, MorphologyOp, const StructuringElement &, bool);
+template vector<uint8_t> ApplyMorphology(VoxelGrid<uint16_t> &, MorphologyOp, const StructuringElement &, bool);
+template vector<uint8_t> ApplyMorphology(VoxelGrid<Half> &, MorphologyOp, const StructuringElement &, bool);
+template vector<uint8_t> ApplyMorphology(VoxelGrid<float> &, MorphologyOp, const StructuringElement &, bool);
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+
+/// @brief モルフォロジー演算
+enum class MorphologyOp
+{
+    Erode,  // 収縮(構造要素の中の最小値)
+    Dilate, // 膨張(構造要素の中の最大値)
+    Open,   // オープニング(収縮してから膨張。構造要素より小さい点状のノイズを消す)
+    Close,  // クロージング(膨張してから収縮。構造要素より小さい穴や割れ目を埋める)
+};
+
+/// @brief 構造要素の形(原点を中心に対称)
+enum class StructuringShape
+{
+    Cube,  // 一辺2r+1の立方体
+    Cross, // 各軸に沿った長さrの腕(r=1なら6近傍)
+    Ball,  // 半径rの球
+};
+
+/// @brief 構造要素
+struct StructuringElement
+{
+    StructuringShape shape = StructuringShape::Cube;
+    int radius = 1;
+};
+
+/// @brief モルフォロジー演算1回分(コマンドラインの--morph)
+struct MorphologyStep
+{
+    MorphologyOp op = MorphologyOp::Open;
+    StructuringElement element;
+};
+
+/// @brief 演算の名前("erode", "dilate", "open", "close")
+const char *MorphologyOpName(MorphologyOp op);
+/// @brief 構造要素の形の名前("cube", "cross", "ball")
+const char *StructuringShapeName(StructuringShape shape);
+/// @brief "op[:shape[:radius]]"(例: "open:ball:2")を解釈する。形の既定はcube、半径の既定は1。不正ならstd::runtime_errorを投げる
+MorphologyStep ParseMorphologyStep(const std::string &text);
+/// @brief 1回の演算で構造要素を当てる回数(Open/Closeは2回)。スループットの計算用
+int MorphologyPasses(MorphologyOp op);
+
+/// @brief 行の最小・最大にAVX2のカーネルを使えるか(x86向けにビルドされ、CPUが対応している)
+bool MorphologySimdAvailable();
+
+/// @brief 濃淡モルフォロジー演算をgridにその場で適用する(0と非0の2値ボリュームなら2値の演算と同じ結果)
+/// @details ボリュームの外は結果に影響しない値(収縮なら最大値、膨張なら最小値)とみなす。
+/// 構造要素を(x, y)ごとのz方向の半幅に分解し、元の平面のz方向の窓の最小・最大を半幅ごとに作ってから、行単位で最小・最大を取る。
+/// x平面の塊ごとに並列化し、各塊は出力平面を半径分遅らせて書き戻すので、作業領域は塊ごとに平面数枚で済む
+/// (塊の境界の外側の平面は始める前に写しておく)。行の最小・最大はAVX2(使えなければスカラー)で求める
+/// @param simd falseならAVX2を使わない(比較用)
+/// @return x平面ごとに、値が変わったなら1
+template <typename T>
+std::vector<uint8_t> ApplyMorphology(VoxelGrid<T> &grid, MorphologyOp op, const StructuringElement &element, bool simd = true);
@@ -144,7 +144,7 @@ double calculateMeanAbsoluteDifference(const std::vector<GLuint> &A, const std::
 /// @param Z Z軸
 /// @param view ビュー行列
 /// @return ソートされた頂点インデックス
-std::vector<GLuint> PointCloud::ReorderIndices(const std::vector<GLuint> &X, const std::vector<GLuint> &Y, const std::vector<GLuint> &Z, const glm::mat4 &MV)
+std::vector<GLuint> PointCloud::ReorderIndices(const CachedArray<GLuint> &X, const CachedArray<GLuint> &Y, const CachedArray<GLuint> &Z, const glm::mat4 &MV)
 {
     using sizevec3 = glm::vec<3, size_t, glm::defaultp>;
     size_t idxSize = X.size();
@@ -209,17 +209,45 @@ std::vector<GLuint> PointCloud::ReorderIndices(const std::vector<GLuint> &X, con
     return reordered;
 }
 
-PointCloud::PointCloud(const Volume &volume)
+PointCloud::PointCloud(const VolumeBase &volume, const DerivedCache *cache)
 {
+    // 詰めたボリュームは表面の点だけなので、同じ内容ハッシュでも別の名前で置く
+    const string prefix = volume.IsPacked() ? "points-v1-binary-" : "points-v1-";
+    if (cache)
+    {
+        const uint64_t key = volume.ContentHash();
+        if (cache->Map(key, prefix + "vertices", vertices) &&
+            cache->Map(key, prefix + "indices-x", indicesX) &&
+            cache->Map(key, prefix + "indices-y", indicesY) &&
+            cache->Map(key, prefix + "indices-z", indicesZ) &&
+            indicesX.size() == vertices.size() && indicesY.size() == vertices.size() && indicesZ.size() == vertices.size())
+            return;
+    }
+
     // ボリュームデータを点群データに変換
-    this->vertices = PointCloud::VolumeToVertices(volume.data);
+    vector<Vertex> points = VisitVolume(volume, [](const auto &typed)
+                                        { return PointCloud::VolumeToVertices(typed); });
     // 各軸方向にインデックスをソート
-    CreateAxisAlignedSortedIndices(vertices, indicesX, [&](GLuint a, GLuint b)
-                                   { return vertices[a].position.x < vertices[b].position.x; });
-    CreateAxisAlignedSortedIndices(vertices, indicesY, [&](GLuint a, GLuint b)
-                                   { return vertices[a].position.y < vertices[b].position.y; });
-    CreateAxisAlignedSortedIndices(vertices, indicesZ, [&](GLuint a, GLuint b)
-                                   { return vertices[a].position.z < vertices[b].position.z; });
+    vector<GLuint> sortedX, sortedY, sortedZ;
+    CreateAxisAlignedSortedIndices(points, sortedX, [&](GLuint a, GLuint b)
+                                   { return points[a].position.x < points[b].position.x; });
+    CreateAxisAlignedSortedIndices(points, sortedY, [&](GLuint a, GLuint b)
+                                   { return points[a].position.y < points[b].position.y; });
+    CreateAxisAlignedSortedIndices(points, sortedZ, [&](GLuint a, GLuint b)
+                                   { return points[a].position.z < points[b].position.z; });
+
+    if (cache)
+    {
+        const uint64_t key = volume.ContentHash();
+        cache->Store(key, prefix + "vertices", points);
+        cache->Store(key, prefix + "indices-x", sortedX);
+        cache->Store(key, prefix + "indices-y", sortedY);
+        cache->Store(key, prefix + "indices-z", sortedZ);
+    }
+    this->vertices = std::move(points);
+    this->indicesX = std::move(sortedX);
+    this->indicesY = std::move(sortedY);
+    this->indicesZ = std::move(sortedZ);
 }
 
 PointCloud::PointCloud(/* args */)
@@ -236,38 +264,89 @@ PointCloud::~PointCloud()
         glDeleteBuffers(1, &ibo);
 }
 
-vector<Vertex> PointCloud::VolumeToVertices(const Volume::VolumeData &data)
+template <typename T>
+vector<Vertex> PointCloud::VolumeToVertices(const Volume<T> &volume)
 {
+    using Traits = VoxelTraits<T>;
     vector<Vertex> vertices;
-    vertices.reserve(static_cast<size_t>(data.size() * data.size() * data.size() * 0.1f)); // 10%でとりあえずアロケート
-    int N = data.size();
-    float scale = 1.0f / static_cast<float>(N);
-    constexpr size_t step = 1;
-    for (int i = 0; i < N; i += step)
+    // レイキャスティングのテクスチャ座標と向きを合わせるため、最速軸(k)をx、最遅軸(i)をzに置く
+    const glm::vec3 scale = volume.extent / glm::vec3(volume.resolution);
+    auto emit = [&](size_t i, size_t j, size_t k, const T &intencity)
     {
-        for (int j = 0; j < N; j += step)
+        if (!Traits::IsZero(intencity))
         {
-            for (int k = 0; k < N; k += step)
+            float x = (k + 0.5f) * scale.x - volume.extent.x * 0.5f;
+            float y = (j + 0.5f) * scale.y - volume.extent.y * 0.5f;
+            float z = (i + 0.5f) * scale.z - volume.extent.z * 0.5f;
+            float colorValue = Traits::Normalize(intencity);
+            vertices.push_back(Vertex{
+                glm::vec3(x, y, z),
+                glm::float32(colorValue),
+            });
+        }
+    };
+
+    if (volume.IsPacked())
+    {
+        // 詰めたボリュームの点は全て不透明(アルファ1)なので、6近傍が埋まった内部の点は手前の点に隠れる。
+        // 表面のボクセルだけをワード単位で取り出し、立っているビットを下位から順に点にする
+        const BitGrid surface = volume.bits.Surface();
+        vertices.reserve(surface.CountOnes());
+        for (size_t i = 0; i < surface.SizeX(); ++i)
+            for (size_t j = 0; j < surface.SizeY(); ++j)
             {
-                auto cell = &data[i][j][k];
-                if (data[i][j][k].intencity != 0)
-                {
-                    float x = (i + 0.5f) * scale - 0.5f;
-                    float y = (j + 0.5f) * scale - 0.5f;
-                    float z = (k + 0.5f) * scale - 0.5f;
-                    float colorValue = static_cast<float>(cell->intencity) / 255.0f;
-                    vertices.push_back(Vertex{
-                        glm::vec3(x, y, z),
-                        glm::float32(colorValue),
-                    });
-                }
+                const uint64_t *words = surface.Row(i, j);
+                for (size_t w = 0; w < surface.WordsPerRow(); ++w)
+                    for (uint64_t word = words[w]; word != 0; word &= word - 1)
+                    {
+                        const size_t k = w * 64 + CountTrailingZeros(word);
+                        vertices.push_back(Vertex{
+                            glm::vec3((k + 0.5f) * scale.x - volume.extent.x * 0.5f, (j + 0.5f) * scale.y - volume.extent.y * 0.5f, (i + 0.5f) * scale.z - volume.extent.z * 0.5f),
+                            glm::float32(1.0f),
+                        });
+                    }
             }
+        return vertices;
+    }
+
+    if (volume.pages)
+    {
+        // ページングしている場合はブリック単位で走査し、各ブリックを1回だけ展開する。空のブリックは展開しない
+        const BrickCache<T> &pages = *volume.pages;
+        for (size_t brick = 0; brick < pages.BrickCount(); ++brick)
+        {
+            if (pages.IsEmpty(brick))
+                continue;
+            const BrickBox box = pages.Box(brick);
+            const T *voxel = pages.Brick(brick);
+            for (size_t x = 0; x < box.size[0]; ++x)
+                for (size_t y = 0; y < box.size[1]; ++y)
+                    for (size_t z = 0; z < box.size[2]; ++z, ++voxel)
+                        emit(box.origin[0] + x, box.origin[1] + y, box.origin[2] + z, *voxel);
+        }
+        return vertices;
+    }
+
+    const VoxelGrid<T> &grid = volume.intencity;
+    vertices.reserve(static_cast<size_t>(grid.Count() * 0.1f)); // 10%でとりあえずアロケート
+    const T *voxel = grid.Data(); // 連続領域なので先頭から順に走査する
+    for (size_t i = 0; i < grid.SizeX(); ++i)
+    {
+        for (size_t j = 0; j < grid.SizeY(); ++j)
+        {
+            for (size_t k = 0; k < grid.SizeZ(); ++k, ++voxel)
+                emit(i, j, k, *voxel);
         }
     }
 
     return vertices;
 }
 
+template vector<Vertex> PointCloud::VolumeToVertices(const Volume<uint8_t> &);
+template vector<Vertex> PointCloud::VolumeToVertices(const Volume<uint16_t> &);
+template vector<Vertex> PointCloud::VolumeToVertices(const Volume<Half> &);
+template vector<Vertex> PointCloud::VolumeToVertices(const Volume<float> &);
+
 void PointCloud::UploadBuffer()
 {
     glGenVertexArrays(1, &this->vao);
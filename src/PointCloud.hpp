@@ -18,22 +18,26 @@ struct Vertex
 // 点群クラス
 class PointCloud
 {
-private:
-    static std::vector<GLuint> ReorderIndices(const std::vector<GLuint> &X, const std::vector<GLuint> &Y, const std::vector<GLuint> &Z, const glm::mat4 &MV);
-
 public:
-    std::vector<Vertex> vertices;
-    std::vector<GLuint> indicesX;
-    std::vector<GLuint> indicesY;
-    std::vector<GLuint> indicesZ;
+    /// @brief 各軸にソートしたインデックスから視点順の描画順を近似する(Draw()が毎フレーム呼ぶ)
+    static std::vector<GLuint> ReorderIndices(const CachedArray<GLuint> &X, const CachedArray<GLuint> &Y, const CachedArray<GLuint> &Z, const glm::mat4 &MV);
+    // キャッシュから読み込んだ場合はマップ領域をコピーせずに参照する
+    CachedArray<Vertex> vertices;
+    CachedArray<GLuint> indicesX;
+    CachedArray<GLuint> indicesY;
+    CachedArray<GLuint> indicesZ;
 
     GLuint vao = 0, vbo = 0, ibo = 0;
     PointCloud(/* args */);
-    PointCloud(const Volume &volume);
+    /// @brief ボリュームを点群に変換し、各軸方向にソートしたインデックスを作る
+    /// @param cache nullptrでなければ、頂点とインデックスがキャッシュにあればマップしたまま使い、無ければ作って保存する
+    PointCloud(const VolumeBase &volume, const DerivedCache *cache = nullptr);
     ~PointCloud();
 
     void UploadBuffer();
     void Draw(const glm::mat4 &view);
 
-    static std::vector<Vertex> VolumeToVertices(const Volume::VolumeData &data);
+    /// @brief 非ゼロのボクセルを点にする。1ビットに詰めたボリュームは表面のボクセルだけを点にする(アルファは全て1)
+    template <typename T>
+    static std::vector<Vertex> VolumeToVertices(const Volume<T> &volume);
 };
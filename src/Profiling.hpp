@@ -0,0 +1,95 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+/// @brief プロセスのピーク常駐メモリ(Peak RSS)をバイト単位で取得する
+inline size_t GetPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return static_cast<size_t>(counters.PeakWorkingSetSize);
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss); // macOSはバイト単位
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024; // Linuxはキロバイト単位
+#endif
+#endif
+}
+
+/// @brief プロセスがストレージから読み込んだバイト数(ページキャッシュに当たった分は含まない)。取得できなければ0
+inline size_t GetStorageReadBytes()
+{
+#ifdef _WIN32
+    IO_COUNTERS counters;
+    if (GetProcessIoCounters(GetCurrentProcess(), &counters))
+        return static_cast<size_t>(counters.ReadTransferCount);
+    return 0;
+#else
+    // Linuxのみ。メモリマップのページフォルトによる読み込みも含む
+    std::ifstream is("/proc/self/io");
+    std::string key;
+    size_t value = 0;
+    while (is >> key >> value)
+        if (key == "read_bytes:")
+            return value;
+    return 0;
+#endif
+}
+
+/// @brief ファイルをページキャッシュから追い出し、次の読み込みをストレージからの読み込みにする(計測用)
+inline void DropFileCache(const std::string &filepath)
+{
+#ifndef _WIN32
+    const int fd = open(filepath.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+    fsync(fd); // 書き込み直後の汚れたページは追い出せない
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+#endif
+    close(fd);
+#endif
+}
+
+/// @brief バイト数をMiB単位に変換する
+inline double ToMiB(size_t bytes)
+{
+    return static_cast<double>(bytes) / (1024.0 * 1024.0);
+}
+
+/// @brief 経過時間を計測するストップウォッチ
+class Stopwatch
+{
+private:
+    std::chrono::high_resolution_clock::time_point start = std::chrono::high_resolution_clock::now();
+
+public:
+    void Reset() { start = std::chrono::high_resolution_clock::now(); }
+    /// @brief 計測開始からの経過時間をミリ秒で返す
+    double ElapsedMs() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+    }
+};
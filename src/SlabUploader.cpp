@@ -0,0 +1,169 @@
+#include "SlabUploader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "MappedFile.hpp"
+
+using namespace std;
+
+SlabUploader::SlabUploader(size_t ringSize, size_t slabBytesTarget)
+    : ring(max<size_t>(ringSize, 1)), slabBytesTarget(slabBytesTarget)
+{
+}
+
+SlabUploader::~SlabUploader()
+{
+    Release();
+    for (Slot &slot : ring)
+    {
+        if (slot.fence)
+            glDeleteSync(slot.fence);
+        if (slot.pbo)
+            glDeleteBuffers(1, &slot.pbo);
+    }
+}
+
+void SlabUploader::Begin(GLuint _texture, const vector<Level> &_levels, GLenum _format, GLenum _type, size_t _voxelBytes)
+{
+    Release();
+    this->bytesDone = 0;
+    this->bytesTotal = 0;
+    this->mapFailed = false;
+
+    this->levels = _levels;
+    for (Level &level : levels)
+    {
+        if (level.texture)
+            continue;
+        level.texture = _texture;
+        level.format = _format;
+        level.type = _type;
+        level.voxelBytes = _voxelBytes;
+    }
+
+    // PBOの容量は最も大きいスラブに合わせる
+    size_t requiredBytes = 0;
+    for (const Level &level : levels)
+    {
+        const size_t levelSliceBytes = static_cast<size_t>(level.resolution.x) * level.resolution.y * level.voxelBytes;
+        const size_t depth = clamp<size_t>(slabBytesTarget / max<size_t>(levelSliceBytes, 1), 1, level.resolution.z);
+        requiredBytes = max(requiredBytes, levelSliceBytes * depth);
+        bytesTotal += levelSliceBytes * level.resolution.z;
+    }
+    // PBOの容量が足りなければ確保し直す
+    if (requiredBytes > this->slabBytes)
+    {
+        this->slabBytes = requiredBytes;
+        for (Slot &slot : ring)
+        {
+            // glBufferDataで確保し直すと転送中の古い領域とは切り離されるので、フェンスは不要になる
+            if (slot.fence)
+            {
+                glDeleteSync(slot.fence);
+                slot.fence = nullptr;
+            }
+            if (slot.pbo == 0)
+                glGenBuffers(1, &slot.pbo);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, this->slabBytes, nullptr, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    this->levelIndex = 0;
+    if (!levels.empty())
+        BeginLevel();
+    this->timer.Reset();
+}
+
+void SlabUploader::BeginLevel()
+{
+    const Level &level = levels[levelIndex];
+    this->nextSlice = 0;
+    this->sliceBytes = static_cast<size_t>(level.resolution.x) * level.resolution.y * level.voxelBytes;
+    // 目標バイト数に収まるスライス数(最低1枚)
+    this->slabDepth = static_cast<int>(clamp<size_t>(slabBytesTarget / max<size_t>(sliceBytes, 1), 1, level.resolution.z));
+    // 最初のスラブの読み込みを先行させる
+    MappedFile::Prefetch(level.data, sliceBytes * slabDepth);
+}
+
+bool SlabUploader::Step(double budgetMs)
+{
+    if (!IsActive())
+        return true;
+
+    Stopwatch frameTimer;
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    do
+    {
+        Slot &slot = ring[ringIndex];
+        // このPBOからの前回の転送が終わっていなければ、待たずに次のフレームへ回す
+        if (slot.fence)
+        {
+            if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+                break;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+
+        const Level &level = levels[levelIndex];
+        glBindTexture(GL_TEXTURE_3D, level.texture);
+        const int depth = min(slabDepth, level.resolution.z - nextSlice);
+        const size_t bytes = sliceBytes * depth;
+        const char *slab = level.data + sliceBytes * nextSlice;
+
+        // 次のスラブのページ読み込みをOSに先行させ、このスラブの転送と重ねる
+        const size_t remaining = sliceBytes * (level.resolution.z - nextSlice - depth);
+        MappedFile::Prefetch(slab + bytes, min(bytes, remaining));
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.pbo);
+        // フェンスで転送完了を確認済みなので同期なしでマップしてよい
+        // (フェンスは転送をまたいで保持するので、前回のBeginの転送が読んでいる途中のPBOは上で待たれる)
+        void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (dst == nullptr)
+        {
+            // マップできなければPBOを使わずクライアントメモリから同期転送する(遅いが転送は止まらない)
+            if (!mapFailed)
+                cerr << "[ERROR] glMapBufferRange failed (GL error 0x" << hex << glGetError() << dec << "), uploading slabs without PBO" << endl;
+            mapFailed = true;
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            glTexSubImage3D(GL_TEXTURE_3D, level.level, 0, 0, nextSlice, level.resolution.x, level.resolution.y, depth, level.format, level.type, slab);
+        }
+        else
+        {
+            memcpy(dst, slab, bytes);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+            // PBOがバインドされているので最後の引数はPBO先頭からのオフセット
+            glTexSubImage3D(GL_TEXTURE_3D, level.level, 0, 0, nextSlice, level.resolution.x, level.resolution.y, depth, level.format, level.type, nullptr);
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+
+        nextSlice += depth;
+        bytesDone += bytes;
+        ringIndex = (ringIndex + 1) % ring.size();
+        if (nextSlice >= level.resolution.z && ++levelIndex < levels.size())
+            BeginLevel();
+    } while (levelIndex < levels.size() && frameTimer.ElapsedMs() < budgetMs);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    if (levelIndex >= levels.size())
+    {
+        Release();
+        return true;
+    }
+    return false;
+}
+
+void SlabUploader::Cancel()
+{
+    Release();
+}
+
+void SlabUploader::Release()
+{
+    // フェンスは消さない。次のBeginの最初のマップ前にStepで待つ
+    this->levels.clear();
+}
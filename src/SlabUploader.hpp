@@ -0,0 +1,79 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Profiling.hpp"
+
+/// @brief 3DテクスチャをZ方向のスラブ単位で、PBOのリングを通して少しずつ転送するクラス
+/// @details 1フレームあたりの時間予算の範囲でスラブを転送するため、巨大なボリュームでも描画が止まらない。
+/// スラブkをPBOからテクスチャへ転送している間に、スラブk+1のファイル読み込みを先行させる。
+/// ミップマップがある場合は渡された順にレベルごとに転送する。形式の違う複数のテクスチャ(強度・勾配・クラスタID)も続けて転送できる。
+class SlabUploader
+{
+public:
+    /// @brief 転送するミップレベル
+    struct Level
+    {
+        int level;             // ミップレベル
+        glm::ivec3 resolution; // このレベルの解像度(幅,高さ,奥行き)
+        const char *data;      // 幅が最速軸のボクセル配列
+        // 転送先と形式。textureが0ならBegin()の引数を使う
+        GLuint texture = 0;
+        GLenum format = GL_RED;
+        GLenum type = GL_UNSIGNED_BYTE;
+        size_t voxelBytes = 1;
+    };
+
+private:
+    struct Slot
+    {
+        GLuint pbo = 0;
+        GLsync fence = nullptr; // このPBOからの転送完了を示すフェンス(転送をまたいで保持する)
+    };
+    std::vector<Slot> ring;
+    size_t ringIndex = 0;
+    size_t slabBytesTarget;
+    size_t slabBytes = 0; // 1スラブのバイト数(PBOの容量)
+    int slabDepth = 1;    // 1スラブのスライス数
+
+    std::vector<Level> levels; // 空なら転送していない
+    size_t levelIndex = 0;     // 転送中のlevelsの要素
+    size_t sliceBytes = 0;
+    int nextSlice = 0;
+    size_t bytesDone = 0;
+    size_t bytesTotal = 0;
+    bool mapFailed = false; // PBOをマップできず同期転送に切り替えた(エラーは1回だけ出す)
+    Stopwatch timer;
+
+    void Release();
+    /// @brief levelIndexのレベルの転送を準備する(スライスのバイト数、スラブの厚さ、先読み)
+    void BeginLevel();
+
+public:
+    /// @param ringSize PBOの個数
+    /// @param slabBytesTarget 1スラブのおおよそのバイト数
+    SlabUploader(size_t ringSize = 3, size_t slabBytesTarget = 4 * 1024 * 1024);
+    ~SlabUploader();
+    SlabUploader(const SlabUploader &) = delete;
+    SlabUploader &operator=(const SlabUploader &) = delete;
+
+    /// @brief 転送を開始する。テクスチャはglTexStorage3Dで全レベル確保済みであること
+    /// @param levels 転送するレベル(この順に転送する)。各レベルのdataは転送完了まで有効であること。textureが0のレベルは引数の転送先と形式を使う
+    void Begin(GLuint texture, const std::vector<Level> &levels, GLenum format, GLenum type, size_t voxelBytes);
+    /// @brief 転送先と形式を全て指定したレベルの転送を開始する
+    void Begin(const std::vector<Level> &levels) { Begin(0, levels, GL_RED, GL_UNSIGNED_BYTE, 1); }
+    /// @brief 時間予算の範囲でスラブを転送する。毎フレーム呼ぶ
+    /// @param budgetMs このフレームで転送に使ってよい時間[ms]
+    /// @return 転送が完了していればtrue
+    bool Step(double budgetMs);
+    /// @brief 転送を中断する
+    void Cancel();
+    bool IsActive() const { return !levels.empty(); }
+    /// @brief 進捗(0~1、バイト数の比)
+    float Progress() const { return bytesTotal > 0 ? static_cast<float>(bytesDone) / bytesTotal : 0.0f; }
+    /// @brief 転送開始からの経過時間[ms]
+    double ElapsedMs() const { return timer.ElapsedMs(); }
+};
@@ -0,0 +1,404 @@
+#include "SliceStack.hpp"
+#include "FileList.hpp"
+#include "Profiling.hpp"
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+    const vector<string> TIFF_EXTENSIONS = {".tif", ".tiff"};
+    const vector<string> SLICE_EXTENSIONS = {".tif", ".tiff", ".raw"};
+
+    // TIFFのタグ
+    constexpr uint16_t TAG_IMAGE_WIDTH = 256;
+    constexpr uint16_t TAG_IMAGE_LENGTH = 257;
+    constexpr uint16_t TAG_BITS_PER_SAMPLE = 258;
+    constexpr uint16_t TAG_COMPRESSION = 259;
+    constexpr uint16_t TAG_STRIP_OFFSETS = 273;
+    constexpr uint16_t TAG_SAMPLES_PER_PIXEL = 277;
+    constexpr uint16_t TAG_ROWS_PER_STRIP = 278;
+    constexpr uint16_t TAG_STRIP_BYTE_COUNTS = 279;
+    constexpr uint16_t TAG_TILE_WIDTH = 322;
+    constexpr uint16_t TAG_SAMPLE_FORMAT = 339;
+    // TIFFの型
+    constexpr uint16_t TYPE_SHORT = 3;
+    constexpr uint16_t TYPE_LONG = 4;
+
+    bool IsHostLittleEndian()
+    {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    }
+
+    /// @brief 要素ごとにバイト順を反転する
+    void SwapBytes(char *data, size_t count, size_t elementBytes)
+    {
+        for (size_t i = 0; i < count; ++i)
+            reverse(data + i * elementBytes, data + (i + 1) * elementBytes);
+    }
+
+    /// @brief TIFFのメタデータ(ヘッダとIFD)を読むためのリーダー。バイト順はファイルに従う
+    class TiffReader
+    {
+    private:
+        string path;
+        ifstream is;
+        uint64_t size = 0;
+
+    public:
+        bool little = true;
+
+        explicit TiffReader(const string &_path)
+            : path(_path), is(_path, ios::binary)
+        {
+            if (!is)
+                throw runtime_error("Failed to open " + path);
+            size = fs::file_size(path);
+        }
+
+        uint64_t Size() const { return size; }
+
+        void ReadAt(uint64_t offset, void *data, size_t bytes)
+        {
+            if (offset + bytes > size)
+                throw runtime_error("TIFF structure is truncated: " + path);
+            is.seekg(static_cast<streamoff>(offset));
+            is.read(static_cast<char *>(data), static_cast<streamsize>(bytes));
+            if (!is)
+                throw runtime_error("Failed to read " + path);
+        }
+
+        uint16_t U16(const unsigned char *p) const
+        {
+            return little ? uint16_t(p[0] | p[1] << 8) : uint16_t(p[0] << 8 | p[1]);
+        }
+        uint32_t U32(const unsigned char *p) const
+        {
+            return little ? uint32_t(p[0]) | uint32_t(p[1]) << 8 | uint32_t(p[2]) << 16 | uint32_t(p[3]) << 24
+                          : uint32_t(p[0]) << 24 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 8 | uint32_t(p[3]);
+        }
+
+        /// @brief IFDエントリ(12バイト)の値の配列。SHORTとLONGのみ対応する
+        vector<uint64_t> Values(const unsigned char *entry)
+        {
+            const uint16_t type = U16(entry + 2);
+            const uint32_t count = U32(entry + 4);
+            if (type != TYPE_SHORT && type != TYPE_LONG)
+                throw runtime_error("Unsupported TIFF field type " + to_string(type) + ": " + path);
+            const size_t elementBytes = type == TYPE_SHORT ? 2 : 4;
+            vector<unsigned char> bytes(static_cast<size_t>(count) * elementBytes);
+            // 4バイトに収まる値はエントリに直接入っている
+            if (bytes.size() <= 4)
+                copy(entry + 8, entry + 8 + bytes.size(), bytes.begin());
+            else
+                ReadAt(U32(entry + 8), bytes.data(), bytes.size());
+            vector<uint64_t> values(count);
+            for (uint32_t i = 0; i < count; ++i)
+                values[i] = type == TYPE_SHORT ? U16(&bytes[i * 2]) : U32(&bytes[i * 4]);
+            return values;
+        }
+    };
+}
+
+RawSliceFormat ParseRawSliceFormat(const string &text)
+{
+    RawSliceFormat format;
+    istringstream is(text);
+    char separator = 0;
+    if (!(is >> format.width >> separator >> format.height) || separator != 'x' || format.width == 0 || format.height == 0)
+        throw runtime_error("Invalid slice format \"" + text + "\". Expected WxH[:u8|u16|f16|f32][be].");
+    string type;
+    if (is.get(separator) && separator == ':' && getline(is, type))
+    {
+        if (type.size() > 2 && type.compare(type.size() - 2, 2, "be") == 0)
+        {
+            format.endian = VolumeHeader::Endian::Big;
+            type.resize(type.size() - 2);
+        }
+        bool known = false;
+        for (VolumeHeader::VoxelType candidate : {VolumeHeader::VoxelType::UInt8, VolumeHeader::VoxelType::UInt16, VolumeHeader::VoxelType::Float16, VolumeHeader::VoxelType::Float32})
+        {
+            if (type == VolumeHeader::VoxelTypeName(candidate))
+            {
+                format.voxelType = candidate;
+                known = true;
+            }
+        }
+        if (!known)
+            throw runtime_error("Unknown slice voxel type \"" + type + "\". Expected u8, u16, f16 or f32.");
+    }
+    return format;
+}
+
+vector<SliceStack::Slice> SliceStack::ReadTiffSlices(const string &path, Format &format)
+{
+    TiffReader reader(path);
+    unsigned char header[8];
+    reader.ReadAt(0, header, sizeof(header));
+    if (header[0] == 'I' && header[1] == 'I')
+        reader.little = true;
+    else if (header[0] == 'M' && header[1] == 'M')
+        reader.little = false;
+    else
+        throw runtime_error("Not a TIFF file: " + path);
+    const uint16_t magic = reader.U16(header + 2);
+    if (magic == 43)
+        throw runtime_error("BigTIFF is not supported: " + path);
+    if (magic != 42)
+        throw runtime_error("Not a TIFF file: " + path);
+
+    vector<Slice> slices;
+    set<uint64_t> visited; // IFDの循環を検出する
+    for (uint64_t ifd = reader.U32(header + 4); ifd != 0;)
+    {
+        if (!visited.insert(ifd).second)
+            throw runtime_error("TIFF IFD chain has a cycle: " + path);
+        unsigned char countBytes[2];
+        reader.ReadAt(ifd, countBytes, 2);
+        const uint16_t entryCount = reader.U16(countBytes);
+        vector<unsigned char> entries(entryCount * 12 + 4);
+        reader.ReadAt(ifd + 2, entries.data(), entries.size());
+
+        Format page;
+        uint64_t bits = 1, compression = 1, samples = 1, sampleFormat = 1, rowsPerStrip = UINT32_MAX;
+        vector<uint64_t> offsets, byteCounts;
+        for (uint16_t i = 0; i < entryCount; ++i)
+        {
+            const unsigned char *entry = &entries[i * 12];
+            const uint16_t tag = reader.U16(entry);
+            switch (tag)
+            {
+            case TAG_IMAGE_WIDTH:
+                page.width = static_cast<uint32_t>(reader.Values(entry).at(0));
+                break;
+            case TAG_IMAGE_LENGTH:
+                page.height = static_cast<uint32_t>(reader.Values(entry).at(0));
+                break;
+            case TAG_BITS_PER_SAMPLE:
+                bits = reader.Values(entry).at(0);
+                break;
+            case TAG_COMPRESSION:
+                compression = reader.Values(entry).at(0);
+                break;
+            case TAG_SAMPLES_PER_PIXEL:
+                samples = reader.Values(entry).at(0);
+                break;
+            case TAG_ROWS_PER_STRIP:
+                rowsPerStrip = reader.Values(entry).at(0);
+                break;
+            case TAG_SAMPLE_FORMAT:
+                sampleFormat = reader.Values(entry).at(0);
+                break;
+            case TAG_STRIP_OFFSETS:
+                offsets = reader.Values(entry);
+                break;
+            case TAG_STRIP_BYTE_COUNTS:
+                byteCounts = reader.Values(entry);
+                break;
+            case TAG_TILE_WIDTH:
+                throw runtime_error("Tiled TIFF is not supported: " + path);
+            }
+        }
+        const string pageName = path + " (page " + to_string(slices.size()) + ")";
+        if (compression != 1)
+            throw runtime_error("Compressed TIFF is not supported: " + pageName);
+        if (samples != 1)
+            throw runtime_error("Only single-channel TIFF is supported: " + pageName);
+        if (bits == 8 && sampleFormat == 1)
+            page.voxelType = VolumeHeader::VoxelType::UInt8;
+        else if (bits == 16 && sampleFormat == 1)
+            page.voxelType = VolumeHeader::VoxelType::UInt16;
+        else if (bits == 16 && sampleFormat == 3)
+            page.voxelType = VolumeHeader::VoxelType::Float16;
+        else if (bits == 32 && sampleFormat == 3)
+            page.voxelType = VolumeHeader::VoxelType::Float32;
+        else
+            throw runtime_error("Unsupported TIFF sample type (" + to_string(bits) + " bits, format " + to_string(sampleFormat) + "): " + pageName);
+        page.endian = reader.little ? VolumeHeader::Endian::Little : VolumeHeader::Endian::Big;
+        if (page.width == 0 || page.height == 0 || offsets.empty())
+            throw runtime_error("TIFF page has no image data: " + pageName);
+
+        // ストリップを画素の順に並べ、末尾の余分(パディング)は読まない
+        const uint64_t rowBytes = static_cast<uint64_t>(page.width) * (bits / 8);
+        uint64_t remaining = rowBytes * page.height;
+        Slice slice{path, {}};
+        for (size_t s = 0; s < offsets.size() && remaining > 0; ++s)
+        {
+            const uint64_t stripBytes = s < byteCounts.size() ? byteCounts[s] : rowBytes * min<uint64_t>(rowsPerStrip, page.height);
+            const uint64_t bytes = min(stripBytes, remaining);
+            if (offsets[s] + bytes > reader.Size())
+                throw runtime_error("TIFF strip is truncated: " + pageName);
+            slice.strips.push_back({offsets[s], bytes});
+            remaining -= bytes;
+        }
+        if (remaining != 0)
+            throw runtime_error("TIFF strips do not cover the image: " + pageName);
+
+        if (slices.empty())
+            format = page;
+        else if (!(page == format))
+            throw runtime_error("TIFF pages differ in size or sample type: " + pageName);
+        slices.push_back(std::move(slice));
+        ifd = reader.U32(&entries[entryCount * 12]);
+    }
+    if (slices.empty())
+        throw runtime_error("TIFF file has no pages: " + path);
+    return slices;
+}
+
+SliceStack::Slice SliceStack::ReadRawSlice(const string &path, const RawSliceFormat &rawFormat, Format &format)
+{
+    const uint64_t size = fs::file_size(path);
+    format.width = rawFormat.width;
+    format.height = rawFormat.height;
+    format.voxelType = rawFormat.voxelType;
+    format.endian = rawFormat.endian;
+    if (format.width == 0)
+    {
+        // 大きさが分からなければ正方形の8bitとみなす
+        const uint64_t n = static_cast<uint64_t>(llround(sqrt(static_cast<double>(size))));
+        if (n == 0 || n * n != size)
+            throw runtime_error("Raw slice " + path + " is not a square 8-bit image. Give its size with --slice WxH[:type].");
+        format.width = format.height = static_cast<uint32_t>(n);
+        format.voxelType = VolumeHeader::VoxelType::UInt8;
+    }
+    const uint64_t bytes = static_cast<uint64_t>(format.width) * format.height * VolumeHeader::VoxelBytes(format.voxelType);
+    if (size < bytes)
+        throw runtime_error("Raw slice " + path + " is smaller than " + to_string(format.width) + "x" + to_string(format.height) + ".");
+    return Slice{path, {{0, bytes}}};
+}
+
+SliceStack::SliceStack(const string &pattern, const RawSliceFormat &rawFormat)
+{
+    vector<string> files;
+    if (fs::is_regular_file(pattern))
+        files.push_back(pattern);
+    else
+        files = ListFiles(pattern, SLICE_EXTENSIONS);
+    if (files.empty())
+        throw runtime_error("No slices match " + pattern);
+
+    // ストレージの待ち時間を重ねるため、ファイルごとのメタデータも並列に読む
+    vector<vector<Slice>> fileSlices(files.size());
+    vector<Format> fileFormats(files.size());
+    vector<string> errors(files.size());
+    const long long fileCount = static_cast<long long>(files.size());
+#pragma omp parallel for schedule(dynamic)
+    for (long long i = 0; i < fileCount; ++i)
+    {
+        try
+        {
+            if (HasExtension(files[i], TIFF_EXTENSIONS))
+                fileSlices[i] = ReadTiffSlices(files[i], fileFormats[i]);
+            else
+                fileSlices[i].push_back(ReadRawSlice(files[i], rawFormat, fileFormats[i]));
+        }
+        catch (const exception &e)
+        {
+            errors[i] = e.what();
+        }
+    }
+    for (size_t i = 0; i < files.size(); ++i)
+    {
+        if (!errors[i].empty())
+            throw runtime_error(errors[i]);
+        if (i == 0)
+            format = fileFormats[i];
+        else if (!(fileFormats[i] == format))
+            throw runtime_error("Slice " + files[i] + " differs in size or sample type from " + files[0]);
+        for (Slice &slice : fileSlices[i])
+            slices.push_back(std::move(slice));
+    }
+}
+
+bool SliceStack::IsSliceStackPath(const string &path)
+{
+    error_code error;
+    if (fs::is_regular_file(path, error))
+        return HasExtension(path, TIFF_EXTENSIONS);
+    if (path.find_first_of("*?") != string::npos)
+        return HasExtension(path, SLICE_EXTENSIONS);
+    if (!fs::is_directory(path, error))
+        return false;
+    // ボリュームファイルがあれば時系列として扱う
+    return ListFiles(path, {".dat", ".glvr"}).empty() && !ListFiles(path, SLICE_EXTENSIONS).empty();
+}
+
+template <typename T>
+unique_ptr<VolumeBase> SliceStack::LoadAs(size_t threadCount, atomic<size_t> *bytesRead, const atomic<bool> *cancel) const
+{
+    // スライスx(奥行き)はグリッド上で連続した(高さ,幅)の面なので、ファイルから直接書き込む
+    VoxelGrid<T> grid(slices.size(), format.height, format.width);
+    const bool swap = sizeof(T) > 1 && (format.endian == VolumeHeader::Endian::Little) != IsHostLittleEndian();
+    const int threads = static_cast<int>(threadCount != 0 ? threadCount : 2 * max(thread::hardware_concurrency(), 1u));
+
+    Stopwatch timer;
+    std::mutex errorMutex;
+    string error;
+    atomic<bool> failed{false};
+    const long long sliceCount = static_cast<long long>(slices.size());
+#pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (long long x = 0; x < sliceCount; ++x)
+    {
+        if (failed || (cancel && *cancel))
+            continue;
+        const Slice &slice = slices[x];
+        char *destination = reinterpret_cast<char *>(&grid(x, 0, 0));
+        ifstream is(slice.path, ios::binary);
+        size_t written = 0;
+        for (const Strip &strip : slice.strips)
+        {
+            is.seekg(static_cast<streamoff>(strip.offset));
+            is.read(destination + written, static_cast<streamsize>(strip.bytes));
+            written += strip.bytes;
+        }
+        if (!is)
+        {
+            lock_guard<std::mutex> lock(errorMutex);
+            error = "Failed to read slice " + to_string(x) + " from " + slice.path;
+            failed = true;
+            continue;
+        }
+        if (swap)
+            SwapBytes(destination, written / sizeof(T), sizeof(T));
+        if (bytesRead)
+            *bytesRead += written;
+    }
+    if (failed)
+        throw runtime_error(error);
+    if (cancel && *cancel)
+        return nullptr;
+
+    const double seconds = timer.ElapsedMs() / 1000.0;
+    cout << "[INFO] Slice stack: " << slices.size() << " slices " << format.width << "x" << format.height << " "
+         << VolumeHeader::VoxelTypeName(format.voxelType) << " in " << seconds * 1000.0 << "ms ("
+         << slices.size() / seconds << " slices/s, " << ToMiB(grid.Bytes()) / seconds << "MiB/s, " << threads << " threads)" << endl;
+    return make_unique<Volume<T>>(std::move(grid));
+}
+
+unique_ptr<VolumeBase> SliceStack::Load(size_t threadCount, atomic<size_t> *bytesRead, const atomic<bool> *cancel) const
+{
+    switch (format.voxelType)
+    {
+    case VolumeHeader::VoxelType::UInt16:
+        return LoadAs<uint16_t>(threadCount, bytesRead, cancel);
+    case VolumeHeader::VoxelType::Float16:
+        return LoadAs<Half>(threadCount, bytesRead, cancel);
+    case VolumeHeader::VoxelType::Float32:
+        return LoadAs<float>(threadCount, bytesRead, cancel);
+    case VolumeHeader::VoxelType::UInt8:
+    default:
+        return LoadAs<uint8_t>(threadCount, bytesRead, cancel);
+    }
+}
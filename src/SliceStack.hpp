@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Volume.hpp"
+
+/// @brief 生スライス(.raw)の形式。ファイルに情報が無いので外から与える(TIFFはタグから求める)
+struct RawSliceFormat
+{
+    uint32_t width = 0; // 0なら正方形の8bitスライスとみなし、ファイルサイズから求める
+    uint32_t height = 0;
+    VolumeHeader::VoxelType voxelType = VolumeHeader::VoxelType::UInt8;
+    VolumeHeader::Endian endian = VolumeHeader::Endian::Little;
+};
+
+/// @brief "WxH[:u8|u16|f16|f32][be]" 形式の文字列を解析する(例: "2048x2048:u16be")。不正な形式ならstd::runtime_errorを投げる
+RawSliceFormat ParseRawSliceFormat(const std::string &text);
+
+/// @brief 2Dスライスの積み重ね(Z方向に1枚ずつ)をボリュームとして読み込むクラス
+/// @details 以下のどちらかを受け付ける。
+/// - スライスのディレクトリ、またはワイルドカード("slices/z_*.tif")。ファイル名の番号順にZ方向へ積む。
+///   非圧縮のTIFF(.tif, .tiff)か、ヘッダ無しの生スライス(.raw)
+/// - 非圧縮のマルチページTIFF 1ファイル。ページ順にZ方向へ積む
+/// 構築時にはメタデータ(TIFFのIFD)だけを読み、Load()でスライスをスレッドプールで並列に読み込んで、
+/// ボリュームの最終的な位置へ直接書き込む(連結した一時ファイルや中間バッファは作らない)。
+/// TIFFは1サンプル/ピクセル、ストリップ形式、8/16bit符号なし整数または16/32bit浮動小数点のみ対応する。
+class SliceStack
+{
+private:
+    /// スライスの中の連続した区間(TIFFのストリップ)。スライス内で順に並べるとスライスの画素になる
+    struct Strip
+    {
+        uint64_t offset;
+        uint64_t bytes;
+    };
+    struct Slice
+    {
+        std::string path;
+        std::vector<Strip> strips;
+    };
+
+    /// スライスの画素の形式。全スライスで一致している必要がある
+    struct Format
+    {
+        uint32_t width = 0, height = 0;
+        VolumeHeader::VoxelType voxelType = VolumeHeader::VoxelType::UInt8;
+        VolumeHeader::Endian endian = VolumeHeader::Endian::Little;
+        bool operator==(const Format &other) const
+        {
+            return width == other.width && height == other.height && voxelType == other.voxelType && endian == other.endian;
+        }
+    };
+
+    std::vector<Slice> slices;
+    Format format;
+
+    /// @brief TIFFファイルの全ページをスライスとして読む(メタデータのみ)。不正なファイルならstd::runtime_errorを投げる
+    static std::vector<Slice> ReadTiffSlices(const std::string &path, Format &format);
+    /// @brief 生スライスを読む(メタデータのみ)。形式が分からなければstd::runtime_errorを投げる
+    static Slice ReadRawSlice(const std::string &path, const RawSliceFormat &rawFormat, Format &format);
+    template <typename T>
+    std::unique_ptr<VolumeBase> LoadAs(size_t threadCount, std::atomic<size_t> *bytesRead, const std::atomic<bool> *cancel) const;
+
+public:
+    /// @brief スライスを列挙してメタデータを読む。スライスが無いか不正ならstd::runtime_errorを投げる
+    /// @param pattern ディレクトリ、ワイルドカード、またはマルチページTIFFのパス
+    /// @param rawFormat 生スライスの形式
+    explicit SliceStack(const std::string &pattern, const RawSliceFormat &rawFormat = RawSliceFormat());
+
+    /// @brief スライスの積み重ねとして開くパスか(TIFFファイル、またはスライスを含むディレクトリかワイルドカード)
+    static bool IsSliceStackPath(const std::string &path);
+
+    size_t SliceCount() const { return slices.size(); }
+    /// @brief ボリューム全体のバイト数
+    size_t Bytes() const { return SliceBytes() * slices.size(); }
+    size_t SliceBytes() const { return static_cast<size_t>(format.width) * format.height * VolumeHeader::VoxelBytes(format.voxelType); }
+
+    /// @brief 全スライスを並列に読み込み、(奥行き=スライス数, 高さ, 幅)のボリュームを作る
+    /// @details 読み込みに失敗した場合はstd::runtime_errorを投げる。読み込み速度(スライス/秒)を標準出力に表示する
+    /// @param threadCount 読み込みスレッド数。0ならコア数の2倍(ストレージのキューを埋めるため)
+    /// @param bytesRead nullptrでなければ読み込んだバイト数を加算する(進捗表示用)
+    /// @param cancel nullptrでなければ、trueになった時点で残りのスライスを読まずにnullptrを返す
+    std::unique_ptr<VolumeBase> Load(size_t threadCount = 0, std::atomic<size_t> *bytesRead = nullptr, const std::atomic<bool> *cancel = nullptr) const;
+};
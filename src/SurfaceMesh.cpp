@@ -0,0 +1,49 @@
+#include "SurfaceMesh.hpp"
+#include <cstddef>
+
+SurfaceMesh::~SurfaceMesh()
+{
+    if (vao)
+        glDeleteVertexArrays(1, &vao);
+    if (vbo)
+        glDeleteBuffers(1, &vbo);
+    if (ibo)
+        glDeleteBuffers(1, &ibo);
+}
+
+void SurfaceMesh::UploadBuffer()
+{
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ibo);
+
+    glBindVertexArray(vao);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(MeshVertex), vertices.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)(offsetof(MeshVertex, position)));
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshVertex), (void *)(offsetof(MeshVertex, normal)));
+    glEnableVertexAttribArray(1);
+
+    glBindVertexArray(0);
+}
+
+void SurfaceMesh::Draw()
+{
+    // 不透明なので深度テストで前後を決める(点群が深度の書き込みを止めている場合があるので戻してから消す)
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LESS);
+    glDepthMask(GL_TRUE);
+    glClear(GL_DEPTH_BUFFER_BIT);
+    glDisable(GL_BLEND);
+
+    glBindVertexArray(vao);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(indices.size()), GL_UNSIGNED_INT, 0);
+    glBindVertexArray(0);
+
+    glDisable(GL_DEPTH_TEST);
+    glEnable(GL_BLEND);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+/// @brief 面のメッシュの頂点。位置は点群と同じワールド座標(ボリュームの中心が原点)、法線は面の外向き
+struct MeshVertex
+{
+    glm::vec3 position;
+    glm::vec3 normal;
+};
+
+/// @brief 不透明に描画する三角形メッシュ(等値面・ボクセルの表面)の共通部分
+class SurfaceMesh
+{
+public:
+    std::vector<MeshVertex> vertices;
+    /// 三角形の頂点インデックス(3つずつ)。外側から見て反時計回り
+    std::vector<GLuint> indices;
+
+    GLuint vao = 0, vbo = 0, ibo = 0;
+    SurfaceMesh() = default;
+    ~SurfaceMesh();
+    SurfaceMesh(const SurfaceMesh &) = delete;
+    SurfaceMesh &operator=(const SurfaceMesh &) = delete;
+
+    size_t TriangleCount() const { return indices.size() / 3; }
+    void UploadBuffer();
+    /// @brief 深度テストを有効にして不透明に描画する(終わったら半透明描画の設定に戻す)
+    void Draw();
+};
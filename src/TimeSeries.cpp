@@ -0,0 +1,151 @@
+#include "TimeSeries.hpp"
+#include "FileList.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <stdexcept>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr size_t PAGE_BYTES = 4096;
+
+    /// @brief テクスチャ転送でページフォルトを待たないよう、ページ単位で読み込んでおく
+    void TouchPages(const char *data, size_t bytes)
+    {
+        MappedFile::Prefetch(data, bytes);
+        unsigned char sink = 0;
+        for (size_t offset = 0; offset < bytes; offset += PAGE_BYTES)
+            sink ^= static_cast<unsigned char>(data[offset]);
+        // 最適化で読み込みが消されないようにする
+        volatile unsigned char keep = sink;
+        (void)keep;
+    }
+}
+
+TimeSeries::TimeSeries(vector<string> _frames, size_t prefetchCount, size_t threadCount)
+    : frames(std::move(_frames)), ring(max<size_t>(prefetchCount, 1))
+{
+    if (frames.empty())
+        throw runtime_error("Time series has no frames.");
+    for (size_t t = 0; t < max<size_t>(threadCount, 1); ++t)
+        workers.emplace_back(&TimeSeries::Work, this);
+}
+
+TimeSeries::~TimeSeries()
+{
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread &worker : workers)
+        worker.join();
+}
+
+vector<string> TimeSeries::ListFrames(const string &pattern)
+{
+    vector<string> frames = ListFiles(pattern, {".dat", ".glvr"});
+    if (frames.empty())
+        throw runtime_error("No volume frames match " + pattern);
+    return frames;
+}
+
+bool TimeSeries::IsSeriesPath(const string &path)
+{
+    return path.find_first_of("*?") != string::npos || fs::is_directory(fs::path(path));
+}
+
+void TimeSeries::Work()
+{
+    unique_lock<std::mutex> lock(mutex);
+    while (!stopping)
+    {
+        size_t frame;
+        if (!ClaimFrame(frame))
+        {
+            wake.wait(lock);
+            continue;
+        }
+        const string path = FramePath(frame);
+        lock.unlock();
+
+        unique_ptr<VolumeBase> volume;
+        string error;
+        try
+        {
+            // 時系列のフレームはページングせず、全体をホストに載せる
+            volume = LoadVolume(path);
+            const VolumeBase::TextureSource source = volume->GetTextureSource();
+            TouchPages(source.data, static_cast<size_t>(volume->resolution.x) * volume->resolution.y * volume->resolution.z * source.voxelBytes);
+            // 空領域スキップ用の強度の範囲は小さく安いので、フレームごとに先読みの間に作っておく
+            volume->BuildMacrocells();
+        }
+        catch (const exception &e)
+        {
+            error = e.what();
+        }
+
+        lock.lock();
+        // 読み込み中のスロットは他のフレームに割り当てられないので、そのまま格納してよい
+        Slot &slot = ring[frame % ring.size()];
+        slot.volume = std::move(volume);
+        slot.error = error;
+        slot.state = error.empty() ? Slot::State::Ready : Slot::State::Failed;
+    }
+}
+
+bool TimeSeries::ClaimFrame(size_t &frame)
+{
+    for (size_t candidate = base; candidate < base + ring.size(); ++candidate)
+    {
+        Slot &slot = ring[candidate % ring.size()];
+        if (slot.frame == candidate || slot.state == Slot::State::Loading)
+            continue; // 読み込み済みか読み込み中
+        // 窓から外れた古いフレームを捨てて使う
+        slot.frame = candidate;
+        slot.state = Slot::State::Loading;
+        slot.volume.reset();
+        slot.error.clear();
+        frame = candidate;
+        return true;
+    }
+    return false;
+}
+
+unique_ptr<VolumeBase> TimeSeries::Take(size_t frame)
+{
+    unique_lock<std::mutex> lock(mutex);
+    Slot &slot = ring[frame % ring.size()];
+    if (slot.frame != frame || slot.state == Slot::State::Loading || slot.state == Slot::State::Empty)
+    {
+        // 表示が先読みを追い越した場合は、窓をframeに合わせて古いフレームを読まないようにする
+        if (frame > base)
+        {
+            base = frame;
+            lock.unlock();
+            wake.notify_all();
+        }
+        return nullptr;
+    }
+
+    unique_ptr<VolumeBase> volume = std::move(slot.volume);
+    const bool failed = slot.state == Slot::State::Failed;
+    const string error = slot.error;
+    slot.frame = SIZE_MAX;
+    slot.state = Slot::State::Empty;
+    base = frame + 1;
+    lock.unlock();
+    wake.notify_all();
+    if (failed)
+        throw runtime_error("Failed to load frame " + FramePath(frame) + ": " + error);
+    return volume;
+}
+
+size_t TimeSeries::ReadyCount() const
+{
+    lock_guard<std::mutex> lock(mutex);
+    return static_cast<size_t>(count_if(ring.begin(), ring.end(), [&](const Slot &slot)
+                                        { return slot.state == Slot::State::Ready && slot.frame >= base; }));
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Volume.hpp"
+
+/// @brief 時系列ボリューム(1ファイル1フレーム)のフレームを、バックグラウンドのスレッドでホストのリングバッファへ先読みするクラス
+/// @details フレームは通し番号で指定し、番号がフレーム数を超えたら先頭へ戻る(ループ再生)。
+/// ワーカーはまだ受け取られていないフレームのうち番号が小さい順に、最大K個(リングの大きさ)を読み込んでおく。
+/// 読み込んだボリュームはGLオブジェクトを持たないので、受け取る前に捨てる場合はどのスレッドで破棄してもよい。
+class TimeSeries
+{
+private:
+    struct Slot
+    {
+        enum class State
+        {
+            Empty,
+            Loading,
+            Ready,
+            Failed,
+        };
+        size_t frame = SIZE_MAX; // 格納している(読み込み中の)フレームの通し番号
+        State state = State::Empty;
+        std::unique_ptr<VolumeBase> volume;
+        std::string error;
+    };
+
+    std::vector<std::string> frames;
+    std::vector<Slot> ring; // フレームnはring[n % K]に入る
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex; // ring, base, stoppingを保護する
+    std::condition_variable wake;
+    size_t base = 0; // 次に受け取られるフレーム。先読みの窓は[base, base+K)
+    bool stopping = false;
+
+    void Work();
+    /// @brief 先読みの窓の中でまだ読み込みに着手していないフレームを探し、読み込み中にする
+    bool ClaimFrame(size_t &frame);
+
+public:
+    /// @param frames フレームのファイルパス(再生順)
+    /// @param prefetchCount 先読みするフレーム数(リングの大きさK)
+    /// @param threadCount 読み込みスレッド数
+    TimeSeries(std::vector<std::string> frames, size_t prefetchCount, size_t threadCount);
+    ~TimeSeries();
+    TimeSeries(const TimeSeries &) = delete;
+    TimeSeries &operator=(const TimeSeries &) = delete;
+
+    /// @brief ディレクトリ内のボリュームファイル(.dat, .glvr)、またはファイル名のワイルドカード(*, ?)に一致するファイルを列挙する
+    /// @details 数字の部分は数値として比較した順(frame_2 < frame_10)に並べる。1つも無ければstd::runtime_errorを投げる
+    static std::vector<std::string> ListFrames(const std::string &pattern);
+    /// @brief 時系列として開くパス(ディレクトリ、またはワイルドカードを含む)か
+    static bool IsSeriesPath(const std::string &path);
+
+    size_t FrameCount() const { return frames.size(); }
+    size_t PrefetchCount() const { return ring.size(); }
+    /// @brief 通し番号frameのファイルパス
+    const std::string &FramePath(size_t frame) const { return frames[frame % frames.size()]; }
+    /// @brief 通し番号frameのボリュームを受け取る。まだ読み込まれていなければnullptr
+    /// @details frameより前のフレームは捨て、先読みの窓をframeの次からにずらす。
+    /// 読み込みに失敗していた場合はstd::runtime_errorを投げる(そのフレームは捨てられる)
+    std::unique_ptr<VolumeBase> Take(size_t frame);
+    /// @brief 先読み済みで受け取り待ちのフレーム数
+    size_t ReadyCount() const;
+};
@@ -0,0 +1,103 @@
+#include "TimeSeriesPlayer.hpp"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+using namespace std;
+
+TimeSeriesPlayer::TimeSeriesPlayer(vector<string> frames, size_t prefetchCount, size_t threadCount)
+    : series(std::move(frames), prefetchCount, threadCount)
+{
+}
+
+TimeSeriesPlayer::~TimeSeriesPlayer()
+{
+    DeleteSpareTexture();
+}
+
+void TimeSeriesPlayer::DeleteSpareTexture()
+{
+    if (spareTexture)
+        glDeleteTextures(1, &spareTexture);
+    spareTexture = 0;
+}
+
+bool TimeSeriesPlayer::Update(unique_ptr<VolumeBase> &volume, SlabUploader &uploader, double budgetMs)
+{
+    const double now = clock.ElapsedMs();
+    const double periodMs = 1000.0 / max(fps, 0.1f);
+    if (!playing)
+        nextPresentMs = now; // 再開したらすぐ表示する
+
+    if (!back)
+    {
+        try
+        {
+            back = series.Take(nextFrame);
+        }
+        catch (const runtime_error &e)
+        {
+            // 読めなかったフレームは飛ばす
+            cerr << "[ERROR] " << e.what() << endl;
+            droppedFrames++;
+            nextFrame++;
+        }
+        if (back)
+        {
+            backFrame = nextFrame++;
+            stalled = false;
+            // 同じ形のテクスチャならフロントから外したものへ上書きする
+            const VolumeBase::TextureSource source = back->GetTextureSource();
+            GLuint texture = 0;
+            if (spareTexture && spareResolution == back->resolution && spareFormat == source.internalFormat && spareLevels == back->MipLevels())
+                swap(texture, spareTexture);
+            DeleteSpareTexture();
+            back->BeginStreamingUpload(uploader, texture);
+        }
+        else if (playing && now >= nextPresentMs && !stalled)
+        {
+            prefetchStalls++;
+            stalled = true;
+        }
+    }
+
+    if (!back || !uploader.Step(budgetMs) || !playing || now < nextPresentMs)
+        return false;
+
+    // フロントと入れ替え、外したテクスチャは次のフレームの転送先にする
+    if (volume)
+    {
+        DeleteSpareTexture();
+        spareResolution = volume->resolution;
+        spareFormat = volume->GetTextureSource().internalFormat;
+        spareLevels = volume->MipLevels();
+        spareTexture = volume->ReleaseTexture();
+    }
+    volume = std::move(back);
+    shownFrame = backFrame;
+    presentedFrames++;
+    if (presentedFrames > 1)
+    {
+        const float instant = static_cast<float>(1000.0 / max(now - lastPresentMs, 1e-3));
+        measuredFps = measuredFps > 0.0f ? measuredFps * 0.9f + instant * 0.1f : instant;
+    }
+    lastPresentMs = now;
+
+    // 表示時刻に間に合わなかった周期の分はフレームを飛ばして、再生速度を保つ
+    const size_t late = now >= nextPresentMs + periodMs ? static_cast<size_t>((now - nextPresentMs) / periodMs) : 0;
+    droppedFrames += late;
+    nextFrame += late;
+    nextPresentMs += periodMs * (late + 1);
+    return true;
+}
+
+string TimeSeriesPlayer::Stats() const
+{
+    ostringstream os;
+    os << "frame " << ShownFrame() + 1 << "/" << series.FrameCount() << ", " << fixed << setprecision(1) << measuredFps << "fps"
+       << ", prefetched " << series.ReadyCount() << "/" << series.PrefetchCount()
+       << "\ndropped " << droppedFrames << ", prefetch stalls " << prefetchStalls;
+    return os.str();
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "Profiling.hpp"
+#include "SlabUploader.hpp"
+#include "TimeSeries.hpp"
+
+/// @brief 時系列ボリュームを目標FPSで再生するクラス(描画スレッド側)
+/// @details 3Dテクスチャをダブルバッファにする。表示中のフレーム(フロント)を描画している間に、
+/// 次のフレームをもう一方のテクスチャ(バック)へSlabUploaderで時間予算の範囲で転送し、
+/// 転送が終わって表示時刻になったらフロントと入れ替える。転送が描画を止めることはない。
+/// 表示時刻に間に合わなかった周期の分はフレームを飛ばし(ドロップ)、
+/// 表示時刻に次のフレームがまだ先読みされていなければ先読み待ち(ストール)として数える。
+class TimeSeriesPlayer
+{
+private:
+    TimeSeries series;
+    std::unique_ptr<VolumeBase> back; // 転送中(または転送済みで表示待ち)の次のフレーム
+    size_t backFrame = 0;
+    size_t nextFrame = 0;  // 次に受け取るフレームの通し番号
+    size_t shownFrame = 0; // 表示中のフレームの通し番号
+
+    // フロントから外したテクスチャ。次のフレームの転送先として再利用する
+    GLuint spareTexture = 0;
+    glm::ivec3 spareResolution = glm::ivec3(0);
+    GLenum spareFormat = 0;
+    int spareLevels = 0;
+
+    Stopwatch clock;
+    double nextPresentMs = 0.0; // 次のフレームを表示する時刻
+    bool stalled = false;       // 現在のフレームで先読み待ちを数えたか
+    size_t presentedFrames = 0;
+    size_t droppedFrames = 0;
+    size_t prefetchStalls = 0;
+
+    double lastPresentMs = 0.0;
+    float measuredFps = 0.0f; // 実際の表示間隔から求めたFPS(指数移動平均)
+
+    /// @brief フロントから外したテクスチャを削除する
+    void DeleteSpareTexture();
+
+public:
+    /// 目標の再生速度[フレーム/秒]
+    float fps = 24.0f;
+    /// falseなら一時停止(先読みと次のフレームの転送は続ける)
+    bool playing = true;
+
+    /// @param frames フレームのファイルパス(TimeSeries::ListFrames())
+    /// @param prefetchCount ホストに先読みするフレーム数
+    /// @param threadCount 読み込みスレッド数
+    TimeSeriesPlayer(std::vector<std::string> frames, size_t prefetchCount, size_t threadCount);
+    ~TimeSeriesPlayer();
+    TimeSeriesPlayer(const TimeSeriesPlayer &) = delete;
+    TimeSeriesPlayer &operator=(const TimeSeriesPlayer &) = delete;
+
+    /// @brief 次のフレームを受け取って転送し、表示時刻になっていればフロントと入れ替える。毎フレーム呼ぶ
+    /// @param volume 表示中のボリューム(フロント)。入れ替えた場合は次のフレームになる
+    /// @param budgetMs このフレームで転送に使ってよい時間[ms]
+    /// @return フロントを入れ替えたらtrue
+    bool Update(std::unique_ptr<VolumeBase> &volume, SlabUploader &uploader, double budgetMs);
+
+    size_t FrameCount() const { return series.FrameCount(); }
+    /// @brief 表示中のフレーム番号(0~FrameCount()-1)
+    size_t ShownFrame() const { return shownFrame % series.FrameCount(); }
+    size_t DroppedFrames() const { return droppedFrames; }
+    size_t PrefetchStalls() const { return prefetchStalls; }
+    /// @brief 再生の統計(フレーム番号、先読み済みのフレーム数、ドロップ数、ストール数)
+    std::string Stats() const;
+};
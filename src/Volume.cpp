@@ -1,142 +1,587 @@
 #include "Volume.hpp"
-#include <queue>
-#include <tuple>
+#include "BrickedVolume.hpp"
+#include "Profiling.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <sstream>
 
 using namespace std;
 
-Volume::Volume(ifstream &file)
+namespace
 {
-    file.seekg(0, ios::end);            // 末尾まで移動
-    streamsize fileSize = file.tellg(); // ファイルサイズ取得
-    file.seekg(0, ios::beg);            // 先頭まで戻す
+    bool IsHostLittleEndian()
+    {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const unsigned char *>(&probe) == 1;
+    }
+
+    /// @brief 要素ごとにバイト順を反転する
+    void SwapBytes(char *data, size_t count, size_t elementBytes)
+    {
+        for (size_t i = 0; i < count; ++i)
+            reverse(data + i * elementBytes, data + (i + 1) * elementBytes);
+    }
+
+    /// @brief ブリック化ペイロードを自前の領域に展開したボリュームを作る
+    template <typename T>
+    unique_ptr<VolumeBase> LoadBrickedVolume(const MappedFile &file, const VolumeHeader &header)
+    {
+        if (header.payloadOffset > file.Size())
+            throw runtime_error("Volume payload is truncated.");
+        VoxelGrid<T> grid(header.resolution[2], header.resolution[1], header.resolution[0]);
+        DecodeBrickedVolume(header, file.Data() + header.payloadOffset, file.Size() - header.payloadOffset, grid);
+        const bool payloadLittle = header.endian == VolumeHeader::Endian::Little;
+        if (sizeof(T) > 1 && payloadLittle != IsHostLittleEndian())
+            SwapBytes(reinterpret_cast<char *>(grid.Data()), grid.Count(), sizeof(T));
+        return make_unique<Volume<T>>(std::move(grid), glm::vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
+    }
+
+    /// @brief 非ブリックのペイロードから領域の行だけを読み込んだボリュームを作る
+    template <typename T>
+    unique_ptr<VolumeBase> LoadRawRegion(const MappedFile &file, const VolumeHeader &header, const VolumeRegion &region)
+    {
+        VoxelGrid<T> grid(region.Size(2), region.Size(1), region.Size(0));
+        const size_t width = header.resolution[0], height = header.resolution[1];
+        const size_t rowBytes = region.Size(0) * sizeof(T);
+        const long long rows = static_cast<long long>(region.Size(2)) * region.Size(1);
+        const char *payload = file.Data() + header.payloadOffset;
+        auto source = [&](long long row)
+        {
+            const size_t z = region.begin[2] + row / region.Size(1), y = region.begin[1] + row % region.Size(1);
+            return payload + ((z * height + y) * width + region.begin[0]) * sizeof(T);
+        };
 
-    size_t totalElements = static_cast<int>(fileSize);
-    this->size = static_cast<size_t>(cbrt(totalElements)); // Nを推測
+        // 先読みで領域外のページまで読まないようにし、領域の行だけを非同期に読み込ませてから並列にコピーする
+        file.AdviseRandom();
+        for (long long row = 0; row < rows; ++row)
+            MappedFile::Prefetch(source(row), rowBytes);
+#pragma omp parallel for schedule(static)
+        for (long long row = 0; row < rows; ++row)
+            memcpy(grid.Data() + row * region.Size(0), source(row), rowBytes);
 
-    if (this->size * this->size * this->size != totalElements)
+        const bool payloadLittle = header.endian == VolumeHeader::Endian::Little;
+        if (sizeof(T) > 1 && payloadLittle != IsHostLittleEndian())
+            SwapBytes(reinterpret_cast<char *>(grid.Data()), grid.Count(), sizeof(T));
+        return make_unique<Volume<T>>(std::move(grid), glm::vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
+    }
+
+    /// @brief ブリック化ペイロードから領域に交わるブリックだけを展開したボリュームを作る
+    template <typename T>
+    unique_ptr<VolumeBase> LoadBrickedRegion(const MappedFile &file, const VolumeHeader &header, const VolumeRegion &region)
     {
-        cerr << "[ERROR] File size is not a perfect cube." << endl;
+        if (header.payloadOffset > file.Size())
+            throw runtime_error("Volume payload is truncated.");
+        VoxelGrid<T> grid(region.Size(2), region.Size(1), region.Size(0));
+        file.AdviseRandom();
+        DecodeBrickedRegion(header, file.Data() + header.payloadOffset, file.Size() - header.payloadOffset, region, grid);
+        const bool payloadLittle = header.endian == VolumeHeader::Endian::Little;
+        if (sizeof(T) > 1 && payloadLittle != IsHostLittleEndian())
+            SwapBytes(reinterpret_cast<char *>(grid.Data()), grid.Count(), sizeof(T));
+        return make_unique<Volume<T>>(std::move(grid), glm::vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
     }
 
-    // データ読み込み
-    vector<char> data(totalElements);
-    if (!file.read(data.data(), fileSize))
+    /// @brief ヘッダ無しの生.datを8bitの立方体とみなしたヘッダ
+    VolumeHeader GuessRawHeader(size_t fileSize)
     {
-        cerr << "[ERROR] Failed to read file data." << endl;
+        VolumeHeader header;
+        size_t n = static_cast<size_t>(round(cbrt(static_cast<double>(fileSize)))); // Nを推測
+        if (n * n * n != fileSize)
+        {
+            cerr << "[ERROR] File size is not a perfect cube. Use a volume header for non-cubic data." << endl;
+            // 範囲外アクセスしないよう、ファイルに収まる最大の立方体に切り詰める
+            while (n * n * n > fileSize)
+                n--;
+        }
+        header.resolution[0] = header.resolution[1] = header.resolution[2] = static_cast<uint32_t>(n);
+        return header;
     }
+}
+
+unique_ptr<VolumeBase> LoadVolume(const string &filepath, size_t cacheBytes)
+{
+    MappedFile file(filepath);
+    VolumeHeader header;
 
-    // 3次元ベクトルに変換
-    this->data = VolumeData(this->size, vector<vector<Cell>>(this->size, vector<Cell>(this->size)));
-    for (size_t i = 0; i < this->size; ++i)
+    if (HasVolumeHeader(file.Data(), file.Size()))
     {
-        for (size_t j = 0; j < this->size; ++j)
+        header = ParseVolumeHeader(file.Data(), file.Size());
+        if (header.BrickCount() != 0 && cacheBytes != 0 && header.PayloadBytes() > cacheBytes)
+        {
+            // 展開するとキャッシュに収まらないので、必要なブリックだけを展開する
+            switch (header.voxelType)
+            {
+            case VolumeHeader::VoxelType::UInt16:
+                return make_unique<Volume<uint16_t>>(make_unique<BrickCache<uint16_t>>(std::move(file), header, cacheBytes));
+            case VolumeHeader::VoxelType::Float16:
+                return make_unique<Volume<Half>>(make_unique<BrickCache<Half>>(std::move(file), header, cacheBytes));
+            case VolumeHeader::VoxelType::Float32:
+                return make_unique<Volume<float>>(make_unique<BrickCache<float>>(std::move(file), header, cacheBytes));
+            case VolumeHeader::VoxelType::UInt8:
+            default:
+                return make_unique<Volume<uint8_t>>(make_unique<BrickCache<uint8_t>>(std::move(file), header, cacheBytes));
+            }
+        }
+        if (header.BrickCount() != 0)
         {
-            for (size_t k = 0; k < this->size; ++k)
+            // 圧縮されたブリックを並列に展開する。展開後はファイルのマップは不要
+            switch (header.voxelType)
             {
-                this->data[i][j][k].intencity = data[i * this->size * this->size + j * this->size + k];
+            case VolumeHeader::VoxelType::UInt16:
+                return LoadBrickedVolume<uint16_t>(file, header);
+            case VolumeHeader::VoxelType::Float16:
+                return LoadBrickedVolume<Half>(file, header);
+            case VolumeHeader::VoxelType::Float32:
+                return LoadBrickedVolume<float>(file, header);
+            case VolumeHeader::VoxelType::UInt8:
+            default:
+                return LoadBrickedVolume<uint8_t>(file, header);
             }
         }
+        if (header.payloadOffset + header.PayloadBytes() > file.Size())
+            throw runtime_error("Volume payload is truncated.");
+    }
+    else
+        header = GuessRawHeader(file.Size());
+
+    switch (header.voxelType)
+    {
+    case VolumeHeader::VoxelType::UInt16:
+        return make_unique<Volume<uint16_t>>(std::move(file), header);
+    case VolumeHeader::VoxelType::Float16:
+        return make_unique<Volume<Half>>(std::move(file), header);
+    case VolumeHeader::VoxelType::Float32:
+        return make_unique<Volume<float>>(std::move(file), header);
+    case VolumeHeader::VoxelType::UInt8:
+    default:
+        return make_unique<Volume<uint8_t>>(std::move(file), header);
+    }
+}
+
+unique_ptr<VolumeBase> LoadVolumeRegion(const string &filepath, const VolumeRegion &requested)
+{
+    MappedFile file(filepath);
+    const VolumeHeader header = HasVolumeHeader(file.Data(), file.Size()) ? ParseVolumeHeader(file.Data(), file.Size()) : GuessRawHeader(file.Size());
+    const VolumeRegion region = requested.Clamped(header.resolution);
+    if (region.Empty())
+    {
+        ostringstream os;
+        os << "Region " << requested << " is outside of the volume (" << header.resolution[0] << "x" << header.resolution[1] << "x" << header.resolution[2] << ").";
+        throw runtime_error(os.str());
     }
 
-    // Volume::Clustering(this->data);
+    if (header.BrickCount() == 0 && header.payloadOffset + header.PayloadBytes() > file.Size())
+        throw runtime_error("Volume payload is truncated.");
+    const bool bricked = header.BrickCount() != 0;
+    switch (header.voxelType)
+    {
+    case VolumeHeader::VoxelType::UInt16:
+        return bricked ? LoadBrickedRegion<uint16_t>(file, header, region) : LoadRawRegion<uint16_t>(file, header, region);
+    case VolumeHeader::VoxelType::Float16:
+        return bricked ? LoadBrickedRegion<Half>(file, header, region) : LoadRawRegion<Half>(file, header, region);
+    case VolumeHeader::VoxelType::Float32:
+        return bricked ? LoadBrickedRegion<float>(file, header, region) : LoadRawRegion<float>(file, header, region);
+    case VolumeHeader::VoxelType::UInt8:
+    default:
+        return bricked ? LoadBrickedRegion<uint8_t>(file, header, region) : LoadRawRegion<uint8_t>(file, header, region);
+    }
+}
+
+template <typename T>
+Volume<T>::Volume(MappedFile &&file, const VolumeHeader &header)
+{
+    this->mappedFile = std::move(file);
+    char *payload = this->mappedFile.Data() + header.payloadOffset;
+
+    // コピーオンライトのマップなので、入れ替えてもファイルは変わらない
+    const bool payloadLittle = header.endian == VolumeHeader::Endian::Little;
+    if (sizeof(T) > 1 && payloadLittle != IsHostLittleEndian())
+        SwapBytes(payload, header.VoxelCount(), sizeof(T));
+
+    // ヘッダは幅(最速軸)から、グリッドは奥行き(最遅軸)から並ぶ
+    this->intencity = IntencityGrid::View(reinterpret_cast<T *>(payload),
+                                          header.resolution[2], header.resolution[1], header.resolution[0]);
+    SetGeometry(intencity.SizeX(), intencity.SizeY(), intencity.SizeZ(),
+                glm::vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
+}
+
+template <typename T>
+Volume<T>::Volume(IntencityGrid &&grid, const glm::vec3 &spacing)
+    : intencity(std::move(grid))
+{
+    SetGeometry(intencity.SizeX(), intencity.SizeY(), intencity.SizeZ(), spacing);
+}
+
+template <typename T>
+Volume<T>::Volume(std::unique_ptr<BrickCache<T>> _pages)
+    : pages(std::move(_pages))
+{
+    const VolumeHeader &header = pages->Header();
+    SetGeometry(pages->SizeX(), pages->SizeY(), pages->SizeZ(),
+                glm::vec3(header.spacing[0], header.spacing[1], header.spacing[2]));
+}
+
+template <typename T>
+void Volume<T>::CreateAtlas()
+{
+    this->atlas = make_unique<BrickAtlas>(resolution, extent, pages->Header().brickSize, pages->EmptyBricks(),
+                                          Traits::internalFormat, Traits::format, Traits::type, sizeof(T), atlasBudgetBytes);
+}
+
+template <typename T>
+void Volume<T>::UpdateResidency(const glm::mat4 &modelViewProjection, double budgetMs)
+{
+    if (!this->atlas)
+        return;
+    this->atlas->Update(modelViewProjection, budgetMs, [&](size_t brick)
+                        { return reinterpret_cast<const char *>(pages->Brick(brick)); });
 }
 
-glm::vec3 Volume::CalcNormalAtIndex(size_t _x, size_t _y, size_t _z)
+template <typename T>
+string Volume<T>::PagingStats() const
 {
-    glm::vec3 grad = {this->data[_x - 1][_y][_z].intencity - this->data[_x][_y][_z].intencity,  // X軸方向の強度
-                      this->data[_x][_y - 1][_z].intencity - this->data[_x][_y][_z].intencity,  // Y軸
-                      this->data[_x][_y][_z - 1].intencity - this->data[_x][_y][_z].intencity}; // Z軸
-    return glm::normalize(grad);
+    if (!pages)
+        return "";
+    string stats = "cache " + pages->Sammary();
+    if (this->atlas)
+        stats += "\nGPU bricks " + to_string(this->atlas->ResidentCount()) + "/" + to_string(this->atlas->SlotCount()) +
+                 " (pending " + to_string(this->atlas->PendingCount()) + "), uploaded " + to_string(static_cast<size_t>(ToMiB(this->atlas->UploadedBytes()))) + "MiB";
+    return stats;
 }
-void Volume::CalcNormal()
+
+template <typename T>
+void Volume<T>::BuildMipmaps(MipReduction reduction, const DerivedCache *cache)
 {
-    for (size_t i = 0; i < this->size; ++i)
+    if (pages || IsPacked())
+        return; // アトラスと詰めたボクセルはレベル0のみ
+    mipReduction = reduction;
+
+    // キャッシュには全レベルを細かい順に連結して1つの配列として置く
+    const string name = string("mips-v1-") + MipReductionName(reduction);
+    vector<glm::ivec3> sizes;
+    size_t total = 0;
+    for (int level = 1; level == 1 || sizes.back() != glm::ivec3(1); ++level)
+    {
+        sizes.push_back(MipResolution(level));
+        total += static_cast<size_t>(sizes.back().x) * sizes.back().y * sizes.back().z;
+    }
+    if (cache && intencity.Count() > 1)
     {
-        for (size_t j = 0; j < this->size; ++j)
+        // 各レベルはマップ領域のビューにする(コピーしない)
+        CachedArray<T> packed;
+        if (cache->Map(ContentHash(), name, packed) && packed.size() == total)
         {
-            for (size_t k = 0; k < this->size; ++k)
+            mips.clear();
+            T *src = packed.data();
+            for (const glm::ivec3 &size : sizes)
             {
-                // this->data[i][j][k].normal = CalcNormalAtIndex(i, j, k);
+                mips.push_back(IntencityGrid::View(src, size.z, size.y, size.x));
+                src += mips.back().Count();
             }
+            mappedMips = std::move(packed);
+            return;
         }
     }
+
+    mips = BuildMipPyramid(intencity, reduction, cancel);
+    if (cache && !mips.empty() && !Cancelled())
+    {
+        vector<T> packed;
+        packed.reserve(total);
+        for (const IntencityGrid &level : mips)
+            packed.insert(packed.end(), level.Data(), level.Data() + level.Count());
+        cache->Store(ContentHash(), name, packed);
+    }
 }
 
-// BFSによる領域探索（スタックオーバーフロー防止）
-void Search(Volume::VolumeData &v, size_t x, size_t y, size_t z, unsigned int id)
+template <typename T>
+uint64_t Volume<T>::HashContent() const
 {
-    const size_t size = v.size();
-    queue<tuple<size_t, size_t, size_t>> queue;
-    queue.emplace(x, y, z);
+    // 形状とボクセル型も鍵に含める(同じバイト列でも解釈が違えば別のボリューム)
+    const float shape[7] = {static_cast<float>(resolution.x), static_cast<float>(resolution.y), static_cast<float>(resolution.z),
+                            extent.x, extent.y, extent.z, static_cast<float>(Traits::voxelType)};
+    const uint64_t seed = DerivedCache::Hash(shape, sizeof(shape));
+    if (pages)
+    {
+        // 圧縮されたファイル全体を読むと開くたびに数GBを読むことになるので、ヘッダとオフセット表(各ブリックの位置と大きさ)、
+        // 空ブリックの配置(構築時に各ブリックの先頭だけを読んで求めてある)をキーにする
+        const uint64_t table = DerivedCache::Hash(pages->File().Data(), min<size_t>(pages->Header().payloadOffset, pages->File().Size()), seed);
+        const vector<bool> &empty = pages->EmptyBricks();
+        vector<uint8_t> flags(empty.begin(), empty.end());
+        return DerivedCache::Hash(flags.data(), flags.size(), table);
+    }
+    if (IsPacked())
+        return DerivedCache::Hash(bits.Data(), bits.Bytes(), seed);
+    return DerivedCache::Hash(intencity.Data(), intencity.Bytes(), seed);
+}
 
-    while (!queue.empty())
+void VolumeBase::ContentChanged()
+{
+    hasContentHash = false;
+    classifiedAlphaMin = numeric_limits<float>::quiet_NaN();
+    // 閾値がNaNなら比較が常に偽になるので、作り直すまで古い距離場は使われない
+    distanceThreshold = numeric_limits<float>::quiet_NaN();
+}
+
+uint64_t VolumeBase::ContentHash() const
+{
+    if (!hasContentHash)
     {
-        auto [cx, cy, cz] = queue.front();
-        queue.pop();
+        contentHash = HashContent();
+        hasContentHash = true;
+    }
+    return contentHash;
+}
 
-        // 範囲外チェック
-        if (cx >= size || cy >= size || cz >= size)
-            continue;
+void VolumeBase::ClusteringCached(const DerivedCache &cache, Connectivity connectivity)
+{
+    if (IsPaged())
+        return;
+    const string name = string("labels-v2-") + ConnectivityName(connectivity);
+    labelConnectivity = connectivity;
+    CachedArray<uint32_t> cached;
+    if (cache.Map(ContentHash(), name, cached) && cached.size() == static_cast<size_t>(resolution.x) * resolution.y * resolution.z)
+    {
+        // マップ領域のビューにする(コピーしない)
+        ids = IdGrid::View(cached.data(), resolution.z, resolution.y, resolution.x);
+        mappedIds = std::move(cached);
+        // ラベルは1から連番なので、成分数は最大のラベル
+        const long long planes = static_cast<long long>(ids.SizeX());
+        const size_t planeCount = ids.SizeY() * ids.SizeZ();
+        vector<uint32_t> planeMax(planes, 0);
+#pragma omp parallel for schedule(static)
+        for (long long x = 0; x < planes; ++x)
+        {
+            const uint32_t *plane = ids.Data() + x * planeCount;
+            planeMax[x] = planeCount > 0 ? *max_element(plane, plane + planeCount) : 0;
+        }
+        componentCount = planes > 0 ? *max_element(planeMax.begin(), planeMax.end()) : 0;
+        components = MeasureComponents(ids, componentCount);
+        NarrowLabels();
+        return;
+    }
+    Clustering(connectivity);
+    if (!Cancelled())
+        cache.Store(ContentHash(), name, ids.Data(), ids.Count());
+}
 
-        Volume::Cell &cell = v[cx][cy][cz];
+VolumeBase::~VolumeBase()
+{
+    if (this->volumeTexture)
+        glDeleteTextures(1, &this->volumeTexture);
+    if (this->labelTexture)
+        glDeleteTextures(1, &this->labelTexture);
+    if (this->streamingLabelTexture)
+        glDeleteTextures(1, &this->streamingLabelTexture);
+    if (this->gradientTexture)
+        glDeleteTextures(1, &this->gradientTexture);
+    if (this->macrocellTexture)
+        glDeleteTextures(1, &this->macrocellTexture);
+    if (this->distanceTexture)
+        glDeleteTextures(1, &this->distanceTexture);
+    if (this->cubeVAO)
+    {
+        glDeleteVertexArrays(1, &this->cubeVAO);
+        glDeleteBuffers(1, &this->cubeVBO);
+        glDeleteBuffers(1, &this->cubeEBO);
+    }
+}
 
-        if (cell.intencity == 0 || cell.id != 0)
-            continue;
+void VolumeBase::SetGeometry(size_t sizeX, size_t sizeY, size_t sizeZ, const glm::vec3 &spacing)
+{
+    this->resolution = glm::ivec3(sizeZ, sizeY, sizeX);
+    const glm::vec3 physical = glm::vec3(this->resolution) * spacing;
+    this->extent = physical / max(physical.x, max(physical.y, physical.z));
+}
 
-        // ID割り当て
-        cell.id = id;
+template <typename T>
+void Volume<T>::BuildGradients(const DerivedCache *cache)
+{
+    if (pages || IsPacked())
+        return; // 全体を持たないので作らない(シェーダはその場で求める)
 
-        // 6方向に探索
-        if (cx + 1 < size)
-            queue.emplace(cx + 1, cy, cz);
-        if (cx > 0)
-            queue.emplace(cx - 1, cy, cz);
-        if (cy + 1 < size)
-            queue.emplace(cx, cy + 1, cz);
-        if (cy > 0)
-            queue.emplace(cx, cy - 1, cz);
-        if (cz + 1 < size)
-            queue.emplace(cx, cy, cz + 1);
-        if (cz > 0)
-            queue.emplace(cx, cy, cz - 1);
+    const string name = "gradients-v1";
+    if (cache)
+    {
+        // マップ領域のビューにする(コピーしない)
+        CachedArray<PackedGradient> cached;
+        if (cache->Map(ContentHash(), name, cached) && cached.size() == intencity.Count())
+        {
+            gradients = GradientGrid::View(cached.data(), intencity.SizeX(), intencity.SizeY(), intencity.SizeZ());
+            mappedGradients = std::move(cached);
+            return;
+        }
     }
+    gradients = ComputeGradients(intencity, cancel);
+    if (cache && !Cancelled())
+        cache->Store(ContentHash(), name, gradients.Data(), gradients.Count());
 }
 
-void Volume::Clustering(VolumeData &v)
+template <typename T>
+void Volume<T>::BuildMacrocells(const DerivedCache *cache)
 {
-    size_t size = v.size();
-    unsigned long long idIndex = 1;
-    for (size_t i = 0; i < size; ++i)
+    if (pages || IsPacked())
+        return; // 全体を持たないので作らない(シェーダは全ステップをサンプルする)
+
+    const string name = "macrocells-v1-" + to_string(macrocellSize);
+    if (cache)
     {
-        for (size_t j = 0; j < size; ++j)
+        const size_t cells = macrocellSize;
+        MacrocellGrid cached((intencity.SizeX() + cells - 1) / cells, (intencity.SizeY() + cells - 1) / cells, (intencity.SizeZ() + cells - 1) / cells);
+        if (cache->Load(ContentHash(), name, cached.Data(), cached.Count()))
         {
-            for (size_t k = 0; k < size; ++k)
-            {
-                if (v[i][j][k].intencity != 0)
-                {
-                    // 値がありかつ未割り当てなら割り当開始
-                    if (v[i][j][k].intencity > 0 && v[i][j][k].id == 0)
-                    {
-                        Search(v, i, j, k, idIndex);
-                        idIndex++;
-                    }
-                }
-            }
+            macrocells = std::move(cached);
+            return;
         }
     }
+    macrocells = ComputeMacrocells(intencity);
+    if (cache)
+        cache->Store(ContentHash(), name, macrocells.Data(), macrocells.Count());
+}
+
+template <typename T>
+vector<uint8_t> Volume<T>::ApplyMorphology(MorphologyOp op, const StructuringElement &element)
+{
+    if (pages || IsPacked())
+        return {};
+    // メモリマップ領域はコピーオンライトなので、書き換えてもファイルは変わらない
+    vector<uint8_t> changed = ::ApplyMorphology(intencity, op, element);
+    if (find(changed.begin(), changed.end(), 1) != changed.end())
+        ContentChanged();
+    return changed;
+}
+
+template <typename T>
+vector<uint8_t> Volume<T>::ApplyFilter(const FilterSettings &settings)
+{
+    if (pages || IsPacked())
+        return {};
+    vector<uint8_t> changed = ::ApplyFilter(intencity, settings);
+    if (find(changed.begin(), changed.end(), 1) != changed.end())
+        ContentChanged();
+    return changed;
+}
+
+template <typename T>
+unique_ptr<VolumeBase> Volume<T>::CopyVoxels(const atomic<bool> *cancel) const
+{
+    if (pages || IsPacked())
+        throw runtime_error("Paged or binary volumes cannot be copied");
+    IntencityGrid grid(intencity.SizeX(), intencity.SizeY(), intencity.SizeZ());
+    const size_t planeCount = intencity.SizeY() * intencity.SizeZ();
+#pragma omp parallel for schedule(static)
+    for (long long x = 0; x < static_cast<long long>(intencity.SizeX()); ++x)
+    {
+        if (cancel && cancel->load(memory_order_relaxed))
+            continue;
+        memcpy(grid.Data() + x * planeCount, intencity.Data() + x * planeCount, planeCount * sizeof(T));
+    }
+    if (cancel && cancel->load())
+        return nullptr;
+    auto copy = make_unique<Volume<T>>(std::move(grid));
+    // 間隔は持っていないので、大きさはそのまま引き継ぐ
+    copy->extent = this->extent;
+    copy->labelConnectivity = this->labelConnectivity;
+    copy->atlasBudgetBytes = this->atlasBudgetBytes;
+    return copy;
 }
-ostream &operator<<(ostream &os, Volume &v)
+
+template <typename T>
+void Volume<T>::RefreshDerived()
+{
+    if (pages || IsPacked())
+        return;
+    if (!mips.empty())
+        mips = BuildMipPyramid(intencity, mipReduction);
+    if (!macrocells.Empty())
+        macrocells = ComputeMacrocells(intencity);
+    if (!histogram.Empty())
+        histogram = ComputeHistogram(intencity);
+    if (!gradients.Empty())
+        gradients = ComputeGradients(intencity);
+    if (!ids.Empty())
+        Clustering(labelConnectivity);
+}
+
+template <typename T>
+void Volume<T>::PackBits()
+{
+    if (pages || IsPacked())
+        return;
+    bits = BitGrid::Pack(intencity);
+    // マップ領域(または自前の領域)とミップピラミッドを手放す
+    intencity = IntencityGrid();
+    mips.clear();
+    mips.shrink_to_fit();
+    mappedMips = CachedArray<T>();
+    mappedFile = MappedFile();
+    // サンプル値は前景なら1、背景なら0になる。範囲が0をまたぐセルは背景を含み得るので下限を0とする
+    ValueRange *cells = macrocells.Data();
+    const long long cellCount = static_cast<long long>(macrocells.Count());
+#pragma omp parallel for schedule(static)
+    for (long long i = 0; i < cellCount; ++i)
+    {
+        const ValueRange range = cells[i];
+        cells[i].min = range.min > 0.0f || range.max < 0.0f ? 1.0f : 0.0f;
+        cells[i].max = range.min != 0.0f || range.max != 0.0f ? 1.0f : 0.0f;
+    }
+}
+
+namespace
+{
+    /// @brief 前景マスク(非ゼロなら1)をidsに書き込む。idsが空なら確保する
+    template <typename T>
+    void ForegroundMask(const VoxelGrid<T> &intencity, VolumeBase::IdGrid &ids)
+    {
+        if (ids.Empty())
+            ids = VolumeBase::IdGrid(intencity.SizeX(), intencity.SizeY(), intencity.SizeZ());
+        const T *values = intencity.Data();
+        uint32_t *mask = ids.Data();
+        const long long count = static_cast<long long>(intencity.Count());
+#pragma omp parallel for schedule(static)
+        for (long long i = 0; i < count; ++i)
+            mask[i] = VoxelTraits<T>::IsZero(values[i]) ? 0 : 1;
+    }
+}
+
+uint32_t VolumeBase::Clustering(const BitGrid &bits, IdGrid &ids, Connectivity connectivity, const atomic<bool> *cancel)
 {
-    size_t size = v.size;
-    size_t step = size / 15;
+    // 前景マスクはワードのビットをそのまま展開する
+    if (ids.Empty())
+        ids = IdGrid(bits.SizeX(), bits.SizeY(), bits.SizeZ());
+    const size_t height = bits.SizeY(), width = bits.SizeZ();
+    const long long rows = static_cast<long long>(bits.SizeX() * height);
+#pragma omp parallel for schedule(static)
+    for (long long row = 0; row < rows; ++row)
+    {
+        const uint64_t *words = bits.Row(row / height, row % height);
+        uint32_t *mask = &ids(row / height, row % height, 0);
+        for (size_t z = 0; z < width; ++z)
+            mask[z] = static_cast<uint32_t>((words[z >> 6] >> (z & 63)) & 1);
+    }
+    return LabelComponents(ids, connectivity, cancel);
+}
+
+template <typename T>
+uint32_t Volume<T>::Clustering(const IntencityGrid &intencity, IdGrid &ids, Connectivity connectivity, const atomic<bool> *cancel)
+{
+    ForegroundMask(intencity, ids);
+    return LabelComponents(ids, connectivity, cancel);
+}
+
+ostream &operator<<(ostream &os, VolumeBase &v)
+{
+    const glm::ivec3 &grid = v.resolution;
     os << v.Sammary() << endl;
-    for (size_t i = 0; i < size; i += step)
+    for (int i = 0; i < grid.z; i += max(grid.z / 15, 1))
     {
-        for (size_t j = 0; j < size; j += step)
+        for (int j = 0; j < grid.y; j += max(grid.y / 15, 1))
         {
-            for (size_t k = 0; k < size; k += step)
+            for (int k = 0; k < grid.x; k += max(grid.x / 15, 1))
             {
-                os << "(" << static_cast<int>(v.data[i][j][k].intencity) << "," << v.data[i][j][k].id << ") ";
+                // ID平面が未確保ならIDは0とみなす
+                int id = v.ids.Empty() ? 0 : v.ids(i, j, k);
+                os << "(" << v.NormalizedAt(i, j, k) << "," << id << ") ";
             }
             os << endl;
         }
@@ -145,48 +590,397 @@ ostream &operator<<(ostream &os, Volume &v)
     return os;
 }
 
-string Volume::Sammary()
+string VolumeBase::Sammary()
 {
-    return to_string(size) + "x" + to_string(size) + "x" + to_string(size) + "=" + to_string(size * size * size);
+    return to_string(resolution.x) + "x" + to_string(resolution.y) + "x" + to_string(resolution.z) + "=" +
+           to_string(static_cast<size_t>(resolution.x) * resolution.y * resolution.z) + " (" + VolumeHeader::VoxelTypeName(VoxelType()) +
+           (IsPaged() ? ", paged)" : IsPacked() ? ", binary, " + to_string(bits.CountOnes()) + " occupied)" : ")");
 }
-void Volume::Draw()
+void VolumeBase::Draw()
 {
     // 設定
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_3D, this->volumeTexture);
+    glBindTexture(GL_TEXTURE_3D, atlas ? atlas->AtlasTexture() : IsPacked() ? 0 : this->volumeTexture);
+    if (IsPacked())
+    { // 詰めたボクセル(整数テクスチャ)はシェーダのbinding=8
+        glActiveTexture(GL_TEXTURE8);
+        glBindTexture(GL_TEXTURE_3D, this->volumeTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if (atlas)
+    { // ブリック表はシェーダのbinding=2
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, atlas->TableTexture());
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if (labelTexture)
+    { // クラスタIDはシェーダのbinding=3
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, labelTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if (gradientTexture)
+    { // 勾配はシェーダのbinding=5
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_3D, gradientTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if (macrocellTexture)
+    { // マクロセルの分類はシェーダのbinding=6
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_3D, macrocellTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+    if (distanceTexture)
+    { // 距離場はシェーダのbinding=7
+        glActiveTexture(GL_TEXTURE7);
+        glBindTexture(GL_TEXTURE_3D, distanceTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
 
     // フルスクリーンクワッド描画で全ピクセルのピクセルシェーダー起動
     glBindVertexArray(cubeVAO);
     glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 }
 
-void Volume::UploadBuffer()
+void VolumeBase::CreateTexture()
+{
+    const TextureSource source = GetTextureSource();
+    if (this->volumeTexture)
+        glDeleteTextures(1, &this->volumeTexture);
+    glGenTextures(1, &this->volumeTexture);
+    glBindTexture(GL_TEXTURE_3D, this->volumeTexture);
+    // ボクセル型そのままの内部フォーマットで確保する(floatへの変換はしない)
+    const int levels = MipLevels();
+    const glm::ivec3 size = TextureResolution(0);
+    glTexStorage3D(GL_TEXTURE_3D, levels, source.internalFormat, size.x, size.y, size.z);
+
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    // 詰めたボクセルは整数テクスチャなので補間できない(シェーダで8ボクセルを読んで補間する)
+    const GLint filter = IsPacked() ? GL_NEAREST : GL_LINEAR;
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : filter);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+}
+
+namespace
 {
-    std::vector<float> volumeData(size * size * size);
-    for (size_t i = 0; i < size; ++i)
+    /// @brief 成分数が収まる最小のテクセルの幅[バイト]
+    size_t LabelTexelBytes(uint32_t componentCount)
     {
-        for (size_t j = 0; j < size; ++j)
-        {
-            for (size_t k = 0; k < size; ++k)
-            {
-                volumeData[i * size * size + j * size + k] = static_cast<float>(data[i][j][k].intencity) / 255.0f;
-            }
-        }
+        return componentCount <= UINT8_MAX ? 1 : componentCount <= UINT16_MAX ? 2 : 4;
+    }
+
+    template <typename Narrow>
+    void NarrowLabelsTo(const VolumeBase::IdGrid &ids, vector<uint8_t> &texels)
+    {
+        texels.resize(ids.Count() * sizeof(Narrow));
+        const uint32_t *labels = ids.Data();
+        Narrow *narrowed = reinterpret_cast<Narrow *>(texels.data());
+        const long long count = static_cast<long long>(ids.Count());
+#pragma omp parallel for schedule(static)
+        for (long long i = 0; i < count; ++i)
+            narrowed[i] = static_cast<Narrow>(labels[i]);
     }
+}
+
+void VolumeBase::NarrowLabels()
+{
+    labelTexels.clear();
+    labelTexels.shrink_to_fit();
+    if (ids.Empty())
+        return;
+    // 成分数が収まる最小の幅で転送する(GPUメモリと転送量を減らす)
+    const size_t bytes = LabelTexelBytes(componentCount);
+    if (bytes == 1)
+        NarrowLabelsTo<uint8_t>(ids, labelTexels);
+    else if (bytes == 2)
+        NarrowLabelsTo<uint16_t>(ids, labelTexels);
+}
+
+SlabUploader::Level VolumeBase::CreateLabelTexture()
+{
+    const size_t bytes = LabelTexelBytes(componentCount);
+    // 詰めていない(または成分数が変わった)場合はここで詰める
+    if (bytes < 4 && labelTexels.size() != ids.Count() * bytes)
+        NarrowLabels();
+    const GLenum internalFormat = bytes == 1 ? GL_R8UI : bytes == 2 ? GL_R16UI : GL_R32UI;
+    const GLenum type = bytes == 1 ? GL_UNSIGNED_BYTE : bytes == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    if (this->labelTexture)
+        glDeleteTextures(1, &this->labelTexture);
+    glGenTextures(1, &this->labelTexture);
+    glBindTexture(GL_TEXTURE_3D, this->labelTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, internalFormat, resolution.x, resolution.y, resolution.z);
+    // 整数テクスチャは補間できないので最近傍
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    const char *texels = bytes < 4 ? reinterpret_cast<const char *>(labelTexels.data()) : reinterpret_cast<const char *>(ids.Data());
+    return {0, resolution, texels, this->labelTexture, GL_RED_INTEGER, type, bytes};
+}
 
-    glGenTextures(1, &volumeTexture);
-    glBindTexture(GL_TEXTURE_3D, volumeTexture);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_RED, size, size, size, 0, GL_RED, GL_FLOAT, volumeData.data());
+void VolumeBase::UploadLabels()
+{
+    if (ids.Empty())
+        return;
+    const SlabUploader::Level level = CreateLabelTexture();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, resolution.x, resolution.y, resolution.z, GL_RED_INTEGER, level.type, level.data);
+}
 
+SlabUploader::Level VolumeBase::CreateGradientTexture()
+{
+    if (this->gradientTexture)
+        glDeleteTextures(1, &this->gradientTexture);
+    glGenTextures(1, &this->gradientTexture);
+    glBindTexture(GL_TEXTURE_3D, this->gradientTexture);
+    glTexStorage3D(GL_TEXTURE_3D, 1, GL_RGB8_SNORM, resolution.x, resolution.y, resolution.z);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return {0, resolution, reinterpret_cast<const char *>(gradients.Data()), this->gradientTexture, GL_RGB, GL_BYTE, sizeof(PackedGradient)};
+}
+
+void VolumeBase::UploadGradients()
+{
+    if (gradients.Empty())
+        return;
+    const SlabUploader::Level level = CreateGradientTexture();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // 1テクセル3バイトなので行が4の倍数とは限らない
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, resolution.x, resolution.y, resolution.z, level.format, level.type, level.data);
+}
+
+void VolumeBase::UpdateMacrocells(float alphaMin)
+{
+    if (macrocells.Empty() || alphaMin == classifiedAlphaMin)
+        return;
+    vector<uint8_t> occupancy;
+    occupiedMacrocells = ClassifyMacrocells(macrocells, alphaMin, occupancy);
+    classifiedAlphaMin = alphaMin;
+    // テクスチャ座標系の順(幅,高さ,奥行き)
+    const GLsizei width = static_cast<GLsizei>(macrocells.SizeZ()), height = static_cast<GLsizei>(macrocells.SizeY()), depth = static_cast<GLsizei>(macrocells.SizeX());
+    if (!this->macrocellTexture)
+    {
+        glGenTextures(1, &this->macrocellTexture);
+        glBindTexture(GL_TEXTURE_3D, this->macrocellTexture);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, width, height, depth);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    else
+        glBindTexture(GL_TEXTURE_3D, this->macrocellTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, width, height, depth, GL_RED_INTEGER, GL_UNSIGNED_BYTE, occupancy.data());
+}
 
+void VolumeBase::UploadDistanceField(const VoxelGrid<uint8_t> &field, float threshold)
+{
+    if (field.Empty())
+        return;
+    if (!this->distanceTexture)
+    {
+        glGenTextures(1, &this->distanceTexture);
+        glBindTexture(GL_TEXTURE_3D, this->distanceTexture);
+        glTexStorage3D(GL_TEXTURE_3D, 1, GL_R8UI, resolution.x, resolution.y, resolution.z);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    else
+        glBindTexture(GL_TEXTURE_3D, this->distanceTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, resolution.x, resolution.y, resolution.z, GL_RED_INTEGER, GL_UNSIGNED_BYTE, field.Data());
+    this->distanceThreshold = threshold;
+}
+
+void VolumeBase::UploadBuffer()
+{
+    if (IsPaged())
+    {
+        CreateAtlas();
+        CreateCube();
+        return;
+    }
+    // マップ領域から直接転送する。中間バッファは作らない
+    if (this->mappedFile.IsOpen())
+        this->mappedFile.AdviseSequential();
+    CreateTexture();
+    const TextureSource source = GetTextureSource();
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // 1行のバイト数が4の倍数とは限らないため
+    for (int level = 0; level < MipLevels(); ++level)
+    {
+        const glm::ivec3 size = TextureResolution(level);
+        glTexSubImage3D(GL_TEXTURE_3D, level, 0, 0, 0, size.x, size.y, size.z, source.format, source.type, MipData(level));
+    }
+    CreateCube();
+}
+
+void VolumeBase::BeginStreamingUpload(SlabUploader &uploader, GLuint texture)
+{
+    if (IsPaged())
+    {
+        if (texture)
+            glDeleteTextures(1, &texture);
+        CreateAtlas();
+        CreateCube();
+        return;
+    }
+    if (texture)
+    {
+        if (this->volumeTexture)
+            glDeleteTextures(1, &this->volumeTexture);
+        this->volumeTexture = texture;
+    }
+    else
+        CreateTexture();
+    const TextureSource source = GetTextureSource();
+    vector<SlabUploader::Level> levels;
+    for (int level = MipLevels() - 1; level >= 0; --level)
+    {
+        // 未転送のスラブがゴミとして描画されないよう0で埋めておく
+        // (再利用したテクスチャは転送が終わるまで描画されないので不要)
+        if (!texture && GLEW_ARB_clear_texture)
+            glClearTexImage(this->volumeTexture, level, source.format, source.type, nullptr);
+        // 小さい粗いレベルから転送し、遠景を先に表示できるようにする
+        levels.push_back({level, TextureResolution(level), MipData(level)});
+    }
+    // 勾配とクラスタIDも同じスラブの予算で続けて送る(一括で送ると1ボクセル3~4バイトの転送で描画が止まる)
+    if (!gradients.Empty())
+        levels.push_back(CreateGradientTexture());
+    if (!ids.Empty())
+        levels.push_back(CreateLabelTexture());
+    CreateCube();
+    uploader.Begin(this->volumeTexture, levels, source.format, source.type, source.voxelBytes);
+}
+
+size_t VolumeBase::UploadChangedPlanes(const vector<uint8_t> &changed)
+{
+    if (IsPaged() || IsPacked() || !this->volumeTexture || changed.size() != static_cast<size_t>(resolution.z))
+        return 0;
+    // 変わった平面の連続区間ごとに転送する
+    size_t bytes = 0;
+    auto uploadRuns = [&](const vector<uint8_t> &planes, auto &&upload)
+    {
+        for (size_t first = 0; first < planes.size();)
+        {
+            if (!planes[first])
+            {
+                ++first;
+                continue;
+            }
+            size_t last = first;
+            while (last < planes.size() && planes[last])
+                ++last;
+            upload(static_cast<GLint>(first), static_cast<GLsizei>(last - first));
+            first = last;
+        }
+    };
+
+    const TextureSource source = GetTextureSource();
+    glBindTexture(GL_TEXTURE_3D, this->volumeTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    vector<uint8_t> levelChanged = changed;
+    for (int level = 0; level < MipLevels(); ++level)
+    {
+        const glm::ivec3 size = MipResolution(level);
+        if (level > 0)
+        {
+            // 1段細かいレベルの平面pは平面p/2に縮約される(奇数なら最後の平面は1つ前と同じ平面へ)
+            vector<uint8_t> coarse(size.z, 0);
+            for (size_t p = 0; p < levelChanged.size(); ++p)
+                if (levelChanged[p])
+                    coarse[min<size_t>(p / 2, size.z - 1)] = 1;
+            levelChanged.swap(coarse);
+        }
+        const size_t sliceBytes = static_cast<size_t>(size.x) * size.y * source.voxelBytes;
+        uploadRuns(levelChanged, [&](GLint first, GLsizei count)
+                   {
+                       glTexSubImage3D(GL_TEXTURE_3D, level, 0, 0, first, size.x, size.y, count, source.format, source.type, MipData(level) + first * sliceBytes);
+                       bytes += count * sliceBytes; });
+    }
+    if (this->gradientTexture && !gradients.Empty())
+    {
+        // 中心差分なので前後1平面の勾配も変わる
+        vector<uint8_t> gradientChanged(changed.size(), 0);
+        for (size_t p = 0; p < changed.size(); ++p)
+            if (changed[p])
+                for (size_t q = p > 0 ? p - 1 : 0; q <= min(p + 1, changed.size() - 1); ++q)
+                    gradientChanged[q] = 1;
+        const size_t sliceBytes = static_cast<size_t>(resolution.x) * resolution.y * sizeof(PackedGradient);
+        glBindTexture(GL_TEXTURE_3D, this->gradientTexture);
+        uploadRuns(gradientChanged, [&](GLint first, GLsizei count)
+                   {
+                       glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, first, resolution.x, resolution.y, count, GL_RGB, GL_BYTE, reinterpret_cast<const char *>(gradients.Data()) + first * sliceBytes);
+                       bytes += count * sliceBytes; });
+    }
+    return bytes;
+}
+
+void VolumeBase::AdoptTextures(VolumeBase &previous)
+{
+    const auto take = [](GLuint &mine, GLuint &theirs)
+    {
+        if (mine)
+            glDeleteTextures(1, &mine);
+        mine = theirs;
+        theirs = 0;
+    };
+    take(this->volumeTexture, previous.volumeTexture);
+    take(this->gradientTexture, previous.gradientTexture);
+    take(this->labelTexture, previous.labelTexture);
+    take(this->macrocellTexture, previous.macrocellTexture);
+    if (!this->cubeVAO)
+    {
+        this->cubeVAO = previous.cubeVAO;
+        this->cubeVBO = previous.cubeVBO;
+        this->cubeEBO = previous.cubeEBO;
+        previous.cubeVAO = previous.cubeVBO = previous.cubeEBO = 0;
+    }
+}
+
+void VolumeBase::BeginLabelStreaming(SlabUploader &uploader)
+{
+    if (ids.Empty())
+        return;
+    // CreateLabelTexture()は今のテクスチャを削除するので、表示中のものを避けておく
+    const GLuint shown = this->labelTexture;
+    this->labelTexture = 0;
+    if (this->streamingLabelTexture)
+        glDeleteTextures(1, &this->streamingLabelTexture);
+    const SlabUploader::Level level = CreateLabelTexture();
+    this->streamingLabelTexture = this->labelTexture;
+    this->labelTexture = shown;
+    uploader.Begin({level});
+}
+
+void VolumeBase::FinishLabelStreaming()
+{
+    if (!this->streamingLabelTexture)
+        return;
+    if (this->labelTexture)
+        glDeleteTextures(1, &this->labelTexture);
+    this->labelTexture = this->streamingLabelTexture;
+    this->streamingLabelTexture = 0;
+    labelTexels = vector<uint8_t>();
+}
+
+GLuint VolumeBase::ReleaseTexture()
+{
+    const GLuint texture = this->volumeTexture;
+    this->volumeTexture = 0;
+    return texture;
+}
+
+void VolumeBase::CreateCube()
+{
     float cubeVertices[] = {
         -0.5f,
         -0.5f,
@@ -213,6 +1007,9 @@ void Volume::UploadBuffer()
         0.5f,
         0.5f,
     };
+    // 非立方体のボリュームに合わせてバウンディングボックスを伸縮する
+    for (size_t v = 0; v < sizeof(cubeVertices) / sizeof(float); ++v)
+        cubeVertices[v] *= this->extent[v % 3];
 
     // インデックスでキューブ6面構成（12三角形）
     unsigned int cubeIndices[] = {
@@ -228,11 +1025,12 @@ void Volume::UploadBuffer()
         3, 7, 6,
         1, 5, 4,
         4, 0, 1};
-    GLuint cubeVBO, cubeEBO;
-    glGenVertexArrays(1, &this->cubeVAO);
-    glGenBuffers(1, &cubeVBO);
-    glGenBuffers(1, &cubeEBO);
-
+    if (this->cubeVAO == 0)
+    {
+        glGenVertexArrays(1, &this->cubeVAO);
+        glGenBuffers(1, &this->cubeVBO);
+        glGenBuffers(1, &this->cubeEBO);
+    }
     glBindVertexArray(cubeVAO);
 
     glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
@@ -244,3 +1042,8 @@ void Volume::UploadBuffer()
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void *)0);
     glEnableVertexAttribArray(0);
 }
+
+template class Volume<uint8_t>;
+template class Volume<uint16_t>;
+template class Volume<Half>;
+template class Volume<float>;
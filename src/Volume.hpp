@@ -1,10 +1,16 @@
 #pragma once
 #include <vector>
+#include <algorithm>
+#include <atomic>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <cmath>
 #include <string>
+#include <memory>
+#include <cstdint>
+#include <type_traits>
+#include <limits>
 
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -12,31 +18,371 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtx/transform.hpp>
 
-/// @brief 3Dボリュームクラス
-class Volume
+#include "MappedFile.hpp"
+#include "VoxelGrid.hpp"
+#include "VoxelTraits.hpp"
+#include "VolumeHeader.hpp"
+#include "SlabUploader.hpp"
+#include "BrickCache.hpp"
+#include "BrickAtlas.hpp"
+#include "MipPyramid.hpp"
+#include "DerivedCache.hpp"
+#include "ConnectedComponents.hpp"
+#include "Gradient.hpp"
+#include "Macrocell.hpp"
+#include "Histogram.hpp"
+#include "BitGrid.hpp"
+#include "Morphology.hpp"
+#include "Filter.hpp"
+
+/// @brief ボクセル型に依存しない3Dボリュームの基底クラス(形状、クラスタID、描画)
+class VolumeBase
 {
-private:
-    glm::vec3 CalcNormalAtIndex(size_t x, size_t y, size_t z);
+protected:
+    /// ボリュームファイルのメモリマップ。ボクセル値はヒープにコピーせずここから直接参照する
+    MappedFile mappedFile;
+    GLuint cubeVBO = 0;
+    GLuint cubeEBO = 0;
+    /// @brief グリッドの大きさとボクセル間隔からresolutionとextentを設定する
+    void SetGeometry(size_t sizeX, size_t sizeY, size_t sizeZ, const glm::vec3 &spacing);
+    /// @brief 3Dテクスチャを不変ストレージ(glTexStorage3D)で確保する。ミップレベルがあれば全レベル確保する
+    void CreateTexture();
+    /// @brief バウンディングボックスのVAOを作る
+    void CreateCube();
+    /// キャッシュから読み込んだ勾配とクラスタIDのマップ。gradients・idsはコピーせずにここを参照する
+    CachedArray<PackedGradient> mappedGradients;
+    CachedArray<uint32_t> mappedIds;
+    /// @brief 内容ハッシュを計算する(ContentHash()から初回のみ呼ばれる)
+    virtual uint64_t HashContent() const = 0;
+    /// @brief ボクセル値を書き換えた後に、内容ハッシュ・マクロセルの分類・距離場を古いものとして捨てる
+    void ContentChanged();
+    /// BuildMipmaps()で使った縮約方法(RefreshDerived()で作り直す時に使う)
+    MipReduction mipReduction = MipReduction::Max;
 
 public:
-    struct Cell
+    /// @brief テクスチャ転送に必要なボクセル配列の情報
+    struct TextureSource
     {
-        char intencity;
-        unsigned char id;
-        // glm::vec3 normal;
+        GLenum internalFormat;
+        GLenum format;
+        GLenum type;
+        size_t voxelBytes;
+        const char *data; // 幅が最速軸の連続領域
     };
 
-    using VolumeData = std::vector<std::vector<std::vector<Cell>>>;
-    size_t size;
-    VolumeData data;
-    Volume(std::ifstream &file);
+    /// クラスタIDの平面(SoA)。32bitなので成分が255個を超えても番号が重ならない
+    using IdGrid = VoxelGrid<uint32_t>;
+    /// 勾配の向きの平面(RGB8_SNORMのテクセル)
+    using GradientGrid = VoxelGrid<PackedGradient>;
+    /// マクロセルごとの強度の範囲
+    using MacrocellGrid = VoxelGrid<ValueRange>;
+
+    /// 解像度(幅,高さ,奥行き)。テクスチャ座標系の順で、幅がメモリ上で最も速く変化する軸
+    glm::ivec3 resolution = glm::ivec3(0);
+    /// 物理的な大きさ(最大辺が1になるよう正規化)。描画時のバウンディングボックスになる
+    glm::vec3 extent = glm::vec3(1.0f);
+    /// クラスタID(1から、背景は0)。Clustering()が呼ばれるまで確保しない
+    IdGrid ids;
+    /// Clustering()で求めた成分数(最大のクラスタID)
+    uint32_t componentCount = 0;
+    /// クラスタIDを求めた時の近傍
+    Connectivity labelConnectivity = Connectivity::Face;
+    /// 成分ごとのボクセル数・外接直方体・重心(クラスタID順、要素0は背景)
+    std::vector<ComponentStats> components;
+    GLuint volumeTexture = 0;
+    /// クラスタIDの整数3Dテクスチャ。UploadLabels()かストリーミング転送を始めるまで0
+    GLuint labelTexture = 0;
+    /// 転送用に、クラスタIDを成分数が収まる最小の幅(8/16bit)に詰めたテクセル。NarrowLabels()で作る。32bitならidsをそのまま送るので空
+    std::vector<uint8_t> labelTexels;
+    /// 陰影用の勾配の向き。BuildGradients()が呼ばれるまで空
+    GradientGrid gradients;
+    /// 勾配の3Dテクスチャ(RGB8_SNORM)。UploadGradients()かストリーミング転送を始めるまで0
+    GLuint gradientTexture = 0;
+    /// 強度のヒストグラム(Alpha Min-Maxの目安)。読み込み時に作る。ページングしている場合は空
+    Histogram histogram;
+    /// 空領域スキップ用の、macrocellSize^3ボクセルごとの強度の範囲。BuildMacrocells()が呼ばれるまで空
+    MacrocellGrid macrocells;
+    /// マクロセルの分類(R8UI、1ならサンプルが必要)。UpdateMacrocells()を呼ぶまで0
+    GLuint macrocellTexture = 0;
+    /// 現在の分類でサンプルが必要なマクロセルの数
+    size_t occupiedMacrocells = 0;
+    /// 1ボクセル1ビットに詰めた2値のボクセル。PackBits()を呼ぶまで空。空でなければボクセル値の代わりに描画・点群・クラスタリングに使う
+    BitGrid bits;
+    /// 占有ボクセルまでの距離場(R8UI、ボクセル単位)。UploadDistanceField()を呼ぶまで0
+    GLuint distanceTexture = 0;
+    /// distanceTextureを作った時の閾値(アルファの下限)。これ以上の閾値なら距離は短めになるだけなので、そのまま使える
+    float distanceThreshold = std::numeric_limits<float>::quiet_NaN();
+    GLuint cubeVAO = 0;
+    /// ページングしている場合、GPUに載せるブリックのアトラス。volumeTextureの代わりに描画に使う
+    std::unique_ptr<BrickAtlas> atlas;
+    /// アトラスに使うGPUメモリの上限
+    size_t atlasBudgetBytes = size_t(512) * 1024 * 1024;
+    /// 派生データを作っている間の中断要求(VolumeLoaderのワーカーが設定する)。nullptrなら中断しない
+    /// @details trueになるとミップピラミッド・勾配・クラスタIDの計算は途中で打ち切り、不完全な結果はキャッシュに保存しない
+    const std::atomic<bool> *cancel = nullptr;
+
+    /// @brief GLオブジェクトを破棄する。GLオブジェクトを作った場合はGLコンテキストのあるスレッドで破棄すること
+    virtual ~VolumeBase();
+    /// @brief 中断が要求されているか(cancel参照)
+    bool Cancelled() const { return cancel && cancel->load(std::memory_order_relaxed); }
+    /// @brief ボクセル型
+    virtual VolumeHeader::VoxelType VoxelType() const = 0;
+    /// @brief 正規化(0~1)したボクセル値を取得する
+    virtual float NormalizedAt(size_t x, size_t y, size_t z) const = 0;
+    /// @brief 連結した非ゼロ領域にIDを振る(並列のunion-find)
+    /// @details ページングしている場合は何もしない(全解像度のクラスタIDは1ボクセル4バイトで、ページングで避けたボクセル値より大きい)
+    virtual void Clustering(Connectivity connectivity = Connectivity::Face) = 0;
+    /// @brief テクスチャ転送元の情報。ページングしている場合dataはnullptr
+    virtual TextureSource GetTextureSource() const = 0;
+    /// @brief ボクセル値をブリックキャッシュ経由で参照しているか
+    virtual bool IsPaged() const = 0;
+    /// @brief ボクセル値を捨てて1ボクセル1ビット(bits)だけを持っているか
+    bool IsPacked() const { return !bits.Empty(); }
+    /// @brief 非ゼロのボクセルを1としてbitsに詰め、ボクセル値とミップピラミッドを解放する(ページングしている場合は何もしない)
+    /// @details 以降のサンプル値は0か1になるので、マクロセルの範囲も0と1に丸め直す。ヒストグラムと勾配は元のボクセル値のまま残す。
+    /// GLを呼ばないのでワーカースレッドで呼んでよい
+    virtual void PackBits() = 0;
+    /// @brief カメラから見えるブリックをGPUに載せる(ページングしている場合のみ)。毎フレーム描画前に呼ぶ
+    /// @param budgetMs このフレームで転送に使ってよい時間[ms]
+    virtual void UpdateResidency(const glm::mat4 &/*modelViewProjection*/, double /*budgetMs*/) {}
+    /// @brief ページングの統計(キャッシュのヒット率、ページングしたバイト数、GPUに常駐しているブリック数)
+    virtual std::string PagingStats() const { return ""; }
+    /// @brief ミップピラミッドを作る(ページングしている場合は何もしない)。GLを呼ばないのでワーカースレッドで呼んでよい
+    /// @param cache nullptrでなければ、キャッシュにあれば読み込み、無ければ作って保存する
+    virtual void BuildMipmaps(MipReduction reduction, const DerivedCache *cache = nullptr) = 0;
+    /// @brief 陰影用の勾配を中心差分で求める(ページングしている場合は何もしない)。GLを呼ばないのでワーカースレッドで呼んでよい
+    /// @param cache nullptrでなければ、キャッシュにあれば読み込み、無ければ作って保存する
+    virtual void BuildGradients(const DerivedCache *cache = nullptr) = 0;
+    /// @brief 空領域スキップ用にマクロセルごとの強度の範囲を求める(ページングしている場合は何もしない)。GLを呼ばないのでワーカースレッドで呼んでよい
+    /// @param cache nullptrでなければ、キャッシュにあれば読み込み、無ければ作って保存する
+    virtual void BuildMacrocells(const DerivedCache *cache = nullptr) = 0;
+    /// @brief ボクセル値にモルフォロジー演算をその場で適用する(ページングしている・詰めている場合は何もしない)
+    /// @details 派生データは作り直さないので、作ってある場合は続けてRefreshDerived()を呼ぶ。GLを呼ばないのでワーカースレッドで呼んでよい
+    /// @return x平面(テクスチャの奥行きのスライス)ごとに、値が変わったなら1。何もしなかった場合は空
+    virtual std::vector<uint8_t> ApplyMorphology(MorphologyOp op, const StructuringElement &element) = 0;
+    /// @brief ボクセル値に分離可能な平滑化フィルタをその場で適用する(ページングしている・詰めている場合は何もしない)
+    /// @details ApplyMorphology()と同じく、派生データは続けてRefreshDerived()で作り直す。GLを呼ばないのでワーカースレッドで呼んでよい
+    /// @return x平面ごとに、値が変わったなら1。何もしなかった場合は空
+    virtual std::vector<uint8_t> ApplyFilter(const FilterSettings &settings) = 0;
+    /// @brief ボクセル値を自前の領域にコピーした新しいボリュームを作る(派生データとGLオブジェクトはコピーしない)
+    /// @details 表示中のボリュームを編集する時に、コピーの方を書き換えるために使う。GLを呼ばないのでワーカースレッドで呼んでよい。
+    /// ページングしている・詰めている場合はstd::runtime_errorを投げる
+    /// @param cancel trueになったら平面の間で打ち切ってnullptrを返す
+    virtual std::unique_ptr<VolumeBase> CopyVoxels(const std::atomic<bool> *cancel = nullptr) const = 0;
+    /// @brief ボクセル値を書き換えた後に、作ってある派生データ(ミップピラミッド、マクロセル、ヒストグラム、勾配、クラスタID)を作り直す
+    /// @details キャッシュは使わない。GLを呼ばないのでワーカースレッドで呼んでよい
+    virtual void RefreshDerived() = 0;
+    /// @brief BuildMipmaps()で使った縮約方法
+    MipReduction GetMipReduction() const { return mipReduction; }
+    /// @brief ミップレベル数(レベル0を含む)
+    virtual int MipLevels() const = 0;
+    /// @brief ミップレベルのボクセル配列(幅が最速軸)。レベル0はGetTextureSource().dataと同じ
+    virtual const char *MipData(int level) const = 0;
+    /// @brief ミップレベルの解像度(幅,高さ,奥行き)
+    glm::ivec3 MipResolution(int level) const
+    {
+        return glm::ivec3(std::max(resolution.x >> level, 1), std::max(resolution.y >> level, 1), std::max(resolution.z >> level, 1));
+    }
+    /// @brief テクスチャのミップレベルの大きさ(幅,高さ,奥行き)。詰めている場合は幅が行の32bitワード数になる
+    glm::ivec3 TextureResolution(int level) const
+    {
+        return IsPacked() ? glm::ivec3(static_cast<int>(bits.WordsPerRow() * 2), resolution.y, resolution.z) : MipResolution(level);
+    }
+    /// @brief ボクセル値・解像度・ボクセル型・大きさから求めた内容ハッシュ。派生データのキャッシュのキーにする
+    /// @details 初回に計算して保持する(ボリュームの大きさに比例した時間がかかる)。
+    /// ページングしている場合はファイル全体を読まないよう、ヘッダ(オフセット表を含む)と空ブリックの配置のハッシュ
+    uint64_t ContentHash() const;
+    /// @brief Clustering()の結果(クラスタID)をキャッシュから読み込む。無ければ計算して保存する(ページングしている場合は何もしない)
+    void ClusteringCached(const DerivedCache &cache, Connectivity connectivity = Connectivity::Face);
+    /// @brief クラスタIDを転送用のlabelTexelsに詰める(Clustering()の後に呼ぶ)。GLを呼ばないのでワーカースレッドで呼んでよい
+    /// @details 描画スレッドで1ボクセル4バイトを読んで詰め直すと、転送の前にその分だけ止まるため
+    void NarrowLabels();
+    /// @brief 詰めたボクセルの連結した1の領域にIDを振る。idsが空なら確保する
+    /// @return 成分数
+    static uint32_t Clustering(const BitGrid &bits, IdGrid &ids, Connectivity connectivity = Connectivity::Face, const std::atomic<bool> *cancel = nullptr);
     std::string Sammary();
-    static void Clustering(VolumeData &v);
     void Draw();
+    /// @brief クラスタIDを整数3Dテクスチャ(成分数に応じてR8UI/R16UI/R32UI)に一括で転送する。転送完了までブロックする
+    /// @details シェーダは成分ごとの表(LabelTable)を引いて非表示・色替えをするので、表示を変えても再転送は不要
+    void UploadLabels();
+    /// @brief 勾配を3Dテクスチャ(RGB8_SNORM、1ボクセル3バイト)に一括で転送する。転送完了までブロックする
+    /// @details シェーダは1ステップあたり6回の強度のサンプルの代わりに、このテクスチャを1回サンプルする
+    void UploadGradients();
+    /// @brief アルファの下限でマクロセルを分類し、3Dテクスチャ(R8UI)に転送する。下限が前回と同じなら何もしない
+    /// @details 強度の範囲は読み込み時に一度だけ求めてあるので、スライダーを動かしても分類(セル数に比例)と転送だけで済む
+    void UpdateMacrocells(float alphaMin);
+    /// @brief 距離場(ComputeDistanceField()の結果)を整数3Dテクスチャ(R8UI)に転送する。転送完了までブロックする
+    /// @param threshold 距離場を作った時の閾値
+    void UploadDistanceField(const VoxelGrid<uint8_t> &field, float threshold);
+    /// @brief ボクセル値を一括で3Dテクスチャに転送する(転送完了までブロックする)
+    /// @details ページングしている場合はアトラスを確保するだけで、ブリックはUpdateResidency()で転送する
     void UploadBuffer();
-    void CalcNormal();
-    GLuint volumeTexture = 0;
-    GLuint cubeVAO = 0;
+    /// @brief テクスチャを確保し、uploaderによるスラブ単位の転送を開始する
+    /// @details 転送完了まではuploader.Step()を毎フレーム呼ぶこと。未転送の領域は0として描画される。
+    /// 勾配とクラスタIDがあれば強度の後に続けて同じuploaderで転送する。
+    /// ページングしている場合はアトラスを確保するだけで、uploaderは使わない
+    void BeginStreamingUpload(SlabUploader &uploader) { BeginStreamingUpload(uploader, 0); }
+    /// @brief 確保済みのテクスチャを再利用して、uploaderによるスラブ単位の転送を開始する(時系列再生のダブルバッファ用)
+    /// @param texture このボリュームと同じ解像度・内部フォーマット・ミップレベル数で確保済みのテクスチャ。所有権を受け取る。0なら新しく確保する
+    void BeginStreamingUpload(SlabUploader &uploader, GLuint texture);
+    /// @brief 同じ解像度・ボクセル型のpreviousから、強度・勾配・クラスタID・マクロセルのテクスチャとVAOの所有権を受け取る
+    /// @details 編集したコピー(CopyVoxels())を表示中のボリュームと差し替える時に、UploadChangedPlanes()で変わった平面だけを転送するために使う。
+    /// 距離場は内容が変わったので受け取らない
+    void AdoptTextures(VolumeBase &previous);
+    /// @brief ApplyMorphology()・ApplyFilter()で値が変わった平面だけを、全ミップレベルと勾配のテクスチャに転送し直す。転送完了までブロックする
+    /// @details 粗いレベルでは、変わった平面から作られる平面だけを転送する。
+    /// クラスタIDは成分数で幅が変わり得るので、ここでは転送せずBeginLabelStreaming()で全体を転送し直す
+    /// @param changed ApplyMorphology()・ApplyFilter()の戻り値
+    /// @return 転送したバイト数
+    size_t UploadChangedPlanes(const std::vector<uint8_t> &changed);
+    /// @brief クラスタIDのテクスチャを新しく確保し、uploaderによるスラブ単位の転送を開始する
+    /// @details 転送が終わるまでは今のlabelTextureで描画し続け、完了したらFinishLabelStreaming()で差し替える
+    void BeginLabelStreaming(SlabUploader &uploader);
+    /// @brief BeginLabelStreaming()の転送が完了した後に、新しいテクスチャに差し替えて詰めたテクセルを解放する
+    void FinishLabelStreaming();
+    /// @brief BeginLabelStreaming()の転送中か
+    bool LabelsStreaming() const { return streamingLabelTexture != 0; }
+    /// @brief テクスチャの所有権を呼び出し側に渡す(このボリュームの破棄時に削除しない)
+    GLuint ReleaseTexture();
+
+protected:
+    /// @brief ページング用のアトラスを確保する
+    virtual void CreateAtlas() {}
+    /// @brief クラスタIDのテクスチャを成分数に応じた形式で確保する(転送はしない)
+    /// @return 転送するレベル(テクセルはlabelTexelsかids)
+    SlabUploader::Level CreateLabelTexture();
+    /// @brief 勾配のテクスチャを確保する(転送はしない)
+    /// @return 転送するレベル(テクセルはgradients)
+    SlabUploader::Level CreateGradientTexture();
+
+private:
+    mutable uint64_t contentHash = 0;
+    mutable bool hasContentHash = false;
+    /// BeginLabelStreaming()で転送中のクラスタIDのテクスチャ
+    GLuint streamingLabelTexture = 0;
+    /// macrocellTextureを分類した時のアルファの下限(未分類ならNaN)
+    float classifiedAlphaMin = std::numeric_limits<float>::quiet_NaN();
 };
 
-std::ostream &operator<<(std::ostream &os, Volume &v);
\ No newline at end of file
+/// @brief ボクセル型Tの3Dボリュームクラス
+/// @tparam T ボクセルの型(uint8_t, uint16_t, Half, float)。GLの内部フォーマットはVoxelTraits<T>で決まる
+template <typename T>
+class Volume : public VolumeBase
+{
+public:
+    /// 強度の平面(SoA)
+    using IntencityGrid = VoxelGrid<T>;
+    using Traits = VoxelTraits<T>;
+
+    /// 強度。メモリマップ領域のビュー、または自前で確保した領域。ページングしている場合は空
+    IntencityGrid intencity;
+    /// ページングしている場合のブリックキャッシュ。intencityの代わりにここから読む
+    std::unique_ptr<BrickCache<T>> pages;
+    /// ミップレベル1以降(mips[0]がレベル1)。BuildMipmaps()が呼ばれるまで空
+    std::vector<IntencityGrid> mips;
+
+    /// @brief メモリマップしたファイルのペイロードを参照するボリュームを作る
+    /// @details ペイロードのエンディアンがホストと異なる場合は、コピーオンライトのマップ上で入れ替える
+    Volume(MappedFile &&file, const VolumeHeader &header);
+    /// @brief メモリ上のボクセル配列からボリュームを作る
+    /// @param spacing ボクセル間隔(幅,高さ,奥行き)
+    Volume(IntencityGrid &&grid, const glm::vec3 &spacing = glm::vec3(1.0f));
+    /// @brief ブリックキャッシュ経由で参照する(ページングする)ボリュームを作る
+    explicit Volume(std::unique_ptr<BrickCache<T>> pages);
+
+    VolumeHeader::VoxelType VoxelType() const override { return Traits::voxelType; }
+    float NormalizedAt(size_t x, size_t y, size_t z) const override
+    {
+        if (this->IsPacked())
+            return this->bits.Get(x, y, z) ? 1.0f : 0.0f;
+        return Traits::Normalize(pages ? (*pages)(x, y, z) : intencity(x, y, z));
+    }
+    void Clustering(Connectivity connectivity = Connectivity::Face) override
+    {
+        if (pages)
+            return;
+        this->labelConnectivity = connectivity;
+        if (this->IsPacked())
+            this->componentCount = VolumeBase::Clustering(this->bits, this->ids, connectivity, this->cancel);
+        else
+            this->componentCount = Clustering(this->intencity, this->ids, connectivity, this->cancel);
+        this->components = MeasureComponents(this->ids, this->componentCount);
+        if (!this->Cancelled())
+            this->NarrowLabels();
+    }
+    TextureSource GetTextureSource() const override
+    {
+        // 詰めたボクセルは64bitワードをリトルエンディアンの32bitワード2つとして転送する
+        if (this->IsPacked())
+            return {GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, sizeof(uint32_t), reinterpret_cast<const char *>(this->bits.Data())};
+        return {Traits::internalFormat, Traits::format, Traits::type, sizeof(T), reinterpret_cast<const char *>(intencity.Data())};
+    }
+    bool IsPaged() const override { return pages != nullptr; }
+    void PackBits() override;
+    void UpdateResidency(const glm::mat4 &modelViewProjection, double budgetMs) override;
+    std::string PagingStats() const override;
+    void BuildMipmaps(MipReduction reduction, const DerivedCache *cache = nullptr) override;
+    void BuildGradients(const DerivedCache *cache = nullptr) override;
+    void BuildMacrocells(const DerivedCache *cache = nullptr) override;
+    std::vector<uint8_t> ApplyMorphology(MorphologyOp op, const StructuringElement &element) override;
+    std::vector<uint8_t> ApplyFilter(const FilterSettings &settings) override;
+    std::unique_ptr<VolumeBase> CopyVoxels(const std::atomic<bool> *cancel = nullptr) const override;
+    void RefreshDerived() override;
+    int MipLevels() const override { return 1 + static_cast<int>(mips.size()); }
+    const char *MipData(int level) const override
+    {
+        return level == 0 ? GetTextureSource().data : reinterpret_cast<const char *>(mips[level - 1].Data());
+    }
+    /// @brief 連結した非ゼロ領域にIDを振る。idsが空なら確保する
+    /// @return 成分数
+    static uint32_t Clustering(const IntencityGrid &intencity, IdGrid &ids, Connectivity connectivity = Connectivity::Face, const std::atomic<bool> *cancel = nullptr);
+
+protected:
+    /// キャッシュから読み込んだミップピラミッドのマップ。mipsはコピーせずにここを参照する
+    CachedArray<T> mappedMips;
+
+    void CreateAtlas() override;
+    uint64_t HashContent() const override;
+};
+
+extern template class Volume<uint8_t>;
+extern template class Volume<uint16_t>;
+extern template class Volume<Half>;
+extern template class Volume<float>;
+
+/// @brief ボリュームファイルを読み込み、ボクセル型に応じたVolume<T>を作る。失敗した場合はstd::runtime_errorを投げる
+/// @details ヘッダ(VolumeHeader)付きのファイルならその解像度・間隔・型を使い、
+/// ヘッダが無ければ生の立方体8bit.datとみなして一辺をファイルサイズから推測する
+/// @param filepath ボリュームファイルのパス
+/// @param cacheBytes ブリック化ファイルの展開後の大きさがこれを超える場合、全体を展開せずにこの容量のブリックキャッシュでページングする。0ならページングしない
+std::unique_ptr<VolumeBase> LoadVolume(const std::string &filepath, size_t cacheBytes = 0);
+/// @brief ボリュームファイルの部分領域だけを読み込む
+/// @details 非ブリックのペイロードは領域の行(幅方向の連続区間)だけを飛び飛びに読み、
+/// ブリック化ペイロードは領域に交わるブリックだけを展開するので、I/Oはファイルではなく領域の大きさに比例する。
+/// 結果は通常のVolumeなので、全ての描画モードで使える。
+/// 領域は解像度に切り詰める。空になる場合や読み込みに失敗した場合はstd::runtime_errorを投げる
+/// @param region 読み込む領域(幅,高さ,奥行き)
+std::unique_ptr<VolumeBase> LoadVolumeRegion(const std::string &filepath, const VolumeRegion &region);
+
+/// @brief ボクセル型に応じてVolume<T>にキャストしてfuncを呼ぶ
+/// @param func Volume<T>&を引数に取る汎用ラムダ
+template <typename Base, typename Func>
+decltype(auto) VisitVolume(Base &volume, Func &&func)
+{
+    using Type = VolumeHeader::VoxelType;
+    constexpr bool isConst = std::is_const<Base>::value;
+    switch (volume.VoxelType())
+    {
+    case Type::UInt16:
+        return func(static_cast<std::conditional_t<isConst, const Volume<uint16_t>, Volume<uint16_t>> &>(volume));
+    case Type::Float16:
+        return func(static_cast<std::conditional_t<isConst, const Volume<Half>, Volume<Half>> &>(volume));
+    case Type::Float32:
+        return func(static_cast<std::conditional_t<isConst, const Volume<float>, Volume<float>> &>(volume));
+    case Type::UInt8:
+    default:
+        return func(static_cast<std::conditional_t<isConst, const Volume<uint8_t>, Volume<uint8_t>> &>(volume));
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, VolumeBase &v);
@@ -0,0 +1,223 @@
+#include "VolumeHeader.hpp"
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+namespace
+{
+    // ヘッダの数値はホストのエンディアンに関わらずリトルエンディアンで読み書きする
+    uint32_t LoadU32(const char *p)
+    {
+        const unsigned char *b = reinterpret_cast<const unsigned char *>(p);
+        return uint32_t(b[0]) | uint32_t(b[1]) << 8 | uint32_t(b[2]) << 16 | uint32_t(b[3]) << 24;
+    }
+    uint64_t LoadU64(const char *p)
+    {
+        return uint64_t(LoadU32(p)) | uint64_t(LoadU32(p + 4)) << 32;
+    }
+    float LoadF32(const char *p)
+    {
+        uint32_t bits = LoadU32(p);
+        float value;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    void StoreU32(char *p, uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+            p[i] = static_cast<char>((v >> (8 * i)) & 0xFF);
+    }
+    void StoreU64(char *p, uint64_t v)
+    {
+        StoreU32(p, static_cast<uint32_t>(v));
+        StoreU32(p + 4, static_cast<uint32_t>(v >> 32));
+    }
+    void StoreF32(char *p, float v)
+    {
+        uint32_t bits;
+        memcpy(&bits, &v, sizeof(bits));
+        StoreU32(p, bits);
+    }
+}
+
+size_t VolumeHeader::VoxelBytes(VoxelType type)
+{
+    switch (type)
+    {
+    case VoxelType::UInt8:
+        return 1;
+    case VoxelType::UInt16:
+        return 2;
+    case VoxelType::Float32:
+        return 4;
+    case VoxelType::Float16:
+        return 2;
+    }
+    return 0;
+}
+
+const char *VolumeHeader::VoxelTypeName(VoxelType type)
+{
+    switch (type)
+    {
+    case VoxelType::UInt8:
+        return "u8";
+    case VoxelType::UInt16:
+        return "u16";
+    case VoxelType::Float32:
+        return "f32";
+    case VoxelType::Float16:
+        return "f16";
+    }
+    return "unknown";
+}
+
+bool HasVolumeHeader(const char *data, size_t size)
+{
+    return size >= VolumeHeader::FIXED_SIZE && memcmp(data, VolumeHeader::MAGIC, sizeof(VolumeHeader::MAGIC)) == 0;
+}
+
+VolumeHeader ParseVolumeHeader(const char *data, size_t size)
+{
+    if (!HasVolumeHeader(data, size))
+        throw runtime_error("Volume header magic not found.");
+
+    VolumeHeader header;
+    const uint32_t version = LoadU32(data + 4);
+    if (version != VolumeHeader::VERSION)
+        throw runtime_error("Unsupported volume header version: " + to_string(version));
+
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        header.resolution[axis] = LoadU32(data + 8 + 4 * axis);
+        header.spacing[axis] = LoadF32(data + 20 + 4 * axis);
+        if (header.resolution[axis] == 0)
+            throw runtime_error("Volume resolution must not be zero.");
+        if (!(header.spacing[axis] > 0.0f))
+            throw runtime_error("Voxel spacing must be positive.");
+    }
+
+    const uint8_t voxelType = static_cast<uint8_t>(data[32]);
+    if (voxelType > static_cast<uint8_t>(VolumeHeader::VoxelType::Float16))
+        throw runtime_error("Unknown voxel type: " + to_string(voxelType));
+    header.voxelType = static_cast<VolumeHeader::VoxelType>(voxelType);
+
+    const uint8_t endian = static_cast<uint8_t>(data[33]);
+    if (endian > static_cast<uint8_t>(VolumeHeader::Endian::Big))
+        throw runtime_error("Unknown endianness: " + to_string(endian));
+    header.endian = static_cast<VolumeHeader::Endian>(endian);
+
+    header.brickSize = LoadU32(data + 36);
+    const uint64_t brickCount = LoadU64(data + 40);
+    header.payloadOffset = LoadU64(data + 48);
+
+    if (brickCount > 0)
+    {
+        if (brickCount >= size / sizeof(uint64_t))
+            throw runtime_error("Brick offset table exceeds file size.");
+        if (header.brickSize == 0)
+            throw runtime_error("Brick table present but brick size is zero.");
+        const size_t tableBytes = (brickCount + 1) * sizeof(uint64_t);
+        if (VolumeHeader::FIXED_SIZE + tableBytes > size)
+            throw runtime_error("Brick offset table exceeds file size.");
+        header.brickOffsets.resize(brickCount + 1);
+        for (size_t i = 0; i <= brickCount; ++i)
+            header.brickOffsets[i] = LoadU64(data + VolumeHeader::FIXED_SIZE + i * sizeof(uint64_t));
+    }
+
+    // ペイロードがファイルに収まるかは呼び出し側がファイルサイズと照合する
+    if (header.payloadOffset < header.HeaderBytes())
+        throw runtime_error("Invalid payload offset.");
+    return header;
+}
+
+bool ReadVolumeHeader(const string &filepath, VolumeHeader &header)
+{
+    ifstream file(filepath, ios::binary);
+    if (!file.is_open())
+        throw runtime_error("Failed to open file: " + filepath);
+
+    file.seekg(0, ios::end);
+    const size_t fileSize = static_cast<size_t>(file.tellg());
+    file.seekg(0, ios::beg);
+
+    vector<char> fixed(VolumeHeader::FIXED_SIZE);
+    if (fileSize < fixed.size() || !file.read(fixed.data(), fixed.size()) || !HasVolumeHeader(fixed.data(), fixed.size()))
+        return false;
+
+    // オフセット表がある場合はその分だけ追加で読む
+    const uint64_t brickCount = LoadU64(fixed.data() + 40);
+    if (brickCount > 0)
+    {
+        if (brickCount >= fileSize / sizeof(uint64_t))
+            throw runtime_error("Brick offset table exceeds file size.");
+        const size_t tableBytes = (brickCount + 1) * sizeof(uint64_t);
+        if (VolumeHeader::FIXED_SIZE + tableBytes > fileSize)
+            throw runtime_error("Brick offset table exceeds file size.");
+        fixed.resize(VolumeHeader::FIXED_SIZE + tableBytes);
+        file.read(fixed.data() + VolumeHeader::FIXED_SIZE, tableBytes);
+    }
+    header = ParseVolumeHeader(fixed.data(), fixed.size());
+    if (header.payloadOffset > fileSize)
+        throw runtime_error("Invalid payload offset.");
+    return true;
+}
+
+void WriteVolumeHeader(ostream &os, VolumeHeader &header)
+{
+    header.payloadOffset = header.HeaderBytes();
+
+    vector<char> bytes(header.HeaderBytes(), 0);
+    memcpy(bytes.data(), VolumeHeader::MAGIC, sizeof(VolumeHeader::MAGIC));
+    StoreU32(bytes.data() + 4, VolumeHeader::VERSION);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        StoreU32(bytes.data() + 8 + 4 * axis, header.resolution[axis]);
+        StoreF32(bytes.data() + 20 + 4 * axis, header.spacing[axis]);
+    }
+    bytes[32] = static_cast<char>(header.voxelType);
+    bytes[33] = static_cast<char>(header.endian);
+    StoreU32(bytes.data() + 36, header.brickSize);
+    StoreU64(bytes.data() + 40, header.BrickCount());
+    StoreU64(bytes.data() + 48, header.payloadOffset);
+    for (size_t i = 0; i < header.brickOffsets.size(); ++i)
+        StoreU64(bytes.data() + VolumeHeader::FIXED_SIZE + i * sizeof(uint64_t), header.brickOffsets[i]);
+    os.write(bytes.data(), bytes.size());
+}
+
+VolumeRegion VolumeRegion::Clamped(const uint32_t resolution[3]) const
+{
+    VolumeRegion clamped;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        clamped.end[axis] = min(end[axis], resolution[axis]);
+        clamped.begin[axis] = min(begin[axis], clamped.end[axis]);
+    }
+    return clamped;
+}
+
+VolumeRegion ParseVolumeRegion(const string &text)
+{
+    VolumeRegion region;
+    istringstream is(text);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        char colon = 0, comma = ',';
+        if (axis > 0)
+            is >> comma;
+        if (!(is >> region.begin[axis] >> colon >> region.end[axis]) || colon != ':' || comma != ',' || region.begin[axis] >= region.end[axis])
+            throw runtime_error("Invalid region \"" + text + "\". Expected x0:x1,y0:y1,z0:z1.");
+    }
+    if (is >> ws && !is.eof())
+        throw runtime_error("Invalid region \"" + text + "\". Expected x0:x1,y0:y1,z0:z1.");
+    return region;
+}
+
+ostream &operator<<(ostream &os, const VolumeRegion &region)
+{
+    return os << region.begin[0] << ":" << region.end[0] << "," << region.begin[1] << ":" << region.end[1] << "," << region.begin[2] << ":" << region.end[2];
+}
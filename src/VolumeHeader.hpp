@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <ostream>
+
+/// @brief 自己記述型ボリュームファイル(.glvr)のヘッダ
+/// @details ファイル先頭の固定長64バイト(リトルエンディアン)と、それに続くブリックオフセット表からなる。
+/// ペイロードを読まずにヘッダだけを解析できる。
+/// | offset | 型          | 内容                                          |
+/// |--------|-------------|-----------------------------------------------|
+/// | 0      | char[4]     | マジック "GLVR"                               |
+/// | 4      | uint32      | バージョン(1)                                 |
+/// | 8      | uint32[3]   | 解像度(幅,高さ,奥行き)。幅がメモリ上で最も速く変化する |
+/// | 20     | float32[3]  | ボクセル間隔(幅,高さ,奥行き)                   |
+/// | 32     | uint8       | ボクセル型(VoxelType)                         |
+/// | 33     | uint8       | ペイロードのエンディアン(Endian)              |
+/// | 34     | uint16      | 予約                                          |
+/// | 36     | uint32      | ブリックの一辺(0ならブリック化されていない)   |
+/// | 40     | uint64      | ブリック数n                                   |
+/// | 48     | uint64      | ペイロード開始位置(ファイル先頭から)          |
+/// | 56     | uint64      | 予約                                          |
+/// | 64     | uint64[n+1] | ブリックオフセット表(ペイロード先頭から,最後の要素は終端) |
+struct VolumeHeader
+{
+    enum class VoxelType : uint8_t
+    {
+        UInt8 = 0,
+        UInt16 = 1,
+        Float32 = 2,
+        Float16 = 3,
+    };
+    enum class Endian : uint8_t
+    {
+        Little = 0,
+        Big = 1,
+    };
+
+    static constexpr char MAGIC[4] = {'G', 'L', 'V', 'R'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t FIXED_SIZE = 64;
+
+    uint32_t resolution[3] = {0, 0, 0};
+    float spacing[3] = {1.0f, 1.0f, 1.0f};
+    VoxelType voxelType = VoxelType::UInt8;
+    Endian endian = Endian::Little;
+    uint32_t brickSize = 0;
+    uint64_t payloadOffset = 0;
+    /// ブリック化されている場合、各ブリックのペイロード先頭からのオフセット(末尾に終端を含む)
+    std::vector<uint64_t> brickOffsets;
+
+    /// @brief ボクセル型1要素のバイト数
+    static size_t VoxelBytes(VoxelType type);
+    static const char *VoxelTypeName(VoxelType type);
+    /// @brief ボクセル総数
+    size_t VoxelCount() const { return static_cast<size_t>(resolution[0]) * resolution[1] * resolution[2]; }
+    /// @brief 非ブリック化ペイロードのバイト数
+    size_t PayloadBytes() const { return VoxelCount() * VoxelBytes(voxelType); }
+    /// @brief ヘッダ(オフセット表を含む)のバイト数
+    size_t HeaderBytes() const { return FIXED_SIZE + brickOffsets.size() * sizeof(uint64_t); }
+    /// @brief ブリック数
+    size_t BrickCount() const { return brickOffsets.empty() ? 0 : brickOffsets.size() - 1; }
+};
+
+/// @brief ボリュームの部分領域 [begin, end)。軸はヘッダと同じ(幅,高さ,奥行き)の順
+struct VolumeRegion
+{
+    uint32_t begin[3] = {0, 0, 0};
+    uint32_t end[3] = {0, 0, 0};
+
+    uint32_t Size(int axis) const { return end[axis] > begin[axis] ? end[axis] - begin[axis] : 0; }
+    size_t VoxelCount() const { return static_cast<size_t>(Size(0)) * Size(1) * Size(2); }
+    bool Empty() const { return VoxelCount() == 0; }
+    /// @brief 解像度の範囲に切り詰めた領域
+    VolumeRegion Clamped(const uint32_t resolution[3]) const;
+};
+
+/// @brief "x0:x1,y0:y1,z0:z1" 形式の文字列を解析する。不正な形式ならstd::runtime_errorを投げる
+VolumeRegion ParseVolumeRegion(const std::string &text);
+std::ostream &operator<<(std::ostream &os, const VolumeRegion &region);
+
+/// @brief メモリ上の先頭バイト列がヘッダで始まっているか
+bool HasVolumeHeader(const char *data, size_t size);
+
+/// @brief メモリ上のヘッダを解析する。不正なヘッダならstd::runtime_errorを投げる
+/// @param data ファイル先頭(メモリマップ領域など)
+/// @param size 利用可能なバイト数
+VolumeHeader ParseVolumeHeader(const char *data, size_t size);
+
+/// @brief ファイルからヘッダだけを読み込む。ペイロードには触れない
+/// @return ヘッダ付きのファイルでなければfalse
+bool ReadVolumeHeader(const std::string &filepath, VolumeHeader &header);
+
+/// @brief ヘッダ(オフセット表を含む)を書き出す。payloadOffsetはヘッダ直後に設定される
+void WriteVolumeHeader(std::ostream &os, VolumeHeader &header);
@@ -0,0 +1,352 @@
+#include "VolumeLoader.hpp"
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <vector>
+
+using namespace std;
+
+namespace
+{
+    constexpr size_t PAGE_BYTES = 4096;
+    constexpr size_t CHUNK_BYTES = 8 * 1024 * 1024;
+}
+
+VolumeLoader::~VolumeLoader()
+{
+    Cancel();
+    // 終了時だけは引退したワーカーを待つ(中断済みなので段階の途中ですぐに戻る)
+    for (auto &entry : retired)
+        entry.first.join();
+}
+
+void VolumeLoader::Request(const string &_filepath)
+{
+    // 前回の結果は描画スレッドで破棄する
+    Cancel();
+    this->filepath = _filepath;
+    this->job = make_shared<Job>();
+    this->timer.Reset();
+    this->worker = thread(&VolumeLoader::Run, job, _filepath, options, cacheBytes);
+}
+
+void VolumeLoader::RequestEdit(const VolumeBase &source, vector<MorphologyStep> morphology, vector<FilterSettings> filters)
+{
+    Cancel();
+    // 派生データは編集元にあるものだけを、同じ設定で作り直す(テクスチャの形式とミップレベル数を変えないため)
+    Options edit;
+    edit.mipReduction = source.GetMipReduction();
+    edit.computeGradients = !source.gradients.Empty();
+    edit.computeLabels = !source.ids.Empty();
+    edit.connectivity = source.labelConnectivity;
+    edit.morphology = std::move(morphology);
+    edit.filters = std::move(filters);
+    this->job = make_shared<Job>();
+    this->job->isEdit = true;
+    this->job->readingSource = true;
+    this->job->stage = "Copying...";
+    this->timer.Reset();
+    this->worker = thread(&VolumeLoader::RunEdit, job, &source, std::move(edit));
+}
+
+void VolumeLoader::Cancel()
+{
+    if (job)
+    {
+        // 段階の途中のワーカーをここで待つと描画が止まるので、中断を伝えて引退させるだけにする
+        job->cancelRequested = true;
+        if (worker.joinable())
+            retired.emplace_back(std::move(worker), job);
+        job.reset();
+    }
+    Reap();
+}
+
+void VolumeLoader::Reap()
+{
+    for (auto it = retired.begin(); it != retired.end();)
+    {
+        if (!it->second->finished)
+        {
+            ++it;
+            continue;
+        }
+        it->first.join();
+        it = retired.erase(it);
+    }
+}
+
+unique_ptr<VolumeBase> VolumeLoader::Poll()
+{
+    Reap();
+    if (!job)
+        return nullptr;
+    const State current = job->state;
+    if (current != State::Ready && current != State::Failed)
+        return nullptr;
+    if (worker.joinable())
+        worker.join();
+    const shared_ptr<Job> done = std::move(job);
+    lock_guard<std::mutex> lock(done->mutex);
+    lastEdit.reset();
+    if (current == State::Failed)
+        throw runtime_error((done->isEdit ? "Failed to edit " : "Failed to load ") + filepath + ": " + done->errorMessage);
+    if (done->isEdit)
+        lastEdit = std::move(done->edit);
+    return std::move(done->result);
+}
+
+bool VolumeLoader::ReadingSource() const
+{
+    if (job && job->readingSource)
+        return true;
+    for (const auto &entry : retired)
+        if (entry.second->readingSource)
+            return true;
+    return false;
+}
+
+float VolumeLoader::Progress() const
+{
+    if (!job)
+        return 0.0f;
+    // 読み込みが終わるまでは段階の数が決まらない
+    const int stages = job->stageCount.load();
+    if (stages > 0)
+        return static_cast<float>(job->stagesDone.load()) / stages;
+    const size_t total = job->bytesTotal.load();
+    return total > 0 ? static_cast<float>(job->bytesRead.load()) / total : 0.0f;
+}
+
+void VolumeLoader::Run(shared_ptr<Job> job, string path, Options options, size_t cacheBytes)
+{
+    Execute(*job, [&]() -> unique_ptr<VolumeBase>
+            {
+        // マップとデコード(必要ならエンディアン変換)
+        unique_ptr<VolumeBase> volume;
+        size_t bytes = 0;
+        if (SliceStack::IsSliceStackPath(path))
+        {
+            // スライスはスレッドプールで並列に読み込み、ボリュームの最終位置へ直接書き込む(読み込み済みなのでTouchは不要)
+            const SliceStack stack(path, options.rawSliceFormat);
+            job->bytesTotal = max<size_t>(stack.Bytes(), 1);
+            volume = stack.Load(0, &job->bytesRead, &job->cancelRequested);
+            if (!volume)
+                return nullptr;
+            if (options.region)
+                cerr << "[WARNING] Region of interest is ignored for slice stacks." << endl;
+        }
+        else
+        {
+            // 部分領域の場合は領域の分だけを読み込んで自前の領域に持つ
+            volume = options.region ? LoadVolumeRegion(path, *options.region) : LoadVolume(path, cacheBytes);
+            // ページングする場合はブリックを必要になった時点で展開するので、ここでは読まない
+            bytes = volume->IsPaged() ? 0 : static_cast<size_t>(volume->resolution.x) * volume->resolution.y * volume->resolution.z * volume->GetTextureSource().voxelBytes;
+            job->bytesTotal = max<size_t>(bytes, 1);
+        }
+        const VolumeBase::TextureSource source = volume->GetTextureSource();
+
+        // 描画スレッドのスラブ転送でページフォルトを待たないよう、先に読み込んでおく
+        if (!Touch(*job, source.data, bytes))
+            return nullptr;
+        if (!Process(*job, *volume, options, nullptr))
+            return nullptr;
+        return volume; });
+}
+
+void VolumeLoader::RunEdit(shared_ptr<Job> job, const VolumeBase *source, Options options)
+{
+    Execute(*job, [&]() -> unique_ptr<VolumeBase>
+            {
+        // 描画スレッドは編集元を表示し続けるので、コピーを書き換える
+        unique_ptr<VolumeBase> volume = source->CopyVoxels(&job->cancelRequested);
+        job->readingSource = false;
+        if (!volume)
+            return nullptr;
+        EditResult edit;
+        if (!Process(*job, *volume, options, &edit))
+            return nullptr;
+        lock_guard<std::mutex> lock(job->mutex);
+        job->edit = std::move(edit);
+        return volume; });
+}
+
+void VolumeLoader::Execute(Job &job, const function<unique_ptr<VolumeBase>()> &produce)
+{
+    try
+    {
+        unique_ptr<VolumeBase> volume = produce();
+        lock_guard<std::mutex> lock(job.mutex);
+        if (volume)
+        {
+            job.result = std::move(volume);
+            job.state = State::Ready;
+        }
+        else
+            job.state = State::Idle; // 中断された。途中結果はGLオブジェクトを持たないので、ここで破棄してよい
+    }
+    catch (const exception &e)
+    {
+        lock_guard<std::mutex> lock(job.mutex);
+        job.errorMessage = e.what();
+        job.state = State::Failed;
+    }
+    job.readingSource = false;
+    job.finished = true;
+}
+
+bool VolumeLoader::Process(Job &job, VolumeBase &volume, Options options, EditResult *edit)
+{
+    // ここからの段階は進捗を段階の数で表す。長い段階(ミップピラミッド・勾配・クラスタリング)は中断要求を途中でも見る
+    volume.cancel = &job.cancelRequested;
+    const bool paged = volume.IsPaged();
+    const size_t edits = paged ? 0 : options.morphology.size() + options.filters.size();
+    // ページングしている場合、全解像度のクラスタID(1ボクセル4バイト)はページングで避けたボクセル値より大きくなるので作らない
+    if (options.computeLabels && paged)
+    {
+        cerr << "[WARNING] Component labels are not available for paged volumes." << endl;
+        options.computeLabels = false;
+    }
+    job.stageCount = static_cast<int>(edits) + (options.packBits ? 0 : 1) + 2 + (options.computeGradients ? 1 : 0) + (options.computeLabels ? 1 : 0) + (options.packBits ? 1 : 0);
+    // 段階を始める。中断されていればfalse
+    const auto enter = [&](const char *stage)
+    {
+        job.stage = stage;
+        return !job.cancelRequested;
+    };
+    const auto leave = [&]()
+    {
+        ++job.stagesDone;
+        return !job.cancelRequested;
+    };
+    // 値が変わった平面を演算ごとの結果の和として集める
+    const auto merge = [&](const vector<uint8_t> &changed, double ms)
+    {
+        if (!edit)
+            return;
+        edit->applyMs += ms;
+        if (edit->changed.empty())
+            edit->changed = changed;
+        else
+            for (size_t p = 0; p < changed.size(); ++p)
+                edit->changed[p] |= changed[p];
+    };
+
+    // ノイズの掃除と平滑化は派生データを作る前に行う(派生データは処理した後の値から作られ、そのままキャッシュのキーになる)
+    // その場で書き換えるので、中断はステップの間でだけ見る
+    if ((!options.morphology.empty() || !options.filters.empty()) && paged)
+        cerr << "[WARNING] Morphology and filters are ignored for paged volumes." << endl;
+    const double voxels = static_cast<double>(volume.resolution.x) * volume.resolution.y * volume.resolution.z;
+    for (const MorphologyStep &step : options.morphology)
+    {
+        if (paged)
+            break;
+        if (!enter("Morphology..."))
+            return false;
+        Stopwatch morphologyTimer;
+        const vector<uint8_t> changed = volume.ApplyMorphology(step.op, step.element);
+        const double ms = morphologyTimer.ElapsedMs();
+        merge(changed, ms);
+        cout << "[INFO] Morphology " << MorphologyOpName(step.op) << " " << StructuringShapeName(step.element.shape) << " r=" << step.element.radius << ": "
+             << voxels * MorphologyPasses(step.op) / (ms / 1000.0) / 1e6 << " Mvoxel/s" << endl;
+        if (!leave())
+            return false;
+    }
+    for (const FilterSettings &filter : options.filters)
+    {
+        if (paged)
+            break;
+        if (!enter("Filtering..."))
+            return false;
+        Stopwatch filterTimer;
+        const vector<uint8_t> changed = volume.ApplyFilter(filter);
+        const double ms = filterTimer.ElapsedMs();
+        merge(changed, ms);
+        cout << "[INFO] Filter " << FilterKindName(filter.kind) << " r=" << filter.radius << ": "
+             << voxels / (ms / 1000.0) / 1e6 << " Mvoxel/s" << endl;
+        if (!leave())
+            return false;
+    }
+    // ミップピラミッド・マクロセル・ヒストグラム・勾配・クラスタIDはページを読み込んだ後に作る(キャッシュにあれば読み込む)
+    // 詰める場合はミップピラミッドを捨てるので作らない
+    if (!options.packBits)
+    {
+        if (!enter("Mipmaps..."))
+            return false;
+        volume.BuildMipmaps(options.mipReduction, options.derivedCache);
+        if (!leave())
+            return false;
+    }
+    if (!enter("Macrocells..."))
+        return false;
+    volume.BuildMacrocells(options.derivedCache);
+    if (!leave() || !enter("Histogram..."))
+        return false;
+    volume.histogram = VisitVolume(volume, [](const auto &typed)
+                                   { return ComputeHistogram(typed.intencity); });
+    if (!leave())
+        return false;
+    if (options.computeGradients)
+    {
+        if (!enter("Gradients..."))
+            return false;
+        volume.BuildGradients(options.derivedCache);
+        if (!leave())
+            return false;
+    }
+    if (options.computeLabels)
+    {
+        if (!enter("Labeling..."))
+            return false;
+        if (options.derivedCache)
+            volume.ClusteringCached(*options.derivedCache, options.connectivity);
+        else
+            volume.Clustering(options.connectivity);
+        if (!leave())
+            return false;
+    }
+    // 派生データは元のボクセル値から作ってあるので、最後に詰める
+    if (options.packBits)
+    {
+        if (!enter("Packing..."))
+            return false;
+        volume.PackBits();
+        if (!leave())
+            return false;
+    }
+    // 受け取った後はjobが破棄され得るので、中断要求への参照を外しておく
+    volume.cancel = nullptr;
+    return true;
+}
+
+bool VolumeLoader::Touch(Job &job, const char *data, size_t bytes)
+{
+    const size_t chunkCount = (bytes + CHUNK_BYTES - 1) / CHUNK_BYTES;
+    atomic<size_t> nextChunk{0};
+
+    auto task = [&]()
+    {
+        unsigned char sink = 0;
+        for (size_t chunk = nextChunk++; chunk < chunkCount && !job.cancelRequested; chunk = nextChunk++)
+        {
+            const size_t begin = chunk * CHUNK_BYTES;
+            const size_t end = min(begin + CHUNK_BYTES, bytes);
+            MappedFile::Prefetch(data + begin, end - begin);
+            for (size_t offset = begin; offset < end; offset += PAGE_BYTES)
+                sink ^= static_cast<unsigned char>(data[offset]);
+            job.bytesRead += end - begin;
+        }
+        // 最適化で読み込みが消されないようにする
+        volatile unsigned char keep = sink;
+        (void)keep;
+    };
+
+    const size_t threadCount = min<size_t>(max(thread::hardware_concurrency(), 1u), max<size_t>(chunkCount, 1));
+    vector<thread> threads;
+    for (size_t t = 1; t < threadCount; ++t)
+        threads.emplace_back(task);
+    task();
+    for (thread &t : threads)
+        t.join();
+    return !job.cancelRequested;
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Volume.hpp"
+#include "SliceStack.hpp"
+
+/// @brief ボリュームをバックグラウンドで読み込むクラス
+/// @details ワーカースレッドがファイルのマップ・デコード(エンディアン変換)を行い、
+/// さらに複数スレッドでペイロードのページを読み込んでからミップピラミッドを作る。描画スレッドはPoll()で完成したボリュームを受け取り、
+/// SlabUploaderでテクスチャへ転送する。GLの呼び出しは描画スレッドでのみ行う。
+/// 中断したワーカーは終了を待たずに引退させ(状態は共有所有)、終わったものから後で回収するので、描画スレッドは止まらない。
+/// 表示中のボリュームへのモルフォロジー演算・フィルタ(RequestEdit())も、同じワーカーでコピーに適用して派生データまで作る。
+class VolumeLoader
+{
+public:
+    enum class State
+    {
+        Idle,    // 読み込み要求なし
+        Loading, // ワーカーが読み込み中
+        Ready,   // 読み込み完了。Poll()での受け取り待ち
+        Failed,  // 読み込み失敗
+    };
+
+    /// @brief 読み込みの設定。Request()の時点の値をワーカーへ渡す
+    struct Options
+    {
+        /// ミップピラミッドの縮約方法
+        MipReduction mipReduction = MipReduction::Max;
+        /// 派生データ(ミップピラミッド、勾配、クラスタID)のキャッシュ。nullptrならキャッシュしない。中断したワーカーも参照するので、ローダーの破棄まで生存している必要がある
+        const DerivedCache *derivedCache = nullptr;
+        /// 読み込み時に陰影用の勾配を求めるか
+        bool computeGradients = false;
+        /// 読み込み時にクラスタIDを求めるか、とその近傍
+        bool computeLabels = false;
+        Connectivity connectivity = Connectivity::Face;
+        /// 読み込んだ後に非ゼロを1として1ボクセル1ビットに詰め、ボクセル値を捨てるか(VolumeBase::PackBits)
+        bool packBits = false;
+        /// 派生データを作る前に、この順に適用するモルフォロジー演算
+        std::vector<MorphologyStep> morphology;
+        /// モルフォロジー演算の後に、この順に適用する平滑化フィルタ
+        std::vector<FilterSettings> filters;
+        /// 設定されていればこの部分領域だけを読み込む(LoadVolumeRegion)
+        std::optional<VolumeRegion> region;
+        /// スライスの積み重ね(SliceStack)のうち生スライスの形式
+        RawSliceFormat rawSliceFormat;
+    };
+
+    /// @brief RequestEdit()の結果のうち、ボリューム以外のもの
+    struct EditResult
+    {
+        /// x平面ごとに、いずれかの演算で値が変わったなら1
+        std::vector<uint8_t> changed;
+        /// モルフォロジー演算・フィルタの適用にかかった時間[ms](コピーと派生データを除く)
+        double applyMs = 0.0;
+    };
+
+private:
+    /// @brief 1回の読み込みの状態。ワーカーと共有し、中断後もワーカーが終わるまで生存する
+    struct Job
+    {
+        std::atomic<State> state{State::Loading};
+        std::atomic<bool> cancelRequested{false};
+        std::atomic<bool> finished{false}; // ワーカーが戻った(joinしても待たない)
+        std::atomic<size_t> bytesRead{0};
+        std::atomic<size_t> bytesTotal{0};
+        std::atomic<const char *> stage{"Reading..."}; // 実行中の段階の名前(文字列リテラル)
+        std::atomic<int> stagesDone{0};                // 読み込みの後の段階のうち終わった数
+        std::atomic<int> stageCount{0};                // 読み込みの後の段階の数
+        std::atomic<bool> readingSource{false};        // 編集元のボリュームをコピーしている
+        bool isEdit = false;                           // RequestEdit()による編集(作成後は変えない)
+
+        std::mutex mutex; // result, edit, errorMessageを保護する
+        std::unique_ptr<VolumeBase> result;
+        EditResult edit;
+        std::string errorMessage;
+    };
+
+    std::thread worker;
+    std::shared_ptr<Job> job; // 実行中または受け取り待ちの読み込み。無ければnullptr
+    /// 中断して終了を待っていないワーカー。終わったものからReap()で回収する
+    std::vector<std::pair<std::thread, std::shared_ptr<Job>>> retired;
+    std::string filepath;
+    Stopwatch timer;
+    /// 最後にPoll()で受け取ったのが編集の結果ならその内容
+    std::optional<EditResult> lastEdit;
+
+    /// @brief ワーカーの本体。ローダーには触らず、jobだけを読み書きする
+    static void Run(std::shared_ptr<Job> job, std::string path, Options options, size_t cacheBytes);
+    /// @brief 編集のワーカーの本体。sourceのボクセル値をコピーしてから編集する
+    static void RunEdit(std::shared_ptr<Job> job, const VolumeBase *source, Options options);
+    /// @brief produce()の結果(中断ならnullptr)か例外をjobに書き込み、終了を知らせる
+    static void Execute(Job &job, const std::function<std::unique_ptr<VolumeBase>()> &produce);
+    /// @brief 読み込み・コピーの後の段階(モルフォロジー演算、フィルタ、派生データ)。中断されたらfalse
+    /// @param edit nullptrでなければ、値が変わった平面と適用時間を書き込む
+    static bool Process(Job &job, VolumeBase &volume, Options options, EditResult *edit);
+    /// @brief ページ単位で読み込んでページキャッシュに載せる(複数スレッド)
+    static bool Touch(Job &job, const char *data, size_t bytes);
+    /// @brief 終了した引退ワーカーをjoinする(待たない)
+    void Reap();
+
+public:
+    /// ブリック化ファイルを展開せずにページングする閾値兼キャッシュ容量(LoadVolumeのcacheBytes)。0ならページングしない
+    size_t cacheBytes = 0;
+    /// 読み込みの設定。Request()の時点の値を使う
+    Options options;
+
+    VolumeLoader() = default;
+    ~VolumeLoader();
+    VolumeLoader(const VolumeLoader &) = delete;
+    VolumeLoader &operator=(const VolumeLoader &) = delete;
+
+    /// @brief 読み込みを開始する。読み込み中のものがあれば中断する
+    void Request(const std::string &filepath);
+    /// @brief sourceのコピーにモルフォロジー演算・フィルタをこの順に適用し、sourceにある派生データを作り直す。読み込み中のものがあれば中断する
+    /// @details 描画スレッドはsourceを表示し続けてよい。結果はPoll()で新しいボリュームとして受け取り、LastEdit()で値が変わった平面を得る。
+    /// sourceはReadingSource()がfalseになるまで破棄しないこと。派生データはキャッシュしない
+    void RequestEdit(const VolumeBase &source, std::vector<MorphologyStep> morphology, std::vector<FilterSettings> filters);
+    /// @brief 読み込みを中断する。ワーカーの終了は待たない(途中結果はワーカーが破棄する)
+    void Cancel();
+    /// @brief 読み込みが完了していればボリュームを受け取る。未完了ならnullptr
+    /// @details 読み込みに失敗していた場合はstd::runtime_errorを投げる(一度だけ)
+    std::unique_ptr<VolumeBase> Poll();
+    /// @brief 最後にPoll()で受け取ったのが編集の結果ならその内容。読み込みの結果ならnullopt
+    const std::optional<EditResult> &LastEdit() const { return lastEdit; }
+    /// @brief 編集のワーカー(中断したものを含む)が編集元のボリュームをまだ読んでいるか
+    bool ReadingSource() const;
+
+    State GetState() const { return job ? job->state.load() : State::Idle; }
+    bool IsLoading() const { return GetState() == State::Loading; }
+    /// @brief 読み込みの進捗(0~1)。読み込み中は読んだバイト数の比、その後は終わった段階の数の比
+    float Progress() const;
+    /// @brief 実行中の段階の名前("Reading...", "Mipmaps..."など)
+    const char *Stage() const { return job ? job->stage.load() : ""; }
+    const std::string &Filepath() const { return filepath; }
+    /// @brief 読み込み開始からの経過時間[ms]
+    double ElapsedMs() const { return timer.ElapsedMs(); }
+};
@@ -0,0 +1,111 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+#include <utility>
+
+#include "VoxelLayout.hpp"
+
+/// @brief 連続したメモリ上に配置された3次元ボクセル配列
+/// @details 既定ではx(最も遅い軸), y, z(最も速い軸)の順に並ぶ。データは自前で確保するか、
+/// メモリマップ等の外部領域をコピーせずに参照(ビュー)することができる。
+/// @tparam T ボクセルの型
+/// @tparam Layout メモリ上の並び(VoxelLayout.hpp)。3次元インデックスでのアクセスはどの並びでも同じように書ける。
+/// 行のポインタやStrideX()/StrideY()を使う処理、テクスチャ転送は線形の並びでのみ使える
+template <typename T, typename Layout = LinearLayout>
+class VoxelGrid
+{
+private:
+    std::vector<T> storage; // 自前で確保した場合の実体
+    T *data = nullptr;      // 先頭要素(storageか外部領域を指す)
+    size_t nx = 0, ny = 0, nz = 0;
+    Layout layout;
+
+    void SetExtent(size_t _nx, size_t _ny, size_t _nz)
+    {
+        nx = _nx;
+        ny = _ny;
+        nz = _nz;
+        layout.Resize(nx, ny, nz);
+    }
+
+public:
+    VoxelGrid() = default;
+
+    /// @brief 指定サイズのグリッドを確保する
+    VoxelGrid(size_t _nx, size_t _ny, size_t _nz, const T &init = T())
+    {
+        SetExtent(_nx, _ny, _nz);
+        storage.assign(layout.Capacity(), init);
+        data = storage.data();
+    }
+
+    /// @brief 別の並びのグリッドから並べ替えて作る(x平面ごとに並列化する)
+    template <typename OtherLayout>
+    explicit VoxelGrid(const VoxelGrid<T, OtherLayout> &other)
+        : VoxelGrid(other.SizeX(), other.SizeY(), other.SizeZ())
+    {
+#pragma omp parallel for schedule(static)
+        for (long long x = 0; x < static_cast<long long>(nx); ++x)
+            for (size_t y = 0; y < ny; ++y)
+                for (size_t z = 0; z < nz; ++z)
+                    (*this)(x, y, z) = other(x, y, z);
+    }
+
+    /// @brief 外部領域をコピーせずに参照するグリッドを作る。領域はLayoutの並びでCapacity()個あること。領域の寿命は呼び出し側が保証すること
+    static VoxelGrid View(T *external, size_t _nx, size_t _ny, size_t _nz)
+    {
+        VoxelGrid grid;
+        grid.SetExtent(_nx, _ny, _nz);
+        grid.data = external;
+        return grid;
+    }
+
+    VoxelGrid(const VoxelGrid &other) { *this = other; }
+    VoxelGrid &operator=(const VoxelGrid &other)
+    {
+        if (this == &other)
+            return *this;
+        storage = other.storage;
+        SetExtent(other.nx, other.ny, other.nz);
+        // ビューならポインタを共有し、実体を持つならコピーした実体を指す
+        data = other.OwnsData() ? storage.data() : other.data;
+        return *this;
+    }
+    VoxelGrid(VoxelGrid &&other) noexcept { *this = std::move(other); }
+    VoxelGrid &operator=(VoxelGrid &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        // vectorのムーブでは確保済み領域のアドレスは変わらないのでdataはそのまま使える
+        storage = std::move(other.storage);
+        SetExtent(other.nx, other.ny, other.nz);
+        data = other.data;
+        other.data = nullptr;
+        other.SetExtent(0, 0, 0);
+        return *this;
+    }
+
+    /// @brief 3次元インデックスを領域内の位置に変換する
+    size_t Index(size_t x, size_t y, size_t z) const { return layout.Index(x, y, z); }
+
+    T &operator()(size_t x, size_t y, size_t z) { return data[Index(x, y, z)]; }
+    const T &operator()(size_t x, size_t y, size_t z) const { return data[Index(x, y, z)]; }
+    T &operator[](size_t index) { return data[index]; }
+    const T &operator[](size_t index) const { return data[index]; }
+
+    T *Data() { return data; }
+    const T *Data() const { return data; }
+    size_t SizeX() const { return nx; }
+    size_t SizeY() const { return ny; }
+    size_t SizeZ() const { return nz; }
+    size_t StrideX() const { return layout.StrideX(); }
+    size_t StrideY() const { return layout.StrideY(); }
+    /// @brief 総ボクセル数
+    size_t Count() const { return nx * ny * nz; }
+    /// @brief 領域の要素数(Data()から並ぶ数)。線形の並びならCount()と同じで、Morton系の並びはパディングを含む
+    size_t Capacity() const { return layout.Capacity(); }
+    size_t Bytes() const { return Capacity() * sizeof(T); }
+    bool Empty() const { return data == nullptr || Count() == 0; }
+    /// @brief 自前で領域を確保しているか(falseならビュー)
+    bool OwnsData() const { return !storage.empty(); }
+};
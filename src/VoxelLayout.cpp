@@ -0,0 +1,36 @@
+#include "VoxelLayout.hpp"
+#include <algorithm>
+
+using namespace std;
+
+void MortonLayout::Resize(size_t nx, size_t ny, size_t nz)
+{
+    const size_t size[3] = {nx, ny, nz};
+    // 軸ごとに必要なビット数(2の冪に切り上げた辺の指数)
+    int bits[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        bits[axis] = 0;
+        while ((size_t(1) << bits[axis]) < size[axis])
+            ++bits[axis];
+    }
+    // 下位からz, y, xの順にビットの置き場所を割り当てる。ビットを使い切った軸は飛ばす
+    vector<int> positions[3];
+    int position = 0;
+    for (int bit = 0; bit < max(bits[0], max(bits[1], bits[2])); ++bit)
+        for (int axis = 2; axis >= 0; --axis)
+            if (bit < bits[axis])
+                positions[axis].push_back(position++);
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        offsets[axis].resize(size[axis]);
+        for (size_t c = 0; c < size[axis]; ++c)
+        {
+            size_t spread = 0;
+            for (int bit = 0; bit < bits[axis]; ++bit)
+                spread |= ((c >> bit) & 1) << positions[axis][bit];
+            offsets[axis][c] = spread;
+        }
+    }
+    capacity = nx * ny * nz == 0 ? 0 : size_t(1) << position;
+}
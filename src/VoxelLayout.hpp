@@ -0,0 +1,101 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// VoxelGridのメモリ上の並び(レイアウトポリシー)。どれも次を持つ:
+//   void Resize(size_t nx, size_t ny, size_t nz)  論理サイズを設定する
+//   size_t Index(size_t x, size_t y, size_t z)     3次元インデックスを領域内の位置に変換する
+//   size_t Capacity()                              必要な要素数(パディングを含む)
+//   static const char *Name()                      ベンチマーク等で表示する名前
+//   static constexpr bool rowsContiguous           z方向の行が連続しているか(&grid(x, y, 0)から行として読めるか)
+
+/// @brief x(最も遅い軸), y, z(最も速い軸)の順の線形の並び。テクスチャ転送やメモリマップはこの並びを前提とする
+class LinearLayout
+{
+private:
+    size_t strideX = 0; // x方向に1進んだ時の要素オフセット(ny*nz)
+    size_t strideY = 0; // y方向に1進んだ時の要素オフセット(nz)
+    size_t capacity = 0;
+
+public:
+    static constexpr bool rowsContiguous = true;
+    static const char *Name() { return "linear"; }
+
+    void Resize(size_t nx, size_t ny, size_t nz)
+    {
+        strideY = nz;
+        strideX = ny * nz;
+        capacity = nx * ny * nz;
+    }
+    size_t Index(size_t x, size_t y, size_t z) const { return x * strideX + y * strideY + z; }
+    size_t Capacity() const { return capacity; }
+    size_t StrideX() const { return strideX; }
+    size_t StrideY() const { return strideY; }
+};
+
+/// @brief 軸ごとの位置の表を足し合わせて位置を求める並び(Morton系のレイアウトの共通部分)
+/// @details Mortonの位置は各軸の座標のビットを散らしたものの和(ビットは重ならない)なので、
+/// 軸ごとに座標から散らした値への表を作っておけば、掛け算もビット演算の繰り返しも無しに表引き3回で求まる
+class TableLayout
+{
+protected:
+    std::vector<size_t> offsets[3]; // 軸(x, y, z)ごとの、座標から位置への寄与
+    size_t capacity = 0;
+
+public:
+    static constexpr bool rowsContiguous = false;
+
+    size_t Index(size_t x, size_t y, size_t z) const { return offsets[0][x] + offsets[1][y] + offsets[2][z]; }
+    size_t Capacity() const { return capacity; }
+};
+
+/// @brief ボリューム全体のMorton順(Zカーブ)。近い3次元の位置が近いアドレスに並ぶ
+/// @details 各軸を2の冪に切り上げ、下位ビットからz, y, xの順にビットを交互に並べる(ビットを使い切った軸は飛ばす)。
+/// 切り上げた分はパディングになるので、辺が2の冪から離れていると最大で約8倍の領域を使う
+class MortonLayout : public TableLayout
+{
+public:
+    static const char *Name() { return "morton"; }
+    void Resize(size_t nx, size_t ny, size_t nz);
+};
+
+/// @brief 一辺Bのブリックを線形に(z方向が最も速く)並べ、ブリックの中をMorton順に並べる
+/// @details パディングは各軸をBの倍数に切り上げた分だけで済み、ブリックの中では近傍が同じキャッシュライン・ページに収まりやすい
+/// @tparam B ブリックの一辺(2の冪)
+template <size_t B>
+class BrickedMortonLayout : public TableLayout
+{
+    static_assert(B >= 2 && (B & (B - 1)) == 0, "Brick size must be a power of two");
+
+public:
+    static const char *Name()
+    {
+        static const std::string name = "morton" + std::to_string(B);
+        return name.c_str();
+    }
+
+    void Resize(size_t nx, size_t ny, size_t nz)
+    {
+        constexpr size_t brickVoxels = B * B * B;
+        const size_t size[3] = {nx, ny, nz};
+        size_t bricks[3];
+        for (int axis = 0; axis < 3; ++axis)
+            bricks[axis] = (size[axis] + B - 1) / B;
+        // ブリック番号の1つ分のオフセット(z方向が最も速い)
+        const size_t brickStride[3] = {bricks[1] * bricks[2] * brickVoxels, bricks[2] * brickVoxels, brickVoxels};
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            offsets[axis].resize(size[axis]);
+            for (size_t c = 0; c < size[axis]; ++c)
+            {
+                // ブリック内の座標のビットlを位置3l + (2 - axis)に置く(zが最下位)
+                size_t local = 0;
+                for (size_t bit = 0; (size_t(1) << bit) < B; ++bit)
+                    local |= ((c >> bit) & 1) << (3 * bit + (2 - axis));
+                offsets[axis][c] = (c / B) * brickStride[axis] + local;
+            }
+        }
+        capacity = bricks[0] * bricks[1] * bricks[2] * brickVoxels;
+    }
+};
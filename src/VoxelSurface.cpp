@@ -0,0 +1,202 @@
+#include "VoxelSurface.hpp"
+#include <algorithm>
+
+using namespace std;
+
+namespace
+{
+    /// @brief チャンクごとのメッシュ。頂点番号はチャンクの中での番号
+    struct ChunkMesh
+    {
+        vector<MeshVertex> vertices;
+        vector<GLuint> indices;
+        size_t exposedFaces = 0;
+    };
+
+    /// @brief Extract()の本体。占有はloadRow(x, y, zBegin, zEnd, out)で行ごとに読む(out[z - zBegin]に0か1を書く)
+    template <typename LoadRow>
+    void ExtractSurface(const size_t size[3], const glm::vec3 &extent, LoadRow &&loadRow,
+                        vector<MeshVertex> &vertices, vector<GLuint> &indices, size_t *exposedFaces)
+    {
+        vertices.clear();
+        indices.clear();
+        if (exposedFaces)
+            *exposedFaces = 0;
+        if (size[0] == 0 || size[1] == 0 || size[2] == 0)
+            return;
+        constexpr size_t chunkSize = voxelChunkSize, apronSize = voxelChunkSize + 2;
+        const size_t chunks[3] = {(size[0] + chunkSize - 1) / chunkSize, (size[1] + chunkSize - 1) / chunkSize, (size[2] + chunkSize - 1) / chunkSize};
+        const size_t chunkCount = chunks[0] * chunks[1] * chunks[2];
+        // ボクセルの角(グリッドの番号)をワールド座標にする。ワールドの(幅,高さ,奥行き)はグリッドの(z, y, x)
+        const glm::vec3 spacing = extent / glm::vec3(static_cast<float>(size[2]), static_cast<float>(size[1]), static_cast<float>(size[0]));
+        const glm::vec3 corner = extent * -0.5f;
+        const auto toWorld = [&](const size_t point[3])
+        {
+            return corner + glm::vec3(static_cast<float>(point[2]), static_cast<float>(point[1]), static_cast<float>(point[0])) * spacing;
+        };
+
+        vector<ChunkMesh> meshes(chunkCount);
+    #pragma omp parallel for schedule(dynamic)
+        for (long long chunk = 0; chunk < static_cast<long long>(chunkCount); ++chunk)
+        {
+            ChunkMesh &mesh = meshes[chunk];
+            const size_t index[3] = {static_cast<size_t>(chunk) / (chunks[1] * chunks[2]), static_cast<size_t>(chunk) / chunks[2] % chunks[1], static_cast<size_t>(chunk) % chunks[2]};
+            size_t origin[3], count[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                origin[axis] = index[axis] * chunkSize;
+                count[axis] = min(chunkSize, size[axis] - origin[axis]);
+            }
+
+            // 周囲1ボクセルを含めた占有(ボリュームの外は空)。番号は1ずらしてある
+            vector<uint8_t> solid(apronSize * apronSize * apronSize, 0);
+            const auto at = [](size_t x, size_t y, size_t z)
+            { return (x * apronSize + y) * apronSize + z; };
+            const size_t zBegin = origin[2] > 0 ? 0 : 1, zEnd = min(count[2] + 2, size[2] - origin[2] + 1);
+            for (size_t x = 0; x < count[0] + 2; ++x)
+            {
+                if (origin[0] + x < 1 || origin[0] + x - 1 >= size[0])
+                    continue;
+                for (size_t y = 0; y < count[1] + 2; ++y)
+                {
+                    if (origin[1] + y < 1 || origin[1] + y - 1 >= size[1])
+                        continue;
+                    loadRow(origin[0] + x - 1, origin[1] + y - 1, origin[2] + zBegin - 1, origin[2] + zEnd - 1, &solid[at(x, y, zBegin)]);
+                }
+            }
+
+            vector<uint8_t> mask(chunkSize * chunkSize);
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                // 面を張る2軸(小さい順)
+                const int u = axis == 0 ? 1 : 0, v = axis == 2 ? 1 : 2;
+                for (int dir = -1; dir <= 1; dir += 2)
+                {
+                    glm::vec3 normal(0.0f);
+                    normal[2 - axis] = static_cast<float>(dir);
+                    // グリッドとワールドで軸の並びが逆なので、u, v方向に張った四角形の表の向きは軸によって変わる
+                    // (u × vはワールドで高さ軸なら+、幅・奥行き軸なら-の向き)
+                    const bool counterClockwise = (axis == 1) == (dir > 0);
+                    for (size_t s = 0; s < count[axis]; ++s)
+                    {
+                        // 隣が空の面
+                        size_t p[3], q[3];
+                        p[axis] = s + 1;
+                        q[axis] = s + 1 + dir;
+                        for (size_t a = 0; a < count[u]; ++a)
+                            for (size_t b = 0; b < count[v]; ++b)
+                            {
+                                p[u] = q[u] = a + 1;
+                                p[v] = q[v] = b + 1;
+                                const uint8_t exposed = solid[at(p[0], p[1], p[2])] & (solid[at(q[0], q[1], q[2])] ^ 1);
+                                mask[a * chunkSize + b] = exposed;
+                                mesh.exposedFaces += exposed;
+                            }
+                        // v方向に伸ばしてから、同じ幅で揃う限りu方向に伸ばす
+                        for (size_t a = 0; a < count[u]; ++a)
+                            for (size_t b = 0; b < count[v]; ++b)
+                            {
+                                if (!mask[a * chunkSize + b])
+                                    continue;
+                                size_t width = 1, height = 1;
+                                while (b + width < count[v] && mask[a * chunkSize + b + width])
+                                    ++width;
+                                for (; a + height < count[u]; ++height)
+                                {
+                                    const uint8_t *row = &mask[(a + height) * chunkSize + b];
+                                    if (!all_of(row, row + width, [](uint8_t m)
+                                                { return m != 0; }))
+                                        break;
+                                }
+                                for (size_t h = 0; h < height; ++h)
+                                    fill_n(&mask[(a + h) * chunkSize + b], width, 0);
+
+                                size_t p0[3];
+                                p0[axis] = origin[axis] + s + (dir > 0 ? 1 : 0);
+                                p0[u] = origin[u] + a;
+                                p0[v] = origin[v] + b;
+                                size_t p1[3] = {p0[0], p0[1], p0[2]}, p2[3] = {p0[0], p0[1], p0[2]}, p3[3] = {p0[0], p0[1], p0[2]};
+                                p1[u] += height;
+                                p2[u] += height;
+                                p2[v] += width;
+                                p3[v] += width;
+                                const GLuint first = static_cast<GLuint>(mesh.vertices.size());
+                                for (const size_t *point : {p0, p1, p2, p3})
+                                    mesh.vertices.push_back(MeshVertex{toWorld(point), normal});
+                                const GLuint quad[6] = {first, first + 1, first + 2, first, first + 2, first + 3};
+                                const GLuint flipped[6] = {first, first + 2, first + 1, first, first + 3, first + 2};
+                                mesh.indices.insert(mesh.indices.end(), counterClockwise ? quad : flipped, (counterClockwise ? quad : flipped) + 6);
+                            }
+                    }
+                }
+            }
+        }
+
+        // チャンクごとの頂点・インデックスをつなげる
+        vector<size_t> vertexOffsets(chunkCount + 1, 0), indexOffsets(chunkCount + 1, 0);
+        size_t faces = 0;
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+        {
+            vertexOffsets[chunk + 1] = vertexOffsets[chunk] + meshes[chunk].vertices.size();
+            indexOffsets[chunk + 1] = indexOffsets[chunk] + meshes[chunk].indices.size();
+            faces += meshes[chunk].exposedFaces;
+        }
+        if (exposedFaces)
+            *exposedFaces = faces;
+        vertices.resize(vertexOffsets[chunkCount]);
+        indices.resize(indexOffsets[chunkCount]);
+    #pragma omp parallel for schedule(static)
+        for (long long chunk = 0; chunk < static_cast<long long>(chunkCount); ++chunk)
+        {
+            const ChunkMesh &mesh = meshes[chunk];
+            copy(mesh.vertices.begin(), mesh.vertices.end(), vertices.begin() + vertexOffsets[chunk]);
+            const GLuint base = static_cast<GLuint>(vertexOffsets[chunk]);
+            GLuint *out = indices.data() + indexOffsets[chunk];
+            for (size_t k = 0; k < mesh.indices.size(); ++k)
+                out[k] = mesh.indices[k] + base;
+        }
+    }
+}
+
+template <typename T>
+void VoxelSurface::Extract(const VoxelGrid<T> &grid, const glm::vec3 &extent, float threshold,
+                           vector<MeshVertex> &vertices, vector<GLuint> &indices, size_t *exposedFaces)
+{
+    const size_t size[3] = {grid.SizeX(), grid.SizeY(), grid.SizeZ()};
+    ExtractSurface(size, extent, [&](size_t x, size_t y, size_t zBegin, size_t zEnd, uint8_t *out)
+                   {
+                       const T *row = &grid(x, y, 0);
+                       for (size_t z = zBegin; z < zEnd; ++z)
+                           out[z - zBegin] = VoxelTraits<T>::Normalize(row[z]) > threshold ? 1 : 0; },
+                   vertices, indices, exposedFaces);
+}
+
+void VoxelSurface::Extract(const BitGrid &bits, const glm::vec3 &extent, float threshold,
+                           vector<MeshVertex> &vertices, vector<GLuint> &indices, size_t *exposedFaces)
+{
+    const size_t size[3] = {bits.SizeX(), bits.SizeY(), bits.SizeZ()};
+    // 詰めたボクセルの値は1なので、閾値が1未満なら立っているビットがそのまま箱になる
+    const uint64_t solidMask = threshold < 1.0f ? ~uint64_t(0) : 0;
+    ExtractSurface(size, extent, [&](size_t x, size_t y, size_t zBegin, size_t zEnd, uint8_t *out)
+                   {
+                       const uint64_t *words = bits.Row(x, y);
+                       for (size_t z = zBegin; z < zEnd; ++z)
+                           out[z - zBegin] = static_cast<uint8_t>(((words[z >> 6] & solidMask) >> (z & 63)) & 1); },
+                   vertices, indices, exposedFaces);
+}
+
+VoxelSurface::VoxelSurface(const VolumeBase &volume, float threshold)
+    : threshold(threshold)
+{
+    if (volume.IsPacked())
+        Extract(volume.bits, volume.extent, threshold, vertices, indices, &exposedFaces);
+    else
+        VisitVolume(volume, [&](const auto &typed)
+                    { Extract(typed.intencity, volume.extent, threshold, vertices, indices, &exposedFaces); });
+    quads = indices.size() / 6;
+}
+
+template void VoxelSurface::Extract(const VoxelGrid<uint8_t> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t *);
+template void VoxelSurface::Extract(const VoxelGrid<uint16_t> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t *);
+template void VoxelSurface::Extract(const VoxelGrid<Half> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t *);
+template void VoxelSurface::Extract(const VoxelGrid<float> &, const glm::vec3 &, float, vector<MeshVertex> &, vector<GLuint> &, size_t *);
@@ -0,0 +1,34 @@
+#pragma once
+#include <vector>
+#include "Volume.hpp"
+#include "SurfaceMesh.hpp"
+
+/// ボクセルの表面を作るチャンクの一辺のボクセル数
+constexpr size_t voxelChunkSize = 32;
+
+// ボクセルの箱の表面のメッシュクラス
+class VoxelSurface : public SurfaceMesh
+{
+public:
+    /// 表面を作った時の閾値(正規化した値)
+    float threshold = 0.0f;
+    /// 貪欲法でまとめる前の露出した面の数と、まとめた後の四角形の数
+    size_t exposedFaces = 0, quads = 0;
+
+    VoxelSurface() = default;
+    /// @brief 正規化した値がthresholdを超えるボクセルを箱として、その表面を作る。ページングしているボリュームは空のメッシュになる
+    /// (1ビットに詰めたボリュームは詰めたボクセルから作る)
+    VoxelSurface(const VolumeBase &volume, float threshold);
+
+    /// @brief 露出した(隣が空の)ボクセルの面だけを取り出し、同じ向き・同じ平面で隣り合う面を貪欲法で大きな四角形にまとめる
+    /// @details voxelChunkSizeの立方体のチャンクごとに並列に処理する(四角形はチャンクをまたがない)。
+    /// ボリュームの外は空として扱うので、表面は常に閉じている
+    /// @param extent ボリュームの物理的な大きさ(VolumeBase::extent)
+    /// @param exposedFaces nullptrでなければ、まとめる前の面の数を入れる
+    template <typename T>
+    static void Extract(const VoxelGrid<T> &grid, const glm::vec3 &extent, float threshold,
+                        std::vector<MeshVertex> &vertices, std::vector<GLuint> &indices, size_t *exposedFaces = nullptr);
+    /// @brief 1ビットに詰めたボクセルの表面を作る。詰めたボクセルの値は1なので、thresholdが1未満なら立っているビットが箱になる
+    static void Extract(const BitGrid &bits, const glm::vec3 &extent, float threshold,
+                        std::vector<MeshVertex> &vertices, std::vector<GLuint> &indices, size_t *exposedFaces = nullptr);
+};
@@ -0,0 +1,147 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <GL/glew.h>
+
+#include "VolumeHeader.hpp"
+
+/// @brief IEEE754半精度浮動小数点数。CPU側では格納のみ行い、計算時はfloatに変換する
+struct Half
+{
+    uint16_t bits = 0;
+
+    float ToFloat() const
+    {
+        const uint32_t sign = static_cast<uint32_t>(bits & 0x8000) << 16;
+        uint32_t exponent = (bits >> 10) & 0x1F;
+        uint32_t mantissa = bits & 0x3FF;
+        uint32_t result;
+        if (exponent == 0)
+        {
+            if (mantissa == 0)
+            {
+                result = sign; // ±0
+            }
+            else
+            {
+                // 非正規化数を正規化する
+                exponent = 127 - 15 + 1;
+                while ((mantissa & 0x400) == 0)
+                {
+                    mantissa <<= 1;
+                    exponent--;
+                }
+                result = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+            }
+        }
+        else if (exponent == 0x1F)
+        {
+            result = sign | 0x7F800000 | (mantissa << 13); // ±Inf, NaN
+        }
+        else
+        {
+            result = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        }
+        float value;
+        std::memcpy(&value, &result, sizeof(value));
+        return value;
+    }
+    /// @brief floatから変換する(最近接偶数丸め、範囲外は±Inf)
+    static Half FromFloat(float value)
+    {
+        uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        const uint16_t sign = static_cast<uint16_t>((f >> 16) & 0x8000);
+        const uint32_t exponent = (f >> 23) & 0xFF;
+        uint32_t mantissa = f & 0x7FFFFF;
+        Half half;
+        if (exponent == 0xFF)
+        {
+            half.bits = sign | 0x7C00 | (mantissa ? 0x200 : 0); // ±Inf, NaN
+            return half;
+        }
+        const int halfExponent = static_cast<int>(exponent) - 127 + 15;
+        if (halfExponent >= 0x1F)
+        {
+            half.bits = sign | 0x7C00; // オーバーフロー
+            return half;
+        }
+        if (halfExponent <= 0)
+        {
+            // 非正規化数(小さすぎれば±0)
+            if (halfExponent < -10)
+            {
+                half.bits = sign;
+                return half;
+            }
+            mantissa |= 0x800000;
+            const int shift = 14 - halfExponent;
+            uint32_t rounded = mantissa >> shift;
+            const uint32_t remainder = mantissa & ((1u << shift) - 1);
+            const uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (rounded & 1)))
+                rounded++;
+            half.bits = static_cast<uint16_t>(sign | rounded);
+            return half;
+        }
+        uint32_t rounded = (static_cast<uint32_t>(halfExponent) << 10) | (mantissa >> 13);
+        const uint32_t remainder = mantissa & 0x1FFF;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (rounded & 1)))
+            rounded++; // 繰り上がりで指数が増えてもビット列としては正しい
+        half.bits = static_cast<uint16_t>(sign | rounded);
+        return half;
+    }
+    bool operator==(const Half &other) const { return bits == other.bits; }
+    bool operator!=(const Half &other) const { return bits != other.bits; }
+};
+
+/// @brief ボクセル型ごとの性質。GLのテクスチャフォーマットはコンパイル時に決まる
+/// @tparam T ボクセルの型(uint8_t, uint16_t, Half, float)
+template <typename T>
+struct VoxelTraits;
+
+template <>
+struct VoxelTraits<uint8_t>
+{
+    static constexpr VolumeHeader::VoxelType voxelType = VolumeHeader::VoxelType::UInt8;
+    static constexpr GLenum internalFormat = GL_R8;
+    static constexpr GLenum format = GL_RED;
+    static constexpr GLenum type = GL_UNSIGNED_BYTE;
+    /// @brief シェーダーでサンプルした時と同じ0~1の値に変換する(正規化整数)
+    static float Normalize(uint8_t v) { return v / 255.0f; }
+    static bool IsZero(uint8_t v) { return v == 0; }
+};
+
+template <>
+struct VoxelTraits<uint16_t>
+{
+    static constexpr VolumeHeader::VoxelType voxelType = VolumeHeader::VoxelType::UInt16;
+    static constexpr GLenum internalFormat = GL_R16;
+    static constexpr GLenum format = GL_RED;
+    static constexpr GLenum type = GL_UNSIGNED_SHORT;
+    static float Normalize(uint16_t v) { return v / 65535.0f; }
+    static bool IsZero(uint16_t v) { return v == 0; }
+};
+
+template <>
+struct VoxelTraits<Half>
+{
+    static constexpr VolumeHeader::VoxelType voxelType = VolumeHeader::VoxelType::Float16;
+    static constexpr GLenum internalFormat = GL_R16F;
+    static constexpr GLenum format = GL_RED;
+    static constexpr GLenum type = GL_HALF_FLOAT;
+    /// @brief 浮動小数点のボクセルは値をそのまま使う
+    static float Normalize(Half v) { return v.ToFloat(); }
+    static bool IsZero(Half v) { return (v.bits & 0x7FFF) == 0; } // ±0
+};
+
+template <>
+struct VoxelTraits<float>
+{
+    static constexpr VolumeHeader::VoxelType voxelType = VolumeHeader::VoxelType::Float32;
+    static constexpr GLenum internalFormat = GL_R32F;
+    static constexpr GLenum format = GL_RED;
+    static constexpr GLenum type = GL_FLOAT;
+    static float Normalize(float v) { return v; }
+    static bool IsZero(float v) { return v == 0.0f; }
+};
@@ -9,6 +9,8 @@
 #include <sstream>
 #include <chrono>
 #include <optional>
+#include <thread>
+#include <algorithm>
 #include "Volume.hpp"
 #include "PointCloud.hpp"
 #include "Shader.hpp"
@@ -17,6 +19,20 @@
 #include "FrameBuffer.hpp"
 #include "Camera.hpp"
 #include "PhotonVolume.hpp"
+#include "Profiling.hpp"
+#include "Benchmark.hpp"
+#include "BrickedVolume.hpp"
+#include "SlabUploader.hpp"
+#include "VolumeLoader.hpp"
+#include "MipPyramid.hpp"
+#include "DerivedCache.hpp"
+#include "TimeSeries.hpp"
+#include "TimeSeriesPlayer.hpp"
+#include "SliceStack.hpp"
+#include "LabelTable.hpp"
+#include "DistanceField.hpp"
+#include "IsoSurface.hpp"
+#include "VoxelSurface.hpp"
 
 using namespace std;
 
@@ -32,10 +48,97 @@ int main(int argc, char const *argv[])
     {
         std::cerr << "Locale setting failed: " << e.what() << std::endl;
     }
-    if (argc < 2)
+    if (argc >= 2 && string(argv[1]) == "--bench")
     {
+        return RunBenchmark(vector<string>(argv + 2, argv + argc));
+    }
+    if (argc >= 2 && string(argv[1]) == "--convert")
+    {
+        return RunConvert(vector<string>(argv + 2, argv + argc));
+    }
+    string volumeFilepath;
+    size_t cacheMiB = 1024; // これより大きいブリック化ボリュームはページングする
+    MipReduction mipReduction = MipReduction::Max;
+    float seriesFps = 24.0f;   // 時系列の再生速度
+    size_t prefetchFrames = 8; // 時系列で先読みするフレーム数
+    string cacheDirectory = ".volumen-cache"; // 派生データのキャッシュ。空ならキャッシュしない
+    bool computeLabels = false;
+    bool computeGradients = false; // 陰影用の勾配を読み込み時に求める
+    bool packBits = false;         // 非ゼロを1として1ボクセル1ビットに詰める
+    Connectivity connectivity = Connectivity::Face; // クラスタIDを求める時の近傍
+    optional<VolumeRegion> region; // 設定されていれば部分領域だけを読み込む
+    RawSliceFormat sliceFormat;    // 生スライス(.raw)の大きさと型
+    vector<MorphologyStep> morphology; // 読み込み時に順に適用するモルフォロジー演算
+    vector<FilterSettings> filters;    // モルフォロジー演算の後に順に適用する平滑化フィルタ
+    for (int i = 1; i < argc; ++i)
+    {
+        const string arg = argv[i];
+        if ((arg == "--cache-mib" || arg == "--fps" || arg == "--prefetch") && i + 1 < argc)
+        {
+            // stoul/stofは数値でなければinvalid_argument、桁あふれならout_of_rangeを投げる
+            try
+            {
+                if (arg == "--cache-mib")
+                    cacheMiB = stoul(argv[++i]);
+                else if (arg == "--fps")
+                    seriesFps = stof(argv[++i]);
+                else
+                    prefetchFrames = stoul(argv[++i]);
+            }
+            catch (const std::exception &)
+            {
+                cerr << "[ERROR] Invalid value for " << arg << ": " << argv[i] << endl;
+                return -1;
+            }
+        }
+        else if (arg == "--cache-dir" && i + 1 < argc)
+            cacheDirectory = argv[++i];
+        else if (arg == "--no-cache")
+            cacheDirectory.clear();
+        else if (arg == "--labels")
+            computeLabels = true;
+        else if (arg == "--gradients")
+            computeGradients = true;
+        else if (arg == "--binary")
+            packBits = true;
+        else if ((arg == "--mip" || arg == "--connectivity" || arg == "--roi" || arg == "--slice" || arg == "--morph" || arg == "--filter") && i + 1 < argc)
+        {
+            try
+            {
+                if (arg == "--mip")
+                    mipReduction = ParseMipReduction(argv[++i]);
+                else if (arg == "--connectivity")
+                {
+                    computeLabels = true;
+                    connectivity = ParseConnectivity(argv[++i]);
+                }
+                else if (arg == "--roi")
+                    region = ParseVolumeRegion(argv[++i]);
+                else if (arg == "--slice")
+                    sliceFormat = ParseRawSliceFormat(argv[++i]);
+                else if (arg == "--morph")
+                    morphology.push_back(ParseMorphologyStep(argv[++i]));
+                else
+                    filters.push_back(ParseFilterSettings(argv[++i]));
+            }
+            catch (const std::runtime_error &e)
+            {
+                cerr << "[ERROR] " << e.what() << endl;
+                return -1;
+            }
+        }
+        else
+            volumeFilepath = arg;
+    }
+    if (volumeFilepath.empty())
+    {
+        cout << "Usage: volumen [--cache-mib N] [--mip max|avg|or] [--cache-dir DIR|--no-cache] [--labels] [--connectivity 6|18|26] [--gradients] [--binary] [--roi x0:x1,y0:y1,z0:z1] [--morph erode|dilate|open|close[:cube|cross|ball[:R]]]... [--filter gaussian[:R[:SIGMA]]|box[:R]|median[:R]]... [volume.dat|volume.glvr]" << endl
+             << "       volumen [--fps F] [--prefetch K] <directory|\"frames/*.dat\">   (time series)" << endl
+             << "       volumen [--slice WxH[:u8|u16|f16|f32][be]] <stack.tif|directory|\"slices/*.tif\">   (slice stack)" << endl
+             << "       volumen --bench <name> [N...]" << endl
+             << "       volumen --convert <input> <output.glvr> [brickSize]" << endl
+             << "[INFO] No volume given. Use \"Load Volume\" in the Control Panel." << endl;
     }
-    string volumeFilepath = argv[1];
 
     Window window;
     window.Initialize();
@@ -58,7 +161,8 @@ int main(int argc, char const *argv[])
     Shader pointCloudShader("shader/VolumePointCloud.vert", "shader/VolumePointCloud.frag");
     Shader raycastShader("shader/VolumeMarching.vert", "shader/VolumeMarching.frag");
     Shader raycastMaxShader("shader/VolumeMarching.vert", "shader/VolumeCasting-Max.frag");
-    Shader &primaryShader = raycastShader;
+    Shader meshShader("shader/SurfaceMesh.vert", "shader/SurfaceMesh.frag");
+    Shader *primaryShader = &raycastShader; // 描画方式に応じてフレームごとに選び直す
 
     /*
     Shader photonVolumeShader = Shader("shader/ComputePhoton.glsl");
@@ -67,17 +171,66 @@ int main(int argc, char const *argv[])
     photonCache.PrintData();
     */
 
-    std::ifstream volumeFile(volumeFilepath, std::ios::binary);
-    if (!volumeFile.is_open())
-    {
-        cerr << "[ERROR] Failed to open file: " << volumeFilepath << endl;
-        return -1;
-    }
-
     // ボリュームデータの定義
-    Volume volume = Volume(volumeFile);
-    volume.UploadBuffer();
+    // ワーカースレッドで読み込み、テクスチャはZ方向のスラブ単位でフレームループの中で少しずつ転送する。
+    // 転送が終わるまでは表示中のボリュームを描画し続け、終わったらフレームの境界で差し替える
+    unique_ptr<VolumeBase> volume;        // 表示中のボリューム
+    unique_ptr<VolumeBase> pendingVolume; // テクスチャ転送中のボリューム
+    // 点群・ミップピラミッド・クラスタIDは内容ハッシュをキーにディスクへキャッシュし、2回目以降は読み込むだけにする
+    // 中断したワーカーもローダーの破棄までは参照し得るので、ローダーより先に作る
+    optional<DerivedCache> derivedCache;
+    if (!cacheDirectory.empty())
+        derivedCache.emplace(cacheDirectory);
+    VolumeLoader loader;
+    loader.cacheBytes = cacheMiB * 1024 * 1024;
+    loader.options.derivedCache = derivedCache ? &*derivedCache : nullptr;
+    loader.options.computeLabels = computeLabels;
+    loader.options.connectivity = connectivity;
+    loader.options.computeGradients = computeGradients;
+    loader.options.packBits = packBits;
+    loader.options.morphology = morphology;
+    loader.options.filters = filters;
+    SlabUploader uploader;
     optional<PointCloud> pointCloud;
+    // アルファの下限を閾値とする等値面。閾値かボリュームが変わったら作り直す
+    optional<IsoSurface> isoSurface;
+    // アルファの下限を超えるボクセルの箱の表面
+    optional<VoxelSurface> voxelSurface;
+    // 成分ごとの表示設定。選択を変えても表だけを転送し直し、ボリュームやクラスタIDは触らない
+    LabelTable labelTable;
+    // 時系列を再生している場合のプレイヤー。volumeが表示中のフレームになる
+    unique_ptr<TimeSeriesPlayer> player;
+    // 表示中のボリュームの距離場をバックグラウンドで作る。ボリュームを参照するので、差し替える前に中断する
+    DistanceFieldBuilder distanceBuilder;
+    // UIに表示しているヒストグラムのボリュームと、部分領域のヒストグラム
+    const VolumeBase *histogramVolume = nullptr;
+    RegionHistogram regionHistogram;
+    bool showingRegionHistogram = false;
+    auto openVolume = [&](const string &path)
+    {
+        uploader.Cancel();
+        distanceBuilder.Cancel();
+        player.reset();
+        pendingVolume.reset();
+        // スライスの積み重ね(TIFFや生スライス)は1つのボリュームとして読み込む
+        if (!TimeSeries::IsSeriesPath(path) || SliceStack::IsSliceStackPath(path))
+        {
+            loader.Request(path);
+            return;
+        }
+        loader.Cancel();
+        try
+        {
+            vector<string> frames = TimeSeries::ListFrames(path);
+            cout << "[INFO] Time series: " << frames.size() << " frames, prefetch " << prefetchFrames << endl;
+            const size_t threads = clamp<size_t>(thread::hardware_concurrency() / 2, 1, max<size_t>(prefetchFrames, 1));
+            player = make_unique<TimeSeriesPlayer>(std::move(frames), prefetchFrames, threads);
+        }
+        catch (const std::runtime_error &e)
+        {
+            cerr << "[ERROR] " << e.what() << endl;
+        }
+    };
 
     float gameTime = 0;
     float deltaSecond = 1.0f / 60.0f;
@@ -88,6 +241,97 @@ int main(int argc, char const *argv[])
     FrameBuffer oglBuffer(100, 100);
     imguiManager.Initialize(window.GetGLFWwindow(), oglBuffer);
     imguiManager.fileBuffer = volumeFilepath;
+    imguiManager.mipReduction = static_cast<int>(mipReduction);
+    imguiManager.seriesFps = seriesFps;
+    imguiManager.computeLabels = computeLabels;
+    imguiManager.gradientMode = computeGradients ? 1 : 0;
+    imguiManager.labelTable = &labelTable;
+    if (region)
+    {
+        imguiManager.roiEnabled = true;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            imguiManager.roiBegin[axis] = static_cast<int>(region->begin[axis]);
+            imguiManager.roiEnd[axis] = static_cast<int>(region->end[axis]);
+        }
+    }
+    imguiManager.callback = [&]()
+    {
+        loader.options.mipReduction = static_cast<MipReduction>(imguiManager.mipReduction);
+        loader.options.computeLabels = imguiManager.computeLabels;
+        loader.options.computeGradients = imguiManager.gradientMode == 1;
+        loader.options.packBits = imguiManager.packBits;
+        loader.options.region.reset();
+        if (imguiManager.roiEnabled)
+        {
+            VolumeRegion box;
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                box.begin[axis] = static_cast<uint32_t>(max(imguiManager.roiBegin[axis], 0));
+                box.end[axis] = static_cast<uint32_t>(max(imguiManager.roiEnd[axis], 0));
+            }
+            loader.options.region = box;
+        }
+        openVolume(imguiManager.filePath);
+    };
+    // 表示中のボリュームへの編集は、読み込みと同じワーカーでコピーに適用して派生データまで作り、
+    // 受け取ったら値が変わった平面だけを転送して差し替える(編集中も元のボリュームを描画し続ける)
+    string editName;             // 実行中の編集の名前
+    int editPasses = 1;          // ボリューム全体を走査する回数(スループットの計算用)
+    string *editStats = nullptr; // 完了時に統計を書き込むUIの文字列
+    auto editVolume = [&](const string &name, int passes, string &stats, vector<MorphologyStep> morphology, vector<FilterSettings> filters)
+    {
+        if (!volume || player)
+            return;
+        if (volume->IsPaged() || volume->IsPacked())
+        {
+            cerr << "[ERROR] " << name << " is not available for paged or binary volumes" << endl;
+            stats = "Not available for paged or binary volumes";
+            return;
+        }
+        if (loader.IsLoading() || pendingVolume || uploader.IsActive())
+        {
+            cerr << "[ERROR] " << name << " is not available while loading or uploading" << endl;
+            stats = "Busy, try again after loading";
+            return;
+        }
+        editName = name;
+        editPasses = passes;
+        editStats = &stats;
+        stats = "Running...";
+        loader.RequestEdit(*volume, std::move(morphology), std::move(filters));
+    };
+    imguiManager.morphologyCallback = [&]()
+    {
+        MorphologyStep step;
+        step.op = static_cast<MorphologyOp>(imguiManager.morphologyOp);
+        step.element.shape = static_cast<StructuringShape>(imguiManager.morphologyShape);
+        step.element.radius = imguiManager.morphologyRadius;
+        const string name = string("Morphology ") + MorphologyOpName(step.op) + " " + StructuringShapeName(step.element.shape) + " r=" + to_string(step.element.radius);
+        editVolume(name, MorphologyPasses(step.op), imguiManager.morphologyStats, {step}, {});
+    };
+    imguiManager.filterCallback = [&]()
+    {
+        FilterSettings settings;
+        settings.kind = static_cast<FilterKind>(imguiManager.filterKind);
+        settings.radius = imguiManager.filterRadius;
+        settings.sigma = imguiManager.filterSigma;
+        const string name = string("Filter ") + FilterKindName(settings.kind) + " r=" + to_string(settings.radius);
+        editVolume(name, 1, imguiManager.filterStats, {}, {settings});
+    };
+    imguiManager.cancelCallback = [&]()
+    {
+        loader.Cancel();
+        uploader.Cancel();
+        pendingVolume.reset();
+        cout << "[INFO] Loading canceled" << endl;
+    };
+
+    loader.options.mipReduction = mipReduction;
+    loader.options.region = region;
+    loader.options.rawSliceFormat = sliceFormat;
+    if (!volumeFilepath.empty())
+        openVolume(volumeFilepath);
 
     /// カメラインスタンス
     Camera camera(window.GetGLFWwindow());
@@ -98,31 +342,239 @@ int main(int argc, char const *argv[])
 
         auto start = std::chrono::high_resolution_clock::now();
 
+        { // バックグラウンド読み込みの受け取りとテクスチャのスラブ転送(時間予算の範囲で)
+            try
+            {
+                // 中断した編集のワーカーが表示中のボリュームをまだコピーしていれば、差し替えを待つ
+                unique_ptr<VolumeBase> loaded = loader.ReadingSource() ? nullptr : loader.Poll();
+                if (loaded && loader.LastEdit())
+                {
+                    // 編集したコピーに表示中のテクスチャを引き継ぎ、値が変わった平面だけを転送し直す
+                    const VolumeLoader::EditResult &edit = *loader.LastEdit();
+                    distanceBuilder.Cancel();
+                    loaded->AdoptTextures(*volume);
+                    Stopwatch uploadTimer;
+                    const size_t planes = count(edit.changed.begin(), edit.changed.end(), 1);
+                    const size_t uploadedBytes = loaded->UploadChangedPlanes(edit.changed);
+                    const double uploadMs = uploadTimer.ElapsedMs();
+                    volume = std::move(loaded);
+                    pointCloud.reset();
+                    isoSurface.reset();
+                    voxelSurface.reset();
+                    histogramVolume = nullptr; // ヒストグラムを作り直したので表示し直す
+                    // クラスタIDは全体が変わり得るので、スラブ単位で転送してから表を切り替える
+                    if (volume->labelTexture)
+                        volume->BeginLabelStreaming(uploader);
+                    const double voxelsPerSecond = static_cast<double>(volume->resolution.x) * volume->resolution.y * volume->resolution.z * editPasses / (edit.applyMs / 1000.0);
+                    cout << "[INFO] " << editName << ": " << edit.applyMs << "ms (" << voxelsPerSecond / 1e6 << " Mvoxel/s), with copy and derived data " << loader.ElapsedMs() << "ms, "
+                         << planes << " planes changed, uploaded " << ToMiB(uploadedBytes) << "MiB in " << uploadMs << "ms" << endl;
+                    if (editStats)
+                        *editStats = to_string(static_cast<int>(voxelsPerSecond / 1e6)) + " Mvoxel/s, " + to_string(static_cast<int>(edit.applyMs)) + "ms, " +
+                                     to_string(planes) + "/" + to_string(edit.changed.size()) + " planes changed";
+                    editStats = nullptr;
+                }
+                else if (loaded)
+                {
+                    cout << "[INFO] Volume " << loaded->Sammary() << " read in " << loader.ElapsedMs() << "ms" << endl;
+                    pendingVolume = std::move(loaded);
+                    pendingVolume->BeginStreamingUpload(uploader);
+                }
+            }
+            catch (const std::runtime_error &e)
+            {
+                cerr << "[ERROR] " << e.what() << endl;
+                if (editStats)
+                    *editStats = "Failed";
+                editStats = nullptr;
+            }
+            // 編集後のクラスタIDの転送。中断された場合は表示が古いままになるので転送し直す
+            if (!pendingVolume && !player && volume && volume->LabelsStreaming())
+            {
+                if (!uploader.IsActive())
+                    volume->BeginLabelStreaming(uploader);
+                else if (uploader.Step(imguiManager.uploadBudgetMs))
+                {
+                    volume->FinishLabelStreaming();
+                    labelTable.Reset(volume->componentCount);
+                    labelTable.Upload();
+                    cout << "[INFO] " << volume->componentCount << " components, labels streamed in " << uploader.ElapsedMs() << "ms" << endl;
+                }
+            }
+            if (pendingVolume && !loader.ReadingSource() && uploader.Step(imguiManager.uploadBudgetMs))
+            {
+                distanceBuilder.Cancel();
+                volume = std::move(pendingVolume);
+                pointCloud.reset();
+                isoSurface.reset();
+                voxelSurface.reset();
+                if (volume->gradientTexture)
+                    cout << "[INFO] Gradients streamed (" << ToMiB(volume->gradients.Bytes()) << "MiB)" << endl;
+                if (volume->labelTexture)
+                {
+                    // クラスタIDは強度に続けてスラブ単位で転送済み。詰めたテクセルはもう要らない
+                    labelTable.Reset(volume->componentCount);
+                    labelTable.Upload();
+                    cout << "[INFO] " << volume->componentCount << " components, labels streamed (" << ToMiB(volume->labelTexels.empty() ? volume->ids.Bytes() : volume->labelTexels.size()) << "MiB)" << endl;
+                    volume->labelTexels = vector<uint8_t>();
+                }
+                cout << "[INFO] Streamed upload finished: " << uploader.ElapsedMs() << "ms, total(with read) "
+                     << loader.ElapsedMs() << "ms, peak RSS " << ToMiB(GetPeakResidentBytes()) << "MiB" << endl;
+            }
+            // 時系列の次のフレームの転送と、表示時刻でのフロントとの入れ替え
+            if (player)
+            {
+                player->fps = imguiManager.seriesFps;
+                player->playing = imguiManager.seriesPlaying;
+                // 入れ替えで表示中のボリュームを手放すので、中断した編集のワーカーがコピーし終わるまで待つ
+                if (!loader.ReadingSource() && player->Update(volume, uploader, imguiManager.uploadBudgetMs))
+                {
+                    pointCloud.reset();
+                    isoSurface.reset();
+                    voxelSurface.reset();
+                }
+                imguiManager.seriesStats = player->Stats();
+            }
+            else
+                imguiManager.seriesStats.clear();
+            if (loader.IsLoading())
+            {
+                imguiManager.loadProgress = loader.Progress();
+                imguiManager.loadStage = loader.Stage();
+            }
+            else if (uploader.IsActive() && !player)
+            {
+                imguiManager.loadProgress = uploader.Progress();
+                imguiManager.loadStage = "Uploading...";
+            }
+            else
+                imguiManager.loadProgress = -1.0f;
+            // 時系列のフレームにはラベルが無いので、表示中のボリュームに合わせて毎フレーム切り替える
+            // 編集後のクラスタIDを転送している間は、表が前の成分数のままなので一覧を出さない
+            imguiManager.components = volume && volume->labelTexture && !volume->LabelsStreaming() ? &volume->components : nullptr;
+            imguiManager.volumePaged = volume && volume->IsPaged();
+            if (imguiManager.labelTableChanged)
+            {
+                labelTable.Upload();
+                imguiManager.labelTableChanged = false;
+            }
+        }
+
         // IMGUIウィンドウのサイズに合わせてアスペクト比を変化
-        glm::mat4 projection = glm::perspective(glm::radians<float>(80),
+        const float fieldOfView = glm::radians<float>(80);
+        glm::mat4 projection = glm::perspective(fieldOfView,
                                                 static_cast<float>(imguiManager.GetMainWindowSize().x) / static_cast<float>(imguiManager.GetMainWindowSize().y),
                                                 imguiManager.nearClip, imguiManager.farClip);
+        // ページングしている場合、カメラから見えるブリックをGPUに載せる
+        if (volume)
+        {
+            volume->UpdateResidency(projection * camera.view * model, imguiManager.uploadBudgetMs);
+            imguiManager.pagingStats = volume->PagingStats();
+            // アルファの下限が変わった時(と新しいボリュームの表示開始時)だけマクロセルを分類し直す
+            volume->UpdateMacrocells(imguiManager.alphaMinMax[0]);
+            imguiManager.macrocellStats = volume->macrocells.Empty() ? "" : to_string(volume->occupiedMacrocells * 100 / volume->macrocells.Count()) + "% of cells sampled";
+            // 距離場は閾値(アルファの下限)が変わるたびにバックグラウンドで作り直す(時系列のフレームと、ボクセル値を持たないボリュームには作らない)
+            if (imguiManager.distanceStepping && !player && !volume->IsPaged() && !volume->IsPacked())
+            {
+                if (optional<DistanceFieldBuilder::Result> built = distanceBuilder.Poll(); built && built->source == volume.get())
+                {
+                    Stopwatch distanceTimer;
+                    volume->UploadDistanceField(built->field, built->threshold);
+                    cout << "[INFO] Distance field (threshold " << built->threshold << ") uploaded in " << distanceTimer.ElapsedMs() << "ms" << endl;
+                }
+                distanceBuilder.Request(*volume, imguiManager.alphaMinMax[0]);
+            }
+            imguiManager.distanceFieldBuilding = distanceBuilder.IsBuilding();
+            // ヒストグラム。部分領域は動かした分だけ数え直す(詰めたボリュームは元の値を持たないので全体のみ)
+            const bool regionRequested = imguiManager.histogramRoiEnabled && !volume->histogram.Empty() && !volume->IsPacked();
+            if (volume.get() != histogramVolume || (showingRegionHistogram && !regionRequested))
+            {
+                histogramVolume = volume.get();
+                regionHistogram.Reset();
+                showingRegionHistogram = false;
+                imguiManager.SetHistogram(volume->histogram.Empty() ? nullptr : &volume->histogram, "Volume");
+            }
+            if (regionRequested)
+            {
+                VolumeRegion box;
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    box.begin[axis] = static_cast<uint32_t>(max(imguiManager.histogramRoiBegin[axis], 0));
+                    box.end[axis] = static_cast<uint32_t>(max(imguiManager.histogramRoiEnd[axis], 0));
+                }
+                const uint32_t volumeResolution[3] = {static_cast<uint32_t>(volume->resolution.x), static_cast<uint32_t>(volume->resolution.y), static_cast<uint32_t>(volume->resolution.z)};
+                box = box.Clamped(volumeResolution);
+                const bool changed = VisitVolume(*volume, [&](const auto &typed)
+                                                 { return regionHistogram.Update(typed.intencity, box, volume->histogram); });
+                if (changed || !showingRegionHistogram)
+                {
+                    showingRegionHistogram = true;
+                    imguiManager.SetHistogram(&regionHistogram.Get(), "ROI (" + to_string(regionHistogram.LastCountedVoxels()) + " voxels counted)");
+                }
+            }
+        }
+        { // 描画方式のシェーダーを選ぶ。glUniformは使用中のプログラムに書き込むので、転送より先にUseしておく
+            switch (imguiManager.currentShaderIndex)
+            {
+            case 1:
+                primaryShader = &raycastMaxShader;
+                break;
+            case 2:
+                primaryShader = &pointCloudShader;
+                break;
+            case 3:
+            case 4:
+                primaryShader = &meshShader;
+                break;
+            default:
+                primaryShader = &raycastShader;
+                break;
+            }
+            primaryShader->Use();
+        }
         { // パラメータのGPUへの転送
 
-            glUniformMatrix4fv(glGetUniformLocation(primaryShader.GetProgramID(), "model"),
+            glUniformMatrix4fv(glGetUniformLocation(primaryShader->GetProgramID(), "model"),
                                1, GL_FALSE, &model[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(primaryShader.GetProgramID(), "view"),
+            glUniformMatrix4fv(glGetUniformLocation(primaryShader->GetProgramID(), "view"),
                                1, GL_FALSE, &camera.view[0][0]);
-            glUniformMatrix4fv(glGetUniformLocation(primaryShader.GetProgramID(), "projection"),
+            glUniformMatrix4fv(glGetUniformLocation(primaryShader->GetProgramID(), "projection"),
                                1, GL_FALSE, &projection[0][0]);
-            glUniform2f(glGetUniformLocation(primaryShader.GetProgramID(), "alphaRange"),
+            glUniform2f(glGetUniformLocation(primaryShader->GetProgramID(), "alphaRange"),
                         imguiManager.alphaMinMax[0], imguiManager.alphaMinMax[1]);
-            glUniform2f(glGetUniformLocation(primaryShader.GetProgramID(), "nearFarClip"),
+            glUniform2f(glGetUniformLocation(primaryShader->GetProgramID(), "nearFarClip"),
                         imguiManager.nearClip, imguiManager.farClip);
-            glUniform1f(glGetUniformLocation(primaryShader.GetProgramID(), "pointSize"),
+            glUniform1f(glGetUniformLocation(primaryShader->GetProgramID(), "pointSize"),
                         imguiManager.pointSize);
-            glUniform1i(glGetUniformLocation(primaryShader.GetProgramID(), "volumeTexture"), 0);
-            // glUniform1i(glGetUniformLocation(primaryShader.GetProgramID(), "radianceChache"), 1);
-            glUniform1i(glGetUniformLocation(primaryShader.GetProgramID(), "volumeResolution"),
-                        volume.size);
-            glUniform3f(glGetUniformLocation(primaryShader.GetProgramID(), "ambientLight"),
+            glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "volumeTexture"), 0);
+            // glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "radianceChache"), 1);
+            if (volume)
+            {
+                glUniform3i(glGetUniformLocation(primaryShader->GetProgramID(), "volumeResolution"),
+                            volume->resolution.x, volume->resolution.y, volume->resolution.z);
+                glUniform3f(glGetUniformLocation(primaryShader->GetProgramID(), "volumeExtent"),
+                            volume->extent.x, volume->extent.y, volume->extent.z);
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "pagedVolume"), volume->atlas ? 1 : 0);
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "binaryVolume"), volume->IsPacked() ? 1 : 0);
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "brickSize"), volume->atlas ? volume->atlas->BrickSize() : 0);
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "volumeLevels"), volume->atlas ? 1 : volume->MipLevels());
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "labelsEnabled"), volume->labelTexture && !labelTable.Empty() ? 1 : 0);
+                // 事前計算の勾配が無いボリューム(ページング、時系列のフレーム)ではシェーダでその場で求める
+                const int gradientMode = imguiManager.gradientMode == 1 && !volume->gradientTexture ? 2 : imguiManager.gradientMode;
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "gradientMode"), gradientMode);
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "macrocellsEnabled"), imguiManager.emptySpaceSkipping && volume->macrocellTexture ? 1 : 0);
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "macrocellSize"), static_cast<int>(macrocellSize));
+                // 閾値を下げた場合、古い距離場は占有ボクセルを見落とすので作り直すまで使わない
+                const bool distanceUsable = imguiManager.distanceStepping && volume->distanceTexture && imguiManager.alphaMinMax[0] >= volume->distanceThreshold;
+                glUniform1i(glGetUniformLocation(primaryShader->GetProgramID(), "distanceFieldEnabled"), distanceUsable ? 1 : 0);
+                const glm::vec3 voxelExtent = volume->extent / glm::vec3(volume->resolution);
+                glUniform1f(glGetUniformLocation(primaryShader->GetProgramID(), "minVoxelSize"), min(voxelExtent.x, min(voxelExtent.y, voxelExtent.z)));
+            }
+            // 1ピクセルが張る視野角。シェーダーはこれとカメラからの距離でミップレベルとステップ幅を選ぶ
+            glUniform1f(glGetUniformLocation(primaryShader->GetProgramID(), "pixelAngle"),
+                        2.0f * tan(fieldOfView * 0.5f) / max(imguiManager.GetMainWindowSize().y, 1));
+            glUniform3f(glGetUniformLocation(primaryShader->GetProgramID(), "ambientLight"),
                         imguiManager.ambientLight.x, imguiManager.ambientLight.y, imguiManager.ambientLight.z);
-            imguiManager.light.UploadBuffer(primaryShader.GetProgramID(), "light");
+            imguiManager.light.UploadBuffer(primaryShader->GetProgramID(), "light");
         }
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); // 全バッファの初期化
@@ -130,30 +582,64 @@ int main(int argc, char const *argv[])
         oglBuffer.Clear();
 
         // レンダリング方式切り替え
-        if (imguiManager.currentShaderIndex == 0)
+        if (!volume)
+        { // 読み込み完了まで何も描画しない
+        }
+        else if (imguiManager.currentShaderIndex == 0)
         { // レイキャスティングで描画
-            primaryShader = raycastShader;
-            primaryShader.Use();
-            volume.Draw();
+            labelTable.Bind(4); // 成分ごとの表示設定はシェーダのbinding=4
+            volume->Draw();
         }
         else if (imguiManager.currentShaderIndex == 1)
         { // レイキャスティングで描画(Max)
-            primaryShader = raycastMaxShader;
-            primaryShader.Use();
-            volume.Draw();
+            labelTable.Bind(4);
+            volume->Draw();
         }
         else if (imguiManager.currentShaderIndex == 2)
         { // ポイントクラウドで描画
             if (pointCloud.has_value() == false)
             {
                 /// 初めてポイントクラウドになったときのみポイントクラウドへの変換を実行
-                pointCloud = PointCloud(volume);
+                Stopwatch pointCloudTimer;
+                pointCloud.emplace(*volume, derivedCache ? &*derivedCache : nullptr);
+                cout << "[INFO] Point cloud " << pointCloud->vertices.size() << " points in " << pointCloudTimer.ElapsedMs() << "ms" << endl;
                 pointCloud->UploadBuffer();
             }
-            primaryShader = pointCloudShader;
-            primaryShader.Use();
             pointCloud->Draw(camera.view * model);
         }
+        else if (imguiManager.currentShaderIndex == 3)
+        { // 等値面のメッシュで描画
+            // スライダーを動かしている間は前の面を描き続け、離してから作り直す
+            const float isovalue = imguiManager.alphaMinMax[0];
+            if (!isoSurface || (isoSurface->isovalue != isovalue && !imguiManager.alphaDragging))
+            {
+                Stopwatch meshTimer;
+                isoSurface.emplace(*volume, isovalue);
+                isoSurface->UploadBuffer();
+                const double meshMs = meshTimer.ElapsedMs();
+                imguiManager.meshStats = volume->IsPaged() || volume->IsPacked() ? "Not available for paged or binary volumes"
+                                                                                 : to_string(isoSurface->TriangleCount()) + " triangles, " + to_string(isoSurface->vertices.size()) + " vertices, " + to_string(static_cast<int>(meshMs)) + "ms";
+                cout << "[INFO] Iso surface at " << isovalue << ": " << isoSurface->TriangleCount() << " triangles, "
+                     << isoSurface->vertices.size() << " vertices in " << meshMs << "ms" << endl;
+            }
+            isoSurface->Draw();
+        }
+        else if (imguiManager.currentShaderIndex == 4)
+        { // ボクセルの箱の表面で描画(深度テストで前後を決めるのでソートしない)
+            const float threshold = imguiManager.alphaMinMax[0];
+            if (!voxelSurface || (voxelSurface->threshold != threshold && !imguiManager.alphaDragging))
+            {
+                Stopwatch meshTimer;
+                voxelSurface.emplace(*volume, threshold);
+                voxelSurface->UploadBuffer();
+                const double meshMs = meshTimer.ElapsedMs();
+                imguiManager.meshStats = volume->IsPaged() ? "Not available for paged volumes"
+                                                           : to_string(voxelSurface->quads) + " quads (" + to_string(voxelSurface->exposedFaces) + " faces), " + to_string(static_cast<int>(meshMs)) + "ms";
+                cout << "[INFO] Voxel surface at " << threshold << ": " << voxelSurface->exposedFaces << " exposed faces merged into "
+                     << voxelSurface->quads << " quads in " << meshMs << "ms" << endl;
+            }
+            voxelSurface->Draw();
+        }
         oglBuffer.unbind();
 
         { // ImGuiフレームの開始